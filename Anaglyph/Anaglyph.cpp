@@ -39,8 +39,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginGrouping "Views/Stereo"
 #define kPluginDescription "Make an anaglyph image out of the two views of the input."
 #define kPluginIdentifier "net.sf.openfx.anaglyphPlugin"
+// History:
+// version 1.0: initial version
+// version 1.1: process both views in a single pass over paired rows, do not crash if a view is missing
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -115,6 +118,8 @@ public:
 
 private:
     // and do some processing
+    // Both views are processed in a single pass: for each row, the addresses of the
+    // red and cyan source rows are computed once, and the pixels are read directly.
     void multiThreadProcessImages(OfxRectI procWindow)
     {
         const Image *srcRedImg = _srcLeftImg;
@@ -123,9 +128,18 @@ private:
         if (_swap) {
             std::swap(srcRedImg, srcCyanImg);
         }
-        const OfxRectI& srcRedBounds = srcRedImg->getBounds();
-        const OfxRectI& srcCyanBounds = srcCyanImg->getBounds();
-
+        OfxRectI srcRedBounds = {0, 0, 0, 0};
+        OfxRectI srcCyanBounds = {0, 0, 0, 0};
+        if (srcRedImg) {
+            srcRedBounds = srcRedImg->getBounds();
+        }
+        if (srcCyanImg) {
+            srcCyanBounds = srcCyanImg->getBounds();
+        }
+        const int redShift = (_offset + 1) / 2; // rounded up
+        const int cyanShift = -(_offset / 2); // rounded down
+        const float amtcolour = (float)_amtcolour;
+        const float amtgray = 1.f - amtcolour;
 
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
@@ -133,33 +147,36 @@ private:
             }
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            // first pixel of each source row, or NULL if the row is outside of the image
+            const PIX *srcRedRow = getRowAddress(srcRedImg, srcRedBounds, y);
+            const PIX *srcCyanRow = getRowAddress(srcCyanImg, srcCyanBounds, y);
 
             for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                // clamp x to avoid black borders
-                int xRed = (std::min)((std::max)(srcRedBounds.x1, x + (_offset + 1) / 2), srcRedBounds.x2 - 1);
-                int xCyan = (std::min)((std::max)(srcCyanBounds.x1, x - _offset / 2), srcCyanBounds.x2 - 1);
-                const PIX *srcRedPix = (const PIX *)(srcRedImg ? srcRedImg->getPixelAddress(xRed, y) : 0);
-                const PIX *srcCyanPix = (const PIX *)(srcCyanImg ? srcCyanImg->getPixelAddress(xCyan, y) : 0);
-
-                dstPix[3] = 0; // start with transparent
-                if (srcRedPix) {
+                PIX dstAlpha = 0; // start with transparent
+                if (srcRedRow) {
+                    // clamp x to avoid black borders
+                    int xRed = (std::min)((std::max)(srcRedBounds.x1, x + redShift), srcRedBounds.x2 - 1);
+                    const PIX *srcRedPix = srcRedRow + (xRed - srcRedBounds.x1) * 4;
                     PIX srcLuminance = luminance(srcRedPix[0], srcRedPix[1], srcRedPix[2]);
-                    dstPix[0] = (PIX)(srcLuminance * (1.f - (float)_amtcolour) + srcRedPix[0] * (float)_amtcolour);
-                    dstPix[3] += (PIX)(0.5f * srcRedPix[3]);
+                    dstPix[0] = (PIX)(srcLuminance * amtgray + srcRedPix[0] * amtcolour);
+                    dstAlpha += (PIX)(0.5f * srcRedPix[3]);
                 } else {
                     // no src pixel here, be black and transparent
                     dstPix[0] = 0;
                 }
-                if (srcCyanPix) {
+                if (srcCyanRow) {
+                    int xCyan = (std::min)((std::max)(srcCyanBounds.x1, x + cyanShift), srcCyanBounds.x2 - 1);
+                    const PIX *srcCyanPix = srcCyanRow + (xCyan - srcCyanBounds.x1) * 4;
                     PIX srcLuminance = luminance(srcCyanPix[0], srcCyanPix[1], srcCyanPix[2]);
-                    dstPix[1] = (PIX)(srcLuminance * (1.f - (float)_amtcolour) + srcCyanPix[1] * (float)_amtcolour);
-                    dstPix[2] = (PIX)(srcLuminance * (1.f - (float)_amtcolour) + srcCyanPix[2] * (float)_amtcolour);
-                    dstPix[3] += (PIX)(0.5f * srcCyanPix[3]);
+                    dstPix[1] = (PIX)(srcLuminance * amtgray + srcCyanPix[1] * amtcolour);
+                    dstPix[2] = (PIX)(srcLuminance * amtgray + srcCyanPix[2] * amtcolour);
+                    dstAlpha += (PIX)(0.5f * srcCyanPix[3]);
                 } else {
                     // no src pixel here, be black and transparent
                     dstPix[1] = 0;
                     dstPix[2] = 0;
                 }
+                dstPix[3] = dstAlpha;
 
                 // increment the dst pixel
                 dstPix += 4;
@@ -168,6 +185,18 @@ private:
     } // multiThreadProcessImages
 
 private:
+    static const PIX * getRowAddress(const Image *img,
+                                     const OfxRectI& bounds,
+                                     int y)
+    {
+        if ( !img || (bounds.x1 >= bounds.x2) ) {
+            return NULL;
+        }
+
+        // NULL if y is outside of the bounds
+        return (const PIX *) img->getPixelAddress(bounds.x1, y);
+    }
+
     /** @brief luminance from linear RGB according to Rec.709.
        See http://www.poynton.com/notes/colour_and_gamma/ColorFAQ.html#RTFToC9 */
     static PIX luminance(PIX red,
@@ -26,6 +26,7 @@
 #include <climits>
 #include <cfloat> // DBL_MAX, FLT_EPSILON
 #include <algorithm>
+#include <vector>
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 #include <windows.h>
 #endif
@@ -37,8 +38,10 @@
 #include "ofxsCoords.h"
 #include "ofxsCopier.h"
 #include "ofxsLut.h"
+#include "ofxsPyramid.h"
 
 #include "CImgFilter.h"
+#include "CImgBatchedFilters.h"
 
 #if cimg_version < 161
 #error "This plugin requires CImg 1.6.1, please upgrade CImg."
@@ -211,6 +214,15 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 "(close to the GNU LGPL) or CeCILL (compatible with the GNU GPL) licenses. " \
 "It can be used in commercial applications (see http://cimg.eu)."
 
+#define kPluginNameEdgeBlur          "EdgeBlur"
+#define kPluginDescriptionEdgeBlur \
+"Blur the image where there are edges in the alpha/matte channel.\n" \
+"The edges are detected in the alpha channel of the source (or in the Matte input if 'External Matte' is checked) by computing its gradient magnitude (as done by EdgeDetect), raised to the power 1/'Edge Mult'. " \
+"The source is then blurred by a Gaussian filter of the same size, and the blurred image is mixed with the source, using the edges as a mask.\n" \
+"CImg is a free, open-source library distributed under the CeCILL-C " \
+"(close to the GNU LGPL) or CeCILL (compatible with the GNU GPL) licenses. " \
+"It can be used in commercial applications (see http://cimg.eu)."
+
 #define kPluginIdentifier    "net.sf.cimg.CImgBlur"
 #define kPluginIdentifierLaplacian    "net.sf.cimg.CImgLaplacian"
 #define kPluginIdentifierSharpen    "net.sf.cimg.CImgSharpen"
@@ -220,6 +232,7 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginIdentifierErodeBlur    "eu.cimg.ErodeBlur"
 #define kPluginIdentifierEdgeExtend    "eu.cimg.EdgeExtend"
 #define kPluginIdentifierEdgeDetect    "eu.cimg.EdgeDetect"
+#define kPluginIdentifierEdgeBlur    "fr.inria.EdgeBlur" // replaces the EdgeBlur PyPlug (version 1)
 
 // History:
 // version 1.0: initial version
@@ -227,8 +240,12 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 3.0: use kNatronOfxParamProcess* parameters
 // version 4.0: the default is to blur all channels including alpha (see processAlpha in describeInContext)
 // version 4.1: added cropToFormat parameter on Natron
+// version 4.2: faster recursive and box filters, processing several columns at once
+// version 4.3: Bloom and EdgeExtend: added pyramid parameter
+// version 4.4: added EdgeBlur
+// version 4.5: Bloom and EdgeExtend: the result of the pyramid does not depend on the tiling
 #define kPluginVersionMajor 4 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 5 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsComponentRemapping 1 // except for ChromaBlur
 #define kSupportsTiles 1
@@ -308,6 +325,14 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamEdgeExtendUnpremultLabel "Unpremult Result"
 #define kParamEdgeExtendUnpremultHint "Unpremultiply the result image by its alpha channel after processing."
 
+#define kParamPyramid "pyramid"
+#define kParamPyramidLabel "Pyramid"
+#define kParamPyramidHint "Compute the large blur kernels on a downscaled image pyramid (each level is half the size of the previous level), then upscale and accumulate the results. This is much faster for large sizes, and the result is visually close to the full resolution computation, except maybe near the image borders. Uncheck to compute all blurs at full resolution (highest quality)."
+#define kParamPyramidDefault false
+
+#define kPyramidMinSigma 2. // minimum standard deviation of the blur kernels computed on a pyramid level, in pixels of that level
+#define kPyramidMinSize 16 // minimum width and height of a pyramid level
+
 
 #define kParamBoundary "boundary"
 #define kParamBoundaryLabel "Border Conditions" //"Boundary Conditions"
@@ -415,6 +440,22 @@ enum EdgeDetectMultiChannelEnum
 #define kParamEdgeDetectBlurLabel "Blur Size"
 #define kParamEdgeDetectBlurHint "Size of the blur kernel applied before edge detection."
 
+#define kClipEdgeBlurMatte "Matte"
+
+#define kParamEdgeBlurExternalMatte "externalMatte"
+#define kParamEdgeBlurExternalMatteLabel "External Matte"
+#define kParamEdgeBlurExternalMatteHint "Use the edges from the Matte input instead of the alpha channel of the source image."
+
+#define kParamEdgeBlurSize "size"
+#define kParamEdgeBlurSizeLabel "Size"
+#define kParamEdgeBlurSizeHint "Size (diameter) of the edge detection and blur filter kernels, in pixel units (>=0)."
+#define kParamEdgeBlurSizeDefault 3.
+
+#define kParamEdgeBlurEdgeMult "edgeMult"
+#define kParamEdgeBlurEdgeMultLabel "Edge Mult"
+#define kParamEdgeBlurEdgeMultHint "Sharpness of the borders of the blur area."
+#define kParamEdgeBlurEdgeMultDefault 2.
+
 #define kParamExpandRoD "expandRoD"
 #define kParamExpandRoDLabel "Expand RoD"
 #define kParamExpandRoDHint "Expand the source region of definition by 1.5*size (3.6*sigma)."
@@ -430,21 +471,6 @@ enum EdgeDetectMultiChannelEnum
 typedef cimgpix_t T;
 using namespace cimg_library;
 
-#if cimg_version < 160
-#define cimgblur_internal_vanvliet
-#endif
-
-#if cimg_version < 200
-// cimg pre-2.0.0's box filter broke TestPIK (check the output of the PIKColor, it should be almost solid green)
-// the reason is:
-// - sum in _cimg_blur_box_apply should be double, not Tfloat
-// other possible issues (which do not affect BlurCImg, since T=float in our case):
-// - win shound be CImg<T> not CImg<Tfloat>
-// - next and prev should be T not Tfloat
-// this was fixed in https://github.com/dtschump/CImg/commit/2067bd0765d23afc4c41b706bc57d094a2dce51d
-#define cimgblur_internal_boxfilter
-#endif
-
 // Exponentiation by squaring
 // works with positive or negative integer exponents
 template<typename T>
@@ -476,547 +502,6 @@ ipow(T base,
     return result;
 }
 
-#ifdef cimgblur_internal_boxfilter
-
-// see cimg_library::CImg::cimg_blur_box_apply
-static inline
-T
-get_data(const T *ptr,
-         const int N,
-         const unsigned long off,
-         const bool boundary_conditions,
-         const int x)
-{
-    assert(N >= 1);
-    if (x < 0) {
-        return boundary_conditions ? ptr[0] : T();
-    }
-    if (x >= N) {
-        return boundary_conditions ? ptr[(N - 1) * off] : T();
-    }
-
-    return ptr[x * off];
-}
-
-// [internal] Apply a box/triangle/quadratic filter (used by CImg<T>::boxfilter() and CImg<T>::blur_box()).
-/**
-   \param ptr the pointer of the data
-   \param N size of the data
-   \param boxsize Size of the box filter (can be subpixel).
-   \param off the offset between two data point
-   \param iter number of iterations (1 = box, 2 = triangle, 3 = quadratic)
-   \param order the order of the filter 0 (smoothing), 1st derivtive, 2nd derivative, 3rd derivative
-   \param boundary_conditions Boundary conditions. Can be <tt>{ 0=dirichlet | 1=neumann }</tt>.
- **/
-// see cimg_library::CImg::cimg_blur_box_apply
-static void
-_cimg_blur_box_apply(T *ptr,
-                     const float boxsize,
-                     const int N,
-                     const unsigned long off,
-                     const int order,
-                     const bool boundary_conditions,
-                     const unsigned int nb_iter)
-{
-    // smooth
-    if ( (boxsize > 1.) && (nb_iter > 0) ) {
-        int w2 = (int)(boxsize - 1) / 2;
-        int winsize = 2 * w2 + 1;
-        double frac = (boxsize - winsize) / 2.;
-        std::vector<T> win(winsize);
-        for (unsigned int iter = 0; iter<nb_iter; ++iter) {
-            // prepare for first iteration
-            double sum = 0; // window sum
-            for (int x = -w2; x <= w2; ++x) {
-                win[x + w2] = get_data(ptr, N, off, boundary_conditions, x);
-                sum += win[x + w2];
-            }
-            int ifirst = 0;
-            int ilast = 2 * w2;
-            T prev = get_data(ptr, N, off, boundary_conditions, -w2 - 1);
-            T next = get_data(ptr, N, off, boundary_conditions, +w2 + 1);
-            // main loop
-            for (int x = 0; x < N - 1; ++x) {
-                // add partial pixels
-                const double sum2 = sum + frac * (prev + next);
-                // fill result
-                ptr[x * off] = sum2 / boxsize;
-                // advance for next iteration
-                prev = win[ifirst];
-                sum -= prev;
-                ifirst = (ifirst + 1) % winsize;
-                ilast = (ilast + 1) % winsize;
-                assert( (ilast + 1) % winsize == ifirst ); // it is a circular buffer
-                win[ilast] = next;
-                sum += next;
-                next = get_data(ptr, N, off, boundary_conditions, x + w2 + 2);
-            }
-            // last iteration
-            // add partial pixels
-            const double sum2 = sum + frac * (prev + next);
-            // fill result
-            ptr[(N - 1) * off] = (T)(sum2 / boxsize);
-        }
-    }
-    // derive
-    switch (order) {
-    case 0:
-        // nothing to do
-        break;
-    case 1: {
-        T p = get_data(ptr, N, off, boundary_conditions, -1);
-        T c = get_data(ptr, N, off, boundary_conditions, 0);
-        T n = get_data(ptr, N, off, boundary_conditions, +1);
-        for (int x = 0; x < N - 1; ++x) {
-            ptr[x * off] = (n - p) / 2.;
-            // advance
-            p = c;
-            c = n;
-            n = get_data(ptr, N, off, boundary_conditions, x + 2);
-        }
-        // last pixel
-        ptr[(N - 1) * off] = (n - p) / 2.;
-    }
-    break;
-    case 2: {
-        T p = get_data(ptr, N, off, boundary_conditions, -1);
-        T c = get_data(ptr, N, off, boundary_conditions, 0);
-        T n = get_data(ptr, N, off, boundary_conditions, +1);
-        for (int x = 0; x < N - 1; ++x) {
-            ptr[x * off] = n - 2 * c + p;
-            // advance
-            p = c;
-            c = n;
-            n = get_data(ptr, N, off, boundary_conditions, x + 2);
-        }
-        // last pixel
-        ptr[(N - 1) * off] = n - 2 * c + p;
-    }
-    break;
-    }
-} // _cimg_box_apply
-
-//! Box/Triangle/Quadratic filter.
-/**
-   \param width width of the box filter
-   \param iter number of iterations (1 = box, 2 = triangle, 3 = quadratic)
-   \param order the order of the filter 0,1,2,3
-   \param axis  Axis along which the filter is computed. Can be <tt>{ 'x' | 'y' | 'z' | 'c' }</tt>.
-   \param boundary_conditions Boundary conditions. Can be <tt>{ 0=dirichlet | 1=neumann }</tt>.
- **/
-/*
- The box filter of width s has the impulse response:
- x < -s/2 or x > s/2: y = 0
- x >= -s/2 and x <= s/2: y = 1/s
-
- The triangle filter of width s has the impulse response:
- x < -s or x > s: y = 0
- x >= -s and x <= 0: y = 1/s + x/(s*s) = int(1/s^2, t = -(1/2)*s .. x+(1/2)*s)
- x > 0 and x <= s: y = 1/s - x/(s*s)
-
- The quadratic filter of width s has the impulse response:
- x < -s*3/2 or x > s*3/2: y = 0
- x >= -s*3/2 and x <= -s/2: y = (4*x^2 + 12*x*s + 9s^2) / (8s^3) = simplify(int((1/s)*(1/s+t/(s*s)), t = -s .. x+(1/2)*s));
-
- x >= -s/2 and x <= s/2: y = (-4x^2 + 3s^2) / (4s^3) = simplify(int((1/s)*(1/s+t/(s*s)), t = x-(1/2)*s .. 0)+int((1/s)*(1/s-t/(s*s)), t = 0 .. x+(1/2)*s));
-
- x >= s/2 and x <= s*3/2: y = (4x^2 - 12xs + 9s^2) / (8s^3)
-
- The equation of a step edge is:
- x<=0: y=0
- x>0: y=1
-
- The convolution of the step edge with the box filter of width s is:
- x < -s/2: y = 0
- x >= -s/2 and x <= s/2: y = 1/2 + x/s
- x > s/2: y = 1
- 
- The convolution of the step edge with the triangle filter of width s is:
- x < -s: y = 0
- x >= -s and x <= 0: y = 1/2 + x/s + x^2/(2*s^2)
- x > 0 and x <= s: y = 1/2 + x/s - x^2/(2*s^2)
- x > s: y = 1
- */
-// see cimg_library::CImg::boxfilter(), this function has the additional parameter "order" to compute derivatives
-static void
-boxfilter(CImg<T>& img,
-          const float boxsize,
-          const int order,
-          const char axis = 'x',
-          const bool boundary_conditions = true,
-          const unsigned int nb_iter = 1)
-{
-    if ( img.is_empty() || !boxsize || ( (boxsize <= 1.f) && !order ) ) {
-        return /* *this*/;
-    }
-    const unsigned int _width = img._width, _height = img._height, _depth = img._depth, _spectrum = img._spectrum;
-    const char naxis = cimg::lowercase(axis); // was cimg::uncase(axis) before CImg 1.7.2
-    const float nboxsize = (boxsize >= 0) ? boxsize : -boxsize * (naxis=='x'?_width:
-                                                                  naxis=='y'?_height:
-                                                                  naxis=='z'?_depth:
-                                                                  _spectrum) / 100;
-    switch (naxis) {
-    case 'x': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forYZC(img, y, z, c)
-        _cimg_blur_box_apply(img.data(0, y, z, c), nboxsize, img._width, 1U, order, boundary_conditions, nb_iter);
-        break;
-    }
-    case 'y': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXZC(img, x, z, c)
-        _cimg_blur_box_apply(img.data(x, 0, z, c), nboxsize, _height, (unsigned long)_width, order, boundary_conditions, nb_iter);
-        break;
-    }
-    case 'z': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXYC(img, x, y, c)
-        _cimg_blur_box_apply(img.data(x, y, 0, c), nboxsize, _depth, (unsigned long)(_width * _height),
-                             order, boundary_conditions, nb_iter);
-        break;
-    }
-    default: {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXYZ(img, x, y, z)
-        _cimg_blur_box_apply(img.data(x, y, z, 0), nboxsize, _spectrum, (unsigned long)(_width * _height * _depth),
-                             order, boundary_conditions, nb_iter);
-    }
-    }
-    /* *this*/
-}
-#endif // cimgblur_internal_boxfilter
-
-#ifdef cimgblur_internal_vanvliet
-// [internal] Apply a recursive filter (used by CImg<T>::vanvliet()).
-/**
-   \param ptr the pointer of the data
-   \param filter the coefficient of the filter in the following order [n,n-1,n-2,n-3].
-   \param N size of the data
-   \param off the offset between two data point
-   \param order the order of the filter 0 (smoothing), 1st derivtive, 2nd derivative, 3rd derivative
-   \param boundary_conditions Boundary conditions. Can be <tt>{ 0=dirichlet | 1=neumann }</tt>.
-   \note dirichlet boundary conditions have a strange behavior. And
-   boundary condition should be corrected using Bill Triggs method (IEEE trans on Sig Proc 2005).
- **/
-template <int K>
-static void
-_cimg_recursive_apply(T *data,
-                      const double filter[],
-                      const int N,
-                      const unsigned long off,
-                      const int order,
-                      const bool boundary_conditions)
-{
-    double val[K];  // res[n,n-1,n-2,n-3,..] or res[n,n+1,n+2,n+3,..]
-    const double
-        sumsq = filter[0],
-        sum = sumsq * sumsq,
-        b1 = filter[1], b2 = filter[2], b3 = filter[3],
-        a3 = b3,
-        a2 = b2,
-        a1 = b1,
-        scaleM = 1.0 / ( (1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3) );
-    double M[9]; // Triggs matrix (for K == 4)
-
-    if (K == 4) {
-        M[0] = scaleM * (-a3 * a1 + 1.0 - a3 * a3 - a2);
-        M[1] = scaleM * (a3 + a1) * (a2 + a3 * a1);
-        M[2] = scaleM * a3 * (a1 + a3 * a2);
-        M[3] = scaleM * (a1 + a3 * a2);
-        M[4] = -scaleM * (a2 - 1.0) * (a2 + a3 * a1);
-        M[5] = -scaleM * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0);
-        M[6] = scaleM * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
-        M[7] = scaleM * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
-        M[8] = scaleM * a3 * (a1 + a3 * a2);
-    }
-    switch (order) {
-    case 0: {
-        const double iplus = (boundary_conditions ? data[(N - 1) * off] : 0);
-        for (int pass = 0; pass < 2; ++pass) {
-            if ( !pass || ( K != 4) ) {
-                for (int k = 1; k < K; ++k) {
-                    val[k] = (boundary_conditions ? *data / sumsq : 0);
-                }
-            } else {
-                /* apply Triggs border condition */
-                const double
-                    uplus = iplus / (1.0 - a1 - a2 - a3),
-                    vplus = uplus / (1.0 - b1 - b2 - b3),
-                    p1 = val[1],
-                    p2 = val[2],
-                    p3 = val[3],
-                    unp = p1 - uplus,
-                    unp1 = p2 - uplus,
-                    unp2 = p3 - uplus;
-                val[0] = (M[0] * unp + M[1] * unp1 + M[2] * unp2 + vplus) * sum;
-                val[1] = (M[3] * unp + M[4] * unp1 + M[5] * unp2 + vplus) * sum;
-                val[2] = (M[6] * unp + M[7] * unp1 + M[8] * unp2 + vplus) * sum;
-                *data = (T)val[0];
-                data -= off;
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            for (int n = (pass && K == 4); n < N; ++n) {
-                val[0] = (*data);
-                if (pass) {
-                    val[0] *= sum;
-                }
-                for (int k = 1; k < K; ++k) {
-                    val[0] += val[k] * filter[k];
-                }
-                *data = (T)val[0];
-                if (!pass) {
-                    data += off;
-                } else {
-                    data -= off;
-                }
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            if (!pass) {
-                data -= off;
-            }
-        }
-    }
-    break;
-    case 1: {
-        double x[3];     // [front,center,back]
-        for (int pass = 0; pass < 2; ++pass) {
-            if ( !pass || ( K != 4) ) {
-                for (int k = 0; k < 3; ++k) {
-                    x[k] = (boundary_conditions ? *data : 0);
-                }
-                for (int k = 0; k < K; ++k) {
-                    val[k] = 0;
-                }
-            } else {
-                /* apply Triggs border condition */
-                const double
-                    unp = val[1],
-                    unp1 = val[2],
-                    unp2 = val[3];
-                val[0] = (M[0] * unp + M[1] * unp1 + M[2] * unp2) * sum;
-                val[1] = (M[3] * unp + M[4] * unp1 + M[5] * unp2) * sum;
-                val[2] = (M[6] * unp + M[7] * unp1 + M[8] * unp2) * sum;
-                *data = (T)val[0];
-                data -= off;
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            for (int n = (pass && K == 4); n < N - 1; ++n) {
-                if (!pass) {
-                    x[0] = *(data + off);
-                    val[0] = 0.5f * (x[0] - x[2]);
-                } else {
-                    val[0] = (*data) * sum;
-                }
-                for (int k = 1; k < K; ++k) {
-                    val[0] += val[k] * filter[k];
-                }
-                *data = (T)val[0];
-                if (!pass) {
-                    data += off;
-                    for (int k = 2; k > 0; --k) {
-                        x[k] = x[k - 1];
-                    }
-                } else {
-                    data -= off;
-                }
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            *data = (T)0;
-        }
-    }
-    break;
-    case 2: {
-        double x[3];     // [front,center,back]
-        for (int pass = 0; pass < 2; ++pass) {
-            if ( !pass || ( K != 4) ) {
-                for (int k = 0; k < 3; ++k) {
-                    x[k] = (boundary_conditions ? *data : 0);
-                }
-                for (int k = 0; k < K; ++k) {
-                    val[k] = 0;
-                }
-            } else {
-                /* apply Triggs border condition */
-                const double
-                    unp = val[1],
-                    unp1 = val[2],
-                    unp2 = val[3];
-                val[0] = (M[0] * unp + M[1] * unp1 + M[2] * unp2) * sum;
-                val[1] = (M[3] * unp + M[4] * unp1 + M[5] * unp2) * sum;
-                val[2] = (M[6] * unp + M[7] * unp1 + M[8] * unp2) * sum;
-                *data = (T)val[0];
-                data -= off;
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            for (int n = (pass && K == 4); n < N - 1; ++n) {
-                if (!pass) {
-                    x[0] = *(data + off); val[0] = (x[1] - x[2]);
-                } else                                                            {
-                    x[0] = *(data - off); val[0] = (x[2] - x[1]) * sum;
-                }
-                for (int k = 1; k < K; ++k) {
-                    val[0] += val[k] * filter[k];
-                }
-                *data = (T)val[0];
-                if (!pass) {
-                    data += off;
-                } else {
-                    data -= off;
-                }
-                for (int k = 2; k > 0; --k) {
-                    x[k] = x[k - 1];
-                }
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            *data = (T)0;
-        }
-    }
-    break;
-    case 3: {
-        double x[3];     // [front,center,back]
-        for (int pass = 0; pass < 2; ++pass) {
-            if ( !pass || ( K != 4) ) {
-                for (int k = 0; k < 3; ++k) {
-                    x[k] = (boundary_conditions ? *data : 0);
-                }
-                for (int k = 0; k < K; ++k) {
-                    val[k] = 0;
-                }
-            } else {
-                /* apply Triggs border condition */
-                const double
-                    unp = val[1],
-                    unp1 = val[2],
-                    unp2 = val[3];
-                val[0] = (M[0] * unp + M[1] * unp1 + M[2] * unp2) * sum;
-                val[1] = (M[3] * unp + M[4] * unp1 + M[5] * unp2) * sum;
-                val[2] = (M[6] * unp + M[7] * unp1 + M[8] * unp2) * sum;
-                *data = (T)val[0];
-                data -= off;
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            for (int n = (pass && K == 4); n < N - 1; ++n) {
-                if (!pass) {
-                    x[0] = *(data + off); val[0] = (x[0] - 2 * x[1] + x[2]);
-                } else                                                                     {
-                    x[0] = *(data - off); val[0] = 0.5f * (x[2] - x[0]) * sum;
-                }
-                for (int k = 1; k < K; ++k) {
-                    val[0] += val[k] * filter[k];
-                }
-                *data = (T)val[0];
-                if (!pass) {
-                    data += off;
-                } else {
-                    data -= off;
-                }
-                for (int k = 2; k > 0; --k) {
-                    x[k] = x[k - 1];
-                }
-                for (int k = K - 1; k > 0; --k) {
-                    val[k] = val[k - 1];
-                }
-            }
-            *data = (T)0;
-        }
-    }
-    break;
-    } // switch
-} // _cimg_recursive_apply
-
-//! Van Vliet recursive Gaussian filter.
-/**
-   \param sigma standard deviation of the Gaussian filter
-   \param order the order of the filter 0,1,2,3
-   \param axis  Axis along which the filter is computed. Can be <tt>{ 'x' | 'y' | 'z' | 'c' }</tt>.
-   \param boundary_conditions Boundary conditions. Can be <tt>{ 0=dirichlet | 1=neumann }</tt>.
-   \note dirichlet boundary condition has a strange behavior
-
-   I.T. Young, L.J. van Vliet, M. van Ginkel, Recursive Gabor filtering.
-   IEEE Trans. Sig. Proc., vol. 50, pp. 2799-2805, 2002.
-
-   (this is an improvement over Young-Van Vliet, Sig. Proc. 44, 1995)
-
-   Boundary conditions (only for order 0) using Triggs matrix, from
-   B. Triggs and M. Sdika. Boundary conditions for Young-van Vliet
-   recursive filtering. IEEE Trans. Signal Processing,
-   vol. 54, pp. 2365-2367, 2006.
- **/
-void
-vanvliet(CImg<T>& img,
-         const float sigma,
-         const int order,
-         const char axis = 'x',
-         const bool boundary_conditions = true)
-{
-    if ( img.is_empty() ) {
-        return /* *this*/;
-    }
-    const unsigned int _width = img._width, _height = img._height, _depth = img._depth, _spectrum = img._spectrum;
-    const char naxis = cimg::uncase(axis);
-    const float nsigma = sigma >= 0 ? sigma : -sigma * (naxis == 'x' ? _width : naxis == 'y' ? _height : naxis == 'z' ? _depth : _spectrum) / 100;
-    if ( img.is_empty() || ( (nsigma < 0.1f) && !order ) ) {
-        return /* *this*/;
-    }
-    const double
-        nnsigma = nsigma < 0.1f ? 0.1f : nsigma,
-        m0 = 1.16680, m1 = 1.10783, m2 = 1.40586,
-        m1sq = m1 * m1, m2sq = m2 * m2,
-        q = ( nnsigma < 3.556 ? -0.2568 + 0.5784 * nnsigma + 0.0561 * nnsigma * nnsigma : 2.5091 + 0.9804 * (nnsigma - 3.556) ),
-        qsq = q * q,
-        scale = (m0 + q) * (m1sq + m2sq + 2 * m1 * q + qsq),
-        b1 = -q * (2 * m0 * m1 + m1sq + m2sq + (2 * m0 + 4 * m1) * q + 3 * qsq) / scale,
-        b2 = qsq * (m0 + 2 * m1 + 3 * q) / scale,
-        b3 = -qsq * q / scale,
-        B = ( m0 * (m1sq + m2sq) ) / scale;
-    double filter[4];
-    filter[0] = B; filter[1] = -b1; filter[2] = -b2; filter[3] = -b3;
-    switch (naxis) {
-    case 'x': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forYZC(img, y, z, c)
-        _cimg_recursive_apply<4>(img.data(0, y, z, c), filter, img._width, 1U, order, boundary_conditions);
-    }
-    break;
-    case 'y': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXZC(img, x, z, c)
-        _cimg_recursive_apply<4>(img.data(x, 0, z, c), filter, _height, (unsigned long)_width, order, boundary_conditions);
-    }
-    break;
-    case 'z': {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXYC(img, x, y, c)
-        _cimg_recursive_apply<4>(img.data(x, y, 0, c), filter, _depth, (unsigned long)(_width * _height),
-                                 order, boundary_conditions);
-    }
-    break;
-    default: {
-        cimg_pragma_openmp(parallel for collapse(3) if (_width>=256 && _height*_depth*_spectrum>=16))
-        cimg_forXYZ(img, x, y, z)
-        _cimg_recursive_apply<4>(img.data(x, y, z, 0), filter, _spectrum, (unsigned long)(_width * _height * _depth),
-                                 order, boundary_conditions);
-    }
-    }
-    /* *this*/
-} // vanvliet
-
-#endif // cimg_version < 160
-
 /// Blur plugin
 struct CImgBlurParams
 {
@@ -1032,12 +517,15 @@ struct CImgBlurParams
     bool edgeExtendPremult;
     double edgeExtendSize;
     bool edgeExtendUnpremult;
+    bool pyramid;
     ColorspaceEnum colorspace;
     int boundary_i;
     FilterEnum filter;
     EdgeDetectFilterEnum edgeDetectFilter;
     EdgeDetectMultiChannelEnum edgeDetectMultiChannel;
     bool edgeDetectNMS;
+    bool edgeBlurExternalMatte;
+    double edgeBlurEdgeMult;
     bool expandRoD;
     bool cropToFormat;
     double alphaThreshold;
@@ -1054,31 +542,9 @@ enum BlurPluginEnum
     eBlurPluginErodeBlur,
     eBlurPluginEdgeExtend,
     eBlurPluginEdgeDetect,
+    eBlurPluginEdgeBlur,
 };
 
-/*
-The convolution of the step edge with the triangle filter of width s is:
-x < -s: y = 0
-x >= -s and x <= 0: y = 1/2 + x/s + x^2/(2*s^2)
-x > 0 and x <= s: y = 1/2 + x/s - x^2/(2*s^2)
-x > s: y = 1
-*/
-static double
-blurredStep(double s, double x)
-{
-    if (s <= 0) {
-        return (x >= 0) ? 1. : 0.;
-    }
-    if (x <= -s) {
-        return 0.;
-    }
-    if (x >= s) {
-        return 1.;
-    }
-    double x_over_s = x/s;
-    return 0.5 + x_over_s * (1. + (x < 0 ? 0.5 : -0.5) * x_over_s);
-}
-
 static void
 mergeOver(const CImg<cimgpix_t> &cimgA, const CImg<cimgpix_t> &cimgB, CImg<cimgpix_t> &cimgOut)
 {
@@ -1135,6 +601,181 @@ unpremult(CImg<cimgpix_t> &cimg)
     }
 }
 
+// 2x downsampling by averaging 2x2 blocks, for the image pyramid (see ofxsPyramid.h).
+// srcBounds are the bounds of src in absolute pixel coordinates of its level, and the bounds
+// of the result are pyramidReduceBounds(srcBounds).
+static void
+pyramidReduce(ImageEffect &effect,
+              const CImg<cimgpix_t>& src,
+              const OfxRectI& srcBounds,
+              CImg<cimgpix_t>& dst)
+{
+    assert(src.depth() == 1);
+    assert( src.width() == srcBounds.x2 - srcBounds.x1 && src.height() == srcBounds.y2 - srcBounds.y1 );
+    const OfxRectI dstBounds = pyramidReduceBounds(srcBounds);
+    dst.assign( dstBounds.x2 - dstBounds.x1, dstBounds.y2 - dstBounds.y1, 1, src.spectrum() );
+    std::vector<const cimgpix_t*> srcPlanes( src.spectrum() );
+    std::vector<cimgpix_t*> dstPlanes( dst.spectrum() );
+    cimg_forC(dst, c) {
+        srcPlanes[c] = src.data(0, 0, 0, c);
+        dstPlanes[c] = dst.data(0, 0, 0, c);
+    }
+    PyramidReduceProcessor processor(effect, &srcPlanes[0], srcBounds, &dstPlanes[0], dst.spectrum());
+    processor.process();
+}
+
+// 2x upsampling with bilinear interpolation, the inverse of pyramidReduce.
+// The bounds of src and of the result are in absolute pixel coordinates of their level.
+static void
+pyramidExpand(ImageEffect &effect,
+              const CImg<cimgpix_t>& src,
+              const OfxRectI& srcBounds,
+              const OfxRectI& dstBounds,
+              CImg<cimgpix_t>& dst)
+{
+    assert(src.depth() == 1);
+    assert( src.width() == srcBounds.x2 - srcBounds.x1 && src.height() == srcBounds.y2 - srcBounds.y1 );
+    dst.assign( dstBounds.x2 - dstBounds.x1, dstBounds.y2 - dstBounds.y1, 1, src.spectrum() );
+    std::vector<const cimgpix_t*> srcPlanes( src.spectrum() );
+    std::vector<cimgpix_t*> dstPlanes( dst.spectrum() );
+    cimg_forC(dst, c) {
+        srcPlanes[c] = src.data(0, 0, 0, c);
+        dstPlanes[c] = dst.data(0, 0, 0, c);
+    }
+    PyramidExpandProcessor processor(effect, &srcPlanes[0], srcBounds, &dstPlanes[0], dstBounds, dst.spectrum());
+    processor.process();
+}
+
+// the blur filter used by the given edge detection filter (the simple, Sobel and
+// rotation-invariant filters are preceded by a Gaussian blur)
+static FilterEnum
+edgeDetectBlurFilter(EdgeDetectFilterEnum edgeDetectFilter)
+{
+    switch (edgeDetectFilter) {
+    case eEdgeDetectFilterSimple:
+    case eEdgeDetectFilterSobel:
+    case eEdgeDetectFilterRotationInvariant:
+    case eEdgeDetectFilterGaussian:
+        return eFilterGaussian;
+    case eEdgeDetectFilterQuasiGaussian:
+        return eFilterQuasiGaussian;
+    case eEdgeDetectFilterBox:
+        return eFilterBox;
+    case eEdgeDetectFilterTriangle:
+        return eFilterTriangle;
+    case eEdgeDetectFilterQuadratic:
+        return eFilterQuadratic;
+    }
+
+    return eFilterGaussian;
+}
+
+// compute the roi required to compute rect with the given filter (sx and sy include the render scale)
+static void
+filterRoI(const OfxRectI& rect,
+          FilterEnum filter,
+          double sx, int orderX,
+          double sy, int orderY,
+          OfxRectI* roi)
+{
+    if ( (filter == eFilterQuasiGaussian) || (filter == eFilterGaussian) ) {
+        float sigmax = (float)(sx / 2.4);
+        float sigmay = (float)(sy / 2.4);
+        if ( (sigmax < 0.1) && (sigmay < 0.1) && (orderX == 0) && (orderY == 0) ) {
+            *roi = rect;
+
+            return;
+        }
+
+        int delta_pixX = (std::max)( 3, (int)std::ceil(sx * 1.5) );
+        int delta_pixY = (std::max)( 3, (int)std::ceil(sy * 1.5) );
+        roi->x1 = rect.x1 - delta_pixX - orderX;
+        roi->x2 = rect.x2 + delta_pixX + orderX;
+        roi->y1 = rect.y1 - delta_pixY - orderY;
+        roi->y2 = rect.y2 + delta_pixY + orderY;
+    } else if ( (filter == eFilterBox) || (filter == eFilterTriangle) || (filter == eFilterQuadratic) ) {
+        int iter = ( filter == eFilterBox ? 1 :
+                     (filter == eFilterTriangle ? 2 : 3) );
+        int delta_pixX = iter * (std::floor( (sx - 1) / 2 ) + 1);
+        int delta_pixY = iter * (std::floor( (sy - 1) / 2 ) + 1);
+        roi->x1 = rect.x1 - delta_pixX - (orderX > 0);
+        roi->x2 = rect.x2 + delta_pixX + (orderX > 0);
+        roi->y1 = rect.y1 - delta_pixY - (orderY > 0);
+        roi->y2 = rect.y2 + delta_pixY + (orderY > 0);
+    } else {
+        assert(false);
+    }
+}
+
+// variance (in pixels^2) of the blur filter of the given size
+static double
+filterVariance(FilterEnum filter,
+               double size)
+{
+    if ( (filter == eFilterQuasiGaussian) || (filter == eFilterGaussian) ) {
+        return (size / 2.4) * (size / 2.4);
+    }
+    int iter = ( filter == eFilterBox ? 1 :
+                (filter == eFilterTriangle ? 2 : 3) );
+
+    return boxFilterVariance(iter, size);
+}
+
+// size of the blur filter with the given variance (the inverse of filterVariance)
+static double
+filterSize(FilterEnum filter,
+           double variance)
+{
+    if (variance <= 0.) {
+        return 0.;
+    }
+    if ( (filter == eFilterQuasiGaussian) || (filter == eFilterGaussian) ) {
+        return 2.4 * std::sqrt(variance);
+    }
+    int iter = ( filter == eFilterBox ? 1 :
+                (filter == eFilterTriangle ? 2 : 3) );
+
+    return boxFilterSize(iter, variance);
+}
+
+// the coarsest pyramid level on which a blur of the given size can be computed
+static int
+pyramidLevel(FilterEnum filter,
+             double sx,
+             double sy,
+             int width,
+             int height)
+{
+    const double sigma = std::sqrt( (std::min)( filterVariance(filter, sx), filterVariance(filter, sy) ) );
+
+    return OFX::pyramidLevel(sigma, kPyramidMinSigma, kPyramidMinSize, width, height);
+}
+
+// compute the roi required to compute rect with the given filter, when the blur is computed on
+// any pyramid level where it is well sampled (sx and sy include the render scale)
+static void
+pyramidFilterRoI(const OfxRectI& rect,
+                 FilterEnum filter,
+                 double sx,
+                 double sy,
+                 OfxRectI* roi)
+{
+    filterRoI(rect, filter, sx, 0, sy, 0, roi);
+    // the actual level also depends on the size of the source RoD, and is at most this one
+    const int maxLevel = pyramidLevel(filter, sx, sy, INT_MAX, INT_MAX);
+    for (int level = 1; level <= maxLevel; ++level) {
+        const double lsx = filterSize( filter, pyramidLevelVariance(filterVariance(filter, sx), level) );
+        const double lsy = filterSize( filter, pyramidLevelVariance(filterVariance(filter, sy), level) );
+        const OfxRectI pixel = {0, 0, 1, 1};
+        OfxRectI levelRoI;
+        filterRoI(pixel, filter, lsx, 0, lsy, 0, &levelRoI);
+        roi->x1 = (std::min)( roi->x1, rect.x1 - pyramidSupport(pixel.x1 - levelRoI.x1, level) );
+        roi->x2 = (std::max)( roi->x2, rect.x2 + pyramidSupport(levelRoI.x2 - pixel.x2, level) );
+        roi->y1 = (std::min)( roi->y1, rect.y1 - pyramidSupport(pixel.y1 - levelRoI.y1, level) );
+        roi->y2 = (std::max)( roi->y2, rect.y2 + pyramidSupport(levelRoI.y2 - pixel.y2, level) );
+    }
+}
+
 
 class CImgBlurPlugin
     : public CImgFilterPluginHelper<CImgBlurParams, false>
@@ -1163,6 +804,7 @@ public:
         , _edgeExtendSize(NULL)
         , _edgeExtendCount(NULL)
         , _edgeExtendUnpremult(NULL)
+        , _pyramid(NULL)
         , _colorspace(NULL)
         , _boundary(NULL)
         , _filter(NULL)
@@ -1171,6 +813,10 @@ public:
         , _edgeDetectBlur(NULL)
         , _edgeDetectErode(NULL)
         , _edgeDetectNMS(NULL)
+        , _matteClip(NULL)
+        , _edgeBlurExternalMatte(NULL)
+        , _edgeBlurSize(NULL)
+        , _edgeBlurEdgeMult(NULL)
         , _expandRoD(NULL)
         , _cropToFormat(NULL)
         , _alphaThreshold(NULL)
@@ -1224,6 +870,12 @@ public:
         } else {
             assert(!paramExists(kParamBloomRatio) && !paramExists(kParamBloomCount) );
         }
+        if (blurPlugin == eBlurPluginBloom || blurPlugin == eBlurPluginEdgeExtend) {
+            _pyramid = fetchBooleanParam(kParamPyramid);
+            assert(_pyramid);
+        } else {
+            assert( !paramExists(kParamPyramid) );
+        }
         if (blurPlugin == eBlurPluginChromaBlur) {
             _colorspace = fetchChoiceParam(kParamColorspace);
             assert(_colorspace);
@@ -1248,6 +900,17 @@ public:
             // kParamFilter and kParamEdgeDetectFilter have the same value
             assert( /*!paramExists(kParamEdgeDetectFilter) &&*/ !paramExists(kParamEdgeDetectMultiChannel) && !paramExists(kParamEdgeDetectBlur) && !paramExists(kParamEdgeDetectErode) && !paramExists(kParamEdgeDetectNMS) );
         }
+        if (_blurPlugin == eBlurPluginEdgeBlur) {
+            _matteClip = fetchClip(kClipEdgeBlurMatte);
+            _edgeDetectFilter = fetchChoiceParam(kParamEdgeDetectFilter);
+            _edgeBlurExternalMatte = fetchBooleanParam(kParamEdgeBlurExternalMatte);
+            _edgeBlurSize = fetchDoubleParam(kParamEdgeBlurSize);
+            _edgeBlurEdgeMult = fetchDoubleParam(kParamEdgeBlurEdgeMult);
+            assert(_matteClip && _edgeDetectFilter && _edgeBlurExternalMatte && _edgeBlurSize && _edgeBlurEdgeMult);
+        } else {
+            // kParamEdgeBlurSize and kParamSize have the same value
+            assert( !paramExists(kParamEdgeBlurExternalMatte) && !paramExists(kParamEdgeBlurEdgeMult) );
+        }
         if (_blurPlugin == eBlurPluginBlur ||
             _blurPlugin == eBlurPluginLaplacian ||
             _blurPlugin == eBlurPluginSharpen ||
@@ -1259,7 +922,7 @@ public:
             assert(_filter);
         } else {
             // kParamFilter and kParamEdgeDetectFilter have the same value
-            assert( (_blurPlugin == eBlurPluginEdgeDetect) || !paramExists(kParamFilter) );
+            assert( (_blurPlugin == eBlurPluginEdgeDetect) || (_blurPlugin == eBlurPluginEdgeBlur) || !paramExists(kParamFilter) );
         }
         if (_blurPlugin == eBlurPluginBlur ||
             _blurPlugin == eBlurPluginBloom ||
@@ -1306,7 +969,8 @@ public:
                _blurPlugin == eBlurPluginBloom ||
                _blurPlugin == eBlurPluginErodeBlur ||
                _blurPlugin == eBlurPluginEdgeExtend ||
-               _blurPlugin == eBlurPluginEdgeDetect);
+               _blurPlugin == eBlurPluginEdgeDetect ||
+               _blurPlugin == eBlurPluginEdgeBlur);
 
         if (_blurPlugin == eBlurPluginSharpen) {
             params.sharpenSoftenAmount = _sharpenSoftenAmount->getValueAtTime(time);
@@ -1319,7 +983,8 @@ public:
                    _blurPlugin == eBlurPluginBloom ||
                    _blurPlugin == eBlurPluginErodeBlur ||
                    _blurPlugin == eBlurPluginEdgeExtend ||
-                   _blurPlugin == eBlurPluginEdgeDetect);
+                   _blurPlugin == eBlurPluginEdgeDetect ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             assert(!_sharpenSoftenAmount);
             params.sharpenSoftenAmount = 0.;
         }
@@ -1343,7 +1008,8 @@ public:
                    _blurPlugin == eBlurPluginSoften ||
                    _blurPlugin == eBlurPluginChromaBlur ||
                    _blurPlugin == eBlurPluginBloom ||
-                   _blurPlugin == eBlurPluginEdgeExtend);
+                   _blurPlugin == eBlurPluginEdgeExtend ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             assert(!_erodeSize && !_erodeBlur);
             params.erodeSize = 0.;
             params.erodeBlur = 0.;
@@ -1361,7 +1027,8 @@ public:
                    _blurPlugin == eBlurPluginChromaBlur ||
                    _blurPlugin == eBlurPluginBloom ||
                    _blurPlugin == eBlurPluginErodeBlur ||
-                   _blurPlugin == eBlurPluginEdgeDetect);
+                   _blurPlugin == eBlurPluginEdgeDetect ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             assert(!_edgeExtendPremult && !_edgeExtendSize);
             params.edgeExtendPremult = false;
             params.edgeExtendSize = 0.;
@@ -1372,6 +1039,8 @@ public:
             params.sizey = params.sizex = params.edgeExtendSize; // used for RoD/RoI/identity
         } else if (_blurPlugin == eBlurPluginEdgeDetect) {
             params.sizey = params.sizex = _edgeDetectBlur->getValueAtTime(time);
+        } else if (_blurPlugin == eBlurPluginEdgeBlur) {
+            params.sizey = params.sizex = (std::max)( 0., _edgeBlurSize->getValueAtTime(time) );
         } else if (_blurPlugin != eBlurPluginErodeBlur) {
             assert(_blurPlugin == eBlurPluginBlur ||
                    _blurPlugin == eBlurPluginLaplacian ||
@@ -1401,7 +1070,8 @@ public:
                    _blurPlugin == eBlurPluginBloom ||
                    _blurPlugin == eBlurPluginErodeBlur ||
                    _blurPlugin == eBlurPluginEdgeExtend ||
-                   _blurPlugin == eBlurPluginEdgeDetect);
+                   _blurPlugin == eBlurPluginEdgeDetect ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             assert(!_orderX && !_orderY);
             params.orderX = params.orderY = 0;
         }
@@ -1426,7 +1096,8 @@ public:
                    _blurPlugin == eBlurPluginSoften ||
                    _blurPlugin == eBlurPluginChromaBlur ||
                    _blurPlugin == eBlurPluginErodeBlur ||
-                   _blurPlugin == eBlurPluginEdgeDetect);
+                   _blurPlugin == eBlurPluginEdgeDetect ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             assert(!_bloomRatio && !_bloomCount);
             params.bloomRatio = 1.;
             params.count = 1;
@@ -1441,13 +1112,15 @@ public:
                    _blurPlugin == eBlurPluginBloom ||
                    _blurPlugin == eBlurPluginErodeBlur ||
                    _blurPlugin == eBlurPluginEdgeExtend ||
-                   _blurPlugin == eBlurPluginEdgeDetect);
+                   _blurPlugin == eBlurPluginEdgeDetect ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             params.colorspace = eColorspaceRec709;
         }
         if (_blurPlugin == eBlurPluginBlur ||
             _blurPlugin == eBlurPluginBloom) {
             params.boundary_i = _boundary->getValueAtTime(time);
-        } else if (_blurPlugin == eBlurPluginErodeBlur) {
+        } else if (_blurPlugin == eBlurPluginErodeBlur ||
+                   _blurPlugin == eBlurPluginEdgeBlur) {
             assert(!_boundary);
             params.boundary_i = 0; // black
         } else {
@@ -1466,28 +1139,12 @@ public:
             assert(!_orderX && !_orderY);
             params.orderX = params.orderY = 1;
             assert(!_filter);
-            switch (params.edgeDetectFilter) {
-                case eEdgeDetectFilterSimple:
-                case eEdgeDetectFilterSobel:
-                case eEdgeDetectFilterRotationInvariant:
-                    params.filter = eFilterGaussian;
-                    break;
-                case eEdgeDetectFilterQuasiGaussian:
-                    params.filter = eFilterQuasiGaussian;
-                    break;
-                case eEdgeDetectFilterGaussian:
-                    params.filter = eFilterGaussian;
-                    break;
-                case eEdgeDetectFilterBox:
-                    params.filter = eFilterBox;
-                    break;
-                case eEdgeDetectFilterTriangle:
-                    params.filter = eFilterTriangle;
-                    break;
-                case eEdgeDetectFilterQuadratic:
-                    params.filter = eFilterQuadratic;
-                    break;
-            }
+            params.filter = edgeDetectBlurFilter(params.edgeDetectFilter);
+        } else if (_blurPlugin == eBlurPluginEdgeBlur) {
+            params.edgeDetectFilter = (EdgeDetectFilterEnum)_edgeDetectFilter->getValueAtTime(time);
+            // the source is blurred with a Gaussian filter, the edge detection filter is only used on the matte
+            assert(!_filter);
+            params.filter = eFilterGaussian;
         } else if (_blurPlugin == eBlurPluginErodeBlur) {
             assert(!_filter);
             params.filter = eFilterTriangle;
@@ -1513,6 +1170,9 @@ public:
             _blurPlugin == eBlurPluginEdgeExtend ||
             _blurPlugin == eBlurPluginEdgeDetect) {
             params.expandRoD = _expandRoD->getValueAtTime(time);
+        } else if (_blurPlugin == eBlurPluginEdgeBlur) {
+            assert(!_expandRoD);
+            params.expandRoD = true; // as the Blur node of the EdgeBlur PyPlug
         } else if (_blurPlugin == eBlurPluginErodeBlur) {
             params.expandRoD = true;
         } else {
@@ -1535,11 +1195,21 @@ public:
                    _blurPlugin == eBlurPluginChromaBlur ||
                    _blurPlugin == eBlurPluginBloom ||
                    _blurPlugin == eBlurPluginErodeBlur ||
-                   _blurPlugin == eBlurPluginEdgeExtend);
+                   _blurPlugin == eBlurPluginEdgeExtend ||
+                   _blurPlugin == eBlurPluginEdgeBlur);
             params.edgeDetectMultiChannel = eEdgeDetectMultiChannelSeparate;
             params.edgeDetectNMS = false;
         }
+        if (_blurPlugin == eBlurPluginEdgeBlur) {
+            params.edgeBlurExternalMatte = _edgeBlurExternalMatte->getValueAtTime(time);
+            params.edgeBlurEdgeMult = _edgeBlurEdgeMult->getValueAtTime(time);
+        } else {
+            assert(!_edgeBlurExternalMatte && !_edgeBlurEdgeMult);
+            params.edgeBlurExternalMatte = false;
+            params.edgeBlurEdgeMult = 1.;
+        }
 
+        params.pyramid = _pyramid ? _pyramid->getValueAtTime(time) : false;
         params.cropToFormat = _cropToFormat ? _cropToFormat->getValueAtTime(time) : false;
         params.alphaThreshold = _alphaThreshold ? _alphaThreshold->getValueAtTime(time) : 0.;
     }
@@ -1641,6 +1311,17 @@ public:
         double sx = renderScale.x * params.sizex;
         double sy = renderScale.y * params.sizey;
 
+        if ( params.pyramid && (_blurPlugin == eBlurPluginEdgeExtend) ) {
+            // each blur is computed from the previous result, so the supports add up
+            const int n = params.count;
+            const double sRatio = 1. / std::sqrt(n*(n+1)*(n+0.5)/3); // see render()
+            *roi = rect;
+            for (int i = 0; i < n; ++i) {
+                pyramidFilterRoI(*roi, params.filter, sx * sRatio * (i + 1), sy * sRatio * (i + 1), roi);
+            }
+
+            return;
+        }
         if (_blurPlugin == eBlurPluginBloom) {
             // size of the largest blur kernel
             // note: for eBlurPluginEdgeExtend, the largest kernel is the first one
@@ -1648,39 +1329,35 @@ public:
             sx *= scale;
             sy *= scale;
         }
-        if ( (params.filter == eFilterQuasiGaussian) || (params.filter == eFilterGaussian) ) {
-            float sigmax = (float)(sx / 2.4);
-            float sigmay = (float)(sy / 2.4);
-            if ( (sigmax < 0.1) && (sigmay < 0.1) && (params.orderX == 0) && (params.orderY == 0) ) {
-                *roi = rect;
+        if ( params.pyramid && (_blurPlugin == eBlurPluginBloom) ) {
+            // the smaller kernels are computed on finer levels, and have a smaller support
+            pyramidFilterRoI(rect, params.filter, sx, sy, roi);
 
-                return;
-            }
+            return;
+        }
+        filterRoI(rect, params.filter, sx, params.orderX, sy, params.orderY, roi);
+        if (_blurPlugin == eBlurPluginEdgeBlur) {
+            // the edges are detected in the neighborhood of each pixel
+            OfxRectI edgeRoI;
+            filterRoI(rect, edgeDetectBlurFilter(params.edgeDetectFilter), sx, 1, sy, 1, &edgeRoI);
+            Coords::rectBoundingBox(*roi, edgeRoI, roi);
+        }
+    }
 
-            int delta_pixX = (std::max)( 3, (int)std::ceil(sx * 1.5) );
-            int delta_pixY = (std::max)( 3, (int)std::ceil(sy * 1.5) );
-            roi->x1 = rect.x1 - delta_pixX - params.orderX;
-            roi->x2 = rect.x2 + delta_pixX + params.orderX;
-            roi->y1 = rect.y1 - delta_pixY - params.orderY;
-            roi->y2 = rect.y2 + delta_pixY + params.orderY;
-        } else if ( (params.filter == eFilterBox) || (params.filter == eFilterTriangle) || (params.filter == eFilterQuadratic) ) {
-            int iter = ( params.filter == eFilterBox ? 1 :
-                         (params.filter == eFilterTriangle ? 2 : 3) );
-            int delta_pixX = iter * (std::floor( (sx - 1) / 2 ) + 1);
-            int delta_pixY = iter * (std::floor( (sy - 1) / 2 ) + 1);
-            roi->x1 = rect.x1 - delta_pixX - (params.orderX > 0);
-            roi->x2 = rect.x2 + delta_pixX + (params.orderX > 0);
-            roi->y1 = rect.y1 - delta_pixY - (params.orderY > 0);
-            roi->y2 = rect.y2 + delta_pixY + (params.orderY > 0);
-        } else {
-            assert(false);
+    // the Matte needs the same region as the source
+    virtual void getOtherRegionsOfInterest(const OfxRectD& srcRoI,
+                                           const CImgBlurParams& params,
+                                           RegionOfInterestSetter &rois) OVERRIDE FINAL
+    {
+        if ( (_blurPlugin == eBlurPluginEdgeBlur) && params.edgeBlurExternalMatte ) {
+            rois.setRegionOfInterest(*_matteClip, srcRoI);
         }
     }
 
     virtual void render(const RenderArguments &args,
                         const CImgBlurParams& params,
-                        int /*x1*/,
-                        int /*y1*/,
+                        int x1,
+                        int y1,
                         cimg_library::CImg<cimgpix_t>& /*mask*/,
                         cimg_library::CImg<cimgpix_t>& cimg,
                         int alphaChannel) OVERRIDE FINAL
@@ -1694,6 +1371,10 @@ public:
             // EdgeDetect has its own render function
             return renderEdgeDetect(args, params, cimg);
         }
+        if (_blurPlugin == eBlurPluginEdgeBlur) {
+            // EdgeBlur has its own render function
+            return renderEdgeBlur(args, params, x1, y1, cimg);
+        }
        // PROCESSING.
         // This is the only place where the actual processing takes place
         double sx = args.renderScale.x * params.sizex;
@@ -1816,8 +1497,21 @@ public:
             cimg1.assign(cimg.width(), cimg.height(), cimg.depth(), cimg.spectrum(), 0.);
         }
 
+        if ( params.pyramid && (_blurPlugin == eBlurPluginBloom || _blurPlugin == eBlurPluginEdgeExtend) ) {
+            // the pyramid levels are chosen from the size of the source RoD, and aligned on
+            // absolute pixel coordinates, so that the result does not depend on the tiling
+            OfxRectI srcRoD;
+            Coords::toPixelEnclosing(_srcClip->getRegionOfDefinition(args.time), args.renderScale, _srcClip->getPixelAspectRatio(), &srcRoD);
+            const OfxRectI bounds = {x1, y1, x1 + cimg.width(), y1 + cimg.height()};
+            if (_blurPlugin == eBlurPluginBloom) {
+                bloomPyramid(params, sx, sy, bounds, srcRoD, cimg, cimg1);
+            } else {
+                edgeExtendPyramid(params, sxBase, syBase, bounds, srcRoD, cimg);
+            }
+            if ( abort() ) { return; }
+        }
         // the loop is used only for eBlurPluginBloom and eBlurPluginEdgeExtend, other filters only do one iteration
-        for (int i = 0; i < params.count; ++i) {
+        for (int i = 0; i < (params.pyramid ? 0 : params.count); ++i) {
             if ( abort() ) { return; }
             if (_blurPlugin == eBlurPluginBloom ||
                 _blurPlugin == eBlurPluginEdgeExtend) {
@@ -2037,21 +1731,15 @@ public:
             if ( (_blurPlugin != eBlurPluginBloom) && (_blurPlugin != eBlurPluginEdgeExtend) && (_blurPlugin != eBlurPluginLaplacian) && (sigmax < 0.1) && (sigmay < 0.1) && (orderX == 0) && (orderY == 0) ) {
                 return false;
             }
-            // VanVliet filter was inexistent before 1.53, and buggy before CImg.h from
-            // 57ffb8393314e5102c00e5f9f8fa3dcace179608 Thu Dec 11 10:57:13 2014 +0100
+            // the 'y' pass processes several adjacent columns at once, see CImgBatchedFilters.h
             if (filter == eFilterGaussian) {
-#             ifdef cimgblur_internal_vanvliet
-                vanvliet(cimg_blur, /*cimg_blur.vanvliet(*/ sigmax, orderX, 'x', boundary);
-                vanvliet(cimg_blur, /*cimg_blur.vanvliet(*/ sigmay, orderY, 'y', boundary);
-#             else
-                cimg_blur.vanvliet(sigmax, orderX, 'x', boundary);
+                CImgBatchedFilters::vanvliet(cimg_blur, sigmax, orderX, 'x', boundary);
                 if ( abort() ) { return false; }
-                cimg_blur.vanvliet(sigmay, orderY, 'y', boundary);
-#             endif
+                CImgBatchedFilters::vanvliet(cimg_blur, sigmay, orderY, 'y', boundary);
             } else {
-                cimg_blur.deriche(sigmax, orderX, 'x', boundary);
+                CImgBatchedFilters::deriche(cimg_blur, sigmax, orderX, 'x', boundary);
                 if ( abort() ) { return false; }
-                cimg_blur.deriche(sigmay, orderY, 'y', boundary);
+                CImgBatchedFilters::deriche(cimg_blur, sigmay, orderY, 'y', boundary);
             }
 
             return true;
@@ -2059,15 +1747,9 @@ public:
             int iter = ( filter == eFilterBox ? 1 :
                         (filter == eFilterTriangle ? 2 : 3) );
 
-#         ifdef cimgblur_internal_boxfilter
-            boxfilter(cimg_blur, /*cimg_blur.boxfilter(*/ sx * scale, orderX, 'x', boundary, iter);
-            if ( abort() ) { return false; }
-            boxfilter(cimg_blur, /*cimg_blur.boxfilter(*/ sy * scale,orderY, 'y', boundary, iter);
-#         else
-            cimg_blur.boxfilter(sx * scale, orderX, 'x', boundary, iter);
+            CImgBatchedFilters::boxfilter(cimg_blur, sx * scale, orderX, 'x', boundary, iter);
             if ( abort() ) { return false; }
-            cimg_blur.boxfilter(sy * scale, orderY, 'y', boundary, iter);
-#         endif
+            CImgBatchedFilters::boxfilter(cimg_blur, sy * scale, orderY, 'y', boundary, iter);
 
             return true;
         }
@@ -2076,6 +1758,110 @@ public:
         return false;
     }
 
+    // blur a pyramid level, compensating for the blur introduced by pyramidReduce
+    void blurPyramidLevel(FilterEnum filter,
+                          double sx,
+                          double sy,
+                          int level,
+                          bool boundary,
+                          cimg_library::CImg<cimgpix_t>& cimg_blur)
+    {
+        const double lsx = filterSize( filter, pyramidLevelVariance(filterVariance(filter, sx), level) );
+        const double lsy = filterSize( filter, pyramidLevelVariance(filterVariance(filter, sy), level) );
+
+        blur(filter, lsx, 0, lsy, 0, 1., boundary, cimg_blur);
+    }
+
+    // Bloom computed on an image pyramid: each blur is done on the coarsest level
+    // where it is still well sampled, and the results are accumulated on each
+    // level, then upscaled and added from the coarsest to the finest level.
+    // The result (the sum of all blurred images) is stored in cimg_sum.
+    // cimgBounds are the bounds of cimg in absolute pixel coordinates.
+    void bloomPyramid(const CImgBlurParams& params,
+                      double sx,
+                      double sy,
+                      const OfxRectI& cimgBounds,
+                      const OfxRectI& srcRoD,
+                      const cimg_library::CImg<cimgpix_t>& cimg,
+                      cimg_library::CImg<cimgpix_t>& cimg_sum)
+    {
+        std::vector<int> levels(params.count);
+        int maxLevel = 0;
+        for (int i = 0; i < params.count; ++i) {
+            const double scale = ipow(params.bloomRatio, i);
+            levels[i] = pyramidLevel(params.filter, sx * scale, sy * scale, srcRoD.x2 - srcRoD.x1, srcRoD.y2 - srcRoD.y1);
+            maxLevel = (std::max)(maxLevel, levels[i]);
+        }
+        std::vector<cimg_library::CImg<cimgpix_t> > pyramid(maxLevel + 1);
+        std::vector<cimg_library::CImg<cimgpix_t> > sums(maxLevel + 1);
+        std::vector<OfxRectI> bounds(maxLevel + 1);
+
+        pyramid[0].assign(cimg, /*is_shared=*/true);
+        bounds[0] = cimgBounds;
+        for (int k = 1; k <= maxLevel; ++k) {
+            pyramidReduce(*this, pyramid[k - 1], bounds[k - 1], pyramid[k]);
+            bounds[k] = pyramidReduceBounds(bounds[k - 1]);
+        }
+        for (int k = 0; k <= maxLevel; ++k) {
+            sums[k].assign(pyramid[k].width(), pyramid[k].height(), pyramid[k].depth(), pyramid[k].spectrum(), 0.);
+        }
+        for (int i = 0; i < params.count; ++i) {
+            if ( abort() ) { return; }
+            const double scale = ipow(params.bloomRatio, i);
+            const int k = levels[i];
+            cimg_library::CImg<cimgpix_t> cimg0(pyramid[k]);
+            blurPyramidLevel(params.filter, sx * scale, sy * scale, k, (bool)params.boundary_i, cimg0);
+            sums[k] += cimg0;
+        }
+        cimg_library::CImg<cimgpix_t> expanded;
+        for (int k = maxLevel; k > 0; --k) {
+            if ( abort() ) { return; }
+            pyramidExpand(*this, sums[k], bounds[k], bounds[k - 1], expanded);
+            sums[k - 1] += expanded;
+            sums[k].clear();
+        }
+        cimg_sum.swap(sums[0]);
+    }
+
+    // EdgeExtend computed on an image pyramid: each blurred image is computed on
+    // the coarsest level where it is still well sampled, upscaled, and the
+    // previous result is merged over it.
+    // cimgBounds are the bounds of cimg in absolute pixel coordinates.
+    void edgeExtendPyramid(const CImgBlurParams& params,
+                           double sxBase,
+                           double syBase,
+                           const OfxRectI& cimgBounds,
+                           const OfxRectI& srcRoD,
+                           cimg_library::CImg<cimgpix_t>& cimg)
+    {
+        cimg_library::CImg<cimgpix_t> cimg0, tmp;
+        std::vector<OfxRectI> bounds(1, cimgBounds);
+
+        for (int i = 0; i < params.count; ++i) {
+            if ( abort() ) { return; }
+            const double sx = sxBase * (i + 1);
+            const double sy = syBase * (i + 1);
+            const int level = pyramidLevel(params.filter, sx, sy, srcRoD.x2 - srcRoD.x1, srcRoD.y2 - srcRoD.y1);
+            // reduce the previous result
+            bounds.resize(1);
+            cimg0 = cimg;
+            for (int k = 1; k <= level; ++k) {
+                pyramidReduce(*this, cimg0, bounds[k - 1], tmp);
+                cimg0.swap(tmp);
+                bounds.push_back( pyramidReduceBounds(bounds[k - 1]) );
+            }
+            blurPyramidLevel(params.filter, sx, sy, level, (bool)params.boundary_i, cimg0);
+            if ( abort() ) { return; }
+            for (int k = level; k > 0; --k) {
+                pyramidExpand(*this, cimg0, bounds[k], bounds[k - 1], tmp);
+                cimg0.swap(tmp);
+            }
+            // merge blurred image over the result
+            // cimg (previous result) over cimg0 (blurred) -> cimg
+            mergeOver(cimg, cimg0, cimg);
+        }
+    }
+
     void renderEdgeDetect(const RenderArguments &args,
                           const CImgBlurParams& params,
                           cimg_library::CImg<cimgpix_t>& cimg)
@@ -2316,6 +2102,99 @@ public:
         }
     }
 
+    // EdgeBlur computes everything the EdgeBlur PyPlug did (EdgeDetect, Gamma, Merge and Blur nodes)
+    // on the image passed to render: the edges of the matte are detected, raised to the power
+    // 1/edgeMult, and used to mix the source with its blurred version.
+    void renderEdgeBlur(const RenderArguments &args,
+                        const CImgBlurParams& params,
+                        int x1,
+                        int y1,
+                        cimg_library::CImg<cimgpix_t>& cimg)
+    {
+        // the matte, extended outside of its bounds with the nearest pixel values
+        CImg<cimgpix_t> edge(cimg.width(), cimg.height(), 1, 1, 0.);
+        {
+            Clip *matteClip = params.edgeBlurExternalMatte ? _matteClip : _srcClip;
+            auto_ptr<const Image> matte( ( matteClip && matteClip->isConnected() ) ?
+                                         matteClip->fetchImage(args.time) : 0 );
+            if ( !matte.get() ) {
+                return;
+            }
+            if ( (matte->getRenderScale().x != args.renderScale.x) ||
+                 ( matte->getRenderScale().y != args.renderScale.y) ||
+                 ( ( matte->getField() != eFieldNone) /* for DaVinci Resolve */ && ( matte->getField() != args.fieldToRender) ) ) {
+                setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+                throwSuiteStatusException(kOfxStatFailed);
+            }
+            const PixelComponentEnum matteComponents = matte->getPixelComponents();
+            const OfxRectI& bounds = matte->getBounds();
+            if ( ( (matteComponents != ePixelComponentRGBA) && (matteComponents != ePixelComponentAlpha) ) ||
+                 Coords::rectIsEmpty(bounds) ) {
+                // no alpha channel, no edges
+                return;
+            }
+            assert(matte->getPixelDepth() == eBitDepthFloat);
+            const int alpha = matte->getPixelComponentCount() - 1;
+            cimg_forY(edge, y) {
+                const int my = (std::max)( bounds.y1, (std::min)(y1 + y, bounds.y2 - 1) );
+                cimg_forX(edge, x) {
+                    const int mx = (std::max)( bounds.x1, (std::min)(x1 + x, bounds.x2 - 1) );
+                    const float *matPix = (const float *)matte->getPixelAddress(mx, my);
+                    assert(matPix);
+                    edge(x, y) = matPix[alpha];
+                }
+            }
+        }
+        if ( abort() ) { return; }
+
+        // detect the edges, with the same parameters as the EdgeDetect node of the PyPlug
+        CImgBlurParams edgeParams = params;
+        edgeParams.filter = edgeDetectBlurFilter(params.edgeDetectFilter);
+        edgeParams.boundary_i = 1; // nearest
+        edgeParams.erodeSize = 0.;
+        edgeParams.edgeDetectMultiChannel = eEdgeDetectMultiChannelSeparate;
+        edgeParams.edgeDetectNMS = false;
+        renderEdgeDetect(args, edgeParams, edge);
+        if ( abort() ) { return; }
+
+        // sharpen the borders of the blur area, as the Gamma node of the PyPlug (there is no edge if the result is zero)
+        const double gamma = 1. / (std::max)(1e-8, params.edgeBlurEdgeMult);
+        bool hasEdges = false;
+        cimg_for(edge, ptr, cimgpix_t) {
+            if (*ptr > 0.) {
+                if (gamma != 1.) {
+                    *ptr = (cimgpix_t)std::pow( (double)*ptr, gamma );
+                }
+                hasEdges = true;
+            }
+        }
+        if (!hasEdges) {
+            return;
+        }
+
+        // blur the source, and mix it with the source using the edges as a mask
+        CImg<cimgpix_t> cimg_blur(cimg);
+        bool blurred = blur(params.filter,
+                            args.renderScale.x * params.sizex, 0,
+                            args.renderScale.y * params.sizey, 0,
+                            1., (bool)params.boundary_i,
+                            cimg_blur);
+        if ( !blurred || abort() ) {
+            return;
+        }
+        cimg_pragma_openmp(parallel for collapse(2) if (cimg.width()>=256 && cimg.height()>=16))
+        cimg_forC(cimg, c) {
+            cimg_forY(cimg, y) {
+                cimgpix_t *pix = cimg.data(0, y, 0, c);
+                const cimgpix_t *blurPix = cimg_blur.data(0, y, 0, c);
+                const cimgpix_t *edgePix = edge.data(0, y);
+                cimg_forX(cimg, x) {
+                    pix[x] += edgePix[x] * (blurPix[x] - pix[x]);
+                }
+            }
+        }
+    }
+
     static double parabola(double Ip, double Ic, double In, double alpha)
     {
         /* equation of the parabola:
@@ -2453,6 +2332,7 @@ private:
     DoubleParam *_edgeExtendSize;
     IntParam *_edgeExtendCount;
     BooleanParam *_edgeExtendUnpremult;
+    BooleanParam *_pyramid;
     ChoiceParam *_colorspace;
     ChoiceParam *_boundary;
     ChoiceParam *_filter;
@@ -2461,6 +2341,10 @@ private:
     DoubleParam *_edgeDetectBlur;
     DoubleParam *_edgeDetectErode;
     BooleanParam *_edgeDetectNMS;
+    Clip *_matteClip;
+    BooleanParam *_edgeBlurExternalMatte;
+    DoubleParam *_edgeBlurSize;
+    DoubleParam *_edgeBlurEdgeMult;
     BooleanParam *_expandRoD;
     BooleanParam *_cropToFormat;
     DoubleParam *_alphaThreshold;
@@ -2514,6 +2398,10 @@ CImgBlurPlugin::describe(ImageEffectDescriptor& desc,
         desc.setLabel(kPluginNameEdgeDetect);
         desc.setPluginDescription(kPluginDescriptionEdgeDetect);
         break;
+    case eBlurPluginEdgeBlur:
+        desc.setLabel(kPluginNameEdgeBlur);
+        desc.setPluginDescription(kPluginDescriptionEdgeBlur);
+        break;
     }
     desc.setPluginGrouping(kPluginGrouping);
 
@@ -2573,6 +2461,14 @@ CImgBlurPlugin::describeInContext(ImageEffectDescriptor& desc,
                                                                             processRGB,
                                                                             processAlpha,
                                                                             /*processIsSecret=*/ (blurPlugin == eBlurPluginEdgeExtend));
+    if (blurPlugin == eBlurPluginEdgeBlur) {
+        ClipDescriptor *matteClip = desc.defineClip(kClipEdgeBlurMatte);
+        matteClip->addSupportedComponent(ePixelComponentAlpha);
+        matteClip->setTemporalClipAccess(false);
+        matteClip->setOptional(true);
+        matteClip->setSupportsTiles(kSupportsTiles);
+        matteClip->setIsMask(true);
+    }
     if (blurPlugin == eBlurPluginSharpen ||
         blurPlugin == eBlurPluginSoften) {
         {
@@ -2746,6 +2642,16 @@ CImgBlurPlugin::describeInContext(ImageEffectDescriptor& desc,
             }
         }
     }
+    if (blurPlugin == eBlurPluginBloom ||
+        blurPlugin == eBlurPluginEdgeExtend) {
+        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamPyramid);
+        param->setLabel(kParamPyramidLabel);
+        param->setHint(kParamPyramidHint);
+        param->setDefault(kParamPyramidDefault);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     if (blurPlugin == eBlurPluginChromaBlur) {
         ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamColorspace);
         param->setLabel(kParamColorspaceLabel);
@@ -2792,7 +2698,32 @@ CImgBlurPlugin::describeInContext(ImageEffectDescriptor& desc,
             page->addChild(*param);
         }
     }
-    if (blurPlugin == eBlurPluginEdgeDetect) {
+    if (blurPlugin == eBlurPluginEdgeBlur) {
+        {
+            BooleanParamDescriptor *param = desc.defineBooleanParam(kParamEdgeBlurExternalMatte);
+            param->setLabel(kParamEdgeBlurExternalMatteLabel);
+            param->setHint(kParamEdgeBlurExternalMatteHint);
+            param->setDefault(false);
+            if (page) {
+                page->addChild(*param);
+            }
+        }
+        {
+            DoubleParamDescriptor *param = desc.defineDoubleParam(kParamEdgeBlurSize);
+            param->setLabel(kParamEdgeBlurSizeLabel);
+            param->setHint(kParamEdgeBlurSizeHint);
+            param->setRange(0., DBL_MAX);
+            param->setDisplayRange(0., 100.);
+            param->setDefault(kParamEdgeBlurSizeDefault);
+            param->setDigits(1);
+            param->setIncrement(0.1);
+            if (page) {
+                page->addChild(*param);
+            }
+        }
+    }
+    if (blurPlugin == eBlurPluginEdgeDetect ||
+        blurPlugin == eBlurPluginEdgeBlur) {
         ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamEdgeDetectFilter);
         param->setLabel(kParamEdgeDetectFilterLabel);
         param->setHint(kParamEdgeDetectFilterHint);
@@ -2900,6 +2831,17 @@ CImgBlurPlugin::describeInContext(ImageEffectDescriptor& desc,
             }
         }
     }
+    if (blurPlugin == eBlurPluginEdgeBlur) {
+        DoubleParamDescriptor *param = desc.defineDoubleParam(kParamEdgeBlurEdgeMult);
+        param->setLabel(kParamEdgeBlurEdgeMultLabel);
+        param->setHint(kParamEdgeBlurEdgeMultHint);
+        param->setRange(0., DBL_MAX);
+        param->setDisplayRange(0.1, 10.);
+        param->setDefault(kParamEdgeBlurEdgeMultDefault);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     if (blurPlugin == eBlurPluginBlur ||
         blurPlugin == eBlurPluginBloom ||
         blurPlugin == eBlurPluginErodeBlur ||
@@ -3221,6 +3163,34 @@ CImgEdgeDetectPluginFactory<majorVersion>::createInstance(OfxImageEffectHandle h
     return new CImgBlurPlugin(handle, eBlurPluginEdgeDetect);
 }
 
+//
+// CImgEdgeBlurPluginFactory
+//
+mDeclarePluginFactoryVersioned(CImgEdgeBlurPluginFactory, {ofxsThreadSuiteCheck();}, {});
+
+template<unsigned int majorVersion>
+void
+CImgEdgeBlurPluginFactory<majorVersion>::describe(ImageEffectDescriptor& desc)
+{
+    return CImgBlurPlugin::describe(desc, this->getMajorVersion(), this->getMinorVersion(), eBlurPluginEdgeBlur);
+}
+
+template<unsigned int majorVersion>
+void
+CImgEdgeBlurPluginFactory<majorVersion>::describeInContext(ImageEffectDescriptor& desc,
+                                                           ContextEnum context)
+{
+    return CImgBlurPlugin::describeInContext(desc, context, this->getMajorVersion(), this->getMinorVersion(), eBlurPluginEdgeBlur);
+}
+
+template<unsigned int majorVersion>
+ImageEffect*
+CImgEdgeBlurPluginFactory<majorVersion>::createInstance(OfxImageEffectHandle handle,
+                                                        ContextEnum /*context*/)
+{
+    return new CImgBlurPlugin(handle, eBlurPluginEdgeBlur);
+}
+
 
 // Declare old versions for backward compatibility.
 // They have default for processAlpha set to false
@@ -3242,6 +3212,7 @@ static CImgSharpenPluginFactory<kPluginVersionMajor> p6(kPluginIdentifierSharpen
 static CImgSoftenPluginFactory<kPluginVersionMajor> p7(kPluginIdentifierSoften, kPluginVersionMinor);
 static CImgEdgeExtendPluginFactory<kPluginVersionMajor> p8(kPluginIdentifierEdgeExtend, kPluginVersionMinor);
 static CImgEdgeDetectPluginFactory<kPluginVersionMajor> p9(kPluginIdentifierEdgeDetect, kPluginVersionMinor);
+static CImgEdgeBlurPluginFactory<kPluginVersionMajor> p10(kPluginIdentifierEdgeBlur, kPluginVersionMinor);
 mRegisterPluginFactoryInstance(p1)
 mRegisterPluginFactoryInstance(p2)
 mRegisterPluginFactoryInstance(p3)
@@ -3251,5 +3222,6 @@ mRegisterPluginFactoryInstance(p6)
 mRegisterPluginFactoryInstance(p7)
 mRegisterPluginFactoryInstance(p8)
 mRegisterPluginFactoryInstance(p9)
+mRegisterPluginFactoryInstance(p10)
 
 OFXS_NAMESPACE_ANONYMOUS_EXIT
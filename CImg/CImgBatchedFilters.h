@@ -0,0 +1,647 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+//
+//  CImgBatchedFilters.h
+//
+//  Separable 1D filters (Van Vliet and Deriche recursive Gaussians, box/triangle/quadratic)
+//  applied to several adjacent lines at once.
+//
+//  The CImg versions of these filters process one line at a time. Along the 'y' axis, this means
+//  that each step of the recursion reads a single float per cache line. Here, up to
+//  kBatchedFiltersLanes adjacent columns are filtered together: the filter state of each column
+//  is a "lane" of a small array, and the innermost loops run over the lanes, so that they are
+//  vectorized by the compiler and each step reads a full cache line.
+//  Along the 'x' axis, blocks of rows are transposed into a column-major buffer, filtered the
+//  same way, and transposed back.
+//
+//  The arithmetic of each lane is exactly the same as in CImg.h (version 2.0.0), so that the
+//  results are identical, up to floating-point contraction done by the compiler.
+//  The lane loops are also compiled for AVX2 and AVX-512, and the variant is selected at
+//  runtime (see ofxsCPUFeatures.h).
+//
+
+#ifndef Misc_CImgBatchedFilters_h
+#define Misc_CImgBatchedFilters_h
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "CImgFilter.h"
+#include "ofxsCPUFeatures.h"
+
+#define kBatchedFiltersLanes 16 // 16 floats = one 64-byte cache line
+
+namespace CImgBatchedFilters {
+/// Van Vliet recursive Gaussian filter, with Triggs boundary conditions.
+/// Same as _cimg_recursive_apply() in CImg.h, on B adjacent lines.
+struct VanVlietFilter
+{
+    VanVlietFilter(const double filter_[4],
+                   unsigned int order_,
+                   bool boundary_conditions_)
+        : order(order_)
+        , boundary_conditions(boundary_conditions_)
+    {
+        for (int k = 0; k < 4; ++k) {
+            filter[k] = filter_[k];
+        }
+        const double a1 = filter[1], a2 = filter[2], a3 = filter[3];
+        const double scaleM = 1.0 / ( (1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3) );
+        M[0] = scaleM * (-a3 * a1 + 1.0 - a3 * a3 - a2);
+        M[1] = scaleM * (a3 + a1) * (a2 + a3 * a1);
+        M[2] = scaleM * a3 * (a1 + a3 * a2);
+        M[3] = scaleM * (a1 + a3 * a2);
+        M[4] = -scaleM * (a2 - 1.0) * (a2 + a3 * a1);
+        M[5] = -scaleM * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0);
+        M[6] = scaleM * (a3 * a1 + a2 + a1 * a1 - a2 * a2);
+        M[7] = scaleM * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3);
+        M[8] = scaleM * a3 * (a1 + a3 * a2);
+    }
+
+    // data points to the first sample of the first line, line l is at data + l,
+    // and sample n of each line is at n * off.
+    template <int B>
+    OFXS_FORCEINLINE void apply(cimgpix_t *data,
+               int N,
+               std::size_t off) const
+    {
+        const double sumsq = filter[0], sum = sumsq * sumsq;
+        const double f1 = filter[1], f2 = filter[2], f3 = filter[3];
+        double v1[B], v2[B], v3[B]; // res[n-1,n-2,n-3] or res[n+1,n+2,n+3]
+        double x0[B], x1[B], x2[B]; // [front,center,back]
+
+        if (order == 0) {
+            double iplus[B];
+            for (int l = 0; l < B; ++l) {
+                iplus[l] = boundary_conditions ? data[(N - 1) * off + l] : 0.;
+                v1[l] = v2[l] = v3[l] = boundary_conditions ? data[l] / sumsq : 0.;
+            }
+            // causal pass
+            for (int n = 0; n < N; ++n) {
+                cimgpix_t *p = data + n * off;
+                for (int l = 0; l < B; ++l) {
+                    double v0 = p[l];
+                    v0 += v1[l] * f1;
+                    v0 += v2[l] * f2;
+                    v0 += v3[l] * f3;
+                    p[l] = (cimgpix_t)v0;
+                    v3[l] = v2[l]; v2[l] = v1[l]; v1[l] = v0;
+                }
+            }
+            // apply Triggs boundary conditions
+            {
+                cimgpix_t *p = data + (N - 1) * off;
+                for (int l = 0; l < B; ++l) {
+                    const double
+                        uplus = iplus[l] / (1.0 - f1 - f2 - f3), vplus = uplus / (1.0 - f1 - f2 - f3),
+                        unp  = v1[l] - uplus, unp1 = v2[l] - uplus, unp2 = v3[l] - uplus;
+                    const double t0 = (M[0] * unp + M[1] * unp1 + M[2] * unp2 + vplus) * sum;
+                    const double t1 = (M[3] * unp + M[4] * unp1 + M[5] * unp2 + vplus) * sum;
+                    const double t2 = (M[6] * unp + M[7] * unp1 + M[8] * unp2 + vplus) * sum;
+                    p[l] = (cimgpix_t)t0;
+                    v1[l] = t0; v2[l] = t1; v3[l] = t2;
+                }
+            }
+            // anticausal pass
+            for (int n = N - 2; n >= 0; --n) {
+                cimgpix_t *p = data + n * off;
+                for (int l = 0; l < B; ++l) {
+                    double v0 = p[l];
+                    v0 *= sum;
+                    v0 += v1[l] * f1;
+                    v0 += v2[l] * f2;
+                    v0 += v3[l] * f3;
+                    p[l] = (cimgpix_t)v0;
+                    v3[l] = v2[l]; v2[l] = v1[l]; v1[l] = v0;
+                }
+            }
+
+            return;
+        }
+
+        // derivatives
+        for (int l = 0; l < B; ++l) {
+            x0[l] = x1[l] = x2[l] = boundary_conditions ? data[l] : 0.;
+            v1[l] = v2[l] = v3[l] = 0.;
+        }
+        // causal pass
+        for (int n = 0; n < N - 1; ++n) {
+            cimgpix_t *p = data + n * off;
+            const cimgpix_t *pn = p + off;
+            for (int l = 0; l < B; ++l) {
+                x0[l] = pn[l];
+                double v0;
+                if (order == 1) {
+                    v0 = 0.5f * (x0[l] - x2[l]);
+                } else if (order == 2) {
+                    v0 = (x1[l] - x2[l]);
+                } else {
+                    v0 = (x0[l] - 2 * x1[l] + x2[l]);
+                }
+                v0 += v1[l] * f1;
+                v0 += v2[l] * f2;
+                v0 += v3[l] * f3;
+                p[l] = (cimgpix_t)v0;
+                x2[l] = x1[l]; x1[l] = x0[l];
+                v3[l] = v2[l]; v2[l] = v1[l]; v1[l] = v0;
+            }
+        }
+        // apply Triggs boundary conditions
+        {
+            cimgpix_t *p = data + (N - 1) * off;
+            for (int l = 0; l < B; ++l) {
+                const double
+                    unp  = v1[l], unp1 = v2[l], unp2 = v3[l];
+                const double t0 = (M[0] * unp + M[1] * unp1 + M[2] * unp2) * sum;
+                const double t1 = (M[3] * unp + M[4] * unp1 + M[5] * unp2) * sum;
+                const double t2 = (M[6] * unp + M[7] * unp1 + M[8] * unp2) * sum;
+                p[l] = (cimgpix_t)t0;
+                v1[l] = t0; v2[l] = t1; v3[l] = t2;
+            }
+        }
+        // anticausal pass
+        for (int n = N - 2; n >= 1; --n) {
+            cimgpix_t *p = data + n * off;
+            const cimgpix_t *pp = p - off;
+            for (int l = 0; l < B; ++l) {
+                double v0;
+                if (order == 1) {
+                    v0 = p[l] * sum;
+                } else if (order == 2) {
+                    x0[l] = pp[l];
+                    v0 = (x2[l] - x1[l]) * sum;
+                } else {
+                    x0[l] = pp[l];
+                    v0 = 0.5f * (x2[l] - x0[l]) * sum;
+                }
+                v0 += v1[l] * f1;
+                v0 += v2[l] * f2;
+                v0 += v3[l] * f3;
+                p[l] = (cimgpix_t)v0;
+                if (order != 1) {
+                    x2[l] = x1[l]; x1[l] = x0[l];
+                }
+                v3[l] = v2[l]; v2[l] = v1[l]; v1[l] = v0;
+            }
+        }
+        if (N > 1) {
+            for (int l = 0; l < B; ++l) {
+                data[l] = (cimgpix_t)0;
+            }
+        }
+    } // apply
+
+    double filter[4];
+    double M[9]; // Triggs matrix
+    unsigned int order;
+    bool boundary_conditions;
+};
+
+/// Deriche recursive Gaussian filter.
+/// Same as _cimg_deriche_apply in CImg.h, on B adjacent lines.
+struct DericheFilter
+{
+    template <int B>
+    OFXS_FORCEINLINE void apply(cimgpix_t *data,
+               int N,
+               std::size_t off) const
+    {
+        std::vector<float> Y( (std::size_t)N * B );
+        float xp[B], yp[B], yb[B];
+
+        for (int l = 0; l < B; ++l) {
+            xp[l] = boundary_conditions ? data[l] : 0.f;
+            yb[l] = yp[l] = boundary_conditions ? coefp * xp[l] : 0.f;
+        }
+        for (int m = 0; m < N; ++m) {
+            const cimgpix_t *p = data + m * off;
+            float *py = &Y[(std::size_t)m * B];
+            for (int l = 0; l < B; ++l) {
+                const float xc = p[l];
+                const float yc = py[l] = a0 * xc + a1 * xp[l] - b1 * yp[l] - b2 * yb[l];
+                xp[l] = xc; yb[l] = yp[l]; yp[l] = yc;
+            }
+        }
+        float *xn = xp, *xa = yp, *yn = yb; // reuse the causal state arrays
+        float ya[B];
+        for (int l = 0; l < B; ++l) {
+            xn[l] = xa[l] = boundary_conditions ? data[(N - 1) * off + l] : 0.f;
+            yn[l] = ya[l] = boundary_conditions ? coefn * xn[l] : 0.f;
+        }
+        for (int n = N - 1; n >= 0; --n) {
+            cimgpix_t *p = data + n * off;
+            const float *py = &Y[(std::size_t)n * B];
+            for (int l = 0; l < B; ++l) {
+                const float xc = p[l];
+                const float yc = a2 * xn[l] + a3 * xa[l] - b1 * yn[l] - b2 * ya[l];
+                xa[l] = xn[l]; xn[l] = xc; ya[l] = yn[l]; yn[l] = yc;
+                p[l] = (cimgpix_t)(py[l] + yc);
+            }
+        }
+    }
+
+    float a0, a1, a2, a3, b1, b2, coefp, coefn;
+    bool boundary_conditions;
+};
+
+/// Box filter, iterated nb_iter times, followed by an optional derivative.
+/// Same as _cimg_blur_box_apply() in CImg.h, on B adjacent lines.
+struct BoxFilter
+{
+    template <int B>
+    OFXS_FORCEINLINE void apply(cimgpix_t *ptr,
+               int N,
+               std::size_t off) const
+    {
+        if ( (boxsize > 1) && nb_iter ) {
+            const int w2 = (int)(boxsize - 1) / 2;
+            const int winsize = 2 * w2 + 1;
+            const double frac = (boxsize - winsize) / 2.;
+            std::vector<cimgpix_t> win( (std::size_t)winsize * B );
+            double sum[B];
+            cimgpix_t prev[B], next[B];
+            for (unsigned int iter = 0; iter < nb_iter; ++iter) {
+                for (int l = 0; l < B; ++l) {
+                    sum[l] = 0.;
+                }
+                for (int x = -w2; x <= w2; ++x) {
+                    const cimgpix_t *p = get(ptr, N, off, x);
+                    cimgpix_t *pw = &win[(std::size_t)(x + w2) * B];
+                    for (int l = 0; l < B; ++l) {
+                        pw[l] = p ? p[l] : cimgpix_t();
+                        sum[l] += pw[l];
+                    }
+                }
+                int ifirst = 0, ilast = 2 * w2;
+                {
+                    const cimgpix_t *pp = get(ptr, N, off, -w2 - 1);
+                    const cimgpix_t *pn = get(ptr, N, off, w2 + 1);
+                    for (int l = 0; l < B; ++l) {
+                        prev[l] = pp ? pp[l] : cimgpix_t();
+                        next[l] = pn ? pn[l] : cimgpix_t();
+                    }
+                }
+                for (int x = 0; x < N - 1; ++x) {
+                    cimgpix_t *p = ptr + x * off;
+                    const cimgpix_t *pwf = &win[(std::size_t)ifirst * B];
+                    ifirst = (ifirst + 1) % winsize;
+                    ilast = (ilast + 1) % winsize;
+                    cimgpix_t *pwl = &win[(std::size_t)ilast * B];
+                    const cimgpix_t *pn = get(ptr, N, off, x + w2 + 2);
+                    // pwf and pwl are the same element of the circular buffer: read before writing
+                    for (int l = 0; l < B; ++l) {
+                        const double sum2 = sum[l] + frac * (prev[l] + next[l]);
+                        p[l] = (cimgpix_t)(sum2 / boxsize);
+                        prev[l] = pwf[l];
+                        sum[l] -= prev[l];
+                        pwl[l] = next[l];
+                        sum[l] += next[l];
+                        next[l] = pn ? pn[l] : cimgpix_t();
+                    }
+                }
+                cimgpix_t *p = ptr + (N - 1) * off;
+                for (int l = 0; l < B; ++l) {
+                    const double sum2 = sum[l] + frac * (prev[l] + next[l]);
+                    p[l] = (cimgpix_t)(sum2 / boxsize);
+                }
+            }
+        }
+
+        if ( (order != 1) && (order != 2) ) {
+            return;
+        }
+        float pv[B], cv[B], nv[B];
+        {
+            const cimgpix_t *pp = get(ptr, N, off, -1);
+            const cimgpix_t *pn = get(ptr, N, off, 1);
+            for (int l = 0; l < B; ++l) {
+                pv[l] = pp ? pp[l] : cimgpix_t();
+                cv[l] = ptr[l];
+                nv[l] = pn ? pn[l] : cimgpix_t();
+            }
+        }
+        for (int x = 0; x < N; ++x) {
+            cimgpix_t *p = ptr + x * off;
+            const cimgpix_t *pn = (x < N - 1) ? get(ptr, N, off, x + 2) : NULL;
+            for (int l = 0; l < B; ++l) {
+                p[l] = (order == 1) ? (cimgpix_t)( (nv[l] - pv[l]) / 2.0 ) : (cimgpix_t)(nv[l] - 2 * cv[l] + pv[l]);
+                pv[l] = cv[l]; cv[l] = nv[l];
+                nv[l] = pn ? pn[l] : cimgpix_t();
+            }
+        }
+    } // apply
+
+    // pointer to sample x with the boundary conditions, or NULL if it is zero
+    const cimgpix_t* get(const cimgpix_t *ptr,
+                         int N,
+                         std::size_t off,
+                         int x) const
+    {
+        if (x < 0) {
+            return boundary_conditions ? ptr : NULL;
+        }
+        if (x >= N) {
+            return boundary_conditions ? ptr + (N - 1) * off : NULL;
+        }
+
+        return ptr + x * off;
+    }
+
+    float boxsize;
+    int order;
+    bool boundary_conditions;
+    unsigned int nb_iter;
+};
+
+// filter B adjacent columns (or B lines of a transposed block) with the widest batch available
+template <class Filter>
+OFXS_FORCEINLINE void
+applyColumnsImpl(const Filter& f,
+                 cimgpix_t *data,
+                 int nLines,
+                 int N,
+                 std::size_t off)
+{
+    int l = 0;
+
+    for (; l + 16 <= nLines; l += 16) {
+        f.template apply<16>(data + l, N, off);
+    }
+    if (l + 8 <= nLines) {
+        f.template apply<8>(data + l, N, off);
+        l += 8;
+    }
+    if (l + 4 <= nLines) {
+        f.template apply<4>(data + l, N, off);
+        l += 4;
+    }
+    for (; l < nLines; ++l) {
+        f.template apply<1>(data + l, N, off);
+    }
+}
+
+#ifdef OFXS_CPU_DISPATCH
+// the same, compiled for wider vectors, see ofxsCPUFeatures.h
+template <class Filter>
+OFXS_TARGET_AVX2 void
+applyColumnsAVX2(const Filter& f,
+                 cimgpix_t *data,
+                 int nLines,
+                 int N,
+                 std::size_t off)
+{
+    applyColumnsImpl(f, data, nLines, N, off);
+}
+
+template <class Filter>
+OFXS_TARGET_AVX512 void
+applyColumnsAVX512(const Filter& f,
+                   cimgpix_t *data,
+                   int nLines,
+                   int N,
+                   std::size_t off)
+{
+    applyColumnsImpl(f, data, nLines, N, off);
+}
+
+#endif
+
+template <class Filter>
+void
+applyColumns(const Filter& f,
+             cimgpix_t *data,
+             int nLines,
+             int N,
+             std::size_t off)
+{
+    switch ( OFX::CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case OFX::CPUFeatures::eISAAVX512:
+        applyColumnsAVX512(f, data, nLines, N, off);
+        break;
+    case OFX::CPUFeatures::eISAAVX2:
+        applyColumnsAVX2(f, data, nLines, N, off);
+        break;
+#endif
+    default:
+        applyColumnsImpl(f, data, nLines, N, off);
+        break;
+    }
+}
+
+/// Apply a 1D filter along the given axis of img.
+template <class Filter>
+void
+applyAxis(cimg_library::CImg<cimgpix_t>& img,
+          const Filter& f,
+          char axis)
+{
+    const int width = img.width(), height = img.height(), depth = img.depth(), spectrum = img.spectrum();
+
+    switch (axis) {
+    case 'x': {
+        // blocks of rows are transposed, so that the filter state of each row is a lane
+        const int nBlocks = (height + kBatchedFiltersLanes - 1) / kBatchedFiltersLanes;
+        cimg_pragma_openmp(parallel for collapse(3) if (width >= 256 && height * depth * spectrum >= 16))
+        for (int c = 0; c < spectrum; ++c) {
+            for (int z = 0; z < depth; ++z) {
+                for (int b = 0; b < nBlocks; ++b) {
+                    const int y0 = b * kBatchedFiltersLanes;
+                    const int nRows = (std::min)(kBatchedFiltersLanes, height - y0);
+                    if (nRows < 4) {
+                        for (int y = y0; y < y0 + nRows; ++y) {
+                            f.template apply<1>(img.data(0, y, z, c), width, 1);
+                        }
+                        continue;
+                    }
+                    std::vector<cimgpix_t> block( (std::size_t)width * nRows );
+                    for (int l = 0; l < nRows; ++l) {
+                        const cimgpix_t *p = img.data(0, y0 + l, z, c);
+                        for (int x = 0; x < width; ++x) {
+                            block[(std::size_t)x * nRows + l] = p[x];
+                        }
+                    }
+                    applyColumns(f, &block[0], nRows, width, nRows);
+                    for (int l = 0; l < nRows; ++l) {
+                        cimgpix_t *p = img.data(0, y0 + l, z, c);
+                        for (int x = 0; x < width; ++x) {
+                            p[x] = block[(std::size_t)x * nRows + l];
+                        }
+                    }
+                }
+            }
+        }
+        break;
+    }
+    case 'y': {
+        // adjacent columns are processed together
+        const int nBlocks = (width + kBatchedFiltersLanes - 1) / kBatchedFiltersLanes;
+        cimg_pragma_openmp(parallel for collapse(3) if (width >= 256 && height * depth * spectrum >= 16))
+        for (int c = 0; c < spectrum; ++c) {
+            for (int z = 0; z < depth; ++z) {
+                for (int b = 0; b < nBlocks; ++b) {
+                    const int x0 = b * kBatchedFiltersLanes;
+                    const int nColumns = (std::min)(kBatchedFiltersLanes, width - x0);
+                    applyColumns(f, img.data(x0, 0, z, c), nColumns, height, (std::size_t)width);
+                }
+            }
+        }
+        break;
+    }
+    case 'z': {
+        const std::size_t off = (std::size_t)width * height;
+        cimg_pragma_openmp(parallel for collapse(2) if (width >= 256 && height * depth * spectrum >= 16))
+        for (int c = 0; c < spectrum; ++c) {
+            for (int y = 0; y < height; ++y) {
+                applyColumns(f, img.data(0, y, 0, c), width, depth, off);
+            }
+        }
+        break;
+    }
+    default: {
+        const std::size_t off = (std::size_t)width * height * depth;
+        cimg_pragma_openmp(parallel for collapse(2) if (width >= 256 && height * depth * spectrum >= 16))
+        for (int z = 0; z < depth; ++z) {
+            for (int y = 0; y < height; ++y) {
+                applyColumns(f, img.data(0, y, z, 0), width, spectrum, off);
+            }
+        }
+    }
+    }
+} // applyAxis
+
+/// Van Vliet recursive Gaussian filter, same as CImg<T>::vanvliet().
+inline void
+vanvliet(cimg_library::CImg<cimgpix_t>& img,
+         const float sigma,
+         const unsigned int order,
+         const char axis = 'x',
+         const bool boundary_conditions = true)
+{
+    if ( img.is_empty() ) {
+        return;
+    }
+    const char naxis = cimg_library::cimg::lowercase(axis);
+    const float nsigma = sigma >= 0 ? sigma : -sigma * (naxis == 'x' ? img.width() : naxis == 'y' ? img.height() : naxis == 'z' ? img.depth() : img.spectrum()) / 100;
+    if ( (nsigma < 0.5f) && !order ) {
+        return;
+    }
+    const double
+        nnsigma = nsigma < 0.5f ? 0.5f : nsigma,
+        m0 = 1.16680, m1 = 1.10783, m2 = 1.40586,
+        m1sq = m1 * m1, m2sq = m2 * m2,
+        q = ( nnsigma < 3.556 ? -0.2568 + 0.5784 * nnsigma + 0.0561 * nnsigma * nnsigma : 2.5091 + 0.9804 * (nnsigma - 3.556) ),
+        qsq = q * q,
+        scale = (m0 + q) * (m1sq + m2sq + 2 * m1 * q + qsq),
+        b1 = -q * (2 * m0 * m1 + m1sq + m2sq + (2 * m0 + 4 * m1) * q + 3 * qsq) / scale,
+        b2 = qsq * (m0 + 2 * m1 + 3 * q) / scale,
+        b3 = -qsq * q / scale,
+        B = ( m0 * (m1sq + m2sq) ) / scale;
+    double filter[4];
+    filter[0] = B; filter[1] = -b1; filter[2] = -b2; filter[3] = -b3;
+    applyAxis(img, VanVlietFilter(filter, order, boundary_conditions), naxis);
+}
+
+/// Deriche recursive Gaussian filter, same as CImg<T>::deriche().
+inline void
+deriche(cimg_library::CImg<cimgpix_t>& img,
+        const float sigma,
+        const unsigned int order = 0,
+        const char axis = 'x',
+        const bool boundary_conditions = true)
+{
+    const char naxis = cimg_library::cimg::lowercase(axis);
+    const float nsigma = sigma >= 0 ? sigma : -sigma * (naxis == 'x' ? img.width() : naxis == 'y' ? img.height() : naxis == 'z' ? img.depth() : img.spectrum()) / 100;
+    if ( img.is_empty() || ( (nsigma < 0.1f) && !order ) ) {
+        return;
+    }
+    const float
+        nnsigma = nsigma < 0.1f ? 0.1f : nsigma,
+        alpha = 1.695f / nnsigma,
+        ema = (float)std::exp(-alpha),
+        ema2 = (float)std::exp(-2 * alpha),
+        b1 = -2 * ema,
+        b2 = ema2;
+    DericheFilter f;
+    f.a0 = f.a1 = f.a2 = f.a3 = 0.f;
+    f.b1 = b1;
+    f.b2 = b2;
+    f.boundary_conditions = boundary_conditions;
+    switch (order) {
+    case 0: {
+        const float k = (1 - ema) * (1 - ema) / (1 + 2 * alpha * ema - ema2);
+        f.a0 = k;
+        f.a1 = k * (alpha - 1) * ema;
+        f.a2 = k * (alpha + 1) * ema;
+        f.a3 = -k * ema2;
+        break;
+    }
+    case 1: {
+        const float k = -(1 - ema) * (1 - ema) * (1 - ema) / ( 2 * (ema + 1) * ema );
+        f.a0 = f.a3 = 0;
+        f.a1 = k * ema;
+        f.a2 = -f.a1;
+        break;
+    }
+    case 2: {
+        const float
+            ea = (float)std::exp(-alpha),
+            k = -(ema2 - 1) / (2 * alpha * ema),
+            kn = ( -2 * (-1 + 3 * ea - 3 * ea * ea + ea * ea * ea) / (3 * ea + 1 + 3 * ea * ea + ea * ea * ea) );
+        f.a0 = kn;
+        f.a1 = -kn * (1 + k * alpha) * ema;
+        f.a2 = kn * (1 - k * alpha) * ema;
+        f.a3 = -kn * ema2;
+        break;
+    }
+    default:
+        throw cimg_library::CImgArgumentException("deriche(): Invalid specified filter order %u "
+                                                  "(should be { 0=smoothing | 1=1st-derivative | 2=2nd-derivative }).",
+                                                  order);
+    }
+    f.coefp = (f.a0 + f.a1) / (1 + b1 + b2);
+    f.coefn = (f.a2 + f.a3) / (1 + b1 + b2);
+    applyAxis(img, f, naxis);
+}
+
+/// Box filter of order 0, 1 or 2, same as CImg<T>::boxfilter().
+inline void
+boxfilter(cimg_library::CImg<cimgpix_t>& img,
+          const float boxsize,
+          const int order,
+          const char axis = 'x',
+          const bool boundary_conditions = true,
+          const unsigned int nb_iter = 1)
+{
+    if ( img.is_empty() || !boxsize || ( (boxsize <= 1) && !order ) ) {
+        return;
+    }
+    const char naxis = cimg_library::cimg::lowercase(axis);
+    BoxFilter f;
+    f.boxsize = boxsize >= 0 ? boxsize : -boxsize * (naxis == 'x' ? img.width() : naxis == 'y' ? img.height() : naxis == 'z' ? img.depth() : img.spectrum()) / 100;
+    f.order = order;
+    f.boundary_conditions = boundary_conditions;
+    f.nb_iter = nb_iter;
+    applyAxis(img, f, naxis);
+}
+} // namespace CImgBatchedFilters
+
+#endif // ifndef Misc_CImgBatchedFilters_h
@@ -40,6 +40,7 @@
 #include "ofxNatron.h"
 #endif
 #include "ofxsThreadSuite.h"
+#include "ofxsRandom.h"
 
 #ifdef thread_local
 # define HAVE_THREAD_LOCAL
@@ -394,6 +395,12 @@ public:
     // 0: Black/Dirichlet, 1: Nearest/Neumann, 2: Repeat/Periodic
     virtual int getBoundary(const Params& /*params*/) { return 0; }
 
+    // set the RoI of the clips defined by the plugin itself, given the RoI of the source clip (in canonical coordinates).
+    // the default RoI is used if they are not set.
+    virtual void getOtherRegionsOfInterest(const OfxRectD& /*srcRoI*/,
+                                           const Params& /*params*/,
+                                           OFX::RegionOfInterestSetter & /*rois*/) {}
+
     //static void describe(OFX::ImageEffectDescriptor &desc, bool supportsTiles);
 
     static OFX::PageParamDescriptor* describeInContextBegin(OFX::ImageEffectDescriptor &desc,
@@ -1078,6 +1085,7 @@ CImgFilterPluginHelper<Params, sourceIsOptional>::getRegionsOfInterest(const OFX
 
     // no need to set it on mask (the default ROI is OK)
     rois.setRegionOfInterest(*_srcClip, srcRoI);
+    getOtherRegionsOfInterest(srcRoI, params, rois);
 }
 
 template <class Params, bool sourceIsOptional>
@@ -1176,30 +1184,25 @@ CImgFilterPluginHelper<Params, sourceIsOptional>::isIdentity(const OFX::IsIdenti
     return false;
 } // >::isIdentity
 
-// functions for a reproductible random number generator (used in CImgNoise.cpp and CImgPlasma.cpp)
+// functions for a reproductible random number generator (used in CImgNoise.cpp and CImgPlasma.cpp),
+// see ofxsRandom.h
 inline unsigned int
 cimg_hash(unsigned int a)
 {
-    a = (a ^ 61) ^ (a >> 16);
-    a = a + (a << 3);
-    a = a ^ (a >> 4);
-    a = a * 0x27d4eb2d;
-    a = a ^ (a >> 15);
-
-    return a;
+    return OFX::Random::hash(a);
 }
 
 // returns a value from 0 to 0x100000000ULL excluded
 inline unsigned int
 cimg_irand(unsigned int seed, int x, int y, int nComponents)
 {
-    return cimg_hash(cimg_hash(cimg_hash(seed ^ x) ^ y) ^ nComponents);
+    return OFX::Random::irand(seed, x, y, nComponents);
 }
 
 inline double
 cimg_rand(unsigned int seed, int x, int y, int nComponents, const double val_min, const double val_max)
 {
-    const double val = cimg_irand(seed, x, y, nComponents) / ( (double)0x100000000ULL );
+    const double val = OFX::Random::toUnit( cimg_irand(seed, x, y, nComponents) );
     return val_min + (val_max - val_min)*val;
 }
 
@@ -1218,18 +1221,7 @@ cimg_rand(unsigned int seed, int x, int y, int nComponents, const double val_max
 inline double
 cimg_grand(unsigned int seed, int x, int y, int nComponents)
 {
-    double x1, w;
-    unsigned int s = seed;
-    do {
-        unsigned int r1 = cimg_irand(s, x, y, nComponents);
-        unsigned int r2 = cimg_irand(r1, x, y, nComponents);
-        s = r2;
-
-        const double x2 =  2 * (double) r2 / ( (double)0x100000000ULL ) - 1.;
-        x1 =  2 * (double) r1 / ( (double)0x100000000ULL ) - 1.;
-        w = x1*x1 + x2*x2;
-    } while (w<=0 || w>=1.0);
-    return x1*std::sqrt((-2*std::log(w))/w);
+    return OFX::Random::gaussian(seed, x, y, nComponents);
 }
 
 //! Return a random variable following a Poisson distribution of parameter z.
@@ -1238,18 +1230,9 @@ cimg_grand(unsigned int seed, int x, int y, int nComponents)
 inline unsigned int
 cimg_prand(unsigned int seed, int x, int y, int nComponents, const double z)
 {
-    if (z<=1.0e-10) {
-        return 0;
-    }
-    if (z>100) {
-        return (unsigned int)((std::sqrt(z) * cimg_grand(seed, x, y, nComponents)) + z);
-    }
-    unsigned int k = 0;
-    const double y1 = std::exp(-z);
-    for (double s = 1.0; s >= y1; ++k) {
-        s *= cimg_rand(seed+1, x, y, nComponents);
-    }
-    return k > 0 ? k - 1 : 0;
+    const double u = (z > 1.0e-10 && z <= 100) ? cimg_rand(seed+1, x, y, nComponents) : 0.;
+    const double g = (z > 100) ? cimg_grand(seed, x, y, nComponents) : 0.;
+    return OFX::Random::poisson(z, u, g);
 }
 
 #endif // ifndef Misc_CImgFilter_h
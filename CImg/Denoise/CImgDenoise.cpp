@@ -24,6 +24,7 @@
 #include <cmath>
 #include <cstring>
 #include <algorithm>
+#include <vector>
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 #include <windows.h>
 #endif
@@ -48,7 +49,10 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "Non-Local Image Smoothing by Applying Anisotropic Diffusion PDE's in the Space of Patches " \
     "(D. Tschumperlé, L. Brun), ICIP'09 " \
     "(https://tschumperle.users.greyc.fr/publications/tschumperle_icip09.pdf).\n" \
-    "Uses the 'blur_patch' function from the CImg library.\n" \
+    "Patch distances are computed for each offset of the lookup window using box-filtered squared differences " \
+    "(J. Darbon et al., \"Fast nonlocal filtering applied to electron cryomicroscopy\", ISBI 2008), " \
+    "so that the computation time does not depend on the patch size. " \
+    "The result is the same as the 'blur_patch' function from the CImg library.\n" \
     "CImg is a free, open-source library distributed under the CeCILL-C " \
     "(close to the GNU LGPL) or CeCILL (compatible with the GNU GPL) licenses. " \
     "It can be used in commercial applications (see http://cimg.eu)."
@@ -57,8 +61,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // History:
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
+// version 2.1: compute patch distances using integral images, multithreaded
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsComponentRemapping 1
 #define kSupportsTiles 1
@@ -109,6 +114,250 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 
 using namespace cimg_library;
 
+/// Non-local means using integral images of squared differences (J. Darbon et al.,
+/// "Fast nonlocal filtering applied to electron cryomicroscopy", ISBI 2008).
+/// For each offset of the lookup window, the squared difference between the image and its
+/// shifted version is box-filtered with the patch size, so that all patch distances for that
+/// offset are obtained at a cost that does not depend on the patch size.
+/// Boundary conditions and weights are the same as CImg's blur_patch (2D case).
+/// The image is split into horizontal bands, one per thread, and each thread loops over all offsets.
+class CImgDenoiseIntegralProcessor
+    : public MultiThread::Processor
+{
+public:
+    CImgDenoiseIntegralProcessor(ImageEffect &instance,
+                                 const CImg<cimgpix_t>& img, // guide image, used for patch distances
+                                 const CImg<cimgpix_t>& src, // image to be averaged
+                                 CImg<cimgpix_t>& res,
+                                 float sigma_s,
+                                 float sigma_p,
+                                 int patch_size,
+                                 int lookup_size,
+                                 bool is_fast_approx)
+        : _effect(instance)
+        , _img(img)
+        , _src(src)
+        , _res(res)
+        , _patch_size(patch_size)
+        , _psize1(patch_size - patch_size / 2 - 1)
+        , _rsize2(lookup_size / 2)
+        , _rsize1(lookup_size - lookup_size / 2 - 1)
+        , _sigma_s2(sigma_s * sigma_s)
+        , _sigma_p3(3 * sigma_p)
+        , _Pnorm( (float)patch_size * patch_size * img.spectrum() * sigma_p * sigma_p )
+        , _is_fast_approx(is_fast_approx)
+    {
+    }
+
+    /** @brief called to process everything */
+    void process(void)
+    {
+        // make sure each band has at least 4 times as many lines as the patch size,
+        // since each band also computes differences on patch_size-1 extra lines
+        unsigned int nCPUs = (unsigned int)( _res.height() / (std::max)(4 * _patch_size, 16) );
+        nCPUs = (std::max)( 1u, (std::min)( nCPUs, MultiThread::getNumCPUs() ) );
+        if (nCPUs == 1) {
+            multiThreadFunction(0, 1);
+        } else {
+            multiThread(nCPUs);
+        }
+    }
+
+private:
+    /** @brief function that will be called in each thread. ID is from 0..nThreads-1 nThreads are the number of threads it is being run over */
+    virtual void multiThreadFunction(unsigned int threadID,
+                                     unsigned int nThreads) OVERRIDE FINAL
+    {
+        int row_begin = 0;
+        int row_end = 0;
+
+        MultiThread::getThreadRange(threadID, nThreads, 0, _res.height(), &row_begin, &row_end);
+        if (row_end <= row_begin) {
+            return;
+        }
+        processBand(row_begin, row_end);
+    }
+
+    void processBand(int row_begin,
+                     int row_end)
+    {
+        const int width = _img.width();
+        const int height = _img.height();
+        const int spectrum = _img.spectrum();
+        const size_t wh = (size_t)width * height;
+        const int bandHeight = row_end - row_begin;
+        // squared differences are computed on the band, extended by the patch size
+        const int ew = width + _patch_size - 1;
+        const int eh = bandHeight + _patch_size - 1;
+        std::vector<float> diff2( (size_t)ew * eh );
+        std::vector<float> hsum( (size_t)width * eh ); // horizontal box sums of diff2
+        std::vector<double> vsum(width); // vertical box sums of hsum (i.e. patch distances) for the current line
+        std::vector<float> sum_weights( (size_t)width * bandHeight, 0.f );
+        std::vector<float> weight_max( (size_t)width * bandHeight, 0.f );
+        std::vector<int> xc(ew), xo(ew); // clamped abscissae (Neumann boundary conditions)
+
+        for (int dy = -_rsize1; dy <= _rsize2; ++dy) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            for (int dx = -_rsize1; dx <= _rsize2; ++dx) {
+                if ( !_is_fast_approx && (dx == 0) && (dy == 0) ) {
+                    continue; // the central pixel gets the maximum weight, see below
+                }
+                // the lookup window is clipped to the image, skip offsets that never fall inside
+                if ( (dx <= -width) || (dx >= width) || (row_begin + dy >= height) || (row_end - 1 + dy < 0) ) {
+                    continue;
+                }
+                const float dist_s = (float)(dx * dx + dy * dy) / _sigma_s2;
+                if ( _is_fast_approx && (dist_s > 3) ) {
+                    continue; // all weights are zero
+                }
+
+                // squared differences between the image and its shifted version, summed over channels
+                for (int i = 0; i < ew; ++i) {
+                    const int x = i - _psize1;
+                    xc[i] = clamp(x, width);
+                    xo[i] = clamp(x + dx, width);
+                }
+                for (int j = 0; j < eh; ++j) {
+                    const int y = row_begin - _psize1 + j;
+                    const int yc = clamp(y, height);
+                    const int yo = clamp(y + dy, height);
+                    float *pd = &diff2[(size_t)j * ew];
+                    for (int c = 0; c < spectrum; ++c) {
+                        const cimgpix_t *pc = _img.data(0, yc, 0, c);
+                        const cimgpix_t *po = _img.data(0, yo, 0, c);
+                        if (c == 0) {
+                            for (int i = 0; i < ew; ++i) {
+                                const float d = pc[xc[i]] - po[xo[i]];
+                                pd[i] = d * d;
+                            }
+                        } else {
+                            for (int i = 0; i < ew; ++i) {
+                                const float d = pc[xc[i]] - po[xo[i]];
+                                pd[i] += d * d;
+                            }
+                        }
+                    }
+                    // horizontal box filter
+                    float *ph = &hsum[(size_t)j * width];
+                    double s = 0.;
+                    for (int i = 0; i < _patch_size - 1; ++i) {
+                        s += pd[i];
+                    }
+                    for (int x = 0; x < width; ++x) {
+                        s += pd[x + _patch_size - 1];
+                        ph[x] = (float)s;
+                        s -= pd[x];
+                    }
+                }
+
+                // vertical box filter, and accumulation
+                std::fill(vsum.begin(), vsum.end(), 0.);
+                for (int j = 0; j < _patch_size - 1; ++j) {
+                    const float *ph = &hsum[(size_t)j * width];
+                    for (int x = 0; x < width; ++x) {
+                        vsum[x] += ph[x];
+                    }
+                }
+                const int x_begin = (std::max)(0, -dx);
+                const int x_end = (std::min)(width, width - dx);
+                for (int y = row_begin; y < row_end; ++y) {
+                    const int t = y - row_begin;
+                    const float *phin = &hsum[(size_t)(t + _patch_size - 1) * width];
+                    const float *phout = &hsum[(size_t)t * width];
+                    for (int x = 0; x < width; ++x) {
+                        vsum[x] += phin[x];
+                    }
+                    const int q = y + dy;
+                    if ( (q >= 0) && (q < height) ) {
+                        float *psw = &sum_weights[(size_t)t * width];
+                        float *pwm = &weight_max[(size_t)t * width];
+                        const cimgpix_t *pimg = _img.data(0, y, 0, 0);
+                        const cimgpix_t *pimgo = _img.data(0, q, 0, 0);
+                        const cimgpix_t *psrc = _src.data(0, q, 0, 0);
+                        cimgpix_t *pres = _res.data(0, y, 0, 0);
+                        for (int x = x_begin; x < x_end; ++x) {
+                            const int p = x + dx;
+                            float weight;
+                            if (_is_fast_approx) {
+                                if ( !(std::abs(pimg[x] - pimgo[p]) < _sigma_p3) ) {
+                                    continue;
+                                }
+                                const float alldist = (float)vsum[x] / _Pnorm + dist_s;
+                                if (alldist > 3) {
+                                    continue;
+                                }
+                                weight = 1.f;
+                            } else {
+                                const float alldist = (float)vsum[x] / _Pnorm + dist_s;
+                                weight = (float)std::exp(-alldist);
+                                if (weight > pwm[x]) {
+                                    pwm[x] = weight;
+                                }
+                            }
+                            psw[x] += weight;
+                            for (int c = 0; c < spectrum; ++c) {
+                                pres[x + c * wh] += weight * psrc[p + c * wh];
+                            }
+                        }
+                    }
+                    for (int x = 0; x < width; ++x) {
+                        vsum[x] -= phout[x];
+                    }
+                }
+            }
+        }
+
+        // normalize
+        for (int y = row_begin; y < row_end; ++y) {
+            const int t = y - row_begin;
+            const float *psw = &sum_weights[(size_t)t * width];
+            const float *pwm = &weight_max[(size_t)t * width];
+            const cimgpix_t *psrc = _src.data(0, y, 0, 0);
+            cimgpix_t *pres = _res.data(0, y, 0, 0);
+            for (int x = 0; x < width; ++x) {
+                float sw = psw[x];
+                if (!_is_fast_approx) {
+                    sw += pwm[x];
+                    for (int c = 0; c < spectrum; ++c) {
+                        pres[x + c * wh] += pwm[x] * psrc[x + c * wh];
+                    }
+                }
+                if (sw > 0) {
+                    for (int c = 0; c < spectrum; ++c) {
+                        pres[x + c * wh] /= sw;
+                    }
+                } else {
+                    for (int c = 0; c < spectrum; ++c) {
+                        pres[x + c * wh] = psrc[x + c * wh];
+                    }
+                }
+            }
+        }
+    } // processBand
+
+    static int clamp(int x,
+                     int n)
+    {
+        return x < 0 ? 0 : (x >= n ? n - 1 : x);
+    }
+
+private:
+    ImageEffect &_effect;
+    const CImg<cimgpix_t>& _img;
+    const CImg<cimgpix_t>& _src;
+    CImg<cimgpix_t>& _res;
+    const int _patch_size;
+    const int _psize1;
+    const int _rsize2;
+    const int _rsize1;
+    const float _sigma_s2;
+    const float _sigma_p3;
+    const float _Pnorm;
+    const bool _is_fast_approx;
+};
+
 /// Denoise plugin
 struct CImgDenoiseParams
 {
@@ -173,161 +422,24 @@ public:
     {
         // PROCESSING.
         // This is the only place where the actual processing takes place
-#ifdef CIMG_ABORTABLE
-        // code copied from CImg.h's get_blur_patch, with calls to abort() added here and there
-
-        // args
         const float sigma_s = (float)(params.sigma_s * args.renderScale.x);
         const float sigma_p = (float)params.sigma_r;
-        const unsigned int patch_size = (unsigned int)std::ceil((std::max)(0, params.psize) * args.renderScale.x);
-        const unsigned int lookup_size = (unsigned int)std::ceil((std::max)(0, params.lsize) * args.renderScale.x);
+        const int patch_size = (int)std::ceil((std::max)(0, params.psize) * args.renderScale.x);
+        const int lookup_size = (int)std::ceil((std::max)(0, params.lsize) * args.renderScale.x);
         const float smoothness = (float)(params.smoothness * args.renderScale.x);
-        const bool is_fast_approx = params.fast_approx;
 
-#define Tfloat float
-#define T float
-#undef _cimg_blur_patch2d_fast
-#undef _cimg_blur_patch2d
-
-#undef cimg_abort_test
-#ifdef cimg_use_openmp
-#define cimg_abort_test if (!omp_get_thread_num() && abort()) throw CImgAbortException("")
-#else
-#define cimg_abort_test if (abort()) throw CImgAbortException("")
-#endif
-
-        // the macros are taken from CImg.h, with (*this) replaced by (cimg)
-#define _cimg_blur_patch2d_fast(N) \
-        cimg_for##N##Y(res,y) { cimg_abort_test; \
-        cimg_for##N##X(res,x) { \
-          T *pP = P._data; cimg_forC(res,c) { cimg_get##N##x##N(img,x,y,0,c,pP,T); pP+=N2; } \
-          const int x0 = x - rsize1, y0 = y - rsize1, x1 = x + rsize2, y1 = y + rsize2; \
-          float sum_weights = 0; \
-          cimg_for_in##N##XY(res,x0,y0,x1,y1,p,q) if (cimg::abs(img(x,y,0,0) - img(p,q,0,0))<sigma_p3) { \
-            T *pQ = Q._data; cimg_forC(res,c) { cimg_get##N##x##N(img,p,q,0,c,pQ,T); pQ+=N2; } \
-            float distance2 = 0; \
-            pQ = Q._data; cimg_for(P,pP,T) { const float dI = (float)*pP - (float)*(pQ++); distance2+=dI*dI; } \
-            distance2/=Pnorm; \
-            const float dx = (float)p - x, dy = (float)q - y, \
-              alldist = distance2 + (dx*dx+dy*dy)/sigma_s2, weight = alldist>3?0.0f:1.0f; \
-            sum_weights+=weight; \
-            cimg_forC(res,c) res(x,y,c)+=weight*(cimg)(p,q,c); \
-          } \
-          if (sum_weights>0) cimg_forC(res,c) res(x,y,c)/=sum_weights; \
-          else cimg_forC(res,c) res(x,y,c) = (Tfloat)((cimg)(x,y,c)); \
-        } }
-
-#define _cimg_blur_patch2d(N) \
-        cimg_for##N##Y(res,y) { cimg_abort_test; \
-        cimg_for##N##X(res,x) { \
-          T *pP = P._data; cimg_forC(res,c) { cimg_get##N##x##N(img,x,y,0,c,pP,T); pP+=N2; } \
-          const int x0 = x - rsize1, y0 = y - rsize1, x1 = x + rsize2, y1 = y + rsize2; \
-          float sum_weights = 0, weight_max = 0; \
-          cimg_for_in##N##XY(res,x0,y0,x1,y1,p,q) if (p!=x || q!=y) { \
-            T *pQ = Q._data; cimg_forC(res,c) { cimg_get##N##x##N(img,p,q,0,c,pQ,T); pQ+=N2; } \
-            float distance2 = 0; \
-            pQ = Q._data; cimg_for(P,pP,T) { const float dI = (float)*pP - (float)*(pQ++); distance2+=dI*dI; } \
-            distance2/=Pnorm; \
-            const float dx = (float)p - x, dy = (float)q - y, \
-              alldist = distance2 + (dx*dx+dy*dy)/sigma_s2, weight = (float)std::exp(-alldist); \
-            if (weight>weight_max) weight_max = weight; \
-            sum_weights+=weight; \
-            cimg_forC(res,c) res(x,y,c)+=weight*(cimg)(p,q,c); \
-          } \
-          sum_weights+=weight_max; cimg_forC(res,c) res(x,y,c)+=weight_max*(cimg)(x,y,c); \
-          if (sum_weights>0) cimg_forC(res,c) res(x,y,c)/=sum_weights; \
-          else cimg_forC(res,c) res(x,y,c) = (Tfloat)((cimg)(x,y,c)); \
-    } }
-
-        if (cimg.is_empty() || !patch_size || !lookup_size) return;
-        CImg<Tfloat> res(cimg._width,cimg._height,cimg._depth,cimg._spectrum,0);
-        const CImg<T> _img = smoothness>0?cimg.get_blur(smoothness):CImg<Tfloat>(),&img = smoothness>0?_img:cimg;
-        CImg<T> P(patch_size*patch_size*cimg._spectrum), Q(P);
-        const float
-        nsigma_s = sigma_s>=0?sigma_s:-sigma_s*cimg::max(cimg._width,cimg._height,cimg._depth)/100,
-        sigma_s2 = nsigma_s*nsigma_s, sigma_p2 = sigma_p*sigma_p, sigma_p3 = 3*sigma_p,
-        Pnorm = P.size()*sigma_p2;
-        const int rsize2 = (int)lookup_size/2, rsize1 = (int)lookup_size - rsize2 - 1;
-        const unsigned int N2 = patch_size*patch_size, N3 = N2*patch_size;
-        cimg::unused(N2,N3);
-        switch (patch_size) { // 2d
-            case 2 : if (is_fast_approx) _cimg_blur_patch2d_fast(2) else _cimg_blur_patch2d(2) break;
-            case 3 : if (is_fast_approx) _cimg_blur_patch2d_fast(3) else _cimg_blur_patch2d(3) break;
-            case 4 : if (is_fast_approx) _cimg_blur_patch2d_fast(4) else _cimg_blur_patch2d(4) break;
-            case 5 : if (is_fast_approx) _cimg_blur_patch2d_fast(5) else _cimg_blur_patch2d(5) break;
-                // use OpenMP when patch_size > 5
-            //case 6 : if (is_fast_approx) _cimg_blur_patch2d_fast(6) else _cimg_blur_patch2d(6) break;
-            //case 7 : if (is_fast_approx) _cimg_blur_patch2d_fast(7) else _cimg_blur_patch2d(7) break;
-            //case 8 : if (is_fast_approx) _cimg_blur_patch2d_fast(8) else _cimg_blur_patch2d(8) break;
-            //case 9 : if (is_fast_approx) _cimg_blur_patch2d_fast(9) else _cimg_blur_patch2d(9) break;
-            default : { // Fast
-                const int psize2 = (int)patch_size/2, psize1 = (int)patch_size - psize2 - 1;
-                _cimg_abort_init_omp;
-                cimg_abort_init;
-                if (is_fast_approx) {
-                    cimg_pragma_openmp(parallel for cimg_openmp_if(res._width>=32 && res._height>=4) firstprivate(P,Q))
-                    cimg_forY(res,y) {
-                        _cimg_abort_try_omp {
-                            cimg_abort_test;
-                            cimg_forX(res,x) { // 2d fast approximation.
-                                P = img.get_crop(x - psize1,y - psize1,x + psize2,y + psize2,true);
-                                const int x0 = x - rsize1, y0 = y - rsize1, x1 = x + rsize2, y1 = y + rsize2;
-                                float sum_weights = 0;
-                                cimg_for_inXY(res,x0,y0,x1,y1,p,q) if (cimg::abs(img(x,y,0)-img(p,q,0))<sigma_p3) {
-                                    (Q = img.get_crop(p - psize1,q - psize1,p + psize2,q + psize2,true))-=P;
-                                    const float
-                                        dx = (float)x - p, dy = (float)y - q,
-                                        distance2 = (float)(Q.pow(2).sum()/Pnorm + (dx*dx + dy*dy)/sigma_s2),
-                                        weight = distance2>3?0.0f:1.0f;
-                                    sum_weights+=weight;
-                                    cimg_forC(res,c) res(x,y,c)+=weight*cimg(p,q,c);
-                                }
-                                if (sum_weights>0) cimg_forC(res,c) res(x,y,c)/=sum_weights;
-                                else cimg_forC(res,c) res(x,y,c) = (Tfloat)(cimg(x,y,c));
-                            }
-                        } _cimg_abort_catch_omp
-                    }
-                } else {
-                    cimg_pragma_openmp(parallel for cimg_openmp_if(res._width>=32 && res._height>=4) firstprivate(P,Q))
-                    cimg_forY(res,y) {
-                        _cimg_abort_try_omp {
-                            cimg_abort_test;
-                            cimg_forX(res,x) { // 2d exact algorithm.
-                                P = img.get_crop(x - psize1,y - psize1,x + psize2,y + psize2,true);
-                                const int x0 = x - rsize1, y0 = y - rsize1, x1 = x + rsize2, y1 = y + rsize2;
-                                float sum_weights = 0, weight_max = 0;
-                                cimg_for_inXY(res,x0,y0,x1,y1,p,q) if (p!=x || q!=y) {
-                                    (Q = img.get_crop(p - psize1,q - psize1,p + psize2,q + psize2,true))-=P;
-                                    const float
-                                            dx = (float)x - p, dy = (float)y - q,
-                                            distance2 = (float)(Q.pow(2).sum()/Pnorm + (dx*dx + dy*dy)/sigma_s2),
-                                            weight = (float)std::exp(-distance2);
-                                    if (weight>weight_max) weight_max = weight;
-                                    sum_weights+=weight;
-                                    cimg_forC(res,c) res(x,y,c)+=weight*cimg(p,q,c);
-                                }
-                                sum_weights+=weight_max; cimg_forC(res,c) res(x,y,c)+=weight_max*cimg(x,y,c);
-                                if (sum_weights>0) cimg_forC(res,c) res(x,y,c)/=sum_weights;
-                                else cimg_forC(res,c) res(x,y,0,c) = (Tfloat)(cimg(x,y,c));
-                            }
-                        } _cimg_abort_catch_omp
-                    }
-                }
-                cimg_abort_test;
-            }
+        if ( cimg.is_empty() || (patch_size <= 0) || (lookup_size <= 0) ) {
+            return;
+        }
+        CImg<cimgpix_t> res(cimg.width(), cimg.height(), cimg.depth(), cimg.spectrum(), 0);
+        const CImg<cimgpix_t> _img = smoothness > 0 ? cimg.get_blur(smoothness) : CImg<cimgpix_t>();
+        const CImg<cimgpix_t>& img = smoothness > 0 ? _img : cimg;
+        CImgDenoiseIntegralProcessor processor(*this, img, cimg, res, sigma_s, sigma_p, patch_size, lookup_size, params.fast_approx);
+        processor.process();
+        if ( abort() ) {
+            return;
         }
-        cimg.assign(res);
-#undef Tfloat
-#undef T
-
-#else // ifdef CIMG_ABORTABLE
-        cimg.blur_patch( (float)(params.sigma_s * args.renderScale.x),
-                         (float)params.sigma_r,
-                         (unsigned int)std::ceil((std::max)(0, params.psize) * args.renderScale.x),
-                         (unsigned int)std::ceil((std::max)(0, params.lsize) * args.renderScale.x),
-                         (float)(params.smoothness * args.renderScale.x),
-                         params.fast_approx );
-#endif // ifdef CIMG_ABORTABLE
+        cimg.swap(res);
     }
 
     virtual bool isIdentity(const IsIdentityArguments & /*args*/,
@@ -23,6 +23,8 @@
 #include <memory>
 #include <cmath>
 #include <cstring>
+#include <list>
+#include <string>
 #include <stdio.h> // for snprintf & _snprintf
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 #  include <windows.h>
@@ -36,6 +38,21 @@
 #include "ofxsMacros.h"
 #include "ofxsCoords.h"
 #include "ofxsCopier.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
 
 #include "CImgFilter.h"
 
@@ -206,10 +223,10 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsComponentRemapping 0 // components may be used in the expression, even if not processed
-#define kSupportsTiles 0 // Expression effect can only be computed on the whole image
+#define kSupportsTiles 1 // tiles are only enabled at the instance level if the expression is pointwise (see CImgExpressionPlugin::updateSupportsTiles())
 #define kSupportsMultiResolution 0
 #define kSupportsRenderScale 1
 #define kSupportsMultipleClipPARs false
@@ -234,6 +251,351 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamHelpLabel "Help..."
 #define kParamHelpHint "Display help for writing GMIC expressions."
 
+#define kExpressionCacheSize 8 // max number of compiled expressions kept by each instance
+
+typedef cimg_library::CImg<cimgpix_t> CImgExpressionImage;
+typedef CImgExpressionImage::_cimg_math_parser CImgExpressionParser;
+
+/// Result of the static analysis of an expression.
+struct CImgExpressionInfo
+{
+    char mode;          //!< leading evaluation mode character ('<', '>', '*', ':'), or 0
+    std::string body;   //!< expression without the mode character
+    bool usesTime;      //!< references the predefined variable 'T'
+    bool usesScale;     //!< references the predefined variable 'K'
+    bool isPointwise;   //!< each pixel only depends on the input pixel at the same location
+    bool isCacheable;   //!< the compiled expression has no state, and can be reused across renders
+};
+
+static bool
+isIdentStart(char c)
+{
+    return ( (c >= 'a') && (c <= 'z') ) || ( (c >= 'A') && (c <= 'Z') ) || (c == '_');
+}
+
+static bool
+isIdentChar(char c)
+{
+    return isIdentStart(c) || ( (c >= '0') && (c <= '9') );
+}
+
+// Conservative analysis of a G'MIC/CImg expression: an identifier that may be
+// a neighbor access, an image-wide statistic, or a coordinate (which depends on
+// the tile origin) makes the expression non-pointwise.
+static void
+analyzeExpression(const std::string& expr,
+                  CImgExpressionInfo* info)
+{
+    size_t start = 0;
+    while ( start < expr.size() && ( (unsigned char)expr[start] <= ' ' ) ) {
+        ++start;
+    }
+    info->mode = 0;
+    if ( start < expr.size() ) {
+        const char c = expr[start];
+        if ( (c == '<') || (c == '>') || (c == '*') || (c == ':') ) {
+            info->mode = c;
+            ++start;
+        }
+    }
+    info->body = expr.substr(start);
+    info->usesTime = false;
+    info->usesScale = false;
+    // '<' and '>' give access to the image being modified
+    info->isPointwise = (info->mode != '<') && (info->mode != '>');
+    info->isCacheable = info->isPointwise;
+    {
+        // value sequences ("1,2,3") are handled by CImg::fill()
+        double value;
+        char sep;
+        const int err = sscanf(info->body.c_str(), "%lf %c", &value, &sep);
+        if ( (err == 1) || ( (err == 2) && (sep == ',') ) ) {
+            info->isCacheable = false;
+        }
+    }
+
+    const std::string& s = info->body;
+    const size_t n = s.size();
+    size_t i = 0;
+    while (i < n) {
+        const char c = s[i];
+        if (c == '\'') {
+            // skip string literal
+            ++i;
+            while ( i < n && s[i] != '\'' ) {
+                if ( (s[i] == '\\') && (i + 1 < n) ) {
+                    ++i;
+                }
+                ++i;
+            }
+            ++i;
+            continue;
+        }
+        if (c == '#') {
+            // image index or macro argument separator
+            info->isPointwise = false;
+            ++i;
+            continue;
+        }
+        if ( !isIdentStart(c) || ( (i > 0) && isIdentChar(s[i - 1]) ) ) {
+            ++i;
+            continue;
+        }
+        size_t e = i + 1;
+        while ( e < n && isIdentChar(s[e]) ) {
+            ++e;
+        }
+        const std::string ident = s.substr(i, e - i);
+        size_t next = e;
+        while ( next < n && ( (unsigned char)s[next] <= ' ' ) ) {
+            ++next;
+        }
+        const bool isCall = ( next < n && ( (s[next] == '(') || (s[next] == '[') ) );
+        i = e;
+
+        if (ident == "T") {
+            info->usesTime = true;
+        } else if (ident == "K") {
+            info->usesScale = true;
+        } else if ( (ident == "init") || (ident == "end") ) {
+            // evaluated once per fill(), the compiled expression cannot be reused
+            info->isCacheable = false;
+            info->isPointwise = false;
+        } else if ( isCall && ( (ident == "i") || (ident == "j") || (ident == "I") || (ident == "J") ) ) {
+            // neighbor access
+            info->isPointwise = false;
+        } else if ( (ident == "x") || (ident == "y") || (ident == "z") ||
+                    (ident == "w") || (ident == "h") || (ident == "d") ||
+                    (ident == "wh") || (ident == "whd") || (ident == "whds") ) {
+            // coordinates and image size depend on the tile
+            info->isPointwise = false;
+        } else if ( (ident == "im") || (ident == "iM") || (ident == "ia") || (ident == "iv") ||
+                    (ident == "is") || (ident == "ip") || (ident == "ic") ||
+                    (ident == "xm") || (ident == "ym") || (ident == "zm") || (ident == "cm") ||
+                    (ident == "xM") || (ident == "yM") || (ident == "zM") || (ident == "cM") ||
+                    (ident == "stats") ) {
+            // image-wide statistics: the parser computes them from the input image
+            // when compiling, and stores them as constants
+            info->isCacheable = false;
+            info->isPointwise = false;
+        } else if ( (ident == "crop") || (ident == "draw") ) {
+            // block accesses
+            info->isPointwise = false;
+        }
+    }
+} // analyzeExpression
+
+/// Compiled expressions, kept across renders.
+/// Each entry is keyed by the expression text and the image geometry, since the image size is
+/// a compile-time constant of the CImg math parser.
+/// An entry is used by a single render at a time: concurrent renders (e.g. tiles) get their own entry.
+class CImgExpressionCache
+{
+public:
+    struct Entry
+    {
+        Entry(const std::string& expr_,
+              cimgpix_t* data,
+              int width_,
+              int height_,
+              int spectrum_)
+            : expr(expr_)
+            , width(width_)
+            , height(height_)
+            , spectrum(spectrum_)
+        {
+            // the parser keeps references to in and out, which are rebound to the image data of each render
+            in.assign(data, width, height, 1, spectrum, true);
+            out.assign(data, width, height, 1, spectrum, true);
+            mp.reset( new CImgExpressionParser(expr.c_str(), "fill", in, &out, 0, 0, true) );
+        }
+
+        std::string expr;
+        int width;
+        int height;
+        int spectrum;
+        CImgExpressionImage in;
+        CImgExpressionImage out;
+        auto_ptr<CImgExpressionParser> mp; // must be declared after in and out
+    };
+
+    CImgExpressionCache()
+        : _mutex()
+        , _entries()
+    {
+    }
+
+    ~CImgExpressionCache()
+    {
+        clear();
+    }
+
+    // get a compiled expression from the cache, or compile a new one.
+    // The returned entry must be given back using release().
+    Entry* acquire(const std::string& expr,
+                   CImgExpressionImage& cimg)
+    {
+        {
+            AutoMutex l (&_mutex);
+            for (std::list<Entry*>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+                Entry* e = *it;
+                if ( (e->width == cimg.width()) && (e->height == cimg.height()) &&
+                     (e->spectrum == cimg.spectrum()) && (e->expr == expr) ) {
+                    _entries.erase(it);
+
+                    return e;
+                }
+            }
+        }
+
+        // compile outside of the lock, this may throw a CImgArgumentException
+        return new Entry(expr, cimg.data(), cimg.width(), cimg.height(), cimg.spectrum());
+    }
+
+    void release(Entry* e)
+    {
+        e->in.assign();
+        e->out.assign();
+        AutoMutex l (&_mutex);
+        _entries.push_front(e);
+        while (_entries.size() > kExpressionCacheSize) {
+            delete _entries.back();
+            _entries.pop_back();
+        }
+    }
+
+    void clear()
+    {
+        AutoMutex l (&_mutex);
+        for (std::list<Entry*>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            delete *it;
+        }
+        _entries.clear();
+    }
+
+private:
+    Mutex _mutex;
+    std::list<Entry*> _entries; //< most recently used first
+};
+
+/// Row-parallel evaluation of a compiled expression (same results as CImg::fill() for pointwise expressions).
+class CImgExpressionProcessor
+    : public MultiThread::Processor
+{
+public:
+    CImgExpressionProcessor(ImageEffect &instance,
+                            CImgExpressionParser& mp,
+                            CImgExpressionImage& cimg)
+        : _effect(instance)
+        , _mp(mp)
+        , _cimg(cimg)
+        , _failed(false)
+    {
+    }
+
+    /** @brief called to process everything */
+    void process(void)
+    {
+        unsigned int nCPUs = 1;
+        if (_mp.is_parallelizable) {
+            // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+            nCPUs = ( (std::min)(_cimg.width(), 4096) * _cimg.height() ) / 4096u;
+            nCPUs = (std::max)( 1u, (std::min)( nCPUs, MultiThread::getNumCPUs() ) );
+        }
+        if (nCPUs == 1) {
+            multiThreadFunction(0, 1);
+        } else {
+            multiThread(nCPUs);
+        }
+    }
+
+    // returns true if the evaluation failed in any thread, and the message of the first error
+    bool failed(std::string *message)
+    {
+        AutoMutex l (&_mutex);
+        *message = _message;
+
+        return _failed;
+    }
+
+private:
+    /** @brief function that will be called in each thread. ID is from 0..nThreads-1 nThreads are the number of threads it is being run over */
+    virtual void multiThreadFunction(unsigned int threadID,
+                                     unsigned int nThreads) OVERRIDE FINAL
+    {
+        int row_begin = 0;
+        int row_end = 0;
+
+        MultiThread::getThreadRange(threadID, nThreads, 0, _cimg.height(), &row_begin, &row_end);
+        if (row_end <= row_begin) {
+            return;
+        }
+        try {
+            if (nThreads == 1) {
+                evaluate(_mp, row_begin, row_end);
+            } else {
+                // each thread needs its own memory for evaluation, the code is shared
+                CImgExpressionParser lmp(_mp);
+                lmp.is_fill = true;
+                evaluate(lmp, row_begin, row_end);
+            }
+        } catch (const cimg_library::CImgException& e) {
+            AutoMutex l (&_mutex);
+            if (!_failed) {
+                _failed = true;
+                _message = e.what();
+            }
+        }
+    }
+
+    void evaluate(CImgExpressionParser& mp,
+                  int row_begin,
+                  int row_end)
+    {
+        const int width = _cimg.width();
+        if (mp.result_dim) {
+            // vector-valued expression
+            const unsigned int N = (std::min)( mp.result_dim, (unsigned int)_cimg.spectrum() );
+            const size_t wh = (size_t)width * _cimg.height();
+            cimg_library::CImg<double> res(1, mp.result_dim);
+            for (int y = row_begin; y < row_end; ++y) {
+                if ( _effect.abort() ) {
+                    return;
+                }
+                cimgpix_t *ptrd = _cimg.data(0, y, 0, 0);
+                for (int x = 0; x < width; ++x, ++ptrd) {
+                    mp(x, y, 0, 0, res.data());
+                    const double *ptrs = res.data();
+                    cimgpix_t *_ptrd = ptrd;
+                    for (unsigned int n = N; n > 0; --n, _ptrd += wh) {
+                        *_ptrd = (cimgpix_t)(*ptrs++);
+                    }
+                }
+            }
+        } else {
+            // scalar-valued expression
+            for (int c = 0; c < _cimg.spectrum(); ++c) {
+                for (int y = row_begin; y < row_end; ++y) {
+                    if ( _effect.abort() ) {
+                        return;
+                    }
+                    cimgpix_t *ptrd = _cimg.data(0, y, 0, c);
+                    for (int x = 0; x < width; ++x) {
+                        *ptrd++ = (cimgpix_t)mp(x, y, 0, c);
+                    }
+                }
+            }
+        }
+    }
+
+    ImageEffect &_effect;      /**< @brief effect to render with */
+    CImgExpressionParser& _mp;
+    CImgExpressionImage& _cimg;
+    Mutex _mutex; // protects _failed and _message, which are set by the worker threads
+    bool _failed;
+    std::string _message;
+};
+
 
 /// Expression plugin
 struct CImgExpressionParams
@@ -251,6 +613,7 @@ public:
     {
         _expr  = fetchStringParam(kParamExpression);
         assert(_expr);
+        updateSupportsTiles();
     }
 
     virtual void getValuesAtTime(double time,
@@ -285,13 +648,57 @@ public:
         if ( params.expr.empty() ) {
             throwSuiteStatusException(kOfxStatFailed);
         }
-        char vars[256];
-        snprintf(vars, sizeof(vars), "T=%g;K=%g;", args.time, args.renderScale.x);
+        CImgExpressionInfo info;
+        analyzeExpression(params.expr, &info);
+        // only define T and K if they are used, so that the compiled expression can be reused at other times
+        std::string vars;
+        if (info.usesTime) {
+            char var[64];
+            snprintf(var, sizeof(var), "T=%g;", args.time);
+            vars += var;
+        }
+        if (info.usesScale) {
+            char var[64];
+            snprintf(var, sizeof(var), "K=%g;", args.renderScale.x);
+            vars += var;
+        }
+        const std::string body = vars + info.body;
+        if (info.isCacheable) {
+            CImgExpressionCache::Entry* e = NULL;
+            try {
+                e = _cache.acquire(body, cimg);
+            } catch (const cimg_library::CImgArgumentException& ex) {
+                setPersistentMessage( Message::eMessageError, "", ex.what() );
+                throwSuiteStatusException(kOfxStatFailed);
+            }
+            assert(e);
+            // pointwise expressions that read other channels of the current pixel need a copy of the input
+            CImgExpressionImage incopy;
+            if (e->mp->need_input_copy) {
+                incopy.assign(cimg);
+                e->in.assign(incopy.data(), cimg.width(), cimg.height(), 1, cimg.spectrum(), true);
+            } else {
+                e->in.assign(cimg.data(), cimg.width(), cimg.height(), 1, cimg.spectrum(), true);
+            }
+            e->out.assign(cimg.data(), cimg.width(), cimg.height(), 1, cimg.spectrum(), true);
+            CImgExpressionProcessor processor(*this, *e->mp, cimg);
+            processor.process();
+            std::string message;
+            const bool failed = processor.failed(&message);
+            _cache.release(e);
+            if (failed) {
+                setPersistentMessage(Message::eMessageError, "", message);
+                throwSuiteStatusException(kOfxStatFailed);
+            }
+
+            return;
+        }
+
         std::string expr;
-        if ( (params.expr[0] == '<') || (params.expr[0] == '>') ) {
-            expr = params.expr.substr(0, 1) + vars + params.expr.substr(1);
+        if (info.mode) {
+            expr = std::string(1, info.mode) + body;
         } else {
-            expr = vars + params.expr;
+            expr = body;
         }
         try {
             cimg.fill(expr.c_str(), true);
@@ -320,6 +727,9 @@ public:
         if (paramName == kParamHelp) {
             sendMessage(Message::eMessageMessage, "", kPluginDescriptionMarkdown);
         } else {
+            if (paramName == kParamExpression) {
+                updateSupportsTiles();
+            }
             // must clear persistent message, or render() is not called by Nuke
             clearPersistentMessage();
             
@@ -329,8 +739,24 @@ public:
 
 private:
 
+    // Pointwise expressions can be computed on tiles: tell the host
+    // (kOfxImageEffectPropSupportsTiles is writable on instances).
+    void updateSupportsTiles()
+    {
+        std::string expr;
+        _expr->getValue(expr);
+        CImgExpressionInfo info;
+        analyzeExpression(expr, &info);
+        const bool supportsTiles = getImageEffectHostDescription()->supportsTiles && info.isPointwise;
+        if (supportsTiles != _supportsTiles) {
+            _supportsTiles = supportsTiles;
+            getPropertySet().propSetInt(kOfxImageEffectPropSupportsTiles, (int)supportsTiles, false);
+        }
+    }
+
     // params
     StringParam *_expr;
+    CImgExpressionCache _cache;
 };
 
 
@@ -24,6 +24,9 @@
 #include <memory>
 #include <cmath>
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <limits>
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 #include <windows.h>
 #endif
@@ -33,6 +36,21 @@
 #include "ofxsMacros.h"
 #include "ofxsCoords.h"
 #include "ofxsCopier.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
 
 #include "CImgFilter.h"
 
@@ -60,6 +78,12 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "(M. Daisy, D. Tschumperlé, O. Lezoray). " \
     "SIGGRAPH Asia 2013 Technical Briefs, Hong-Kong, November 2013.\n" \
     "\n" \
+    "The PatchMatch algorithm is a faster alternative for large holes. It fills the hole coarse-to-fine, " \
+    "using the randomized nearest-neighbor search described in:\n" \
+    "\"PatchMatch: A Randomized Correspondence Algorithm for Structural Image Editing.\" " \
+    "(C. Barnes, E. Shechtman, A. Finkelstein, D. B Goldman). " \
+    "ACM Transactions on Graphics (Proc. SIGGRAPH), 28(3), August 2009.\n" \
+    "\n" \
     "Uses the 'inpaint' plugin from the CImg library.\n" \
     "CImg is a free, open-source library distributed under the CeCILL-C " \
     "(close to the GNU LGPL) or CeCILL (compatible with the GNU GPL) licenses. " \
@@ -69,8 +93,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginIdentifier    "eu.cimg.Inpaint"
 // History:
 // version 1.0: initial version
+// version 1.1: add PatchMatch algorithm
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsComponentRemapping 1
 #define kSupportsTiles 0 // requires the whole image to search for patches, which may be far away (how far exactly?)
@@ -89,6 +114,31 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kSupportsXY true
 #define kSupportsAlpha true
 
+#define kParamAlgorithm "algorithm"
+#define kParamAlgorithmLabel "Algorithm"
+#define kParamAlgorithmHint "Inpainting algorithm."
+#define kParamAlgorithmOptionPatch "Patch-Based", "Examplar-based inpainting with patch blending (CImg inpaint_patch). Cost grows quickly with the hole size.", "patch"
+#define kParamAlgorithmOptionPatchMatch "PatchMatch", "Coarse-to-fine inpainting using the PatchMatch randomized nearest-neighbor search. Much faster on large holes, the blend parameters are not used.", "patchmatch"
+enum AlgorithmEnum
+{
+    eAlgorithmPatch = 0,
+    eAlgorithmPatchMatch,
+};
+#define kParamAlgorithmDefault eAlgorithmPatch
+
+#define kParamIterations "iterations"
+#define kParamIterationsLabel "Iterations"
+#define kParamIterationsHint "Number of search and vote iterations at each scale of the PatchMatch algorithm."
+#define kParamIterationsDefault 5 // 1-20
+
+#define kParamTemporalCoherence "temporalCoherence"
+#define kParamTemporalCoherenceLabel "Temporal Coherence"
+#define kParamTemporalCoherenceHint "Use the nearest-neighbor field computed on the previous frame to initialize the PatchMatch search, for less flickering between frames. Frames should be rendered in sequence."
+#define kParamTemporalCoherenceDefault false
+
+#define kPatchMatchMaxLevels 10 // max number of levels in the PatchMatch pyramid
+#define kPatchMatchSeed 0x5eed
+
 #define kParamPatchSize "patchSize"
 #define kParamPatchSizeLabel "Patch Size" //, "Patch size in pixels."
 #define kParamPatchSizeDefault 7 // 1-64
@@ -125,6 +175,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 /// Inpaint plugin
 struct CImgInpaintParams
 {
+    int algorithm;
+    int iterations;
+    bool temporal_coherence;
     int patch_size;
     double lookup_size;
     double lookup_factor;
@@ -136,6 +189,600 @@ struct CImgInpaintParams
     bool is_blend_outer;
 };
 
+//////////////////////////////////////////////////////////////////////////////////////////
+// PatchMatch inpainting
+
+/// Nearest-neighbor field of the hole pixels at full resolution, in absolute pixel coordinates.
+struct PatchMatchMatch
+{
+    int x, y;   // hole pixel
+    int qx, qy; // center of the matching source patch
+};
+
+inline bool
+operator<(const PatchMatchMatch& a,
+          const PatchMatchMatch& b)
+{
+    return (a.y < b.y) || ( (a.y == b.y) && (a.x < b.x) );
+}
+
+struct PatchMatchField
+{
+    PatchMatchField()
+        : time(0.)
+        , width(0)
+        , height(0)
+        , scale(0.)
+        , matches()
+    {
+    }
+
+    double time;
+    int width;
+    int height;
+    double scale;
+    std::vector<PatchMatchMatch> matches; // sorted
+};
+
+class PatchMatchInpainter;
+
+/// Runs one pass of the PatchMatch algorithm over the hole pixels of a level.
+class PatchMatchProcessor
+    : public MultiThread::Processor
+{
+public:
+    enum PassEnum
+    {
+        ePassSearch = 0,
+        ePassVote,
+    };
+
+    PatchMatchProcessor(PatchMatchInpainter& pm,
+                        PassEnum pass,
+                        int parity,
+                        int iteration,
+                        int n)
+        : _pm(pm)
+        , _pass(pass)
+        , _parity(parity)
+        , _iteration(iteration)
+        , _n(n)
+    {
+    }
+
+    /** @brief called to process everything */
+    void process(void)
+    {
+        // make sure there are at least 256 hole pixels per CPU
+        unsigned int nCPUs = (std::max)( 1u, (std::min)( (unsigned int)_n / 256u, MultiThread::getNumCPUs() ) );
+        if (nCPUs == 1) {
+            multiThreadFunction(0, 1);
+        } else {
+            multiThread(nCPUs);
+        }
+    }
+
+private:
+    /** @brief function that will be called in each thread. ID is from 0..nThreads-1 nThreads are the number of threads it is being run over */
+    virtual void multiThreadFunction(unsigned int threadID, unsigned int nThreads) OVERRIDE FINAL;
+
+    PatchMatchInpainter& _pm;
+    PassEnum _pass;
+    int _parity;
+    int _iteration;
+    int _n;
+};
+
+/// Coarse-to-fine PatchMatch inpainting.
+/// All buffers are restricted to the bounding box of the hole, enlarged by the lookup radius,
+/// so that memory scales with the masked area rather than with the image size.
+class PatchMatchInpainter
+{
+    struct Level
+    {
+        int w, h, s;
+        cimg_library::CImg<cimgpix_t> img;      // w x h x 1 x s
+        cimg_library::CImg<unsigned char> hole; // 1 if the pixel is unknown
+        cimg_library::CImg<unsigned char> valid; // 1 if a fully known patch is centered on the pixel
+        cimg_library::CImg<int> holeIndex;      // index in holes, or -1
+        std::vector<int> holes;                 // offsets of the hole pixels
+        std::vector<int> parityHoles[2];        // indices in holes, split by (x+y)%2
+        std::vector<int> validList;             // offsets of the valid patch centers
+        std::vector<int> nnx, nny;              // nearest-neighbor field
+        std::vector<float> nnd;                 // patch distance
+        std::vector<cimgpix_t> vote;            // voted colors of the hole pixels
+    };
+
+public:
+    PatchMatchInpainter(ImageEffect& effect,
+                        int patchSize,
+                        int lookupRadius,
+                        int iterations)
+        : _effect(effect)
+        , _r( (std::max)(1, patchSize / 2) )
+        , _lookupRadius( (std::max)(1, lookupRadius) )
+        , _iterations( (std::max)(1, iterations) )
+        , _levels()
+        , _level(0)
+        , _prev(NULL)
+        , _x0(0)
+        , _y0(0)
+    {
+    }
+
+    // Inpaint the pixels of cimg where mask is non-zero.
+    // (x1,y1) is the position of cimg in the full image, prev is an optional field computed on a previous frame.
+    // Returns false if the hole could not be filled (e.g. there is no valid source patch).
+    bool inpaint(cimg_library::CImg<cimgpix_t>& cimg,
+                 const cimg_library::CImg<cimgpix_t>& mask,
+                 int x1,
+                 int y1,
+                 const PatchMatchField* prev,
+                 PatchMatchField* field)
+    {
+        // bounding box of the hole
+        int bx1 = cimg.width(), by1 = cimg.height(), bx2 = -1, by2 = -1;
+        cimg_forXY(mask, x, y) {
+            if (mask(x, y) > 0) {
+                bx1 = (std::min)(bx1, x);
+                bx2 = (std::max)(bx2, x);
+                by1 = (std::min)(by1, y);
+                by2 = (std::max)(by2, y);
+            }
+        }
+        if (bx2 < 0) {
+            // nothing to inpaint
+            return true;
+        }
+        const int margin = _lookupRadius + 2 * _r;
+        const int cx1 = (std::max)(0, bx1 - margin);
+        const int cy1 = (std::max)(0, by1 - margin);
+        const int cx2 = (std::min)(cimg.width() - 1, bx2 + margin);
+        const int cy2 = (std::min)(cimg.height() - 1, by2 + margin);
+        _x0 = x1 + cx1;
+        _y0 = y1 + cy1;
+        _prev = (prev && !prev->matches.empty()) ? prev : NULL;
+
+        // build the pyramid
+        _levels.clear();
+        _levels.reserve(kPatchMatchMaxLevels);
+        _levels.resize(1);
+        {
+            Level& l0 = _levels[0];
+            l0.w = cx2 - cx1 + 1;
+            l0.h = cy2 - cy1 + 1;
+            l0.s = cimg.spectrum();
+            l0.img = cimg.get_crop(cx1, cy1, 0, 0, cx2, cy2, 0, cimg.spectrum() - 1);
+            l0.hole.assign(l0.w, l0.h);
+            cimg_forXY(l0.hole, x, y) {
+                l0.hole(x, y) = (mask(cx1 + x, cy1 + y) > 0);
+            }
+        }
+        const int patchWidth = 2 * _r + 1;
+        while ( (int)_levels.size() < kPatchMatchMaxLevels &&
+                ( (std::min)(_levels.back().w, _levels.back().h) / 2 >= 2 * patchWidth ) ) {
+            _levels.push_back( Level() );
+            downsample(_levels[_levels.size() - 2], _levels.back());
+        }
+        int start = -1;
+        for (int L = (int)_levels.size() - 1; L >= 0; --L) {
+            setup(_levels[L]);
+            if ( (start < 0) && !_levels[L].validList.empty() ) {
+                start = L;
+            }
+        }
+        if (start < 0) {
+            // no fully known patch to copy from
+            return false;
+        }
+
+        for (_level = start; _level >= 0; --_level) {
+            Level& l = _levels[_level];
+            if (_level == start) {
+                fillCoarsest(l);
+            } else {
+                upsample(_levels[_level + 1], l);
+            }
+            initField(l, _level == start);
+            for (int it = 0; it < _iterations; ++it) {
+                for (int parity = 0; parity < 2; ++parity) {
+                    PatchMatchProcessor proc(*this, PatchMatchProcessor::ePassSearch, parity, it, (int)l.parityHoles[parity].size());
+                    proc.process();
+                }
+                {
+                    PatchMatchProcessor proc(*this, PatchMatchProcessor::ePassVote, 0, it, (int)l.holes.size());
+                    proc.process();
+                }
+                for (size_t i = 0; i < l.holes.size(); ++i) {
+                    for (int c = 0; c < l.s; ++c) {
+                        l.img[l.holes[i] + (size_t)c * l.w * l.h] = l.vote[i * l.s + c];
+                    }
+                }
+                if ( _effect.abort() ) {
+                    return true;
+                }
+            }
+        }
+
+        // copy the result back
+        const Level& l0 = _levels[0];
+        for (size_t i = 0; i < l0.holes.size(); ++i) {
+            const int x = l0.holes[i] % l0.w;
+            const int y = l0.holes[i] / l0.w;
+            for (int c = 0; c < l0.s; ++c) {
+                cimg(cx1 + x, cy1 + y, 0, c) = l0.img(x, y, 0, c);
+            }
+        }
+        if (field) {
+            field->matches.resize( l0.holes.size() );
+            for (size_t i = 0; i < l0.holes.size(); ++i) {
+                PatchMatchMatch& m = field->matches[i];
+                m.x = _x0 + l0.holes[i] % l0.w;
+                m.y = _y0 + l0.holes[i] / l0.w;
+                m.qx = _x0 + l0.nnx[i];
+                m.qy = _y0 + l0.nny[i];
+            }
+            std::sort( field->matches.begin(), field->matches.end() );
+        }
+        _levels.clear();
+
+        return true;
+    } // inpaint
+
+    // improve the nearest-neighbor field of the hole pixels of the given parity in [begin,end)
+    void search(int parity,
+                int iteration,
+                int begin,
+                int end)
+    {
+        Level& l = _levels[_level];
+        const int radius = (std::max)(l.w, l.h); // the level is already restricted to the lookup area
+        const int dxs[4] = {-1, 1, 0, 0};
+        const int dys[4] = {0, 0, -1, 1};
+
+        for (int k = begin; k < end; ++k) {
+            if ( ( (k - begin) % 256 == 0 ) && _effect.abort() ) {
+                return;
+            }
+            const int i = l.parityHoles[parity][k];
+            const int x = l.holes[i] % l.w;
+            const int y = l.holes[i] / l.w;
+            int bx = l.nnx[i];
+            int by = l.nny[i];
+            float bd = l.nnd[i];
+            // propagation: neighbors have the other parity, and are not modified by this pass
+            for (int n = 0; n < 4; ++n) {
+                const int nx = x + dxs[n];
+                const int ny = y + dys[n];
+                if ( (nx < 0) || (nx >= l.w) || (ny < 0) || (ny >= l.h) ) {
+                    continue;
+                }
+                const int j = l.holeIndex(nx, ny);
+                if (j >= 0) {
+                    tryCandidate(l, x, y, l.nnx[j] - dxs[n], l.nny[j] - dys[n], &bx, &by, &bd);
+                }
+            }
+            // random search around the best match, with exponentially decreasing radius
+            unsigned int seed = kPatchMatchSeed + iteration;
+            for (int rad = radius; rad >= 1; rad /= 2) {
+                seed = cimg_irand(seed, x, y, rad);
+                const int rx = bx + (int)( seed % (2 * rad + 1) ) - rad;
+                seed = cimg_hash(seed);
+                const int ry = by + (int)( seed % (2 * rad + 1) ) - rad;
+                tryCandidate(l, x, y, rx, ry, &bx, &by, &bd);
+            }
+            l.nnx[i] = bx;
+            l.nny[i] = by;
+            l.nnd[i] = bd;
+        }
+    }
+
+    // each hole pixel gets the average of the colors proposed by the overlapping hole patches
+    void vote(int begin,
+              int end)
+    {
+        Level& l = _levels[_level];
+        const size_t wh = (size_t)l.w * l.h;
+        std::vector<double> sum(l.s);
+
+        for (int i = begin; i < end; ++i) {
+            if ( ( (i - begin) % 256 == 0 ) && _effect.abort() ) {
+                return;
+            }
+            const int x = l.holes[i] % l.w;
+            const int y = l.holes[i] / l.w;
+            std::fill(sum.begin(), sum.end(), 0.);
+            int count = 0;
+            for (int dy = -_r; dy <= _r; ++dy) {
+                const int ny = y + dy;
+                if ( (ny < 0) || (ny >= l.h) ) {
+                    continue;
+                }
+                for (int dx = -_r; dx <= _r; ++dx) {
+                    const int nx = x + dx;
+                    if ( (nx < 0) || (nx >= l.w) ) {
+                        continue;
+                    }
+                    const int j = l.holeIndex(nx, ny);
+                    if (j < 0) {
+                        continue;
+                    }
+                    // pixel (x,y) is at position (-dx,-dy) in the patch centered on (nx,ny)
+                    const cimgpix_t *src = l.img.data(l.nnx[j] - dx, l.nny[j] - dy);
+                    for (int c = 0; c < l.s; ++c) {
+                        sum[c] += src[c * wh];
+                    }
+                    ++count;
+                }
+            }
+            assert(count > 0); // the patch centered on (x,y) always votes
+            for (int c = 0; c < l.s; ++c) {
+                l.vote[(size_t)i * l.s + c] = (cimgpix_t)(sum[c] / count);
+            }
+        }
+    }
+
+private:
+    // sum of squared differences between the patches centered on p and q (q is fully known)
+    float distance(const Level& l,
+                   int px,
+                   int py,
+                   int qx,
+                   int qy,
+                   float maxd) const
+    {
+        const size_t wh = (size_t)l.w * l.h;
+        float d = 0.f;
+
+        for (int dy = -_r; dy <= _r; ++dy) {
+            const int y = py + dy;
+            if ( (y < 0) || (y >= l.h) ) {
+                continue;
+            }
+            const int x1 = (std::max)(0, px - _r);
+            const int x2 = (std::min)(l.w - 1, px + _r);
+            for (int c = 0; c < l.s; ++c) {
+                const cimgpix_t *pp = l.img.data(x1, y) + c * wh;
+                const cimgpix_t *pq = l.img.data(qx + x1 - px, qy + dy) + c * wh;
+                for (int x = x1; x <= x2; ++x) {
+                    const float diff = *pp++ - *pq++;
+                    d += diff * diff;
+                }
+            }
+            if (d >= maxd) {
+                return d;
+            }
+        }
+
+        return d;
+    }
+
+    void tryCandidate(const Level& l,
+                      int x,
+                      int y,
+                      int qx,
+                      int qy,
+                      int* bx,
+                      int* by,
+                      float* bd) const
+    {
+        if ( (qx < 0) || (qx >= l.w) || (qy < 0) || (qy >= l.h) ||
+             ( (qx == *bx) && (qy == *by) ) || !l.valid(qx, qy) ) {
+            return;
+        }
+        const float d = distance(l, x, y, qx, qy, *bd);
+        if (d < *bd) {
+            *bx = qx;
+            *by = qy;
+            *bd = d;
+        }
+    }
+
+    // half-resolution level: a pixel is a hole if any of its children is a hole, known pixels are averaged
+    static void downsample(const Level& src,
+                           Level& dst)
+    {
+        dst.w = (src.w + 1) / 2;
+        dst.h = (src.h + 1) / 2;
+        dst.s = src.s;
+        dst.img.assign(dst.w, dst.h, 1, dst.s, 0);
+        dst.hole.assign(dst.w, dst.h, 1, 1, 0);
+        cimg_forXY(dst.hole, x, y) {
+            int count = 0;
+            for (int sy = 2 * y; sy < (std::min)(2 * y + 2, src.h); ++sy) {
+                for (int sx = 2 * x; sx < (std::min)(2 * x + 2, src.w); ++sx) {
+                    if ( src.hole(sx, sy) ) {
+                        dst.hole(x, y) = 1;
+                    } else {
+                        for (int c = 0; c < dst.s; ++c) {
+                            dst.img(x, y, 0, c) += src.img(sx, sy, 0, c);
+                        }
+                        ++count;
+                    }
+                }
+            }
+            if (count > 1) {
+                for (int c = 0; c < dst.s; ++c) {
+                    dst.img(x, y, 0, c) /= count;
+                }
+            }
+        }
+    }
+
+    // compute the hole list and the valid patch centers
+    void setup(Level& l) const
+    {
+        // integral image of the hole, to find the fully known patches
+        std::vector<int> integral( (size_t)(l.w + 1) * (l.h + 1), 0 );
+        for (int y = 0; y < l.h; ++y) {
+            int row = 0;
+            for (int x = 0; x < l.w; ++x) {
+                row += l.hole(x, y);
+                integral[(size_t)(y + 1) * (l.w + 1) + x + 1] = integral[(size_t)y * (l.w + 1) + x + 1] + row;
+            }
+        }
+        l.valid.assign(l.w, l.h, 1, 1, 0);
+        l.holeIndex.assign(l.w, l.h, 1, 1, -1);
+        l.holes.clear();
+        l.parityHoles[0].clear();
+        l.parityHoles[1].clear();
+        l.validList.clear();
+        for (int y = 0; y < l.h; ++y) {
+            for (int x = 0; x < l.w; ++x) {
+                if ( l.hole(x, y) ) {
+                    l.holeIndex(x, y) = (int)l.holes.size();
+                    l.parityHoles[(x + y) & 1].push_back( (int)l.holes.size() );
+                    l.holes.push_back(x + y * l.w);
+                } else if ( (x >= _r) && (x < l.w - _r) && (y >= _r) && (y < l.h - _r) ) {
+                    const int xa = x - _r, xb = x + _r + 1, ya = y - _r, yb = y + _r + 1;
+                    const int n = ( integral[(size_t)yb * (l.w + 1) + xb] - integral[(size_t)ya * (l.w + 1) + xb] -
+                                    integral[(size_t)yb * (l.w + 1) + xa] + integral[(size_t)ya * (l.w + 1) + xa] );
+                    if (n == 0) {
+                        l.valid(x, y) = 1;
+                        l.validList.push_back(x + y * l.w);
+                    }
+                }
+            }
+        }
+        l.nnx.assign(l.holes.size(), 0);
+        l.nny.assign(l.holes.size(), 0);
+        l.nnd.assign(l.holes.size(), 0.f);
+        l.vote.assign(l.holes.size() * l.s, 0.f);
+    }
+
+    // initial colors of the coarsest level: propagate the known colors inwards (onion peel)
+    static void fillCoarsest(Level& l)
+    {
+        cimg_library::CImg<unsigned char> filled(l.w, l.h);
+        cimg_forXY(filled, x, y) {
+            filled(x, y) = !l.hole(x, y);
+        }
+        std::vector<int> front, next;
+        for (size_t i = 0; i < l.holes.size(); ++i) {
+            front.push_back(l.holes[i]);
+        }
+        while ( !front.empty() ) {
+            next.clear();
+            std::vector<int> done;
+            for (size_t i = 0; i < front.size(); ++i) {
+                const int x = front[i] % l.w;
+                const int y = front[i] / l.w;
+                int count = 0;
+                std::vector<double> sum(l.s, 0.);
+                for (int ny = (std::max)(0, y - 1); ny <= (std::min)(l.h - 1, y + 1); ++ny) {
+                    for (int nx = (std::max)(0, x - 1); nx <= (std::min)(l.w - 1, x + 1); ++nx) {
+                        if ( filled(nx, ny) == 1 ) {
+                            for (int c = 0; c < l.s; ++c) {
+                                sum[c] += l.img(nx, ny, 0, c);
+                            }
+                            ++count;
+                        }
+                    }
+                }
+                if (count) {
+                    for (int c = 0; c < l.s; ++c) {
+                        l.img(x, y, 0, c) = (cimgpix_t)(sum[c] / count);
+                    }
+                    done.push_back(front[i]);
+                } else {
+                    next.push_back(front[i]);
+                }
+            }
+            if ( done.empty() ) {
+                // no known pixel at all
+                break;
+            }
+            for (size_t i = 0; i < done.size(); ++i) {
+                filled[done[i]] = 1;
+            }
+            front.swap(next);
+        }
+    }
+
+    // initial colors from the coarser level
+    static void upsample(const Level& src,
+                         Level& dst)
+    {
+        for (size_t i = 0; i < dst.holes.size(); ++i) {
+            const int x = dst.holes[i] % dst.w;
+            const int y = dst.holes[i] / dst.w;
+            for (int c = 0; c < dst.s; ++c) {
+                dst.img(x, y, 0, c) = src.img(x / 2, y / 2, 0, c);
+            }
+        }
+    }
+
+    // initialize the nearest-neighbor field, from the coarser level, the previous frame, or randomly
+    void initField(Level& l,
+                   bool coarsest)
+    {
+        const Level* coarse = coarsest ? NULL : &_levels[_level + 1];
+
+        for (size_t i = 0; i < l.holes.size(); ++i) {
+            const int x = l.holes[i] % l.w;
+            const int y = l.holes[i] / l.w;
+            int bx = -1, by = -1;
+            float bd = std::numeric_limits<float>::max();
+            if (coarse) {
+                const int j = coarse->holeIndex(x / 2, y / 2);
+                assert(j >= 0); // the parent of a hole is a hole
+                if (j >= 0) {
+                    const int qx = (std::max)( _r, (std::min)(l.w - 1 - _r, 2 * coarse->nnx[j] + (x & 1) ) );
+                    const int qy = (std::max)( _r, (std::min)(l.h - 1 - _r, 2 * coarse->nny[j] + (y & 1) ) );
+                    tryCandidate(l, x, y, qx, qy, &bx, &by, &bd);
+                }
+            }
+            if (_prev) {
+                // the previous field is in full-resolution absolute coordinates
+                PatchMatchMatch key;
+                key.x = _x0 + (x << _level);
+                key.y = _y0 + (y << _level);
+                std::vector<PatchMatchMatch>::const_iterator it = std::lower_bound(_prev->matches.begin(), _prev->matches.end(), key);
+                if ( ( it != _prev->matches.end() ) && (it->x == key.x) && (it->y == key.y) ) {
+                    tryCandidate(l, x, y, (it->qx - _x0) >> _level, (it->qy - _y0) >> _level, &bx, &by, &bd);
+                }
+            }
+            if (bx < 0) {
+                const unsigned int k = cimg_irand(kPatchMatchSeed, x, y, _level) % l.validList.size();
+                bx = l.validList[k] % l.w;
+                by = l.validList[k] / l.w;
+                bd = distance(l, x, y, bx, by, std::numeric_limits<float>::max());
+            }
+            l.nnx[i] = bx;
+            l.nny[i] = by;
+            l.nnd[i] = bd;
+        }
+    }
+
+    ImageEffect& _effect;
+    const int _r;
+    const int _lookupRadius;
+    const int _iterations;
+    std::vector<Level> _levels;
+    int _level; // current level
+    const PatchMatchField* _prev;
+    int _x0, _y0; // position of level 0 in the full image
+};
+
+void
+PatchMatchProcessor::multiThreadFunction(unsigned int threadID,
+                                         unsigned int nThreads)
+{
+    int begin = 0;
+    int end = 0;
+
+    MultiThread::getThreadRange(threadID, nThreads, 0, _n, &begin, &end);
+    if (end <= begin) {
+        return;
+    }
+    if (_pass == ePassSearch) {
+        _pm.search(_parity, _iteration, begin, end);
+    } else {
+        _pm.vote(begin, end);
+    }
+}
+
+
 class CImgInpaintPlugin
     : public CImgFilterPluginHelper<CImgInpaintParams, false>
 {
@@ -143,7 +790,12 @@ public:
 
     CImgInpaintPlugin(OfxImageEffectHandle handle)
         : CImgFilterPluginHelper<CImgInpaintParams, false>(handle, /*usesMask=*/true, kSupportsComponentRemapping, kSupportsTiles, kSupportsMultiResolution, kSupportsRenderScale, /*defaultUnpremult=*/ true)
+        , _fieldMutex()
+        , _field()
     {
+        _algorithm       = fetchChoiceParam(kParamAlgorithm);
+        _iterations      = fetchIntParam(kParamIterations);
+        _temporal_coherence = fetchBooleanParam(kParamTemporalCoherence);
         _patch_size      = fetchIntParam(kParamPatchSize);
         _lookup_size     = fetchDoubleParam(kParamLookupSize);
         _lookup_factor   = fetchDoubleParam(kParamLookupFactor);
@@ -152,12 +804,17 @@ public:
         _blend_decay     = fetchDoubleParam(kParamBlendDecay);
         _blend_scales    = fetchIntParam(kParamBlendScales);
         _is_blend_outer  = fetchBooleanParam(kParamIsBlendOuter);
+        assert(_algorithm && _iterations && _temporal_coherence);
         assert(_patch_size && _lookup_size && _lookup_factor && _blend_size && _blend_threshold && _blend_decay && _blend_scales && _is_blend_outer);
+        updateVisibility();
     }
 
     virtual void getValuesAtTime(double time,
                                  CImgInpaintParams& params) OVERRIDE FINAL
     {
+        params.algorithm = _algorithm->getValueAtTime(time);
+        _iterations->getValueAtTime(time, params.iterations);
+        _temporal_coherence->getValueAtTime(time, params.temporal_coherence);
         _patch_size->getValueAtTime(time, params.patch_size);
         _lookup_size->getValueAtTime(time, params.lookup_size);
         _lookup_factor->getValueAtTime(time, params.lookup_factor);
@@ -186,13 +843,12 @@ public:
 
     virtual void render(const RenderArguments &args,
                         const CImgInpaintParams& params,
-                        int /*x1*/,
-                        int /*y1*/,
+                        int x1,
+                        int y1,
                         cimg_library::CImg<cimgpix_t>& mask,
                         cimg_library::CImg<cimgpix_t>& cimg,
                         int /*alphaChannel*/) OVERRIDE FINAL
     {
-        printf("%dx%d\n",cimg.width(), cimg.height());
         // PROCESSING.
         // This is the only place where the actual processing takes place
         if ( (params.patch_size <= 0) || (params.lookup_size <= 0.) || cimg.is_empty() ) {
@@ -202,6 +858,34 @@ public:
         cimg_for(mask, ptrd, cimgpix_t) {
             *ptrd = (*ptrd > 0);
         }
+        if (params.algorithm == eAlgorithmPatchMatch) {
+            PatchMatchInpainter pm(*this,
+                                   (int)std::ceil(params.patch_size * args.renderScale.x),
+                                   (int)std::ceil(params.patch_size * params.lookup_size * args.renderScale.x),
+                                   params.iterations);
+            PatchMatchField prev;
+            if (params.temporal_coherence) {
+                AutoMutex l (&_fieldMutex);
+                if ( (_field.width == cimg.width()) && (_field.height == cimg.height()) &&
+                     (_field.scale == args.renderScale.x) && (std::abs(_field.time - args.time) <= 1.) ) {
+                    prev = _field;
+                }
+            }
+            PatchMatchField field;
+            field.time = args.time;
+            field.width = cimg.width();
+            field.height = cimg.height();
+            field.scale = args.renderScale.x;
+            if ( pm.inpaint(cimg, mask, x1, y1, params.temporal_coherence ? &prev : NULL, &field) ) {
+                if ( params.temporal_coherence && !abort() ) {
+                    AutoMutex l (&_fieldMutex);
+                    std::swap(_field, field);
+                }
+
+                return;
+            }
+            // no valid source patch, fall back to patch-based inpainting
+        }
         cimg.inpaint_patch(mask,
                            (int)std::ceil(params.patch_size * args.renderScale.x),
                            (int)std::ceil(params.patch_size * params.lookup_size * args.renderScale.x),
@@ -220,17 +904,36 @@ public:
         return (params.patch_size <= 0) || (params.lookup_size <= 0.);
     };
 
-    /*
     virtual void changedParam(const InstanceChangedArgs &args,
                               const std::string &paramName) OVERRIDE FINAL
     {
-        CImgFilterPluginHelper<CImgInpaintParams, false>::changedParam(args, paramName);
+        if (paramName == kParamAlgorithm) {
+            updateVisibility();
+        } else {
+            CImgFilterPluginHelper<CImgInpaintParams, false>::changedParam(args, paramName);
+        }
     }
-     */
 
 private:
 
+    void updateVisibility()
+    {
+        const bool patchMatch = (_algorithm->getValue() == eAlgorithmPatchMatch);
+
+        _iterations->setEnabled(patchMatch);
+        _temporal_coherence->setEnabled(patchMatch);
+        _lookup_factor->setEnabled(!patchMatch);
+        _blend_size->setEnabled(!patchMatch);
+        _blend_threshold->setEnabled(!patchMatch);
+        _blend_decay->setEnabled(!patchMatch);
+        _blend_scales->setEnabled(!patchMatch);
+        _is_blend_outer->setEnabled(!patchMatch);
+    }
+
     // params
+    ChoiceParam *_algorithm;
+    IntParam *_iterations;
+    BooleanParam *_temporal_coherence;
     IntParam *_patch_size;
     DoubleParam *_lookup_size;
     DoubleParam *_lookup_factor;
@@ -239,6 +942,8 @@ private:
     DoubleParam *_blend_decay;
     IntParam *_blend_scales;
     BooleanParam *_is_blend_outer;
+    Mutex _fieldMutex;
+    PatchMatchField _field; // nearest-neighbor field of the last rendered frame, for temporal coherence
 };
 
 
@@ -288,6 +993,19 @@ CImgInpaintPluginFactory::describeInContext(ImageEffectDescriptor& desc,
                                                                          /*processAlpha*/ false,
                                                                          /*processIsSecret=*/ false);
 
+    {
+        ChoiceParamDescriptor *param = desc.defineChoiceParam(kParamAlgorithm);
+        param->setLabel(kParamAlgorithmLabel);
+        param->setHint(kParamAlgorithmHint);
+        assert(param->getNOptions() == eAlgorithmPatch);
+        param->appendOption(kParamAlgorithmOptionPatch);
+        assert(param->getNOptions() == eAlgorithmPatchMatch);
+        param->appendOption(kParamAlgorithmOptionPatchMatch);
+        param->setDefault( (int)kParamAlgorithmDefault );
+        if (page) {
+            page->addChild(*param);
+        }
+    }
     {
         IntParamDescriptor *param = desc.defineIntParam(kParamPatchSize);
         param->setLabel(kParamPatchSizeLabel);
@@ -370,6 +1088,26 @@ CImgInpaintPluginFactory::describeInContext(ImageEffectDescriptor& desc,
             page->addChild(*param);
         }
     }
+    {
+        IntParamDescriptor *param = desc.defineIntParam(kParamIterations);
+        param->setLabel(kParamIterationsLabel);
+        param->setHint(kParamIterationsHint);
+        param->setRange(1, 20);
+        param->setDisplayRange(1, 20);
+        param->setDefault(kParamIterationsDefault);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        BooleanParamDescriptor *param = desc.defineBooleanParam(kParamTemporalCoherence);
+        param->setLabel(kParamTemporalCoherenceLabel);
+        param->setHint(kParamTemporalCoherenceHint);
+        param->setDefault(kParamTemporalCoherenceDefault);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
 
     CImgInpaintPlugin::describeInContextEnd(desc, context, page);
 } // CImgInpaintPluginFactory::describeInContext
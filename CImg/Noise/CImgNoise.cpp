@@ -23,6 +23,7 @@
 #include <memory>
 #include <cmath>
 #include <cstring>
+#include <vector>
 #if defined(_WIN32) || defined(__WIN32__) || defined(WIN32)
 #include <windows.h>
 #endif
@@ -53,8 +54,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // History:
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
+// version 2.1: compute the random values of a row at once (same values as 2.0)
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsComponentRemapping 1
 #define kSupportsTiles 1
@@ -123,6 +125,7 @@ using namespace cimg_library;
 // - replaced all cimg_rof loops with cimg_forXYC, in order to get reproductible results
 // - replaced cimg::grand with cimg_grand, etc.
 // - add cimg_pragma_openmp(...)
+// - compute the random values of a row at once with OFX::Random::Generator
 /**
  \param sigma Amplitude of the random additive noise. If \p sigma<0, it stands for a percentage of the
  global value range.
@@ -161,29 +164,53 @@ noise(CImg<T>&img, const double sigma, const unsigned int noise_type, unsigned i
     if (nsigma<0) {
         nsigma = (Tfloat)(-nsigma*(M-m)/100.0);
     }
+    // the random values of a row are computed at once, see ofxsRandom.h
+    const int width = img.width();
+    const int height = img.height();
+    const int spectrum = img.spectrum();
+    const OFX::Random::Generator gen(seed, x1, x1 + width);
     switch (noise_type) {
         case 0 : { // Gaussian noise
-            cimg_pragma_openmp(parallel for collapse(3) cimg_openmp_if(img.size()>=2048))
-            cimg_forXYC(img, x, y, c) {
-                Tfloat val = (Tfloat)(img(x,y,0,c) + nsigma * cimg_grand(seed, x + x1, y + y1, c));
-                if (val > vmax) {
-                    val = vmax;
-                } else if (val < vmin) {
-                    val = vmin;
+            cimg_pragma_openmp(parallel for cimg_openmp_if(img.size()>=2048))
+            cimg_forY(img, y) {
+                std::vector<unsigned int> keys(width);
+                std::vector<double> g(width);
+                gen.rowKeys(y + y1, &keys.front());
+                cimg_forC(img, c) {
+                    gen.gaussian(&keys.front(), y + y1, c, &g.front());
+                    T *ptr = img.data(0, y, 0, c);
+                    for (int x = 0; x < width; ++x) {
+                        Tfloat val = (Tfloat)(ptr[x] + nsigma * g[x]);
+                        if (val > vmax) {
+                            val = vmax;
+                        } else if (val < vmin) {
+                            val = vmin;
+                        }
+                        ptr[x] = (T)val;
+                    }
                 }
-                img(x,y,0,c) = (T)val;
             }
         } break;
         case 1 : { // Uniform noise
-            cimg_pragma_openmp(parallel for collapse(3) cimg_openmp_if(img.size()>=2048))
-            cimg_forXYC(img, x, y, c) {
-                Tfloat val = (Tfloat)(img(x,y,0,c) + nsigma * cimg_rand(seed, x + x1, y + y1, c, -1,1));
-                if (val > vmax) {
-                    val = vmax;
-                } else if (val < vmin) {
-                    val = vmin;
+            cimg_pragma_openmp(parallel for cimg_openmp_if(img.size()>=2048))
+            cimg_forY(img, y) {
+                std::vector<unsigned int> keys(width);
+                std::vector<double> u(width);
+                gen.rowKeys(y + y1, &keys.front());
+                cimg_forC(img, c) {
+                    gen.uniform(&keys.front(), c, &u.front());
+                    T *ptr = img.data(0, y, 0, c);
+                    for (int x = 0; x < width; ++x) {
+                        // same as cimg_rand(seed, x + x1, y + y1, c, -1, 1)
+                        Tfloat val = (Tfloat)(ptr[x] + nsigma * (-1 + 2 * u[x]));
+                        if (val > vmax) {
+                            val = vmax;
+                        } else if (val < vmin) {
+                            val = vmin;
+                        }
+                        ptr[x] = (T)val;
+                    }
                 }
-                img(x,y,0,c) = (T)val;
             }
         } break;
         case 2 : { // Salt & Pepper noise
@@ -194,34 +221,80 @@ noise(CImg<T>&img, const double sigma, const unsigned int noise_type, unsigned i
                 m = 0;
                 M = cimg::type<T>::is_float()?(Tfloat)1:(Tfloat)cimg::type<T>::max();
             }
-            cimg_pragma_openmp(parallel for collapse(3) cimg_openmp_if(img.size()>=2048))
-            cimg_forXYC(img, x, y, c) {
-                if (cimg_rand(seed, x + x1, y1 + img.height() - y, c, 100) < nsigma) {
-                    img(x,y,0,c) = (T)(cimg_rand(seed, x + x1, y + y1, c)<0.5?M:m);
+            cimg_pragma_openmp(parallel for cimg_openmp_if(img.size()>=2048))
+            cimg_forY(img, y) {
+                // the pixels to change are selected using the values of row y1 + height - y
+                std::vector<unsigned int> keys(width);
+                std::vector<unsigned int> flipKeys(width);
+                std::vector<double> flip(width);
+                gen.rowKeys(y + y1, &keys.front());
+                gen.rowKeys(y1 + height - y, &flipKeys.front());
+                cimg_forC(img, c) {
+                    gen.uniform(&flipKeys.front(), c, &flip.front());
+                    T *ptr = img.data(0, y, 0, c);
+                    for (int x = 0; x < width; ++x) {
+                        if (100 * flip[x] < nsigma) {
+                            // same as cimg_rand(seed, x + x1, y + y1, c)
+                            const double u = OFX::Random::toUnit( OFX::Random::hash(keys[x] ^ c) );
+                            ptr[x] = (T)(u<0.5?M:m);
+                        }
+                    }
                 }
             }
         } break;
         case 3 : { // Poisson Noise
-            cimg_pragma_openmp(parallel for collapse(3) cimg_openmp_if(img.size()>=2048))
-            cimg_forXYC(img,x,y,c) {
-                img(x,y,0,c) = (T)cimg_prand(seed, x + x1, y + y1, c, img(x,y,0,c));
+            const OFX::Random::Generator gen1(seed + 1, x1, x1 + width);
+            cimg_pragma_openmp(parallel for cimg_openmp_if(img.size()>=2048))
+            cimg_forY(img, y) {
+                std::vector<unsigned int> keys(width);
+                std::vector<unsigned int> keys1(width);
+                std::vector<double> u(width);
+                std::vector<double> g(width);
+                gen.rowKeys(y + y1, &keys.front());
+                gen1.rowKeys(y + y1, &keys1.front());
+                cimg_forC(img, c) {
+                    T *ptr = img.data(0, y, 0, c);
+                    // the gaussian values are only used for large values
+                    bool large = false;
+                    for (int x = 0; x < width; ++x) {
+                        large |= ( (double)ptr[x] > 100 );
+                    }
+                    gen1.uniform(&keys1.front(), c, &u.front());
+                    if (large) {
+                        gen.gaussian(&keys.front(), y + y1, c, &g.front());
+                    }
+                    for (int x = 0; x < width; ++x) {
+                        ptr[x] = (T)OFX::Random::poisson(ptr[x], u[x], large ? g[x] : 0.);
+                    }
+                }
             }
         } break;
         case 4 : { // Rice noise
             const Tfloat sqrt2 = (Tfloat)std::sqrt(2.0);
-            cimg_pragma_openmp(parallel for collapse(3) cimg_openmp_if(img.size()>=2048))
-            cimg_forXYC(img, x, y, c) {
-                const Tfloat
-                val0 = (Tfloat)img(x,y)/sqrt2,
-                re = (Tfloat)(val0 + nsigma * cimg_grand(seed, x + x1, y + y1, c)),
-                im = (Tfloat)(val0 + nsigma * cimg_grand(seed, x + x1, y + y1, c));
-                Tfloat val = cimg::hypot(re,im);
-                if (val > vmax) {
-                    val = vmax;
-                } else if (val < vmin) {
-                    val = vmin;
+            cimg_pragma_openmp(parallel for cimg_openmp_if(img.size()>=2048))
+            cimg_forY(img, y) {
+                std::vector<unsigned int> keys(width);
+                std::vector<double> g(width);
+                gen.rowKeys(y + y1, &keys.front());
+                const T *ptr0 = img.data(0, y, 0, 0);
+                cimg_forC(img, c) {
+                    gen.gaussian(&keys.front(), y + y1, c, &g.front());
+                    T *ptr = img.data(0, y, 0, c);
+                    for (int x = 0; x < width; ++x) {
+                        // the real and imaginary parts use the same random value
+                        const Tfloat
+                        val0 = (Tfloat)ptr0[x]/sqrt2,
+                        re = (Tfloat)(val0 + nsigma * g[x]),
+                        im = re;
+                        Tfloat val = cimg::hypot(re,im);
+                        if (val > vmax) {
+                            val = vmax;
+                        } else if (val < vmin) {
+                            val = vmin;
+                        }
+                        ptr[x] = (T)val;
+                    }
                 }
-                img(x,y,0,c) = (T)val;
             }
         } break;
         default :
@@ -29,6 +29,7 @@
 #include <iostream>
 
 #include "ofxsTransform3x3.h"
+#include "ofxsTransform3x3Mipmap.h"
 #include "ofxsCoords.h"
 #include "ofxsThreadSuite.h"
 #include "ofxsGenerator.h"
@@ -70,8 +71,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "http://opticalenquiry.com/nuke/index.php?title=Card3D"
 
 #define kPluginIdentifier "net.sf.openfx.Card3D"
+// History:
+// version 1.0: initial version
+// version 1.1: add mipmap parameter, for faster downscaling
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kParamSrcClipChanged "srcClipChanged"
 
@@ -1553,12 +1557,12 @@ PosMatParam::changedParam(const InstanceChangedArgs &args,
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class Card3DPlugin
-    : public Transform3x3Plugin
+    : public Transform3x3MipmapPlugin
 {
 public:
     /** @brief ctor */
     Card3DPlugin(OfxImageEffectHandle handle)
-        : Transform3x3Plugin(handle, false, eTransform3x3ParamsTypeMotionBlur)
+        : Transform3x3MipmapPlugin(handle, false, eTransform3x3ParamsTypeMotionBlur)
         //, _transformAmount(NULL)
         , _interactive(NULL)
         , _srcClipChanged(NULL)
@@ -2295,6 +2299,7 @@ Card3DPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     }
 
     Transform3x3DescribeInContextEnd(desc, context, page, false, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur);
+    ofxsMipmapDescribeParams(desc, page);
 
     {
         BooleanParamDescriptor* param = desc.defineBooleanParam(kParamSrcClipChanged);
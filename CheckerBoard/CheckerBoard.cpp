@@ -29,6 +29,7 @@
 #include "ofxsMacros.h"
 #include "ofxsGenerator.h"
 #include "ofxsLut.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -46,8 +47,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "See also: http://opticalenquiry.com/nuke/index.php?title=Constant,_CheckerBoard,_ColorBars,_ColorWheel"
 
 #define kPluginIdentifier "net.sf.openfx.CheckerBoardPlugin"
+// History:
+// version 1.0: initial version
+// version 1.1: fill lines with block copies, compute one row of boxes per parity and copy the others
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -269,6 +273,10 @@ private:
         OfxPointD center;
         center.x = (_rod.x1 + _rod.x2) / 2;
         center.y = (_rod.y1 + _rod.y2) / 2;
+        const int width = procWindow.x2 - procWindow.x1;
+        // rows of boxes only depend on the parity of the box index: the first row of each parity
+        // is computed, the others are copies
+        const PIX *boxRowPix[2] = { NULL, NULL };
 
         // push pixels
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
@@ -280,26 +288,21 @@ private:
 
             // check if we are on the centerline
             if ( ( (center.y - _centerlineInfY) <= y ) && ( y < (center.y + _centerlineSupY) ) ) {
-                for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                    for (int c = 0; c < nComponents; ++c) {
-                        dstPix[c] = centerlineColor[c];
-                    }
-                    dstPix += nComponents;
-                }
+                ofxsFillPixels<PIX, nComponents>(dstPix, centerlineColor, width);
             } else {
                 // the closest line between boxes
                 double yline = center.y + _boxSize.y * std::floor( (y - center.y) / _boxSize.y + 0.5 );
                 // check if we are on a line
                 if ( ( (yline - _lineInfY) <= y ) && ( y < (yline + _lineSupY) ) ) {
-                    for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                        for (int c = 0; c < nComponents; ++c) {
-                            dstPix[c] = lineColor[c];
-                        }
-                        dstPix += nComponents;
-                    }
+                    ofxsFillPixels<PIX, nComponents>(dstPix, lineColor, width);
                 } else {
                     // draw boxes and vertical lines
-                  int ybox = (int)std::floor( (y - center.y) / _boxSize.y );
+                    int ybox = (int)std::floor( (y - center.y) / _boxSize.y );
+                    if (boxRowPix[ybox & 1]) {
+                        ofxsCopyPixels<PIX, nComponents>(dstPix, boxRowPix[ybox & 1], width);
+                        continue;
+                    }
+                    boxRowPix[ybox & 1] = dstPix;
                     PIX *c0 = (ybox & 1) ? color3 : color0;
                     PIX *c1 = (ybox & 1) ? color2 : color1;
 
@@ -29,6 +29,7 @@
 #include "ofxsGenerator.h"
 #include "ofxsLut.h"
 #include "ofxsCoords.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -46,8 +47,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "See also: http://opticalenquiry.com/nuke/index.php?title=Constant,_CheckerBoard,_ColorBars,_ColorWheel"
 
 #define kPluginIdentifier "net.sf.openfx.ColorBars"
+// History:
+// version 1.0: initial version
+// version 1.1: compute one row per band, copy the others
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -122,6 +126,9 @@ private:
     void multiThreadProcessImages(OfxRectI procWindow)
     {
         float ire[3];
+        // all rows within a band are identical: only the first one is computed, the others are copies
+        const PIX *bandRowPix = NULL;
+        int bandRow = -1;
 
         // push pixels
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
@@ -131,6 +138,13 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
             int yhd = (y - _rod.y1) * 1080 / (_rod.y2 - _rod.y1);
+            const int band = (yhd < 270) ? 0 : (yhd < 360) ? 1 : (yhd < 450) ? 2 : 3;
+            if ( bandRowPix && (band == bandRow) ) {
+                ofxsCopyPixels<PIX, nComponents>(dstPix, bandRowPix, procWindow.x2 - procWindow.x1);
+                continue;
+            }
+            bandRowPix = dstPix;
+            bandRow = band;
             for (int x = procWindow.x1; x < procWindow.x2; x++) {
                 int xhd = (x - _rod.x1) * 1920 / (_rod.x2 - _rod.x1);
                 if (yhd < 270) { // bottom row (pluge)
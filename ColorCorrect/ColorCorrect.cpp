@@ -22,6 +22,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <vector>
 #include <cfloat> // DBL_MAX
 
 #include "ofxsProcessing.H"
@@ -30,6 +31,7 @@
 #include "ofxsLut.h"
 #include "ofxsMacros.h"
 #include "ofxsThreadSuite.h"
+#include "ofxsFastMath.h"
 
 using namespace OFX;
 
@@ -51,8 +53,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
 // version 2.1: add range params
+// version 2.2: lookup tables for 8-bit and 16-bit images when channels are independent, fast pow approximation otherwise
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -173,6 +176,16 @@ struct ColorControlValues
     {
         r = g = b = a = v;
     }
+
+    bool operator==(const ColorControlValues &other) const
+    {
+        return r == other.r && g == other.g && b == other.b && a == other.a;
+    }
+
+    double operator[](int c) const
+    {
+        return c == 0 ? r : (c == 1 ? g : (c == 2 ? b : a));
+    }
 };
 
 struct ColorControlGroup
@@ -182,6 +195,11 @@ struct ColorControlGroup
     ColorControlValues gamma;
     ColorControlValues gain;
     ColorControlValues offset;
+
+    bool operator==(const ColorControlGroup &other) const
+    {
+        return saturation == other.saturation && contrast == other.contrast && gamma == other.gamma && gain == other.gain && offset == other.offset;
+    }
 };
 
 template<typename T>
@@ -218,6 +236,108 @@ luminance(T r,
     }
 }
 
+// luminance of n pixels given as planar arrays
+static void
+luminanceRow(const float *r,
+             const float *g,
+             const float *b,
+             float *l,
+             int n,
+             LuminanceMathEnum luminanceMath)
+{
+    switch (luminanceMath) {
+    case eLuminanceMathRec709:
+    default:
+        for (int i = 0; i < n; ++i) {
+            l[i] = Color::rgb709_to_y(r[i], g[i], b[i]);
+        }
+        break;
+    case eLuminanceMathRec2020:
+        for (int i = 0; i < n; ++i) {
+            l[i] = Color::rgb2020_to_y(r[i], g[i], b[i]);
+        }
+        break;
+    case eLuminanceMathACESAP0:
+        for (int i = 0; i < n; ++i) {
+            l[i] = Color::rgbACESAP0_to_y(r[i], g[i], b[i]);
+        }
+        break;
+    case eLuminanceMathACESAP1:
+        for (int i = 0; i < n; ++i) {
+            l[i] = Color::rgbACESAP1_to_y(r[i], g[i], b[i]);
+        }
+        break;
+    case eLuminanceMathCcir601:
+        for (int i = 0; i < n; ++i) {
+            l[i] = 0.2989f * r[i] + 0.5866f * g[i] + 0.1145f * b[i];
+        }
+        break;
+    case eLuminanceMathAverage:
+        for (int i = 0; i < n; ++i) {
+            l[i] = (r[i] + g[i] + b[i]) / 3;
+        }
+        break;
+    case eLuminanceMathMaximum:
+        for (int i = 0; i < n; ++i) {
+            l[i] = FastMath::fmax(FastMath::fmax(r[i], g[i]), b[i]);
+        }
+        break;
+    }
+}
+
+// Apply the corrections of a ColorControlGroup to n pixels given as planar
+// arrays (the row version of RGBAPixel::applyGroup), l is the luminance of the
+// pixels. The contrast and gamma are combined into a single power function:
+// for x > 0, pow(pow(x / 0.18, contrast) * 0.18, 1 / gamma) = scale * pow(x, contrast / gamma)
+// with scale = pow(0.18, (1 - contrast) / gamma), which is computed with the
+// fast pow approximation (relative error below 2e-6).
+static void
+applyGroupRow(float *p[4],
+              const float *l,
+              int n,
+              const ColorControlGroup &group,
+              const bool doProcess[4])
+{
+    for (int c = 0; c < 3; ++c) {
+        const float s = (float)group.saturation[c];
+        if ( doProcess[c] && (s != 1.f) ) {
+            float *v = p[c];
+            for (int i = 0; i < n; ++i) {
+                v[i] = (1.f - s) * l[i] + s * v[i];
+            }
+        }
+    }
+    for (int c = 0; c < 4; ++c) {
+        if (!doProcess[c]) {
+            continue;
+        }
+        float *v = p[c];
+        const double contrast = group.contrast[c];
+        const double gamma = group.gamma[c];
+        if (gamma == 0.) {
+            // pow(x, infinity)
+            for (int i = 0; i < n; ++i) {
+                if (v[i] > 0.f) {
+                    v[i] = (float)std::pow(std::pow(v[i] / 0.18, contrast) * 0.18, 1. / gamma);
+                }
+            }
+        } else if ( (contrast != 1.) || (gamma != 1.) ) {
+            const float exponent = (float)(contrast / gamma);
+            const float scale = contrast == 1. ? 1.f : (float)std::pow(0.18, (1. - contrast) / gamma);
+            for (int i = 0; i < n; ++i) {
+                v[i] = FastMath::select(v[i] > 0.f, scale * FastMath::fast_pow(v[i], exponent), v[i]);
+            }
+        }
+        const float gain = (float)group.gain[c];
+        const float offset = (float)group.offset[c];
+        if ( (gain != 1.f) || (offset != 0.f) ) {
+            for (int i = 0; i < n; ++i) {
+                v[i] = v[i] * gain + offset;
+            }
+        }
+    }
+}
+
 template<bool processR, bool processG, bool processB, bool processA>
 struct RGBAPixel
 {
@@ -268,6 +388,15 @@ struct RGBAPixel
         applyGroup(masterValues);
     }
 
+    void applyGroup(const ColorControlGroup& group)
+    {
+        applySaturation(group.saturation);
+        applyContrast(group.contrast);
+        applyGamma(group.gamma);
+        applyGain(group.gain);
+        applyOffset(group.offset);
+    }
+
 private:
     void applySaturation(const ColorControlValues &c)
     {
@@ -365,15 +494,6 @@ private:
             a = a + c.a;
         }
     }
-
-    void applyGroup(const ColorControlGroup& group)
-    {
-        applySaturation(group.saturation);
-        applyContrast(group.contrast);
-        applyGamma(group.gamma);
-        applyGain(group.gain);
-        applyOffset(group.offset);
-    }
 };
 
 class ColorCorrecterBase
@@ -411,6 +531,7 @@ public:
         , _processB(false)
         , _processA(false)
         , _luminanceMath(eLuminanceMathRec709)
+        , _useTables(false)
     {
     }
 
@@ -448,6 +569,7 @@ public:
         _processA = processA;
     }
 
+    void buildTables(int maxValue, const OfxRectI &renderWindow);
 
 protected:
     // clamp for integer PIX types
@@ -472,6 +594,8 @@ protected:
     ColorControlGroup _midtoneValues;
     ColorControlGroup _highlightsValues;
     LuminanceMathEnum _luminanceMath;
+    bool _useTables;
+    std::vector<float> _table[4];
 };
 
 // floats don't clamp except if _clampBlack or _clampWhite
@@ -505,6 +629,45 @@ ColorCorrecterBase::clamp<float>(double value,
     return value;
 }
 
+// Build the lookup tables of 8-bit and 16-bit images, which give the corrected
+// value of each code value. This is only possible if each channel is corrected
+// independently of the others: the saturation is 1, and the shadows, midtones
+// and highlights corrections are the same, so that the result does not depend
+// on the luminance. The tables cannot be used on premultiplied images, and
+// they are only worth it if the render window has more pixels than a table
+// has entries.
+void
+ColorCorrecterBase::buildTables(int maxValue,
+                                const OfxRectI &renderWindow)
+{
+    _useTables = ( !_premult &&
+                   (double)(renderWindow.x2 - renderWindow.x1) * (renderWindow.y2 - renderWindow.y1) > maxValue + 1 &&
+                   _shadowValues == _midtoneValues && _shadowValues == _highlightsValues &&
+                   _masterValues.saturation[0] == 1. && _masterValues.saturation[1] == 1. && _masterValues.saturation[2] == 1. &&
+                   _shadowValues.saturation[0] == 1. && _shadowValues.saturation[1] == 1. && _shadowValues.saturation[2] == 1. );
+    if (!_useTables) {
+        return;
+    }
+    const bool doProcess[4] = { _processR, _processG, _processB, _processA };
+    for (int c = 0; c < 4; ++c) {
+        if (doProcess[c]) {
+            _table[c].resize(maxValue + 1);
+        }
+    }
+    for (int i = 0; i <= maxValue; ++i) {
+        const double v = i / (double)maxValue;
+        RGBAPixel<true, true, true, true> p(v, v, v, v, _luminanceMath);
+        p.applyGroup(_shadowValues);
+        p.applyGroup(_masterValues);
+        const double out[4] = { p.r, p.g, p.b, p.a };
+        for (int c = 0; c < 4; ++c) {
+            if (doProcess[c]) {
+                _table[c][i] = (float)clamp<float>(out[c], 1);
+            }
+        }
+    }
+}
+
 // template to do the processing.
 // nbValues is the number of values in the LUT minus 1. For integer types, it should be the same as
 // maxValue
@@ -628,26 +791,50 @@ private:
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert( !processA || (nComponents == 1 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
+        assert(!_useTables || maxValue != 1);
+        const bool doProcess[4] = { processR, processG, processB, processA };
         float unpPix[4];
         float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        // the row, the corrected row of a tone range, the sum of the tone ranges, the luminance and the tone range weights
+        std::vector<float> rowBuf(15 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
+        float *tmp[4] = { &rowBuf[4 * n], &rowBuf[5 * n], &rowBuf[6 * n], &rowBuf[7 * n] };
+        float *sum[4] = { &rowBuf[8 * n], &rowBuf[9 * n], &rowBuf[10 * n], &rowBuf[11 * n] };
+        float *l = &rowBuf[12 * n];
+        float *sScale = &rowBuf[13 * n];
+        float *hScale = &rowBuf[14 * n];
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            // unpremultiply the row into one array per channel, and correct
+            // the processed channels, either with the lookup tables or row by row
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
                 ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-                double t_r = unpPix[0];
-                double t_g = unpPix[1];
-                double t_b = unpPix[2];
-                double t_a = unpPix[3];
-                colorTransform<processR, processG, processB, processA>(&t_r, &t_g, &t_b, &t_a);
-                tmpPix[0] = (float)t_r;
-                tmpPix[1] = (float)t_g;
-                tmpPix[2] = (float)t_b;
-                tmpPix[3] = (float)t_a;
+                for (int c = 0; c < 4; ++c) {
+                    planes[c][i] = unpPix[c];
+                }
+                if (_useTables) {
+                    for (int c = 0; c < nComponents; ++c) {
+                        if (doProcess[c]) {
+                            planes[c][i] = _table[c][srcPix ? (int)srcPix[c] : 0];
+                        }
+                    }
+                }
+            }
+            if (!_useTables) {
+                colorTransformRow(planes, tmp, sum, l, sScale, hScale, n, doProcess);
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
+                }
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // copy back original values from unprocessed channels
                 if (nComponents == 1) {
@@ -674,33 +861,80 @@ private:
         }
     } // process
 
-    template<bool processR, bool processG, bool processB, bool processA>
-    void colorTransform(double *r,
-                        double *g,
-                        double *b,
-                        double *a)
+    // the row version of RGBAPixel::applySMH followed by clamping
+    void colorTransformRow(float *planes[4],
+                           float *tmp[4],
+                           float *sum[4],
+                           float *l,
+                           float *sScale,
+                           float *hScale,
+                           int n,
+                           const bool doProcess[4])
     {
-        double l = luminance(*r, *g, *b, _luminanceMath);
-        double s_scale = interpolate(0, l);
-        double h_scale = interpolate(1, l);
-        double m_scale = 1.f - s_scale - h_scale;
-
-        RGBAPixel<processR, processG, processB, processA> p(*r, *g, *b, *a, _luminanceMath);
-        p.applySMH(_shadowValues, s_scale,
-                   _midtoneValues, m_scale,
-                   _highlightsValues, h_scale,
-                   _masterValues);
-        if (processR) {
-            *r = clamp<float>(p.r, 1);
-        }
-        if (processG) {
-            *g = clamp<float>(p.g, 1);
+        luminanceRow(planes[0], planes[1], planes[2], l, n, _luminanceMath);
+        if ( (_shadowValues == _midtoneValues) && (_shadowValues == _highlightsValues) ) {
+            // the tone range weights sum to 1
+            applyGroupRow(planes, l, n, _shadowValues, doProcess);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                sScale[i] = interpolate(0, l[i]);
+                hScale[i] = interpolate(1, l[i]);
+            }
+            for (int range = 0; range < 3; ++range) {
+                for (int c = 0; c < 4; ++c) {
+                    if (doProcess[c]) {
+                        std::copy(planes[c], planes[c] + n, tmp[c]);
+                    }
+                }
+                applyGroupRow(tmp, l, n, range == 0 ? _shadowValues : (range == 1 ? _midtoneValues : _highlightsValues), doProcess);
+                for (int c = 0; c < 4; ++c) {
+                    if (!doProcess[c]) {
+                        continue;
+                    }
+                    const float *v = tmp[c];
+                    float *s = sum[c];
+                    if (range == 0) {
+                        for (int i = 0; i < n; ++i) {
+                            s[i] = v[i] * sScale[i];
+                        }
+                    } else if (range == 1) {
+                        for (int i = 0; i < n; ++i) {
+                            s[i] += v[i] * (1.f - sScale[i] - hScale[i]);
+                        }
+                    } else {
+                        for (int i = 0; i < n; ++i) {
+                            s[i] += v[i] * hScale[i];
+                        }
+                    }
+                }
+            }
+            for (int c = 0; c < 4; ++c) {
+                if (doProcess[c]) {
+                    std::copy(sum[c], sum[c] + n, planes[c]);
+                }
+            }
         }
-        if (processB) {
-            *b = clamp<float>(p.b, 1);
+        if ( (doProcess[0] && _masterValues.saturation.r != 1.) ||
+             (doProcess[1] && _masterValues.saturation.g != 1.) ||
+             (doProcess[2] && _masterValues.saturation.b != 1.) ) {
+            luminanceRow(planes[0], planes[1], planes[2], l, n, _luminanceMath);
         }
-        if (processA) {
-            *a = clamp<float>(p.a, 1);
+        applyGroupRow(planes, l, n, _masterValues, doProcess);
+        for (int c = 0; c < 4; ++c) {
+            if (!doProcess[c]) {
+                continue;
+            }
+            float *v = planes[c];
+            if (_clampBlack) {
+                for (int i = 0; i < n; ++i) {
+                    v[i] = FastMath::fmax(v[i], 0.f);
+                }
+            }
+            if (_clampWhite) {
+                for (int i = 0; i < n; ++i) {
+                    v[i] = FastMath::fmin(v[i], 1.f);
+                }
+            }
         }
     }
 
@@ -1049,6 +1283,9 @@ ColorCorrectPlugin::setupAndProcess(ColorCorrecterBase &processor,
 
     processor.setColorControlValues(masterValues, shadowValues, midtoneValues, highlightValues, luminanceMath, premult, premultChannel, mix,
                                     processR, processG, processB, processA);
+    if ( (dstBitDepth == eBitDepthUByte) || (dstBitDepth == eBitDepthUShort) ) {
+        processor.buildTables(dstBitDepth == eBitDepthUByte ? 255 : 65535, args.renderWindow);
+    }
     processor.process();
 } // ColorCorrectPlugin::setupAndProcess
 
@@ -21,11 +21,13 @@
  */
 
 #include <cmath>
+#include <vector>
 
 #include "ofxsProcessing.H"
 #include "ofxsMaskMix.h"
 #include "ofxsMacros.h"
 #include "ofxsLut.h"
+#include "ofxsFastMath.h"
 
 using namespace OFX;
 
@@ -145,8 +147,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // history:
 // 1.0 initial version
 // 2.0 named plugins more consistently, add a few conversions
+// 2.1 process rows one channel at a time, add fastTransfer parameter
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -167,6 +170,15 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 
 #define kParamPremultChanged "premultChanged"
 
+#define kParamFastTransfer "fastTransfer"
+#define kParamFastTransferLabel "Fast Transfer Function"
+#define kParamFastTransferHint \
+    "Use a fast approximation of the sRGB or Rec.709 transfer function instead of the exact function. " \
+    "The absolute error is below 2.5e-7 for values between 0 and 1, and the relative error is below 1.5e-6 for values up to 64, " \
+    "which is well below the quantization step of 16-bit images. " \
+    "Uncheck to compare with the exact transfer function."
+#define kParamFastTransferDefault false
+
 
 enum ColorTransformEnum
 {
@@ -212,6 +224,291 @@ enum ColorTransformEnum
 
 #define fromRGB(e) ( !toRGB(e) && ( (e) != eColorTransformXYZToLab ) && ( (e) != eColorTransformLabToXYZ ) && ( (e) != eColorTransformXYZToxyY ) && ( (e) != eColorTransformxyYToXYZ ) )
 
+enum TransferEnum
+{
+    eTransferNone,
+    eTransferSRGB,
+    eTransferRec709,
+};
+
+// transfer function (OETF) applied to RGB before the conversion
+static TransferEnum
+preTransfer(ColorTransformEnum e)
+{
+    switch (e) {
+    case eColorTransformRGBToYCbCr601:
+    case eColorTransformRGBToYPbPr601:
+    case eColorTransformRGBToYUV601:
+
+        return eTransferSRGB;
+    case eColorTransformRGBToYCbCr709:
+    case eColorTransformRGBToYPbPr709:
+    case eColorTransformRGBToYUV709:
+
+        return eTransferRec709;
+    default:
+
+        return eTransferNone;
+    }
+}
+
+// transfer function (EOTF) applied to RGB after the conversion
+static TransferEnum
+postTransfer(ColorTransformEnum e)
+{
+    switch (e) {
+    case eColorTransformYCbCrToRGB601:
+    case eColorTransformYPbPrToRGB601:
+    case eColorTransformYUVToRGB601:
+
+        return eTransferSRGB;
+    case eColorTransformYCbCrToRGB709:
+    case eColorTransformYPbPrToRGB709:
+    case eColorTransformYUVToRGB709:
+
+        return eTransferRec709;
+    default:
+
+        return eTransferNone;
+    }
+}
+
+#define hasTransfer(e) ( preTransfer(e) != eTransferNone || postTransfer(e) != eTransferNone )
+
+// apply the OETF to n contiguous values
+static void
+applyOETF(TransferEnum transfer,
+          bool fast,
+          float *v,
+          int n)
+{
+    switch (transfer) {
+    case eTransferNone:
+        break;
+    case eTransferSRGB:
+        if (fast) {
+            FastMath::to_func_srgb(v, n);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                v[i] = Color::to_func_srgb(v[i]);
+            }
+        }
+        break;
+    case eTransferRec709:
+        if (fast) {
+            FastMath::to_func_Rec709(v, n);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                v[i] = Color::to_func_Rec709(v[i]);
+            }
+        }
+        break;
+    }
+}
+
+// apply the EOTF to n contiguous values
+static void
+applyEOTF(TransferEnum transfer,
+          bool fast,
+          float *v,
+          int n)
+{
+    switch (transfer) {
+    case eTransferNone:
+        break;
+    case eTransferSRGB:
+        if (fast) {
+            FastMath::from_func_srgb(v, n);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                v[i] = Color::from_func_srgb(v[i]);
+            }
+        }
+        break;
+    case eTransferRec709:
+        if (fast) {
+            FastMath::from_func_Rec709(v, n);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                v[i] = Color::from_func_Rec709(v[i]);
+            }
+        }
+        break;
+    }
+}
+
+// the color conversion itself, without the transfer functions
+template <ColorTransformEnum transform>
+inline void
+colorTransformPix(float in[3],
+                  float out[3])
+{
+    switch (transform) {
+    case eColorTransformRGBToHSV:
+        // Nuke 5-8 version used sRGB colors to compute HSV
+        // However, as Alvin Ray Smith said in his paper,
+        // "We shall assume that an RGB monitor is a linear device"
+        // We thus use linear values (same as Nuke 9 and later).
+        // Fixes https://github.com/NatronGitHub/Natron/issues/286
+        // Reference:
+        // "Color gamut transform pairs", Alvy Ray Smith, Proceeding SIGGRAPH '78
+        // https://doi.org/10.1145/800248.807361
+        // http://www.icst.pku.edu.cn/F/course/ImageProcessing/2018/resource/Color78.pdf
+        //in[0] = Color::to_func_srgb(in[0]);
+        //in[1] = Color::to_func_srgb(in[1]);
+        //in[2] = Color::to_func_srgb(in[2]);
+        Color::rgb_to_hsv(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformHSVToRGB:
+        Color::hsv_to_rgb(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        // Use linear color values, see comment above
+        //out[0] = Color::from_func_srgb(out[0]);
+        //out[1] = Color::from_func_srgb(out[1]);
+        //out[2] = Color::from_func_srgb(out[2]);
+        break;
+
+    case eColorTransformRGBToHSL:
+        // Use linear color values, see comment above
+        //in[0] = Color::to_func_srgb(in[0]);
+        //in[1] = Color::to_func_srgb(in[1]);
+        //in[2] = Color::to_func_srgb(in[2]);
+        Color::rgb_to_hsl(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformHSLToRGB:
+        Color::hsl_to_rgb(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        // Use linear color values, see comment above
+        //out[0] = Color::from_func_srgb(out[0]);
+        //out[1] = Color::from_func_srgb(out[1]);
+        //out[2] = Color::from_func_srgb(out[2]);
+        break;
+
+    case eColorTransformRGBToHSI:
+        // Use linear color values, see comment above
+        //in[0] = Color::to_func_srgb(in[0]);
+        //in[1] = Color::to_func_srgb(in[1]);
+        //in[2] = Color::to_func_srgb(in[2]);
+        Color::rgb_to_hsi(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformHSIToRGB:
+        Color::hsi_to_rgb(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        // Use linear color values, see comment above
+        //out[0] = Color::from_func_srgb(out[0]);
+        //out[1] = Color::from_func_srgb(out[1]);
+        //out[2] = Color::from_func_srgb(out[2]);
+        break;
+
+
+    case eColorTransformRGBToYCbCr601:
+        Color::rgb_to_ycbcr601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYCbCrToRGB601:
+        Color::ycbcr_to_rgb601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGBToYCbCr709:
+        Color::rgb_to_ycbcr709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYCbCrToRGB709:
+        Color::ycbcr_to_rgb709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGBToYPbPr601:
+        Color::rgb_to_ypbpr601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYPbPrToRGB601:
+        Color::ypbpr_to_rgb601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGBToYPbPr709:
+        Color::rgb_to_ypbpr709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYPbPrToRGB709:
+        Color::ypbpr_to_rgb709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGBToYUV601:
+        Color::rgb_to_yuv601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYUVToRGB601:
+        Color::yuv_to_rgb601(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGBToYUV709:
+        Color::rgb_to_yuv709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformYUVToRGB709:
+        Color::yuv_to_rgb709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGB709ToXYZ:
+        Color::rgb709_to_xyz(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformXYZToRGB709:
+        Color::xyz_to_rgb709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformRGB709ToLab:
+        Color::rgb709_to_lab(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        out[0] /= 100;
+        out[1] /= 100;
+        out[2] /= 100;
+        break;
+
+    case eColorTransformLabToRGB709:
+        in[0] *= 100;
+        in[1] *= 100;
+        in[2] *= 100;
+        Color::lab_to_rgb709(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformXYZToLab:
+        Color::xyz_to_lab(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        out[0] /= 100;
+        out[1] /= 100;
+        out[2] /= 100;
+        break;
+
+    case eColorTransformLabToXYZ:
+        in[0] *= 100;
+        in[1] *= 100;
+        in[2] *= 100;
+        Color::lab_to_xyz(in[0], in[1], in[2], &out[0], &out[1], &out[2]);
+        break;
+
+    case eColorTransformXYZToxyY: {
+        float X = in[0];
+        float Y = in[1];
+        float Z = in[2];
+        float XYZ = X + Y + Z;
+        float invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
+        out[0] = X * invXYZ;
+        out[1] = Y * invXYZ;
+        out[2] = Y;
+        break;
+    }
+    case eColorTransformxyYToXYZ: {
+        float x = in[0];
+        float y = in[1];
+        float Y = in[2];
+        float invy = (y <= 0) ? 0. : (1 / y);
+        out[0] = x * Y * invy;
+        out[1] = Y;
+        out[2] = (1 - x - y) * Y * invy;
+        break;
+    }
+    } // switch
+}
+
 class ColorTransformProcessorBase
     : public ImageProcessor
 {
@@ -219,6 +516,7 @@ protected:
     const Image *_srcImg;
     bool _premult;
     int _premultChannel;
+    bool _fastTransfer;
     double _mix;
 
 public:
@@ -228,6 +526,7 @@ public:
         , _srcImg(NULL)
         , _premult(false)
         , _premultChannel(3)
+        , _fastTransfer(false)
         , _mix(1.)
     {
     }
@@ -235,10 +534,12 @@ public:
     void setSrcImg(const Image *v) {_srcImg = v; }
 
     void setValues(bool premult,
-                   int premultChannel)
+                   int premultChannel,
+                   bool fastTransfer)
     {
         _premult = premult;
         _premultChannel = premultChannel;
+        _fastTransfer = fastTransfer;
     }
 
 private:
@@ -263,218 +564,55 @@ public:
         float tmpPix[4];
         const bool dounpremult = _premult && fromRGB(transform);
         const bool dopremult = _premult && toRGB(transform);
+        const int n = procWindow.x2 - procWindow.x1;
+        // the row is processed one channel at a time, so that the transfer
+        // functions are applied on contiguous arrays
+        std::vector<float> rowBuf(4 * n);
+        float *r = &rowBuf[0];
+        float *g = r + n;
+        float *b = g + n;
+        float *a = b + n;
 
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, dounpremult, _premultChannel);
+                r[i] = unpPix[0];
+                g[i] = unpPix[1];
+                b[i] = unpPix[2];
+                a[i] = unpPix[3];
+            }
+            if (preTransfer(transform) != eTransferNone) {
+                applyOETF(preTransfer(transform), _fastTransfer, r, n);
+                applyOETF(preTransfer(transform), _fastTransfer, g, n);
+                applyOETF(preTransfer(transform), _fastTransfer, b, n);
+            }
+            for (int i = 0; i < n; ++i) {
+                float in[3] = { r[i], g[i], b[i] };
+                float out[3];
+                colorTransformPix<transform>(in, out);
+                r[i] = out[0];
+                g[i] = out[1];
+                b[i] = out[2];
+            }
+            if (postTransfer(transform) != eTransferNone) {
+                applyEOTF(postTransfer(transform), _fastTransfer, r, n);
+                applyEOTF(postTransfer(transform), _fastTransfer, g, n);
+                applyEOTF(postTransfer(transform), _fastTransfer, b, n);
+            }
+
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, dounpremult, _premultChannel);
-                switch (transform) {
-                case eColorTransformRGBToHSV:
-                    // Nuke 5-8 version used sRGB colors to compute HSV
-                    // However, as Alvin Ray Smith said in his paper,
-                    // "We shall assume that an RGB monitor is a linear device"
-                    // We thus use linear values (same as Nuke 9 and later).
-                    // Fixes https://github.com/NatronGitHub/Natron/issues/286
-                    // Reference:
-                    // "Color gamut transform pairs", Alvy Ray Smith, Proceeding SIGGRAPH '78
-                    // https://doi.org/10.1145/800248.807361
-                    // http://www.icst.pku.edu.cn/F/course/ImageProcessing/2018/resource/Color78.pdf
-                    //unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    //unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    //unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_hsv(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformHSVToRGB:
-                    Color::hsv_to_rgb(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    // Use linear color values, see comment above
-                    //tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    //tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    //tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToHSL:
-                    // Use linear color values, see comment above
-                    //unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    //unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    //unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_hsl(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformHSLToRGB:
-                    Color::hsl_to_rgb(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    // Use linear color values, see comment above
-                    //tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    //tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    //tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToHSI:
-                    // Use linear color values, see comment above
-                    //unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    //unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    //unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_hsi(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformHSIToRGB:
-                    Color::hsi_to_rgb(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    // Use linear color values, see comment above
-                    //tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    //tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    //tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-
-                case eColorTransformRGBToYCbCr601:
-                    unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_ycbcr601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYCbCrToRGB601:
-                    Color::ycbcr_to_rgb601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToYCbCr709:
-                    unpPix[0] = Color::to_func_Rec709(unpPix[0]);
-                    unpPix[1] = Color::to_func_Rec709(unpPix[1]);
-                    unpPix[2] = Color::to_func_Rec709(unpPix[2]);
-                    Color::rgb_to_ycbcr709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYCbCrToRGB709:
-                    Color::ycbcr_to_rgb709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_Rec709(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_Rec709(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_Rec709(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToYPbPr601:
-                    unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_ypbpr601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYPbPrToRGB601:
-                    Color::ypbpr_to_rgb601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToYPbPr709:
-                    unpPix[0] = Color::to_func_Rec709(unpPix[0]);
-                    unpPix[1] = Color::to_func_Rec709(unpPix[1]);
-                    unpPix[2] = Color::to_func_Rec709(unpPix[2]);
-                    Color::rgb_to_ypbpr709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYPbPrToRGB709:
-                    Color::ypbpr_to_rgb709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_Rec709(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_Rec709(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_Rec709(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToYUV601:
-                    unpPix[0] = Color::to_func_srgb(unpPix[0]);
-                    unpPix[1] = Color::to_func_srgb(unpPix[1]);
-                    unpPix[2] = Color::to_func_srgb(unpPix[2]);
-                    Color::rgb_to_yuv601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYUVToRGB601:
-                    Color::yuv_to_rgb601(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_srgb(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_srgb(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_srgb(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGBToYUV709:
-                    unpPix[0] = Color::to_func_Rec709(unpPix[0]);
-                    unpPix[1] = Color::to_func_Rec709(unpPix[1]);
-                    unpPix[2] = Color::to_func_Rec709(unpPix[2]);
-                    Color::rgb_to_yuv709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformYUVToRGB709:
-                    Color::yuv_to_rgb709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] = Color::from_func_Rec709(tmpPix[0]);
-                    tmpPix[1] = Color::from_func_Rec709(tmpPix[1]);
-                    tmpPix[2] = Color::from_func_Rec709(tmpPix[2]);
-                    break;
-
-                case eColorTransformRGB709ToXYZ:
-                    Color::rgb709_to_xyz(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformXYZToRGB709:
-                    Color::xyz_to_rgb709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformRGB709ToLab:
-                    Color::rgb709_to_lab(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] /= 100;
-                    tmpPix[1] /= 100;
-                    tmpPix[2] /= 100;
-                    break;
-
-                case eColorTransformLabToRGB709:
-                    unpPix[0] *= 100;
-                    unpPix[1] *= 100;
-                    unpPix[2] *= 100;
-                    Color::lab_to_rgb709(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformXYZToLab:
-                    Color::xyz_to_lab(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    tmpPix[0] /= 100;
-                    tmpPix[1] /= 100;
-                    tmpPix[2] /= 100;
-                    break;
-
-                case eColorTransformLabToXYZ:
-                    unpPix[0] *= 100;
-                    unpPix[1] *= 100;
-                    unpPix[2] *= 100;
-                    Color::lab_to_xyz(unpPix[0], unpPix[1], unpPix[2], &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                    break;
-
-                case eColorTransformXYZToxyY: {
-                    float X = unpPix[0];
-                    float Y = unpPix[1];
-                    float Z = unpPix[2];
-                    float XYZ = X + Y + Z;
-                    float invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
-                    tmpPix[0] = X * invXYZ;
-                    tmpPix[1] = Y * invXYZ;
-                    tmpPix[2] = Y;
-                    break;
-                }
-                case eColorTransformxyYToXYZ: {
-                    float x = unpPix[0];
-                    float y = unpPix[1];
-                    float Y = unpPix[2];
-                    float invy = (y <= 0) ? 0. : (1 / y);
-                    tmpPix[0] = x * Y * invy;
-                    tmpPix[1] = Y;
-                    tmpPix[2] = (1 - x - y) * Y * invy;
-                    break;
-                }
-                } // switch
-                tmpPix[3] = unpPix[3];
+                tmpPix[0] = r[i];
+                tmpPix[1] = g[i];
+                tmpPix[2] = b[i];
+                tmpPix[3] = a[i];
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, dopremult, _premultChannel, x, y, srcPix, /*doMasking=*/ false, /*maskImg=*/ NULL, /*mix=*/ 1.f, /*maskInvert=*/ false, dstPix);
                 // increment the dst pixel
                 dstPix += nComponents;
@@ -499,6 +637,7 @@ public:
         , _premult(NULL)
         , _premultChannel(NULL)
         , _premultChanged(NULL)
+        , _fastTransfer(NULL)
     {
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
         assert( _dstClip && (!_dstClip->isConnected() || _dstClip->getPixelComponents() == ePixelComponentRGB ||
@@ -514,6 +653,10 @@ public:
             _premultChanged = fetchBooleanParam(kParamPremultChanged);
             assert(_premultChanged);
         }
+        if ( hasTransfer(transform) ) {
+            _fastTransfer = fetchBooleanParam(kParamFastTransfer);
+            assert(_fastTransfer);
+        }
     }
 
 private:
@@ -537,6 +680,7 @@ private:
     BooleanParam* _premult;
     ChoiceParam* _premultChannel;
     BooleanParam* _premultChanged; // set to true the first time the user connects src
+    BooleanParam* _fastTransfer;
 };
 
 
@@ -599,7 +743,12 @@ ColorTransformPlugin<transform>::setupAndProcess(ColorTransformProcessorBase &pr
         _premultChannel->getValueAtTime(args.time, premultChannel);
     }
 
-    processor.setValues(premult, premultChannel);
+    bool fastTransfer = false;
+    if (_fastTransfer) {
+        _fastTransfer->getValueAtTime(args.time, fastTransfer);
+    }
+
+    processor.setValues(premult, premultChannel, fastTransfer);
     processor.process();
 } // >::setupAndProcess
 
@@ -961,6 +1110,17 @@ ColorTransformPluginFactory<transform>::describeInContext(ImageEffectDescriptor
                 page->addChild(*param);
             }
         }
+
+        if ( hasTransfer(transform) ) {
+            BooleanParamDescriptor* param = desc.defineBooleanParam(kParamFastTransfer);
+            param->setLabel(kParamFastTransferLabel);
+            param->setHint(kParamFastTransferHint);
+            param->setDefault(kParamFastTransferDefault);
+            param->setAnimates(false);
+            if (page) {
+                page->addChild(*param);
+            }
+        }
     }
 } // >::describeInContext
 
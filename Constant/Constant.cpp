@@ -28,6 +28,7 @@
 #include "ofxsMacros.h"
 #include "ofxsGenerator.h"
 #include "ofxsLut.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -43,8 +44,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginSolidName "SolidOFX"
 #define kPluginSolidDescription "Generate an image with a constant opaque color."
 #define kPluginSolidIdentifier "net.sf.openfx.Solid"
+// History:
+// version 1.0: initial version
+// version 1.1: fill rows with block copies
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -163,12 +167,7 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                for (int c = 0; c < nComponents; ++c) {
-                    dstPix[c] = color[c];
-                }
-                dstPix += nComponents;
-            }
+            ofxsFillPixels<PIX, nComponents>(dstPix, color, procWindow.x2 - procWindow.x1);
         }
     }
 };
@@ -55,6 +55,7 @@
 
 #include "ofxsOGLTextRenderer.h"
 #include "ofxsTransform3x3.h"
+#include "ofxsTransform3x3Mipmap.h"
 #include "ofxsThreadSuite.h"
 
 using namespace OFX;
@@ -98,8 +99,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 
 #define kPluginIdentifier "net.sf.openfx.CornerPinPlugin"
 #define kPluginMaskedIdentifier "net.sf.openfx.CornerPinMaskedPlugin"
+// History:
+// version 1.0: initial version
+// version 1.1: add mipmap parameter, for faster downscaling
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define POINT_SIZE 5
 #define POINT_TOLERANCE 6
@@ -183,13 +187,13 @@ static bool gHostSupportsDefaultCoordinateSystem = true; // for kParamDefaultsNo
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class CornerPinPlugin
-    : public Transform3x3Plugin
+    : public Transform3x3MipmapPlugin
 {
 public:
     /** @brief ctor */
     CornerPinPlugin(OfxImageEffectHandle handle,
                     bool masked)
-        : Transform3x3Plugin(handle, masked, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur)
+        : Transform3x3MipmapPlugin(handle, masked, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur)
         , _transformAmount(NULL)
         , _extraMatrixRow1(NULL)
         , _extraMatrixRow2(NULL)
@@ -1313,6 +1317,7 @@ CornerPinPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     CornerPinPluginDescribeInContext(desc, context, page);
 
     Transform3x3DescribeInContextEnd(desc, context, page, false, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur);
+    ofxsMipmapDescribeParams(desc, page);
 
     // srcClipChanged
     {
@@ -1356,6 +1361,7 @@ CornerPinMaskedPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     CornerPinPluginDescribeInContext(desc, context, page);
 
     Transform3x3DescribeInContextEnd(desc, context, page, true, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur);
+    ofxsMipmapDescribeParams(desc, page);
 
     // srcClipChanged
     {
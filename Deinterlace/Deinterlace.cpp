@@ -29,6 +29,7 @@
 #include "ofxsMultiThread.h"
 #include "ofxsProcessing.H"
 #include "ofxsMacros.h"
+#include "ofxsCoords.h"
 
 using namespace OFX;
 
@@ -49,15 +50,20 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 
 #define kPluginIdentifier    "net.sf.openfx.Deinterlace"
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
-#define kSupportsTiles 0
+#define kSupportsTiles 1
 #define kSupportsMultiResolution 0
 #define kSupportsRenderScale 1 // are images still fielded at any renderscale?
 #define kSupportsMultipleClipPARs false
 #define kSupportsMultipleClipDepths false
 #define kRenderThreadSafety eRenderFullySafe
 
+#define kYadifVectorized 1 // use the branch-free filter_line (which can be vectorized) rather than filter_line_c
+#define kYadifChunkSize 256 // number of components processed at once by filter_line
+#define kYadifMarginX 3 // the spatial check reads up to x-3 and x+3
+#define kYadifMarginY 2 // the spatial interlacing check reads up to y-2 and y+2
+
 #define kParamMode "mode"
 #define kParamModeLabel "Deinterlacing Mode"
 #define kParamModeHint "Choice of the deinterlacing mode/algorithm"
@@ -148,6 +154,9 @@ private:
     /* override is identity */
     virtual bool isIdentity(const IsIdentityArguments &args, Clip * &identityClip, double &identityTime, int& view, std::string& plane) OVERRIDE FINAL;
 
+    // override the roi call
+    virtual void getRegionsOfInterest(const RegionsOfInterestArguments &args, RegionOfInterestSetter &rois) OVERRIDE FINAL;
+
     /** Override the get frames needed action */
     virtual void getFramesNeeded(const FramesNeededArguments &args, FramesNeededSetter &frames) OVERRIDE FINAL;
 
@@ -301,39 +310,163 @@ filter_line_c(Comp *dst1,
     FILTER(0, w, 1)
 }
 
-#define MAX_ALIGN 8
+// branch-free selection. For float, the selection is done on the bit
+// patterns, else the compiler may not if-convert the loop, since floating-point
+// operations may trap.
+inline int
+yadif_select(bool m, int a, int b) { return m ? a : b; }
+
+inline float
+yadif_select(bool m, float a, float b)
+{
+    unsigned int ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    const unsigned int mask = -(unsigned int)m;
+    ia = (ia & mask) | (ib & ~mask);
+    std::memcpy(&a, &ia, sizeof(float));
+    return a;
+}
+
+template<int ch, int j, typename Comp, typename Diff>
+inline Diff
+spatial_score_at(const Comp *curm,
+                 const Comp *curp)
+{
+    return FFABS(curm[ch * ( -1 + j )] - curp[ch * ( -1 - j )])
+           + FFABS(curm[ch * j] - curp[-ch * j])
+           + FFABS(curm[ch * ( 1 + j )] - curp[ch * ( 1 - j )]);
+}
+
+/* Same as filter_line_c, but processes all channels of the line at once (n is
+ * the number of components, i.e. the number of pixels times ch), and the CHECK
+ * chain is replaced by selects. There are no branches in the loop body, so
+ * that compilers can vectorize it for 8-bit, 16-bit and float images. The
+ * result is bit-exact with filter_line_c. */
+template<int ch, typename Comp, typename Diff, bool spatial_check>
+inline void
+filter_line_mode(Comp *dst,
+                 const Comp *prev,
+                 const Comp *cur,
+                 const Comp *next,
+                 int n,
+                 int prefs,
+                 int mrefs,
+                 int parity)
+{
+    const Comp *prev2 = parity ? prev : cur;
+    const Comp *next2 = parity ? cur  : next;
+    // the results are first written to a local buffer, which cannot alias the
+    // source images: this avoids run-time aliasing checks in the vectorized loop
+    Comp out[kYadifChunkSize];
+
+    for (int x0 = 0; x0 < n; x0 += kYadifChunkSize) {
+        const int x1 = (std::min)(n, x0 + kYadifChunkSize);
+        for (int x = x0; x < x1; ++x) {
+            const Comp *curm = cur + mrefs + x;
+            const Comp *curp = cur + prefs + x;
+            Diff c = curm[0];
+            Diff d = halven(prev2[x] + next2[x]);
+            Diff e = curp[0];
+            Diff temporal_diff0 = FFABS(prev2[x] - next2[x]);
+            Diff temporal_diff1 = halven( FFABS(prev[mrefs + x] - c) + FFABS(prev[prefs + x] - e) );
+            Diff temporal_diff2 = halven( FFABS(next[mrefs + x] - c) + FFABS(next[prefs + x] - e) );
+            Diff diff = FFMAX3(halven(temporal_diff0), temporal_diff1, temporal_diff2);
+            Diff spatial_pred = halven(c + e);
+            Diff spatial_score = FFABS(curm[-ch] - curp[-ch]) + FFABS(c - e)
+                                 + FFABS(curm[ch] - curp[ch]) - one1( (Comp*)0 );
+
+            // all the loads are done before the selects, so that the loop has no branches
+            const Diff score_m1 = spatial_score_at<ch, -1, Comp, Diff>(curm, curp);
+            const Diff score_m2 = spatial_score_at<ch, -2, Comp, Diff>(curm, curp);
+            const Diff score_p1 = spatial_score_at<ch, 1, Comp, Diff>(curm, curp);
+            const Diff score_p2 = spatial_score_at<ch, 2, Comp, Diff>(curm, curp);
+            const Diff pred_m1 = halven(curm[-ch] + curp[ch]);
+            const Diff pred_m2 = halven(curm[-2 * ch] + curp[2 * ch]);
+            const Diff pred_p1 = halven(curm[ch] + curp[-ch]);
+            const Diff pred_p2 = halven(curm[2 * ch] + curp[-2 * ch]);
+
+            // CHECK(-1) CHECK(-2): the second check is only done if the first one succeeded
+            bool better = score_m1 < spatial_score;
+            spatial_score = yadif_select(better, score_m1, spatial_score);
+            spatial_pred = yadif_select(better, pred_m1, spatial_pred);
+            better = better & (score_m2 < spatial_score);
+            spatial_score = yadif_select(better, score_m2, spatial_score);
+            spatial_pred = yadif_select(better, pred_m2, spatial_pred);
+            // CHECK(1) CHECK(2)
+            better = score_p1 < spatial_score;
+            spatial_score = yadif_select(better, score_p1, spatial_score);
+            spatial_pred = yadif_select(better, pred_p1, spatial_pred);
+            better = better & (score_p2 < spatial_score);
+            spatial_pred = yadif_select(better, pred_p2, spatial_pred);
+
+            if (spatial_check) {
+                Diff b = halven(prev2[2 * mrefs + x] + next2[2 * mrefs + x]);
+                Diff f = halven(prev2[2 * prefs + x] + next2[2 * prefs + x]);
+                Diff max = FFMAX3( d - e, d - c, FFMIN(b - c, f - e) );
+                Diff min = FFMIN3( d - e, d - c, FFMAX(b - c, f - e) );
+
+                diff = FFMAX3(diff, min, -max);
+            }
+
+            const Diff hi = d + diff;
+            const Diff lo = d - diff;
+            spatial_pred = yadif_select(spatial_pred > hi, hi, yadif_select(spatial_pred < lo, lo, spatial_pred));
+
+            out[x - x0] = (Comp)spatial_pred;
+        }
+        std::memcpy( dst + x0, out, (x1 - x0) * sizeof(Comp) );
+    }
+}
+
+template<int ch, typename Comp, typename Diff>
+inline void
+filter_line(Comp *dst,
+            const Comp *prev,
+            const Comp *cur,
+            const Comp *next,
+            int n,
+            int prefs,
+            int mrefs,
+            int parity,
+            int mode)
+{
+    // the mode test is moved out of the loop
+    if ( !(mode & 2) ) {
+        filter_line_mode<ch, Comp, Diff, true>(dst, prev, cur, next, n, prefs, mrefs, parity);
+    } else {
+        filter_line_mode<ch, Comp, Diff, false>(dst, prev, cur, next, n, prefs, mrefs, parity);
+    }
+}
+
+/* Process the n first pixels of a line, without the spatial check (which
+ * would read up to x-3 and x+3). This is used for the three pixels at each
+ * border of the frame. */
 template<int ch, typename Comp, typename Diff>
 inline void
 filter_edges(Comp *dst1,
              const Comp *prev1,
              const Comp *cur1,
              const Comp *next1,
-             int w,
+             int n,
              int prefs,
              int mrefs,
              int parity,
              int mode)
 {
-    Comp *dst  = dst1;
-    const Comp *prev = prev1;
-    const Comp *cur  = cur1;
-    const Comp *next = next1;
-    int x;
-    const Comp *prev2 = parity ? prev : cur;
-    const Comp *next2 = parity ? cur  : next;
-
-    /* Only edge pixels need to be processed here.  A constant value of false
-     * for is_not_edge should let the compiler ignore the whole branch. */
-    FILTER(0, 3, 0)
-
-    dst  = dst1  + (w - 3) * ch;
-    prev = prev1 + (w - 3) * ch;
-    cur  = cur1  + (w - 3) * ch;
-    next = next1 + (w - 3) * ch;
-    prev2 = parity ? prev : cur;
-    next2 = parity ? cur  : next;
-
-    FILTER(w - 3, w, 0)
+    for (int c = 0; c < ch; ++c) {
+        Comp *dst  = dst1 + c;
+        const Comp *prev = prev1 + c;
+        const Comp *cur  = cur1 + c;
+        const Comp *next = next1 + c;
+        int x;
+        const Comp *prev2 = parity ? prev : cur;
+        const Comp *next2 = parity ? cur  : next;
+
+        /* A constant value of false for is_not_edge should let the compiler
+         * ignore the whole branch. */
+        FILTER(0, n, 0)
+    }
 }
 
 #if 0
@@ -365,50 +498,155 @@ interpolate(float *dst,
 
 #endif
 
+/* Filter the pixels x1..x2-1 of a line of a frame of width w (x1 and x2 are
+ * relative to the left border of the frame). The pointers point to pixel x1. */
 template<int ch, typename Comp, typename Diff>
 static void
-filter_plane(int mode,
-             Comp *dst,
-             int dst_stride,
-             const Comp *prev0,
-             const Comp *cur0,
-             const Comp *next0,
-             int refs,
-             int w,
-             int h,
-             int parity,
-             int tff)
+filter_row(Comp *dst,
+           const Comp *prev,
+           const Comp *cur,
+           const Comp *next,
+           int x1,
+           int x2,
+           int w,
+           int prefs,
+           int mrefs,
+           int parity,
+           int mode)
 {
-    int pix_3 = 3 * ch;
-
-    for (int y = 0; y < h; ++y) {
-        if ( ( (y ^ parity) & 1 ) ) {
-            const Comp *prev = prev0 + y * refs;
-            const Comp *cur = cur0 + y * refs;
-            const Comp *next = next0 + y * refs;
-            Comp *dst2 = dst + y * dst_stride;
-            int mode2 = y == 1 || y + 2 == h ? 2 : mode;
-
-            for (int c = 0; c < ch; ++c) {
-                filter_line_c<ch, Comp, Diff>(dst2 + c + pix_3, prev + c + pix_3, cur + c + pix_3, next + c + pix_3, w - 6,
-                                              y + 1 < h ? refs : -refs,
-                                              y ? -refs : refs,
-                                              parity ^ tff, mode2);
-                filter_edges<ch, Comp, Diff>(dst2 + c, prev + c, cur + c, next + c, w,
-                                             y + 1 < h ? refs : -refs,
-                                             y ? -refs : refs,
-                                             parity ^ tff, mode2);
-            }
-        } else {
-            std::memcpy( &dst[y * dst_stride],
-                         &cur0[y * refs], w * ch * sizeof(Comp) ); // copy original
+    // [x1,xa) is the left border, [xa,xb) the interior, [xb,x2) the right border
+    const int xa = (std::min)( x2, (std::max)(x1, 3) );
+    const int xb = (std::max)( xa, (std::min)(x2, w - 3) );
+
+    if (xa > x1) {
+        filter_edges<ch, Comp, Diff>(dst, prev, cur, next, xa - x1,
+                                     prefs, mrefs, parity, mode);
+    }
+    if (xb > xa) {
+        const int o = (xa - x1) * ch;
+#if kYadifVectorized
+        filter_line<ch, Comp, Diff>(dst + o, prev + o, cur + o, next + o, (xb - xa) * ch,
+                                    prefs, mrefs, parity, mode);
+#else
+        for (int c = 0; c < ch; ++c) {
+            filter_line_c<ch, Comp, Diff>(dst + o + c, prev + o + c, cur + o + c, next + o + c, xb - xa,
+                                          prefs, mrefs, parity, mode);
         }
+#endif
+    }
+    if (x2 > xb) {
+        const int o = (xb - x1) * ch;
+        filter_edges<ch, Comp, Diff>(dst + o, prev + o, cur + o, next + o, x2 - xb,
+                                     prefs, mrefs, parity, mode);
     }
 }
 
+class YadifProcessorBase
+    : public ImageProcessor
+{
+protected:
+    const Image *_prevImg;
+    const Image *_curImg;
+    const Image *_nextImg;
+    OfxRectI _frame; // the borders of the frame are used for the edge conditions, whatever the render window is
+    int _mode;
+    int _parity;
+    int _tff;
+
+public:
+    YadifProcessorBase(ImageEffect &instance)
+        : ImageProcessor(instance)
+        , _prevImg(NULL)
+        , _curImg(NULL)
+        , _nextImg(NULL)
+        , _mode(0)
+        , _parity(0)
+        , _tff(0)
+    {
+        _frame.x1 = _frame.y1 = _frame.x2 = _frame.y2 = 0;
+    }
+
+    // the three images must have the same bounds and row bytes
+    void setSrcImgs(const Image *prev,
+                    const Image *cur,
+                    const Image *next)
+    {
+        _prevImg = prev;
+        _curImg = cur;
+        _nextImg = next;
+    }
+
+    void setValues(const OfxRectI& frame,
+                   int mode,
+                   int parity,
+                   int tff)
+    {
+        _frame = frame;
+        _mode = mode;
+        _parity = parity;
+        _tff = tff;
+    }
+};
+
+template<int ch, typename Comp, typename Diff>
+class YadifProcessor
+    : public YadifProcessorBase
+{
+public:
+    YadifProcessor(ImageEffect &instance)
+        : YadifProcessorBase(instance)
+    {
+    }
+
+private:
+    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
+    {
+        const int w = _frame.x2 - _frame.x1;
+        const int h = _frame.y2 - _frame.y1;
+        const int x1 = (std::max)(procWindow.x1, _frame.x1);
+        const int x2 = (std::min)(procWindow.x2, _frame.x2);
+        const int y1 = (std::max)(procWindow.y1, _frame.y1);
+        const int y2 = (std::min)(procWindow.y2, _frame.y2);
+
+        if (x2 <= x1) {
+            return;
+        }
+        const int refs = _curImg->getRowBytes() / (int)sizeof(Comp); // may be negative, @see kOfxImagePropRowBytes
+
+        for (int y = y1; y < y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+            Comp *dst = (Comp*)_dstImg->getPixelAddress(x1, y);
+            const Comp *cur = (const Comp*)_curImg->getPixelAddress(x1, y);
+            if (!dst || !cur) {
+                continue;
+            }
+            const int r = y - _frame.y1;
+            if ( (w >= 3) && (h >= 3) && ( (r ^ _parity) & 1 ) ) {
+                const Comp *prev = (const Comp*)_prevImg->getPixelAddress(x1, y);
+                const Comp *next = (const Comp*)_nextImg->getPixelAddress(x1, y);
+                int mode2 = r == 1 || r + 2 == h ? 2 : _mode;
+
+                filter_row<ch, Comp, Diff>(dst, prev, cur, next,
+                                           x1 - _frame.x1, x2 - _frame.x1, w,
+                                           r + 1 < h ? refs : -refs,
+                                           r ? -refs : refs,
+                                           _parity ^ _tff, mode2);
+            } else {
+                // copy original (video of less than 3 columns or lines is not supported)
+                std::memcpy( dst, cur, (x2 - x1) * ch * sizeof(Comp) );
+            }
+        }
+    }
+};
+
 template<int ch, typename Comp, typename Diff>
 static void
-filter_plane_ofx(int mode,
+filter_plane_ofx(ImageEffect &effect,
+                 const OfxRectI& renderWindow,
+                 const OfxRectI& frame,
+                 int mode,
                  Image *dst_,
                  const Image *srcp,
                  const Image *src,
@@ -416,23 +654,31 @@ filter_plane_ofx(int mode,
                  int parity,
                  int tff)
 {
-    Comp *dst = (Comp*)dst_->getPixelData(); // change this when we support renderWindow
-    int dst_stride = dst_->getRowBytes() / sizeof(Comp); // may be negative, @see kOfxImagePropRowBytes
-    const Comp *prev0 = (const Comp*)( srcp ? srcp->getPixelData() : src->getPixelData() );
-    const Comp *cur0 = (const Comp*)src->getPixelData();
-    const Comp *next0 = (const Comp*)( srcn ? srcn->getPixelData() : src->getPixelData() );
-    int refs = src->getRowBytes() / sizeof(Comp); // may be negative, @see kOfxImagePropRowBytes
-    const OfxRectI bounds = dst_->getBounds();
-
-    filter_plane<ch, Comp, Diff>(mode, dst, dst_stride,
-                                 prev0, cur0, next0,
-                                 refs,
-                                 bounds.x2 - bounds.x1, bounds.y2 - bounds.y1,
-                                 parity, tff);
+    YadifProcessor<ch, Comp, Diff> processor(effect);
+
+    processor.setDstImg(dst_);
+    processor.setSrcImgs(srcp ? srcp : src, src, srcn ? srcn : src);
+    processor.setRenderWindow(renderWindow);
+    processor.setValues(frame, mode, parity, tff);
+    // Call the base class process member, this will call the derived templated process code
+    processor.process();
 }
 
 // =========== GNU Lesser General Public License code end =================
 
+static bool
+sameLayout(const Image& a,
+           const Image& b)
+{
+    const OfxRectI& ba = a.getBounds();
+    const OfxRectI& bb = b.getBounds();
+
+    return ( ba.x1 == bb.x1 && ba.y1 == bb.y1 && ba.x2 == bb.x2 && ba.y2 == bb.y2 &&
+             a.getRowBytes() == b.getRowBytes() &&
+             a.getPixelDepth() == b.getPixelDepth() &&
+             a.getPixelComponents() == b.getPixelComponents() );
+}
+
 void
 DeinterlacePlugin::render(const RenderArguments &args)
 {
@@ -491,9 +737,18 @@ DeinterlacePlugin::render(const RenderArguments &args)
         }
     }
 
-    const OfxRectI rect = dst->getBounds();
-    int width = rect.x2 - rect.x1;
-    int height = rect.y2 - rect.y1;
+    // the previous and next images are processed with the same row offsets as the current image
+    if ( srcp.get() && !sameLayout(*srcp, *src) ) {
+        srcp.reset(0);
+    }
+    if ( srcn.get() && !sameLayout(*srcn, *src) ) {
+        srcn.reset(0);
+    }
+
+    // the edge conditions of Yadif depend on the frame borders, not on the render window
+    OfxRectI frame;
+    Coords::toPixelEnclosing(_srcClip->getRegionOfDefinition(args.time), args.renderScale, _srcClip->getPixelAspectRatio(), &frame);
+    int width = frame.x2 - frame.x1;
     int imode       = 0;
     int ifieldOrder = 2;
     int iparity     = 0;
@@ -512,126 +767,111 @@ DeinterlacePlugin::render(const RenderArguments &args)
         }
     }
 
-
-    if ( (width < 3) || (height < 3) ) {
-        // Video of less than 3 columns or lines is not supported
-        // just copy src to dst
-        for (int y = 0; y < height; y++) {
-            unsigned char* lineStart = (unsigned char*)dst->getPixelAddress(0, y);
-            unsigned int lineLen = std::abs( dst->getRowBytes() );
-            if ( src.get() ) {
-                std::memcpy( lineStart, src->getPixelAddress(0, y), lineLen );
-            } else {
-                std::fill( lineStart, lineStart + lineLen, 0 );
-            }
+    if (dstComponents == ePixelComponentRGBA) {
+        switch (dstBitDepth) {
+        case eBitDepthUByte:
+            filter_plane_ofx<4, unsigned char, int>(*this, args.renderWindow, frame, imode, // mode
+                                                    dst.get(),
+                                                    srcp.get(), src.get(), srcn.get(),
+                                                    iparity, ifieldOrder); // parity, tff
+            break;
+
+        case eBitDepthUShort:
+            filter_plane_ofx<4, unsigned short, int>(*this, args.renderWindow, frame, imode, // mode
+                                                     dst.get(),
+                                                     srcp.get(), src.get(), srcn.get(),
+                                                     iparity, ifieldOrder); // parity, tff
+            break;
+
+        case eBitDepthFloat:
+            filter_plane_ofx<4, float, float>(*this, args.renderWindow, frame, imode,   // mode
+                                              dst.get(),
+                                              srcp.get(), src.get(), srcn.get(),
+                                              iparity, ifieldOrder);  // parity, tff
+            break;
+
+        default:
+            break;
+        }
+    } else if (dstComponents == ePixelComponentRGB) {
+        switch (dstBitDepth) {
+        case eBitDepthUByte:
+            filter_plane_ofx<3, unsigned char, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                    dst.get(),
+                                                    srcp.get(), src.get(), srcn.get(),
+                                                    iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthUShort:
+            filter_plane_ofx<3, unsigned short, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                     dst.get(),
+                                                     srcp.get(), src.get(), srcn.get(),
+                                                     iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthFloat:
+            filter_plane_ofx<3, float, float>(*this, args.renderWindow, frame, imode,   // mode
+                                              dst.get(),
+                                              srcp.get(), src.get(), srcn.get(),
+                                              iparity, ifieldOrder);  // parity, tff
+            break;
+
+        default:
+            break;
         }
-    } else {
-        if (dstComponents == ePixelComponentRGBA) {
-            switch (dstBitDepth) {
-            case eBitDepthUByte:
-                filter_plane_ofx<4, unsigned char, int>(imode, // mode
-                                                        dst.get(),
-                                                        srcp.get(), src.get(), srcn.get(),
-                                                        iparity, ifieldOrder); // parity, tff
-                break;
-
-            case eBitDepthUShort:
-                filter_plane_ofx<4, unsigned short, int>(imode, // mode
-                                                         dst.get(),
-                                                         srcp.get(), src.get(), srcn.get(),
-                                                         iparity, ifieldOrder); // parity, tff
-                break;
-
-            case eBitDepthFloat:
-                filter_plane_ofx<4, float, float>(imode,   // mode
-                                                  dst.get(),
-                                                  srcp.get(), src.get(), srcn.get(),
-                                                  iparity, ifieldOrder);  // parity, tff
-                break;
-
-            default:
-                break;
-            }
-        } else if (dstComponents == ePixelComponentRGB) {
-            switch (dstBitDepth) {
-            case eBitDepthUByte:
-                filter_plane_ofx<3, unsigned char, int>(imode,   // mode
-                                                        dst.get(),
-                                                        srcp.get(), src.get(), srcn.get(),
-                                                        iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthUShort:
-                filter_plane_ofx<3, unsigned short, int>(imode,   // mode
-                                                         dst.get(),
-                                                         srcp.get(), src.get(), srcn.get(),
-                                                         iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthFloat:
-                filter_plane_ofx<3, float, float>(imode,   // mode
-                                                  dst.get(),
-                                                  srcp.get(), src.get(), srcn.get(),
-                                                  iparity, ifieldOrder);  // parity, tff
-                break;
-
-            default:
-                break;
-            }
 #ifdef OFX_EXTENSIONS_NATRON
-        } else if (dstComponents == ePixelComponentXY) {
-            switch (dstBitDepth) {
-            case eBitDepthUByte:
-                filter_plane_ofx<2, unsigned char, int>(imode,   // mode
-                                                        dst.get(),
-                                                        srcp.get(), src.get(), srcn.get(),
-                                                        iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthUShort:
-                filter_plane_ofx<2, unsigned short, int>(imode,   // mode
-                                                         dst.get(),
-                                                         srcp.get(), src.get(), srcn.get(),
-                                                         iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthFloat:
-                filter_plane_ofx<2, float, float>(imode,   // mode
-                                                  dst.get(),
-                                                  srcp.get(), src.get(), srcn.get(),
-                                                  iparity, ifieldOrder);  // parity, tff
-                break;
-
-            default:
-                break;
-            }
+    } else if (dstComponents == ePixelComponentXY) {
+        switch (dstBitDepth) {
+        case eBitDepthUByte:
+            filter_plane_ofx<2, unsigned char, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                    dst.get(),
+                                                    srcp.get(), src.get(), srcn.get(),
+                                                    iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthUShort:
+            filter_plane_ofx<2, unsigned short, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                     dst.get(),
+                                                     srcp.get(), src.get(), srcn.get(),
+                                                     iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthFloat:
+            filter_plane_ofx<2, float, float>(*this, args.renderWindow, frame, imode,   // mode
+                                              dst.get(),
+                                              srcp.get(), src.get(), srcn.get(),
+                                              iparity, ifieldOrder);  // parity, tff
+            break;
+
+        default:
+            break;
+        }
 #endif
-        } else if (dstComponents == ePixelComponentAlpha) {
-            switch (dstBitDepth) {
-            case eBitDepthUByte:
-                filter_plane_ofx<1, unsigned char, int>(imode,   // mode
-                                                        dst.get(),
-                                                        srcp.get(), src.get(), srcn.get(),
-                                                        iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthUShort:
-                filter_plane_ofx<1, unsigned short, int>(imode,   // mode
-                                                         dst.get(),
-                                                         srcp.get(), src.get(), srcn.get(),
-                                                         iparity, ifieldOrder);  // parity, tff
-                break;
-
-            case eBitDepthFloat:
-                filter_plane_ofx<1, float, float>(imode,   // mode
-                                                  dst.get(),
-                                                  srcp.get(), src.get(), srcn.get(),
-                                                  iparity, ifieldOrder);  // parity, tff
-                break;
-
-            default:
-                break;
-            }
+    } else if (dstComponents == ePixelComponentAlpha) {
+        switch (dstBitDepth) {
+        case eBitDepthUByte:
+            filter_plane_ofx<1, unsigned char, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                    dst.get(),
+                                                    srcp.get(), src.get(), srcn.get(),
+                                                    iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthUShort:
+            filter_plane_ofx<1, unsigned short, int>(*this, args.renderWindow, frame, imode,   // mode
+                                                     dst.get(),
+                                                     srcp.get(), src.get(), srcn.get(),
+                                                     iparity, ifieldOrder);  // parity, tff
+            break;
+
+        case eBitDepthFloat:
+            filter_plane_ofx<1, float, float>(*this, args.renderWindow, frame, imode,   // mode
+                                              dst.get(),
+                                              srcp.get(), src.get(), srcn.get(),
+                                              iparity, ifieldOrder);  // parity, tff
+            break;
+
+        default:
+            break;
         }
     }
 } // DeinterlacePlugin::render
@@ -668,6 +908,34 @@ DeinterlacePlugin::isIdentity(const IsIdentityArguments &args,
     return false;
 }
 
+void
+DeinterlacePlugin::getRegionsOfInterest(const RegionsOfInterestArguments &args,
+                                        RegionOfInterestSetter &rois)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    if (!_srcClip || !_srcClip->isConnected()) {
+        return;
+    }
+    const OfxRectD srcRod = _srcClip->getRegionOfDefinition(args.time);
+    if ( Coords::rectIsEmpty(srcRod) || Coords::rectIsEmpty(args.regionOfInterest) ) {
+        return;
+    }
+    double par = _srcClip->getPixelAspectRatio();
+    OfxRectI roiPixel;
+    Coords::toPixelEnclosing(args.regionOfInterest, args.renderScale, par, &roiPixel);
+    roiPixel.x1 -= kYadifMarginX;
+    roiPixel.x2 += kYadifMarginX;
+    roiPixel.y1 -= kYadifMarginY;
+    roiPixel.y2 += kYadifMarginY;
+    OfxRectD roi;
+    Coords::toCanonical(roiPixel, args.renderScale, par, &roi);
+
+    Coords::rectIntersection<OfxRectD>(roi, srcRod, &roi);
+    rois.setRegionOfInterest(*_srcClip, roi);
+}
+
 void
 DeinterlacePlugin::getFramesNeeded(const FramesNeededArguments &args,
                                    FramesNeededSetter &frames)
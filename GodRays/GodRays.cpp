@@ -24,6 +24,7 @@
 #include <cfloat> // DBL_MAX
 #include <iostream>
 #include <algorithm>
+#include <vector>
 
 #include "ofxsTransform3x3.h"
 #include "ofxsTransformInteract.h"
@@ -44,8 +45,12 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "This plugin concatenates transforms upstream."
 
 #define kPluginIdentifier "net.sf.openfx.GodRays"
+// History:
+// version 1.0: initial version
+// version 1.1: faster motion blur: translations use precomputed sample weights, other transforms are processed row by row
+// version 1.2: add the recursiveDoubling parameter
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsMultipleClipPARs false
 #define kSupportsMultipleClipDepths false
@@ -68,6 +73,10 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamSteps "steps"
 #define kParamStepsLabel "Steps"
 #define kParamStepsHint "The number of intermediate images is 2^steps, i.e. 32 for steps=5."
+
+#define kParamRecursiveDoubling "recursiveDoubling"
+#define kParamRecursiveDoublingLabel "Recursive Doubling"
+#define kParamRecursiveDoublingHint "Compute the result in 'steps' passes, each pass adding the result of the previous pass to a transformed copy of itself, rather than sampling the input image 2^steps times for each pixel. This is much faster for large values of steps, and exact if the transform is a translation, or a rotation and/or a scale around the center. The intermediate images are resampled using bilinear interpolation, so that the result is slightly softer. The gamma parameter is ignored (the intermediate colors always follow an exponential decay, as with gamma=1)."
 #endif
 
 #define kParamMax "max"
@@ -86,6 +95,53 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define OFX_COMPONENTS_OK(c) ((c)== ePixelComponentAlpha || (c) == ePixelComponentRGB || (c) == ePixelComponentRGBA)
 #endif
 
+enum TransformClassEnum
+{
+    eTransformClassTranslation = 0, // all transforms are translations
+    eTransformClassGeneral,
+};
+
+// Check if all the inverse transforms (in pixel coordinates) are translations,
+// and if they are, return the offset of each transform in translation.
+static TransformClassEnum
+classifyTransforms(const Matrix3x3* invtransform,
+                   size_t invtransformsize,
+                   std::vector<OfxPointD>* translation)
+{
+    translation->resize(invtransformsize);
+    for (size_t i = 0; i < invtransformsize; ++i) {
+        const Matrix3x3 & H = invtransform[i];
+        const double z = H(2,2);
+        // the linear part must be the identity, up to a rounding error
+        const double eps = 1e-10 * std::abs(z);
+        if ( (H(2,0) != 0.) || (H(2,1) != 0.) || (z <= 0.) ||
+             (std::abs(H(0,0) - z) > eps) || (std::abs(H(1,1) - z) > eps) ||
+             (std::abs(H(0,1)) > eps) || (std::abs(H(1,0)) > eps) ) {
+            translation->clear();
+
+            return eTransformClassGeneral;
+        }
+        (*translation)[i].x = H(0,2) / z;
+        (*translation)[i].y = H(1,2) / z;
+    }
+
+    return eTransformClassTranslation;
+}
+
+
+static Matrix3x3
+identityMatrix()
+{
+    Matrix3x3 m;
+
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            m(i,j) = (i == j) ? 1. : 0.;
+        }
+    }
+
+    return m;
+}
 
 class GodRaysProcessorBase
     : public Transform3x3ProcessorBase
@@ -96,6 +152,14 @@ protected:
     double _gamma[4];
 #ifdef USE_STEPS
     int _steps;
+    // recursive doubling: pass k computes I_k+1(p) = I_k(H0 p) + w^(2^k) I_k(H1 p), where I_0 is the source image
+    int _doublingPass; // -1 if not rendering by recursive doubling
+    Matrix3x3 _doublingH0;
+    Matrix3x3 _doublingH1;
+    const float* _doublingSrcBuf; // I_k, or NULL for the first pass
+    OfxRectI _doublingSrcBufBounds;
+    float* _doublingDstBuf; // I_k+1, or NULL for the last pass, which writes to the destination image
+    OfxRectI _doublingDstBufBounds;
 #endif
     bool _max;
 
@@ -105,14 +169,41 @@ public:
         : Transform3x3ProcessorBase(instance)
 #ifdef USE_STEPS
         , _steps(5)
+        , _doublingPass(-1)
+        , _doublingSrcBuf(NULL)
+        , _doublingDstBuf(NULL)
 #endif
         , _max(false)
     {
         for (int c = 0; c < 4; ++c) {
             _fromColor[c] = _toColor[c] = _gamma[c] = 1.;
         }
+#ifdef USE_STEPS
+        _doublingSrcBufBounds.x1 = _doublingSrcBufBounds.y1 = _doublingSrcBufBounds.x2 = _doublingSrcBufBounds.y2 = 0;
+        _doublingDstBufBounds = _doublingSrcBufBounds;
+#endif
     }
 
+#ifdef USE_STEPS
+    // set the parameters of a recursive doubling pass, see multiThreadProcessImagesRecursiveDoubling()
+    void setRecursiveDoublingPass(int pass,
+                                  const Matrix3x3 & H0,
+                                  const Matrix3x3 & H1,
+                                  const float* srcBuf,
+                                  const OfxRectI & srcBufBounds,
+                                  float* dstBuf,
+                                  const OfxRectI & dstBufBounds)
+    {
+        _doublingPass = pass;
+        _doublingH0 = H0;
+        _doublingH1 = H1;
+        _doublingSrcBuf = srcBuf;
+        _doublingSrcBufBounds = srcBufBounds;
+        _doublingDstBuf = dstBuf;
+        _doublingDstBufBounds = dstBufBounds;
+    }
+#endif
+
     virtual void setValues(const Matrix3x3* invtransform, //!< non-generic - must be in PIXEL coords
                            size_t invtransformsize,
                            // all generic parameters below
@@ -150,6 +241,7 @@ class GodRaysProcessor
 public:
     GodRaysProcessor(ImageEffect &instance)
         : GodRaysProcessorBase(instance)
+        , _transformClass(eTransformClassGeneral)
     {
     }
 
@@ -179,6 +271,7 @@ private:
                            bool max) OVERRIDE FINAL
     {
         GodRaysProcessorBase::setValues(invtransform, invtransformsize, blackOutside, motionblur, mix, fromColor, toColor, gamma, steps, max);
+        _transformClass = classifyTransforms(invtransform, invtransformsize, &_translation);
 
         _color.resize(invtransformsize);
 #ifdef GODRAYS_LINEAR_INTERPOLATION
@@ -226,9 +319,20 @@ private:
         assert(_invtransform);
         if (_motionblur == 0.) { // no motion blur
             return multiThreadProcessImagesNoBlur(procWindow);
-        } else { // motion blur
-            return multiThreadProcessImagesMotionBlur(procWindow);
         }
+#ifdef USE_STEPS
+        if (_doublingPass >= 0) {
+            return multiThreadProcessImagesRecursiveDoubling(procWindow);
+        }
+        if ( _srcImg && (_transformClass == eTransformClassTranslation) &&
+             ( (filter == eFilterImpulse) || (filter == eFilterBilinear) ) ) {
+            return multiThreadProcessImagesTranslation(procWindow);
+        }
+
+        return multiThreadProcessImagesRows(procWindow);
+#else
+        return multiThreadProcessImagesMotionBlur(procWindow);
+#endif
     } // multiThreadProcessImages
 
 private:
@@ -281,16 +385,309 @@ private:
         }
     }
 
-    void multiThreadProcessImagesMotionBlur(const OfxRectI &procWindow)
+#ifdef USE_STEPS
+    // Sample the source image at the back-transformed point (same as multiThreadProcessImagesNoBlur).
+    void sample(const Matrix3x3 & H,
+                const Point3D & transformed,
+                float *tmpPix)
+    {
+        if ( !_srcImg || (transformed.z <= 0.) ) {
+            // the back-transformed point is at infinity (==0) or behind the camera (<0)
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] = 0;
+            }
+        } else {
+            double fx = transformed.z != 0 ? transformed.x / transformed.z : transformed.x;
+            double fy = transformed.z != 0 ? transformed.y / transformed.z : transformed.y;
+            if (filter == eFilterImpulse) {
+                ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, _srcImg, _blackOutside, tmpPix);
+            } else {
+                double Jxx = (H(0,0) * transformed.z - transformed.x * H(2,0)) / (transformed.z * transformed.z);
+                double Jxy = (H(0,1) * transformed.z - transformed.x * H(2,1)) / (transformed.z * transformed.z);
+                double Jyx = (H(1,0) * transformed.z - transformed.y * H(2,0)) / (transformed.z * transformed.z);
+                double Jyy = (H(1,1) * transformed.z - transformed.y * H(2,1)) / (transformed.z * transformed.z);
+                ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, _srcImg, _blackOutside, tmpPix);
+            }
+        }
+    }
+
+    // add (or take the max of) the sample of transform t to the accumulated pixel
+    void accumulate(int t,
+                    const float *tmpPix,
+                    float *accPix)
+    {
+        for (int c = 0; c < nComponents; ++c) {
+            const float v = tmpPix[c] * _color[t][c];
+            if (_max) {
+                accPix[c] = (std::max)(accPix[c], v);
+            } else {
+                accPix[c] += v;
+            }
+        }
+    }
+
+    // write the accumulated row, divided by the number of samples, to the destination
+    void finishRow(const OfxRectI &procWindow,
+                   int y,
+                   const float *accPix)
+    {
+        float tmpPix[nComponents];
+        const float norm = _max ? 1.f : 1.f / (float)_invtransformsize;
+        PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+        for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents, accPix += nComponents) {
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] = accPix[c] * norm;
+            }
+            ofxsMaskMix<PIX, nComponents, maxValue, true>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+        }
+    }
+
+    // General case: the samples of each transform are accumulated over the whole row before going to the
+    // next transform, so that consecutive reads follow a line in the source image, and the back-transformed
+    // point is computed incrementally along the row.
+    void multiThreadProcessImagesRows(const OfxRectI &procWindow)
     {
+        const int width = procWindow.x2 - procWindow.x1;
+        std::vector<float> accRow(width * nComponents);
         float tmpPix[nComponents];
 
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            std::fill(accRow.begin(), accRow.end(), 0.f);
+            for (int t = 0; t < (int)_invtransformsize; ++t) {
+                const Matrix3x3& H = _invtransform[t];
+                // the back-transformed center of the first pixel of the row
+                // see http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#CanonicalCoordinates
+                Point3D canonicalCoords;
+                canonicalCoords.x = (double)procWindow.x1 + 0.5;
+                canonicalCoords.y = (double)y + 0.5;
+                canonicalCoords.z = 1;
+                const Point3D start = H * canonicalCoords;
+                float *accPix = &accRow.front();
+                for (int i = 0; i < width; ++i, accPix += nComponents) {
+                    // moving one pixel to the right adds the first column of H
+                    Point3D transformed;
+                    transformed.x = start.x + i * H(0,0);
+                    transformed.y = start.y + i * H(1,0);
+                    transformed.z = start.z + i * H(2,0);
+                    sample(H, transformed, tmpPix);
+                    accumulate(t, tmpPix, accPix);
+                }
+            }
+            finishRow(procWindow, y, &accRow.front());
+        }
+    } // multiThreadProcessImagesRows
+
+    // All transforms are translations: the sample of transform t is at the same offset for all pixels,
+    // so that the interpolation weights are computed once per transform, and each row of the result
+    // is a weighted sum of shifted source rows. Pixels whose samples fall near or outside of the source
+    // bounds go through the generic interpolation, which handles the blackOutside setting.
+    void multiThreadProcessImagesTranslation(const OfxRectI &procWindow)
+    {
+        assert( _srcImg && (filter == eFilterImpulse || filter == eFilterBilinear) );
+        const int width = procWindow.x2 - procWindow.x1;
+        std::vector<float> accRow(width * nComponents);
+        float tmpPix[nComponents];
+        const OfxRectI srcBounds = _srcImg->getBounds();
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            std::fill(accRow.begin(), accRow.end(), 0.f);
+            for (int t = 0; t < (int)_invtransformsize; ++t) {
+                const OfxPointD & offset = _translation[t];
+                // the source pixel (ix,iy) and the bilinear weights (wx,wy) of the sample for destination pixel (0,0)
+                int ix, iy;
+                float wx, wy;
+                if (filter == eFilterImpulse) {
+                    ix = (int)std::floor(offset.x + 0.5);
+                    iy = (int)std::floor(offset.y + 0.5);
+                    wx = wy = 0.f;
+                } else {
+                    // the pixel centers are at integer + 0.5
+                    ix = (int)std::floor(offset.x);
+                    iy = (int)std::floor(offset.y);
+                    wx = (float)(offset.x - ix);
+                    wy = (float)(offset.y - iy);
+                }
+                float w00[nComponents], w10[nComponents], w01[nComponents], w11[nComponents];
+                for (int c = 0; c < nComponents; ++c) {
+                    const float col = _color[t][c];
+                    w00[c] = (1.f - wx) * (1.f - wy) * col;
+                    w10[c] = wx * (1.f - wy) * col;
+                    w01[c] = (1.f - wx) * wy * col;
+                    w11[c] = wx * wy * col;
+                }
+
+                // [xa,xb) is the range of pixels for which the four source pixels are inside the source bounds
+                const int sy = y + iy;
+                int xa = procWindow.x1;
+                int xb = procWindow.x1;
+                if ( (srcBounds.y1 <= sy) && (sy + 1 < srcBounds.y2) ) {
+                    xa = (std::min)( (std::max)(procWindow.x1, srcBounds.x1 - ix), procWindow.x2 );
+                    xb = (std::max)( (std::min)(procWindow.x2, srcBounds.x2 - 1 - ix), xa );
+                }
+
+                // border pixels
+                for (int x = procWindow.x1; x < procWindow.x2; ++x) {
+                    if (x == xa) {
+                        x = xb;
+                        if (x == procWindow.x2) {
+                            break;
+                        }
+                    }
+                    ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(x + 0.5 + offset.x, y + 0.5 + offset.y, _srcImg, _blackOutside, tmpPix);
+                    accumulate(t, tmpPix, &accRow[(x - procWindow.x1) * nComponents]);
+                }
+
+                if (xa == xb) {
+                    continue;
+                }
+                const PIX *srcPix0 = (const PIX *) _srcImg->getPixelAddress(xa + ix, sy);
+                const PIX *srcPix1 = (const PIX *) _srcImg->getPixelAddress(xa + ix, sy + 1);
+                assert(srcPix0 && srcPix1);
+                float *accPix = &accRow[(xa - procWindow.x1) * nComponents];
+                if (_max) {
+                    for (int x = xa; x < xb; ++x, srcPix0 += nComponents, srcPix1 += nComponents, accPix += nComponents) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            const float v = ( w00[c] * srcPix0[c] + w10[c] * srcPix0[nComponents + c] +
+                                              w01[c] * srcPix1[c] + w11[c] * srcPix1[nComponents + c] );
+                            accPix[c] = (std::max)(accPix[c], v);
+                        }
+                    }
+                } else {
+                    for (int x = xa; x < xb; ++x, srcPix0 += nComponents, srcPix1 += nComponents, accPix += nComponents) {
+                        for (int c = 0; c < nComponents; ++c) {
+                            accPix[c] += ( w00[c] * srcPix0[c] + w10[c] * srcPix0[nComponents + c] +
+                                           w01[c] * srcPix1[c] + w11[c] * srcPix1[nComponents + c] );
+                        }
+                    }
+                }
+            }
+            finishRow(procWindow, y, &accRow.front());
+        }
+    } // multiThreadProcessImagesTranslation
+
+    // Sample I_k at the back-transformed point: the first pass samples the source image using the selected
+    // filter, the other passes use bilinear interpolation in the buffer of the previous pass.
+    void sampleRecursiveDoubling(const Matrix3x3 & H,
+                                 const Point3D & canonicalCoords,
+                                 float *tmpPix)
+    {
+        const Point3D transformed = H * canonicalCoords;
+
+        if (!_doublingSrcBuf) {
+            return sample(H, transformed, tmpPix);
+        }
+        if (transformed.z <= 0.) {
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] = 0;
+            }
+
+            return;
+        }
+        // the buffer bounds contain all the samples, up to a rounding error: clamp to the bounds
+        const OfxRectI & b = _doublingSrcBufBounds;
+        const int w = b.x2 - b.x1;
+        const int h = b.y2 - b.y1;
+        const double fx = (std::min)( (std::max)(transformed.x / transformed.z - 0.5 - b.x1, 0.), (double)(w - 1) );
+        const double fy = (std::min)( (std::max)(transformed.y / transformed.z - 0.5 - b.y1, 0.), (double)(h - 1) );
+        const int x0 = (int)fx;
+        const int y0 = (int)fy;
+        const int x1 = (std::min)(x0 + 1, w - 1);
+        const int y1 = (std::min)(y0 + 1, h - 1);
+        const float dx = (float)(fx - x0);
+        const float dy = (float)(fy - y0);
+        const float *p00 = _doublingSrcBuf + ( (size_t)y0 * w + x0 ) * nComponents;
+        const float *p10 = _doublingSrcBuf + ( (size_t)y0 * w + x1 ) * nComponents;
+        const float *p01 = _doublingSrcBuf + ( (size_t)y1 * w + x0 ) * nComponents;
+        const float *p11 = _doublingSrcBuf + ( (size_t)y1 * w + x1 ) * nComponents;
+        for (int c = 0; c < nComponents; ++c) {
+            tmpPix[c] = ( (1.f - dy) * ( (1.f - dx) * p00[c] + dx * p10[c] ) +
+                          dy * ( (1.f - dx) * p01[c] + dx * p11[c] ) );
+        }
+    }
+
+    // One pass of recursive doubling.
+    // With N = 2^steps transforms, the transform of amount j/N (j in [0,N-1]) is the transform of amount 1/N
+    // applied j times, and its color is fromColor * (toColor/fromColor)^(j/N) = fromColor * w^j.
+    // The sum of the N samples is thus obtained in steps passes:
+    // I_0 = the source image, I_k+1(p) = I_k(p) + w^(2^k) I_k(H_2^k p), and the result is fromColor * I_steps / N.
+    // With max, the sums are replaced by max.
+    void multiThreadProcessImagesRecursiveDoubling(const OfxRectI &procWindow)
+    {
+        const double n = (double)(1 << _steps);
+        float weight[nComponents];
+        float norm[nComponents];
+
+        for (int c = 0; c < nComponents; ++c) {
+            int ci = (nComponents == 1) ? 3 : c;
+            double col1 = (std::max)(0.001, _fromColor[ci]);
+            double col2 = (std::max)(0.001, _toColor[ci]);
+            weight[c] = (float)std::pow(col2 / col1, (1 << _doublingPass) / n);
+            norm[c] = (float)(_max ? col1 : col1 / n);
+        }
+
+        float pix0[nComponents];
+        float pix1[nComponents];
+        const OfxRectI & b = _doublingDstBufBounds;
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = NULL;
+            float *dstBufPix = NULL;
+            if (_doublingDstBuf) {
+                dstBufPix = _doublingDstBuf + ( (size_t)(y - b.y1) * (b.x2 - b.x1) + (procWindow.x1 - b.x1) ) * nComponents;
+            } else {
+                dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            }
+
+            // the coordinates of the center of the pixel in canonical coordinates
+            // see http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#CanonicalCoordinates
+            Point3D canonicalCoords;
+            canonicalCoords.z = 1;
+            canonicalCoords.y = (double)y + 0.5;
+
+            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
+                canonicalCoords.x = (double)x + 0.5;
+                sampleRecursiveDoubling(_doublingH0, canonicalCoords, pix0);
+                sampleRecursiveDoubling(_doublingH1, canonicalCoords, pix1);
+                for (int c = 0; c < nComponents; ++c) {
+                    const float v = pix1[c] * weight[c];
+                    pix0[c] = _max ? (std::max)(pix0[c], v) : (pix0[c] + v);
+                }
+                if (dstBufPix) {
+                    std::copy(pix0, pix0 + nComponents, dstBufPix);
+                    dstBufPix += nComponents;
+                } else {
+                    for (int c = 0; c < nComponents; ++c) {
+                        pix0[c] *= norm[c];
+                    }
+                    ofxsMaskMix<PIX, nComponents, maxValue, true>(pix0, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    dstPix += nComponents;
+                }
+            }
+        }
+    } // multiThreadProcessImagesRecursiveDoubling
+
+#endif
 #ifndef USE_STEPS
+    void multiThreadProcessImagesMotionBlur(const OfxRectI &procWindow)
+    {
+        float tmpPix[nComponents];
+
         const double maxErr2 = kTransform3x3ProcessorMotionBlurMaxError * kTransform3x3ProcessorMotionBlurMaxError; // maximum expected squared error
         const int maxIt = kTransform3x3ProcessorMotionBlurMaxIterations; // maximum number of iterations
         // Monte Carlo integration, starting with at least 13 regularly spaced samples, and then low discrepancy
         // samples from the van der Corput sequence.
-#endif
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
                 break;
@@ -308,33 +705,22 @@ private:
                 float max[nComponents];
                 double accPix[nComponents];
                 double mean[nComponents];
-#ifndef USE_STEPS
                 double accPix2[nComponents];
                 double var[nComponents];
-#endif
                 for (int c = 0; c < nComponents; ++c) {
                     max[c] = 0;
                     accPix[c] = 0;
                     mean[c] = 0.;
-#ifndef USE_STEPS
                     accPix2[c] = 0;
                     var[c] = (double)maxValue * maxValue;
-#endif
                 }
                 int sample = 0;
-#ifdef USE_STEPS
-                const int minsamples = _invtransformsize;
-#else
                 const int minsamples = kTransform3x3ProcessorMotionBlurMinIterations; // minimum number of samples (at most maxIt/3
                 unsigned int seed = (unsigned int)( hash(hash( x + (unsigned int)(0x10000 * _motionblur) ) + y) );
-#endif
                 int maxsamples = minsamples;
                 while (sample < maxsamples) {
                     for (; sample < maxsamples; ++sample) {
                         int t;
-#ifdef USE_STEPS
-                        t = sample;
-#else
                         //int t = 0.5*(van_der_corput<2>(seed1) + van_der_corput<3>(seed2)) * _invtransform.size();
                         if (sample < minsamples) {
                             // distribute the first samples evenly over the interval
@@ -343,7 +729,6 @@ private:
                             t = (int)(van_der_corput<2>(seed) * _invtransformsize);
                         }
                         ++seed;
-#endif
                         // NON-GENERIC TRANSFORM
 
                         // the coordinates of the center of the pixel in canonical coordinates
@@ -376,12 +761,9 @@ private:
                                 max[c] = (std::max)(max[c], tmpPix[c]);
                             }
                             accPix[c] += tmpPix[c];
-#ifndef USE_STEPS
                             accPix2[c] += tmpPix[c] * tmpPix[c];
-#endif
                         }
                     }
-#ifndef USE_STEPS
                     // compute mean and variance (unbiased)
                     for (int c = 0; c < nComponents; ++c) {
                         mean[c] = sample ? accPix[c] / sample : 0;
@@ -401,18 +783,12 @@ private:
                             }
                         }
                     }
-#endif
                 }
                 if (_max) {
                     for (int c = 0; c < nComponents; ++c) {
                         tmpPix[c] = (float)max[c];
                     }
                 } else {
-#ifdef USE_STEPS
-                    for (int c = 0; c < nComponents; ++c) {
-                        mean[c] = sample ? accPix[c] / sample : 0;
-                    }
-#endif
                     for (int c = 0; c < nComponents; ++c) {
                         tmpPix[c] = (float)mean[c];
                     }
@@ -422,7 +798,6 @@ private:
         }
     } // multiThreadProcessImagesMotionBlur
 
-#ifndef USE_STEPS
     // Compute the /seed/th element of the van der Corput sequence
     // see http://en.wikipedia.org/wiki/Van_der_Corput_sequence
     template <int base>
@@ -474,6 +849,8 @@ private:
     };
 
     std::vector<Pix > _color;
+    TransformClassEnum _transformClass;
+    std::vector<OfxPointD> _translation; // the offset of each transform, if they are all translations
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -499,6 +876,7 @@ public:
         , _gamma(NULL)
 #ifdef USE_STEPS
         , _steps(NULL)
+        , _recursiveDoubling(NULL)
 #endif
         , _max(NULL)
         , _premultChanged(NULL)
@@ -524,7 +902,8 @@ public:
         _gamma = fetchRGBAParam(kParamGamma);
 #ifdef USE_STEPS
         _steps = fetchIntParam(kParamSteps);
-        assert(_steps);
+        _recursiveDoubling = fetchBooleanParam(kParamRecursiveDoubling);
+        assert(_steps && _recursiveDoubling);
 #endif
         _max = fetchBooleanParam(kParamMax);
 
@@ -565,6 +944,10 @@ private:
     /* set up and run a processor */
     void setupAndProcess(GodRaysProcessorBase &, const RenderArguments &args);
 
+#ifdef USE_STEPS
+    bool processRecursiveDoubling(GodRaysProcessorBase &processor, const RenderArguments &args, int nComponents, int steps, const std::vector<Matrix3x3> &invtransform, const Matrix3x3 &srcTransformInverse);
+#endif
+
     // NON-GENERIC
     Double2DParam* _translate;
     DoubleParam* _rotate;
@@ -580,6 +963,9 @@ private:
     RGBAParam* _toColor;
     RGBAParam* _gamma;
     IntParam* _steps;
+#ifdef USE_STEPS
+    BooleanParam* _recursiveDoubling;
+#endif
     BooleanParam* _max;
     BooleanParam* _premultChanged; // set to true the first time the user connects src
 };
@@ -871,6 +1257,9 @@ GodRaysPlugin::setupAndProcess(GodRaysProcessorBase &processor,
     double mix = 1.;
 #ifdef USE_STEPS
     int steps = 5;
+    bool recursiveDoubling = false;
+    std::vector<Matrix3x3> invtransformNoSrc; // the transforms, not composed with the input transform
+    Matrix3x3 srcTransformInverse = identityMatrix();
 #endif
 
     if ( !src.get() ) {
@@ -928,6 +1317,16 @@ GodRaysPlugin::setupAndProcess(GodRaysProcessorBase &processor,
         if (invtransformsize == 1) {
             motionblur  = 0.;
         }
+#ifdef USE_STEPS
+        if (_recursiveDoubling) {
+            _recursiveDoubling->getValueAtTime(time, recursiveDoubling);
+        }
+        // recursive doubling needs all the transforms
+        recursiveDoubling = recursiveDoubling && steps > 0 && invtransformsize == invtransformsizealloc;
+        if (recursiveDoubling) {
+            invtransformNoSrc = invtransform;
+        }
+#endif
         // compose with the input transform
         if ( !src->getTransformIsIdentity() ) {
             double srcTransform[9]; // transform to apply to the source image, in pixel coordinates, from source to destination
@@ -943,7 +1342,9 @@ GodRaysPlugin::setupAndProcess(GodRaysProcessorBase &processor,
             srcTransformMat(2,1) = srcTransform[7];
             srcTransformMat(2,2) = srcTransform[8];
             // invert it
+#ifndef USE_STEPS
             Matrix3x3 srcTransformInverse;
+#endif
             if ( srcTransformMat.inverse(&srcTransformInverse) ) {
                 for (size_t i = 0; i < invtransformsize; ++i) {
                     invtransform[i] = srcTransformInverse * invtransform[i];
@@ -1011,10 +1412,156 @@ GodRaysPlugin::setupAndProcess(GodRaysProcessorBase &processor,
 #endif
                         max);
 
+#ifdef USE_STEPS
+    if ( recursiveDoubling &&
+         processRecursiveDoubling(processor, args, dst->getPixelComponentCount(), steps, invtransformNoSrc, srcTransformInverse) ) {
+        return;
+    }
+#endif
+
     // Call the base class process member, this will call the derived templated process code
     processor.process();
 } // setupAndProcess
 
+#ifdef USE_STEPS
+// bounding box of the pixels needed to interpolate at the back-transformed points of the pixel centers of rect
+static bool
+transformedBounds(const Matrix3x3 & H,
+                  const OfxRectI & rect,
+                  OfxRectI* bounds)
+{
+    double xmin = DBL_MAX, xmax = -DBL_MAX, ymin = DBL_MAX, ymax = -DBL_MAX;
+
+    for (int i = 0; i < 4; ++i) {
+        Point3D p;
+        p.x = (i & 1) ? rect.x2 : rect.x1;
+        p.y = (i & 2) ? rect.y2 : rect.y1;
+        p.z = 1;
+        p = H * p;
+        if (p.z <= 0.) {
+            return false;
+        }
+        xmin = (std::min)(xmin, p.x / p.z);
+        xmax = (std::max)(xmax, p.x / p.z);
+        ymin = (std::min)(ymin, p.y / p.z);
+        ymax = (std::max)(ymax, p.y / p.z);
+    }
+    // one more pixel on each side for the bilinear interpolation
+    bounds->x1 = (int)std::floor(xmin) - 1;
+    bounds->x2 = (int)std::ceil(xmax) + 1;
+    bounds->y1 = (int)std::floor(ymin) - 1;
+    bounds->y2 = (int)std::ceil(ymax) + 1;
+
+    return true;
+}
+
+// true if H1 and H2 map the corners of rect to the same points, within tol pixels
+static bool
+sameTransform(const Matrix3x3 & H1,
+              const Matrix3x3 & H2,
+              const OfxRectI & rect,
+              double tol)
+{
+    for (int i = 0; i < 4; ++i) {
+        Point3D p;
+        p.x = (i & 1) ? rect.x2 : rect.x1;
+        p.y = (i & 2) ? rect.y2 : rect.y1;
+        p.z = 1;
+        const Point3D p1 = H1 * p;
+        const Point3D p2 = H2 * p;
+        if ( (p1.z <= 0.) || (p2.z <= 0.) ||
+             !( std::abs(p1.x / p1.z - p2.x / p2.z) <= tol ) ||
+             !( std::abs(p1.y / p1.z - p2.y / p2.z) <= tol ) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Render using the recursive doubling passes (see GodRaysProcessor::multiThreadProcessImagesRecursiveDoubling).
+// The intermediate images are stored in two float buffers allocated from the host memory pool, used alternately by the passes.
+// Returns false (and renders nothing) if the transforms are not suitable.
+bool
+GodRaysPlugin::processRecursiveDoubling(GodRaysProcessorBase &processor,
+                                        const RenderArguments &args,
+                                        int nComponents,
+                                        int steps,
+                                        const std::vector<Matrix3x3> &invtransform,
+                                        const Matrix3x3 &srcTransformInverse)
+{
+    const int n = 1 << steps;
+
+    assert( (int)invtransform.size() == n );
+    // the transform of amount j/n is invtransform[n - 1 - j], and the first one must be the identity
+    const Matrix3x3 & H = invtransform[n - 1];
+    const double eps = 1e-10 * std::abs( H(2,2) );
+    if ( (std::abs(H(0,0) - H(2,2)) > eps) || (std::abs(H(1,1) - H(2,2)) > eps) ||
+         (std::abs( H(0,1) ) > eps) || (std::abs( H(0,2) ) > eps) || (std::abs( H(1,0) ) > eps) ||
+         (std::abs( H(1,2) ) > eps) || (std::abs( H(2,0) ) > eps) || (std::abs( H(2,1) ) > eps) ) {
+        return false;
+    }
+    // pass k applies H_{2^k} to the result of the previous passes, which
+    // requires H_{2^k}.H_{2^k} = H_{2^(k+1)}. This is true for a single
+    // translation, rotation or uniform scale, but not for the interpolation of
+    // combined transforms (e.g. translate and scale, or skew).
+    for (int k = 0; k < steps - 1; ++k) {
+        const Matrix3x3 & Hk = invtransform[n - 1 - (1 << k)];
+        if ( !sameTransform(Hk * Hk, invtransform[n - 1 - ( 1 << (k + 1) )], args.renderWindow, 1e-3) ) {
+            return false;
+        }
+    }
+
+    // region[k] is the region where I_k is needed (region[steps] is the render window)
+    std::vector<OfxRectI> region(steps + 1);
+    region[steps] = args.renderWindow;
+    for (int k = steps - 1; k >= 1; --k) {
+        OfxRectI bounds;
+        if ( !transformedBounds(invtransform[n - 1 - (1 << k)], region[k + 1], &bounds) ) {
+            return false;
+        }
+        Coords::rectBoundingBox(region[k + 1], bounds, &region[k]);
+    }
+    const size_t nPixels = (size_t)(region[1].x2 - region[1].x1) * (region[1].y2 - region[1].y1);
+    const size_t nPixelsWindow = (size_t)(args.renderWindow.x2 - args.renderWindow.x1) * (args.renderWindow.y2 - args.renderWindow.y1);
+    if (nPixels > 4 * nPixelsWindow + 4096) {
+        // the intermediate images would be too large (e.g. a large translation of a small render window)
+        return false;
+    }
+
+    auto_ptr<ImageMemory> bufMem[2];
+    float* buf[2] = { NULL, NULL };
+    if (steps > 1) {
+        for (int i = 0; i < 2; ++i) {
+            bufMem[i].reset( new ImageMemory(nPixels * nComponents * sizeof(float), this) );
+            buf[i] = (float*)bufMem[i]->lock();
+            if (!buf[i]) {
+                throwSuiteStatusException(kOfxStatErrMemory);
+            }
+        }
+    }
+
+    const Matrix3x3 I = identityMatrix();
+    for (int k = 0; k < steps; ++k) {
+        if ( abort() ) {
+            break;
+        }
+        const Matrix3x3 & Hk = invtransform[n - 1 - (1 << k)];
+        processor.setRecursiveDoublingPass(k,
+                                           (k == 0) ? srcTransformInverse : I,
+                                           (k == 0) ? srcTransformInverse * Hk : Hk,
+                                           (k == 0) ? NULL : buf[(k - 1) % 2],
+                                           region[k],
+                                           (k == steps - 1) ? NULL : buf[k % 2],
+                                           region[k + 1]);
+        processor.setRenderWindow(region[k + 1]);
+        processor.process();
+    }
+
+    return true;
+} // GodRaysPlugin::processRecursiveDoubling
+#endif
+
 template <class PIX, int nComponents, int maxValue>
 void
 GodRaysPlugin::renderInternalForBitDepth(const RenderArguments &args)
@@ -1237,6 +1784,17 @@ GodRaysPluginFactory::describeInContext(ImageEffectDescriptor &desc,
             page->addChild(*param);
         }
     }
+
+    // recursiveDoubling
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamRecursiveDoubling);
+        param->setLabel(kParamRecursiveDoublingLabel);
+        param->setHint(kParamRecursiveDoublingHint);
+        param->setDefault(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
 #else
     // motionBlur
     {
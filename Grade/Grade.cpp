@@ -24,6 +24,7 @@
 #include <cfloat> // DBL_MAX
 #include <limits>
 #include <algorithm>
+#include <vector>
 
 #include "ofxsProcessing.H"
 #include "ofxsMaskMix.h"
@@ -45,6 +46,7 @@ namespace {
     typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
 }
 #endif
+#include "ofxsFastMath.h"
 
 using namespace OFX;
 
@@ -73,8 +75,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // History:
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
+// version 2.1: lookup tables for 8-bit and 16-bit images, fast pow approximation for float images
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -398,6 +401,7 @@ public:
         , _processG(false)
         , _processB(false)
         , _processA(false)
+        , _useTables(false)
         , _reverse(false)
         , _clampBlack(true)
         , _clampWhite(false)
@@ -506,85 +510,110 @@ public:
         }
      }
 
-    template<bool processR, bool processG, bool processB, bool processA>
-    void grade(double *r,
-               double *g,
-               double *b,
-               double *a)
-    {
-        if (processR) {
-            grade(r, _whitePoint.r, _blackPoint.r, _white.r, _black.r, _multiply.r, _offset.r, _gamma.r);
-        }
-        if (processG) {
-            grade(g, _whitePoint.g, _blackPoint.g, _white.g, _black.g, _multiply.g, _offset.g, _gamma.g);
-        }
-        if (processB) {
-            grade(b, _whitePoint.b, _blackPoint.b, _white.b, _black.b, _multiply.b, _offset.b, _gamma.b);
-        }
-        if (processA) {
-            grade(a, _whitePoint.a, _blackPoint.a, _white.a, _black.a, _multiply.a, _offset.a, _gamma.a);
-        }
-    }
-
-    template<bool processR, bool processG, bool processB, bool processA>
-    void invgrade(double *r,
-                  double *g,
-                  double *b,
-                  double *a)
+    // grade (or reverse grade) and clamp one value of channel c, in double precision
+    void gradeChannel(double *v,
+                      int c)
     {
-        if (processR) {
-            invgrade(r, _whitePoint.r, _blackPoint.r, _white.r, _black.r, _multiply.r, _offset.r, _gamma.r);
-        }
-        if (processG) {
-            invgrade(g, _whitePoint.g, _blackPoint.g, _white.g, _black.g, _multiply.g, _offset.g, _gamma.g);
+        if (_reverse) {
+            invgrade(v, channel(_whitePoint, c), channel(_blackPoint, c), channel(_white, c), channel(_black, c), channel(_multiply, c), channel(_offset, c), channel(_gamma, c));
+        } else {
+            grade(v, channel(_whitePoint, c), channel(_blackPoint, c), channel(_white, c), channel(_black, c), channel(_multiply, c), channel(_offset, c), channel(_gamma, c));
         }
-        if (processB) {
-            invgrade(b, _whitePoint.b, _blackPoint.b, _white.b, _black.b, _multiply.b, _offset.b, _gamma.b);
+        if (_clampBlack) {
+            *v = (std::max)(0., *v);
         }
-        if (processA) {
-            invgrade(a, _whitePoint.a, _blackPoint.a, _white.a, _black.a, _multiply.a, _offset.a, _gamma.a);
+        if (_clampWhite) {
+            *v = (std::min)(1., *v);
         }
     }
 
-    template<bool processR, bool processG, bool processB, bool processA>
-    void clamp(double *r,
-               double *g,
-               double *b,
-               double *a)
+    // grade (or reverse grade) and clamp n values of channel c, using the fast
+    // pow approximation (relative error below 2e-6)
+    void gradeRow(float *v,
+                  int n,
+                  int c) const
     {
-        if (_clampBlack) {
-            if (processR) {
-                *r = (std::max)(0., *r);
+        const double d = channel(_whitePoint, c) - channel(_blackPoint, c);
+        const double dA = d != 0 ? channel(_multiply, c) * ( channel(_white, c) - channel(_black, c) ) / d : 0;
+        const float A = (float)dA;
+        const float B = (float)( channel(_offset, c) + channel(_black, c) - dA * channel(_blackPoint, c) );
+        const double gamma = channel(_gamma, c);
+
+        if (!_reverse) {
+            for (int i = 0; i < n; ++i) {
+                v[i] = A * v[i] + B;
             }
-            if (processG) {
-                *g = (std::max)(0., *g);
+            if (gamma <= 0) {
+                for (int i = 0; i < n; ++i) {
+                    v[i] = v[i] < 1.f ? 0.f : (v[i] == 1.f ? 1.f : std::numeric_limits<float>::infinity());
+                }
+            } else if (gamma != 1.) {
+                const float invgamma = (float)(1. / gamma);
+                for (int i = 0; i < n; ++i) {
+                    v[i] = FastMath::select(v[i] > 0.f, FastMath::fast_pow(v[i], invgamma), v[i]);
+                }
             }
-            if (processB) {
-                *b = (std::max)(0., *b);
+        } else {
+            if (gamma != 1.) {
+                const float g = (float)gamma;
+                for (int i = 0; i < n; ++i) {
+                    v[i] = FastMath::select(v[i] > 0.f, FastMath::fast_pow(v[i], g), v[i]);
+                }
             }
-            if (processA) {
-                *a = (std::max)(0., *a);
+            const float invA = A != 0 ? 1.f / A : 1.f;
+            for (int i = 0; i < n; ++i) {
+                v[i] = (v[i] - B) * invA;
             }
         }
-        if (_clampWhite) {
-            if (processR) {
-                *r = (std::min)(1., *r);
+        if (_clampBlack) {
+            for (int i = 0; i < n; ++i) {
+                v[i] = FastMath::fmax(v[i], 0.f);
             }
-            if (processG) {
-                *g = (std::min)(1., *g);
+        }
+        if (_clampWhite) {
+            for (int i = 0; i < n; ++i) {
+                v[i] = FastMath::fmin(v[i], 1.f);
             }
-            if (processB) {
-                *b = (std::min)(1., *b);
+        }
+    }
+
+    // Build the lookup tables of 8-bit and 16-bit images, which give the
+    // graded value of each code value. They cannot be used on premultiplied
+    // images, and they are only worth it if the render window has more pixels
+    // than a table has entries.
+    void buildTables(int maxValue,
+                     const OfxRectI &renderWindow)
+    {
+        const bool doProcess[4] = { _processR, _processG, _processB, _processA };
+
+        _useTables = !_premult && (double)(renderWindow.x2 - renderWindow.x1) * (renderWindow.y2 - renderWindow.y1) > maxValue + 1;
+        if (!_useTables) {
+            return;
+        }
+        for (int c = 0; c < 4; ++c) {
+            if (!doProcess[c]) {
+                continue;
             }
-            if (processA) {
-                *a = (std::min)(1., *a);
+            _table[c].resize(maxValue + 1);
+            for (int i = 0; i <= maxValue; ++i) {
+                double v = i / (double)maxValue;
+                gradeChannel(&v, c);
+                _table[c][i] = (float)v;
             }
         }
     }
 
-    bool reverse() const { return _reverse; }
+protected:
+    bool _useTables;
+    std::vector<float> _table[4];
 
 private:
+    static double channel(const RGBAValues &v,
+                          int c)
+    {
+        return c == 0 ? v.r : (c == 1 ? v.g : (c == 2 ? v.b : v.a));
+    }
+
     RGBAValues _blackPoint;
     RGBAValues _whitePoint;
     RGBAValues _black;
@@ -688,57 +717,48 @@ private:
         assert( !processA || (nComponents == 1 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
         assert(_dstImg);
+        assert(!_useTables || maxValue != 1);
+        const bool doProcess[4] = { processR, processG, processB, processA };
         float unpPix[4];
         float tmpPix[4];
-        if ( reverse() ) {
-            for (int y = procWindow.y1; y < procWindow.y2; y++) {
-                if ( _effect.abort() ) {
-                    break;
-                }
-
-                PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-
-                for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                    const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                    ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-                    double t_r = unpPix[0];
-                    double t_g = unpPix[1];
-                    double t_b = unpPix[2];
-                    double t_a = unpPix[3];
-                    invgrade<processR, processG, processB, processA>(&t_r, &t_g, &t_b, &t_a);
-                    clamp<processR, processG, processB, processA>(&t_r, &t_g, &t_b, &t_a);
-                    tmpPix[0] = (float)t_r;
-                    tmpPix[1] = (float)t_g;
-                    tmpPix[2] = (float)t_b;
-                    tmpPix[3] = (float)t_a;
-                    ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                    // increment the dst pixel
-                    dstPix += nComponents;
-                }
-            }
-
-            return;
-        }
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            // unpremultiply the row into one array per channel, and grade the
+            // processed channels, either with the lookup tables or row by row
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
                 ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-                double t_r = unpPix[0];
-                double t_g = unpPix[1];
-                double t_b = unpPix[2];
-                double t_a = unpPix[3];
-                grade<processR, processG, processB, processA>(&t_r, &t_g, &t_b, &t_a);
-                clamp<processR, processG, processB, processA>(&t_r, &t_g, &t_b, &t_a);
-                tmpPix[0] = (float)t_r;
-                tmpPix[1] = (float)t_g;
-                tmpPix[2] = (float)t_b;
-                tmpPix[3] = (float)t_a;
+                for (int c = 0; c < 4; ++c) {
+                    planes[c][i] = unpPix[c];
+                }
+                if (_useTables) {
+                    for (int c = 0; c < nComponents; ++c) {
+                        if (doProcess[c]) {
+                            planes[c][i] = _table[c][srcPix ? (int)srcPix[c] : 0];
+                        }
+                    }
+                }
+            }
+            if (!_useTables) {
+                for (int c = 0; c < 4; ++c) {
+                    if (doProcess[c]) {
+                        gradeRow(planes[c], n, c);
+                    }
+                }
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
+                }
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // increment the dst pixel
                 dstPix += nComponents;
@@ -747,7 +767,6 @@ private:
     }
 };
 
-
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class GradePlugin
@@ -1048,6 +1067,9 @@ GradePlugin::setupAndProcess(GradeProcessorBase &processor,
     processor.setValues(blackPoint, whitePoint, black, white, multiply, offset, gamma,
                         reverse, clampBlack, clampWhite, premult, premultChannel, mix,
                         processR, processG, processB, processA);
+    if ( (dstBitDepth == eBitDepthUByte) || (dstBitDepth == eBitDepthUShort) ) {
+        processor.buildTables(dstBitDepth == eBitDepthUByte ? 255 : 65535, args.renderWindow);
+    }
     processor.process();
 } // GradePlugin::setupAndProcess
 
@@ -31,6 +31,7 @@
 #include "ofxsLut.h"
 #include "ofxsMacros.h"
 #include "ofxsRectangleInteract.h"
+#include "ofxsHSV.h"
 #include "ofxsThreadSuite.h"
 #include "ofxsMultiThread.h"
 #ifdef OFX_USE_MULTITHREAD_MUTEX
@@ -73,8 +74,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "First, set the Range parameter of the Hue parameter set and then work down the other Ranges parameters, tuning with the range Falloff and Adjustment parameters." \
 
 #define kPluginIdentifier "net.sf.openfx.HSVToolPlugin"
+// History:
+// version 1.0: initial version
+// version 1.1: convert rows to HSV and back at once
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -514,19 +518,19 @@ public:
         _mix = mix;
     } // setValues
 
-    void hsvtool(float r,
-                 float g,
-                 float b,
-                 float *hcoeff,
-                 float *scoeff,
-                 float *vcoeff,
-                 float *rout,
-                 float *gout,
-                 float *bout)
+    // compute the coefficients of the HSV color (as given by Color::rgb_to_hsv),
+    // and adjust it if the returned coefficient is positive.
+    // The adjusted color must then be converted back with Color::hsv_to_rgb.
+    float hsvtool(float *hp,
+                  float *sp,
+                  float *vp,
+                  float *hcoeff,
+                  float *scoeff,
+                  float *vcoeff)
     {
-        float h, s, v;
-
-        Color::rgb_to_hsv(r, g, b, &h, &s, &v);
+        float h = *hp;
+        float s = *sp;
+        float v = *vp;
 
         h *= 360. / OFXS_HUE_CIRCLE;
         const double h0 = _values.hueRange[0];
@@ -579,11 +583,7 @@ public:
         assert(0 <= *vcoeff && *vcoeff <= 1.);
         float coeff = (std::min)((std::min)(*hcoeff, *scoeff), *vcoeff);
         assert(0 <= coeff && coeff <= 1.);
-        if (coeff <= 0.) {
-            *rout = r;
-            *gout = g;
-            *bout = b;
-        } else {
+        if (coeff > 0.) {
             //h += coeff * (float)_values.hueRotation;
             h += coeff * ( (float)_values.hueRotation + (_values.hueRotationGain - 1.) * normalizeAngleSigned(h - _values.hueMean) );
             s += coeff * ( (float)_values.satAdjust + (_values.satAdjustGain - 1.) * (s - (s0 + s1) / 2) );
@@ -592,8 +592,18 @@ public:
             }
             v += coeff * ( (float)_values.valAdjust + (_values.valAdjustGain - 1.) * (v - (v0 + v1) / 2) );
             h *= OFXS_HUE_CIRCLE / 360.;
-            Color::hsv_to_rgb(h, s, v, rout, gout, bout);
+            *hp = h;
+            *sp = s;
+            *vp = v;
         }
+
+        return coeff;
+    } // hsvtool
+
+    void clampRGB(float *rout,
+                  float *gout,
+                  float *bout)
+    {
         if (_clampBlack) {
             *rout = (std::max)(0.f, *rout);
             *gout = (std::max)(0.f, *gout);
@@ -604,7 +614,7 @@ public:
             *gout = (std::min)(1.f, *gout);
             *bout = (std::min)(1.f, *bout);
         }
-    } // hsvtool
+    }
 
 private:
     HSVToolValues _values;
@@ -627,8 +637,12 @@ public:
     {
         assert(nComponents == 3 || nComponents == 4);
         assert(_dstImg);
-        float unpPix[4];
         float tmpPix[4];
+        // the unpremultiplied source, its HSV values, and the converted colors, for a span of the row
+        float rs[kHSVChunkSize], gs[kHSVChunkSize], bs[kHSVChunkSize];
+        float hs[kHSVChunkSize], ss[kHSVChunkSize], vs[kHSVChunkSize];
+        float ro[kHSVChunkSize], go[kHSVChunkSize], bo[kHSVChunkSize];
+        float hcoeffs[kHSVChunkSize], scoeffs[kHSVChunkSize], vcoeffs[kHSVChunkSize], coeffs[kHSVChunkSize];
         // only premultiply output if keeping the source alpha
         const bool premultOut = _premult && (_outputAlpha == eOutputAlphaSource);
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
@@ -638,60 +652,89 @@ public:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-                float hcoeff, scoeff, vcoeff;
-                hsvtool(unpPix[0], unpPix[1], unpPix[2], &hcoeff, &scoeff, &vcoeff, &tmpPix[0], &tmpPix[1], &tmpPix[2]);
-                ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, premultOut, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                // if output alpha is not source alpha, set it to the right value
-                if ( (nComponents == 4) && (_outputAlpha != eOutputAlphaSource) ) {
-                    float a = 0.f;
-                    switch (_outputAlpha) {
-                    case eOutputAlphaSource:
-                        break;
-                    case eOutputAlphaHue:
-                        a = hcoeff;
-                        break;
-                    case eOutputAlphaSaturation:
-                        a = scoeff;
-                        break;
-                    case eOutputAlphaBrightness:
-                        a = vcoeff;
-                        break;
-                    case eOutputAlphaHueSaturation:
-                        a = (std::min)(hcoeff, scoeff);
-                        break;
-                    case eOutputAlphaHueBrightness:
-                        a = (std::min)(hcoeff, vcoeff);
-                        break;
-                    case eOutputAlphaSaturationBrightness:
-                        a = (std::min)(scoeff, vcoeff);
-                        break;
-                    case eOutputAlphaAll:
-                        a = (std::min)((std::min)(hcoeff, scoeff), vcoeff);
-                        break;
+            for (int x0 = procWindow.x1; x0 < procWindow.x2; x0 += kHSVChunkSize) {
+                const int n = (std::min)(kHSVChunkSize, procWindow.x2 - x0);
+                for (int i = 0; i < n; ++i) {
+                    const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x0 + i, y) : 0);
+                    float unpPix[4];
+                    ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
+                    rs[i] = unpPix[0];
+                    gs[i] = unpPix[1];
+                    bs[i] = unpPix[2];
+                }
+                HSV::rgb_to_hsv(rs, gs, bs, hs, ss, vs, n);
+                for (int i = 0; i < n; ++i) {
+                    coeffs[i] = hsvtool(&hs[i], &ss[i], &vs[i], &hcoeffs[i], &scoeffs[i], &vcoeffs[i]);
+                }
+                // the colors that are not affected are converted too, but not used
+                HSV::hsv_to_rgb(hs, ss, vs, ro, go, bo, n);
+
+                for (int i = 0; i < n; ++i) {
+                    const int x = x0 + i;
+                    const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                    const float hcoeff = hcoeffs[i];
+                    const float scoeff = scoeffs[i];
+                    const float vcoeff = vcoeffs[i];
+                    if (coeffs[i] <= 0.) {
+                        tmpPix[0] = rs[i];
+                        tmpPix[1] = gs[i];
+                        tmpPix[2] = bs[i];
+                    } else {
+                        tmpPix[0] = ro[i];
+                        tmpPix[1] = go[i];
+                        tmpPix[2] = bo[i];
                     }
-                    if (_doMasking) {
-                        // we do, get the pixel from the mask
-                        const PIX* maskPix = _maskImg ? (const PIX *)_maskImg->getPixelAddress(x, y) : 0;
-                        float maskScale;
-                        // figure the scale factor from that pixel
-                        if (maskPix == 0) {
-                            maskScale = _maskInvert ? 1.f : 0.f;
-                        } else {
-                            maskScale = *maskPix / float(maxValue);
-                            if (_maskInvert) {
-                                maskScale = 1.f - maskScale;
+                    clampRGB(&tmpPix[0], &tmpPix[1], &tmpPix[2]);
+                    ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, premultOut, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    // if output alpha is not source alpha, set it to the right value
+                    if ( (nComponents == 4) && (_outputAlpha != eOutputAlphaSource) ) {
+                        float a = 0.f;
+                        switch (_outputAlpha) {
+                        case eOutputAlphaSource:
+                            break;
+                        case eOutputAlphaHue:
+                            a = hcoeff;
+                            break;
+                        case eOutputAlphaSaturation:
+                            a = scoeff;
+                            break;
+                        case eOutputAlphaBrightness:
+                            a = vcoeff;
+                            break;
+                        case eOutputAlphaHueSaturation:
+                            a = (std::min)(hcoeff, scoeff);
+                            break;
+                        case eOutputAlphaHueBrightness:
+                            a = (std::min)(hcoeff, vcoeff);
+                            break;
+                        case eOutputAlphaSaturationBrightness:
+                            a = (std::min)(scoeff, vcoeff);
+                            break;
+                        case eOutputAlphaAll:
+                            a = (std::min)((std::min)(hcoeff, scoeff), vcoeff);
+                            break;
+                        }
+                        if (_doMasking) {
+                            // we do, get the pixel from the mask
+                            const PIX* maskPix = _maskImg ? (const PIX *)_maskImg->getPixelAddress(x, y) : 0;
+                            float maskScale;
+                            // figure the scale factor from that pixel
+                            if (maskPix == 0) {
+                                maskScale = _maskInvert ? 1.f : 0.f;
+                            } else {
+                                maskScale = *maskPix / float(maxValue);
+                                if (_maskInvert) {
+                                    maskScale = 1.f - maskScale;
+                                }
                             }
+                            a = (std::min)(a, maskScale);
                         }
-                        a = (std::min)(a, maskScale);
+                        dstPix[3] = maxValue * a;
                     }
-                    dstPix[3] = maxValue * a;
-                }
 
-                // increment the dst pixel
-                dstPix += nComponents;
+                    // increment the dst pixel
+                    dstPix += nComponents;
+                }
             }
         }
     } // multiThreadProcessImages
@@ -43,6 +43,24 @@
 #include "ofxsCoords.h"
 #include "ofxsLut.h"
 #include "ofxsMacros.h"
+#include "ofxsThreadSuite.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
+#include "ofxsHSV.h"
+#include "ofxsHueCurves.h"
 
 using namespace OFX;
 
@@ -68,8 +86,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "See also: http://opticalenquiry.com/nuke/index.php?title=HueCorrect"
 
 #define kPluginIdentifier "net.sf.openfx.HueCorrect"
+// History:
+// version 1.0: initial version
+// version 1.1: cache the curve tables across renders, convert rows to HSV at once
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -269,40 +290,20 @@ luminance(T r,
 }
 
 // template to do the processing.
-// nbValues is the number of values in the LUT minus 1. For integer types, it should be the same as
-// maxValue
-template <class PIX, int nComponents, int maxValue, int nbValues>
+template <class PIX, int nComponents, int maxValue>
 class HueCorrectProcessor
     : public HueCorrectProcessorBase
 {
 public:
     // ctor
     HueCorrectProcessor(ImageEffect &instance,
-                        const RenderArguments &args,
-                        ParametricParam  *hueParam,
+                        const HueCurves *curves,
                         bool clampBlack,
                         bool clampWhite)
         : HueCorrectProcessorBase(instance, clampBlack, clampWhite)
-        , _hueParam(hueParam)
+        , _curves(curves)
     {
-        // build the LUT
-        assert(_hueParam);
-        _time = args.time;
-        for (int c = 0; c < kCurveNb; ++c) {
-            _hue[c].resize(nbValues + 1);
-            for (int position = 0; position <= nbValues; ++position) {
-                // position to evaluate the param at
-                double parametricPos = 6 * double(position) / nbValues;
-
-                // evaluate the parametric param
-                double value = _hueParam->getValue(c, _time, parametricPos);
-
-                // all the values (in HueCorrect) must be positive. We don't care if sat_thrsh goes above 1.
-                value = (std::max)(0., value);
-                // set that in the lut
-                _hue[c][position] = value;
-            }
-        }
+        assert(_curves);
     }
 
 private:
@@ -312,6 +313,9 @@ private:
         assert(nComponents == 3 || nComponents == 4);
         assert(_dstImg);
         float tmpPix[4];
+        // the unpremultiplied source and its HSV values, for a span of the row
+        float rs[kHSVChunkSize], gs[kHSVChunkSize], bs[kHSVChunkSize], as[kHSVChunkSize];
+        float hs[kHSVChunkSize], ss[kHSVChunkSize], vs[kHSVChunkSize];
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
@@ -319,124 +323,115 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                float unpPix[4];
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-                // ofxsUnPremult outputs normalized data
-
-                float r = unpPix[0];
-                float g = unpPix[1];
-                float b = unpPix[2];
-                float l_in = 0.;
-                if (_luminanceMix > 0.) {
-                    l_in = luminance(r, g, b, _luminanceMath);
+            for (int x0 = procWindow.x1; x0 < procWindow.x2; x0 += kHSVChunkSize) {
+                const int n = (std::min)(kHSVChunkSize, procWindow.x2 - x0);
+                for (int i = 0; i < n; ++i) {
+                    const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x0 + i, y) : 0);
+                    float unpPix[4];
+                    ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
+                    // ofxsUnPremult outputs normalized data
+                    rs[i] = unpPix[0];
+                    gs[i] = unpPix[1];
+                    bs[i] = unpPix[2];
+                    as[i] = unpPix[3];
                 }
-                float h, s, v;
-                Color::rgb_to_hsv( r, g, b, &h, &s, &v );
-                h = h * 6 + 1;
-                if (h > 6) {
-                    h -= 6;
-                }
-                double sat = interpolate(kCurveSat, h);
-                double lum = interpolate(kCurveLum, h);
-                double red = interpolate(kCurveRed, h);
-                double green = interpolate(kCurveGreen, h);
-                double blue = interpolate(kCurveBlue, h);
-                double r_sup = interpolate(kCurveRSup, h);
-                double g_sup = interpolate(kCurveGSup, h);
-                double b_sup = interpolate(kCurveBSup, h);
-                float sat_thrsh = interpolate(kCurveSatThrsh, h);
-
-                if (r_sup != 1.) {
-                    // If r > min(g,b),  r = min(g,b) + r_sup * (r-min(g,b))
-                    float m = (std::min)(g, b);
-                    if (r > m) {
-                        r = m + r_sup * (r - m);
+                HSV::rgb_to_hsv(rs, gs, bs, hs, ss, vs, n);
+
+                for (int i = 0; i < n; ++i) {
+                    const int x = x0 + i;
+                    const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                    float r = rs[i];
+                    float g = gs[i];
+                    float b = bs[i];
+                    float l_in = 0.;
+                    if (_luminanceMix > 0.) {
+                        l_in = luminance(r, g, b, _luminanceMath);
                     }
-                }
-                if (g_sup != 1.) {
-                    float m = (std::min)(r, b);
-                    if (g > m) {
-                        g = m + g_sup * (g - m);
+                    float h = hs[i];
+                    float s = ss[i];
+                    h = h * 6 + 1;
+                    if (h > 6) {
+                        h -= 6;
                     }
-                }
-                if (b_sup != 1.) {
-                    float m = (std::min)(r, g);
-                    if (b > m) {
-                        b = m + b_sup * (b - m);
+                    double values[kCurveNb];
+                    _curves->interpolate(h, values);
+                    double sat = values[kCurveSat];
+                    double lum = values[kCurveLum];
+                    double red = values[kCurveRed];
+                    double green = values[kCurveGreen];
+                    double blue = values[kCurveBlue];
+                    double r_sup = values[kCurveRSup];
+                    double g_sup = values[kCurveGSup];
+                    double b_sup = values[kCurveBSup];
+                    float sat_thrsh = values[kCurveSatThrsh];
+
+                    if (r_sup != 1.) {
+                        // If r > min(g,b),  r = min(g,b) + r_sup * (r-min(g,b))
+                        float m = (std::min)(g, b);
+                        if (r > m) {
+                            r = m + r_sup * (r - m);
+                        }
                     }
-                }
-                if (s > sat_thrsh) {
-                    // Get a smooth effect: identity at s=sat_thrsh, full if sat_thrsh = 0
-                    r *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * red * lum) / s); // red * lum
-                    g *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * green * lum) / s); // green * lum;
-                    b *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * blue * lum) / s); // blue * lum;
-                } else if (sat_thrsh == 0.) {
-                    assert(s == 0.);
-                    r *= (float)(red * lum); // red * lum
-                    g *= (float)(green * lum); // green * lum;
-                    b *= (float)(blue * lum); // blue * lum;
-                }
-                if (sat != 1.) {
-                    float l_sat = luminance(r, g, b, _luminanceMath);
-                    r = (float)((1. - sat) * l_sat + sat * r);
-                    g = (float)((1. - sat) * l_sat + sat * g);
-                    b = (float)((1. - sat) * l_sat + sat * b);
-                }
-                if (_luminanceMix > 0.) {
-                    float l_out = luminance(r, g, b, _luminanceMath);
-                    if (l_out <= 0.) {
-                        r = g = b = l_in;
-                    } else {
-                        float f = (float)(1 + _luminanceMix * (l_in / l_out - 1.));
-                        r *= f;
-                        g *= f;
-                        b *= f;
+                    if (g_sup != 1.) {
+                        float m = (std::min)(r, b);
+                        if (g > m) {
+                            g = m + g_sup * (g - m);
+                        }
+                    }
+                    if (b_sup != 1.) {
+                        float m = (std::min)(r, g);
+                        if (b > m) {
+                            b = m + b_sup * (b - m);
+                        }
+                    }
+                    if (s > sat_thrsh) {
+                        // Get a smooth effect: identity at s=sat_thrsh, full if sat_thrsh = 0
+                        r *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * red * lum) / s); // red * lum
+                        g *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * green * lum) / s); // green * lum;
+                        b *= (float)((sat_thrsh * 1. + (s - sat_thrsh) * blue * lum) / s); // blue * lum;
+                    } else if (sat_thrsh == 0.) {
+                        assert(s == 0.);
+                        r *= (float)(red * lum); // red * lum
+                        g *= (float)(green * lum); // green * lum;
+                        b *= (float)(blue * lum); // blue * lum;
+                    }
+                    if (sat != 1.) {
+                        float l_sat = luminance(r, g, b, _luminanceMath);
+                        r = (float)((1. - sat) * l_sat + sat * r);
+                        g = (float)((1. - sat) * l_sat + sat * g);
+                        b = (float)((1. - sat) * l_sat + sat * b);
+                    }
+                    if (_luminanceMix > 0.) {
+                        float l_out = luminance(r, g, b, _luminanceMath);
+                        if (l_out <= 0.) {
+                            r = g = b = l_in;
+                        } else {
+                            float f = (float)(1 + _luminanceMix * (l_in / l_out - 1.));
+                            r *= f;
+                            g *= f;
+                            b *= f;
+                        }
                     }
-                }
 
-                tmpPix[0] = clamp<float>(r, 1.);
-                tmpPix[1] = clamp<float>(g, 1.);
-                tmpPix[2] = clamp<float>(b, 1.);
-                tmpPix[3] = unpPix[3]; // alpha is left unchanged
-                for (int c = 0; c < nComponents; ++c) {
-                    assert( !OFX::IsNaN(unpPix[c]) && !OFX::IsNaN(unpPix[c]) &&
-                            !OFX::IsNaN(tmpPix[c]) && !OFX::IsNaN(tmpPix[c]) );
-                }
+                    tmpPix[0] = clamp<float>(r, 1.);
+                    tmpPix[1] = clamp<float>(g, 1.);
+                    tmpPix[2] = clamp<float>(b, 1.);
+                    tmpPix[3] = as[i]; // alpha is left unchanged
+                    for (int c = 0; c < nComponents; ++c) {
+                        assert( !OFX::IsNaN(tmpPix[c]) );
+                    }
 
-                // ofxsPremultMaskMixPix expects normalized input
-                ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
-                // increment the dst pixel
-                dstPix += nComponents;
+                    // ofxsPremultMaskMixPix expects normalized input
+                    ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+                    // increment the dst pixel
+                    dstPix += nComponents;
+                }
             }
         }
     } // multiThreadProcessImages
 
-    double interpolate(int c, // the curve number
-                       double value)
-    {
-        if ( (value < 0.) || (6. < value) ) {
-            // slow version
-            double ret = _hueParam->getValue(c, _time, value);
-
-            return ret;
-        } else {
-            double x = value / 6.;
-            int i = (int)(x * nbValues);
-            assert(0 <= i && i <= nbValues);
-            double alpha = (std::max)( 0., (std::min)(x * nbValues - i, 1.) );
-            double a = _hue[c][i];
-            double b = (i  < nbValues) ? _hue[c][i + 1] : 0.f;
-
-            return a * (1.f - alpha) + b * alpha;
-        }
-    }
-
 private:
-    std::vector<double> _hue[kCurveNb];
-    ParametricParam*  _hueParam;
-    double _time;
+    const HueCurves *_curves;
 };
 
 
@@ -509,6 +504,10 @@ private:
         if ( (paramName == kParamMixLuminanceEnable) && (args.reason == eChangeUserEdit) ) {
             _luminanceMix->setEnabled( _luminanceMixEnable->getValueAtTime(time) );
         }
+        if (paramName == kParamHue) {
+            // the curves may have changed without changing their control points
+            _curvesCache.invalidate();
+        }
     } // changedParam
 
 private:
@@ -527,6 +526,7 @@ private:
     BooleanParam* _maskApply;
     BooleanParam* _maskInvert;
     BooleanParam* _premultChanged; // set to true the first time the user connects src
+    HueCurvesCache<Mutex> _curvesCache;
 };
 
 
@@ -623,17 +623,20 @@ HueCorrectPlugin::renderForComponents(const RenderArguments &args,
 
     switch (dstBitDepth) {
     case eBitDepthUByte: {
-        HueCorrectProcessor<unsigned char, nComponents, 255, 255> fred(*this, args, _hue, clampBlack, clampWhite);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueCorrectProcessor<unsigned char, nComponents, 255> fred(*this, curves.acquire(_hue, time, kCurveNb, 255), clampBlack, clampWhite);
         setupAndProcess(fred, args);
         break;
     }
     case eBitDepthUShort: {
-        HueCorrectProcessor<unsigned short, nComponents, 65535, 65535> fred(*this, args, _hue, clampBlack, clampWhite);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueCorrectProcessor<unsigned short, nComponents, 65535> fred(*this, curves.acquire(_hue, time, kCurveNb, 65535), clampBlack, clampWhite);
         setupAndProcess(fred, args);
         break;
     }
     case eBitDepthFloat: {
-        HueCorrectProcessor<float, nComponents, 1, 1023> fred(*this, args, _hue, clampBlack, clampWhite);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueCorrectProcessor<float, nComponents, 1> fred(*this, curves.acquire(_hue, time, kCurveNb, 1023), clampBlack, clampWhite);
         setupAndProcess(fred, args);
         break;
     }
@@ -1158,42 +1161,22 @@ floatToSample(double value)
     return PIX(value * maxValue + 0.5);
 }
 
-template <class PIX, int nComponents, int maxValue, int nbValues>
+template <class PIX, int nComponents, int maxValue>
 class HueKeyerProcessor
     : public HueKeyerProcessorBase
 {
 private:
-    std::vector<double> _hue[kCurveKeyerNb];
-    ParametricParam*  _hueParam;
-    double _time;
+    const HueCurves *_curves;
 
 public:
     // ctor
     HueKeyerProcessor(ImageEffect &instance,
-                      const RenderArguments &args,
-                      ParametricParam  *hueParam)
+                      const HueCurves *curves)
         : HueKeyerProcessorBase(instance)
-        , _hueParam(hueParam)
+        , _curves(curves)
     {
         assert(nComponents == 4);
-        // build the LUT
-        assert(_hueParam);
-        _time = args.time;
-        for (int c = 0; c < kCurveKeyerNb; ++c) {
-            _hue[c].resize(nbValues + 1);
-            for (int position = 0; position <= nbValues; ++position) {
-                // position to evaluate the param at
-                double parametricPos = 6 * double(position) / nbValues;
-
-                // evaluate the parametric param
-                double value = _hueParam->getValue(c, _time, parametricPos);
-
-                // all the values (in HueKeyer) must be positive. We don't care if sat_thrsh goes above 1.
-                value = (std::max)(0., value);
-                // set that in the lut
-                _hue[c][position] = value;
-            }
-        }
+        assert(_curves);
     }
 
 private:
@@ -1202,6 +1185,9 @@ private:
     {
         assert(nComponents == 4);
         assert(_dstImg);
+        // the source and its HSV values, for a span of the row
+        float rs[kHSVChunkSize], gs[kHSVChunkSize], bs[kHSVChunkSize];
+        float hs[kHSVChunkSize], ss[kHSVChunkSize], vs[kHSVChunkSize];
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
@@ -1209,61 +1195,64 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                if (!srcPix) {
+            if (!_srcImg) {
+                for (int x = procWindow.x1; x < procWindow.x2; x++) {
                     std::fill( dstPix, dstPix + 3, PIX() );
                     dstPix[3] = maxValue;
-                } else {
-                    std::copy(srcPix, srcPix + 3, dstPix);
-                    float r = sampleToFloat<PIX, maxValue>(srcPix[0]);
-                    float g = sampleToFloat<PIX, maxValue>(srcPix[1]);
-                    float b = sampleToFloat<PIX, maxValue>(srcPix[2]);
-                    float h, s, v;
-                    Color::rgb_to_hsv( r, g, b, &h, &s, &v );
-                    h = h * 6 + 1;
-                    if (h > 6) {
-                        h -= 6;
+                    // increment the dst pixel
+                    dstPix += nComponents;
+                }
+                continue;
+            }
+
+            for (int x0 = procWindow.x1; x0 < procWindow.x2; x0 += kHSVChunkSize) {
+                const int n = (std::min)(kHSVChunkSize, procWindow.x2 - x0);
+                for (int i = 0; i < n; ++i) {
+                    const PIX *srcPix = (const PIX *) _srcImg->getPixelAddress(x0 + i, y);
+                    if (!srcPix) {
+                        rs[i] = gs[i] = bs[i] = 0.f;
+                    } else {
+                        rs[i] = sampleToFloat<PIX, maxValue>(srcPix[0]);
+                        gs[i] = sampleToFloat<PIX, maxValue>(srcPix[1]);
+                        bs[i] = sampleToFloat<PIX, maxValue>(srcPix[2]);
                     }
-                    double amount = interpolate(kCurveKeyerAmount, h);
-                    double sat_thrsh = interpolate(kCurveKeyerSatThrsh, h);
-                    float a = 0.;
-                    if (s == 0) {
-                        // saturation is 0, hue is undetermined
-                        a = 0.;
-                    } else if (s >= sat_thrsh) {
-                        a = amount;
+                }
+                HSV::rgb_to_hsv(rs, gs, bs, hs, ss, vs, n);
+
+                for (int i = 0; i < n; ++i) {
+                    const PIX *srcPix = (const PIX *) _srcImg->getPixelAddress(x0 + i, y);
+                    if (!srcPix) {
+                        std::fill( dstPix, dstPix + 3, PIX() );
+                        dstPix[3] = maxValue;
                     } else {
-                        a = amount * s / sat_thrsh;
+                        float h = hs[i];
+                        float s = ss[i];
+                        h = h * 6 + 1;
+                        if (h > 6) {
+                            h -= 6;
+                        }
+                        double values[kCurveKeyerNb];
+                        _curves->interpolate(h, values);
+                        double amount = values[kCurveKeyerAmount];
+                        double sat_thrsh = values[kCurveKeyerSatThrsh];
+                        float a = 0.;
+                        if (s == 0) {
+                            // saturation is 0, hue is undetermined
+                            a = 0.;
+                        } else if (s >= sat_thrsh) {
+                            a = amount;
+                        } else {
+                            a = amount * s / sat_thrsh;
+                        }
+                        std::copy(srcPix, srcPix + 3, dstPix);
+                        dstPix[3] = floatToSample<PIX, maxValue>(1. - a);
                     }
-                    std::copy(srcPix, srcPix + 3, dstPix);
-                    dstPix[3] = floatToSample<PIX, maxValue>(1. - a);
+                    // increment the dst pixel
+                    dstPix += nComponents;
                 }
-                // increment the dst pixel
-                dstPix += nComponents;
             }
         }
     }
-
-    double interpolate(int c, // the curve number
-                       double value)
-    {
-        if ( (value < 0.) || (6. < value) ) {
-            // slow version
-            double ret = _hueParam->getValue(c, _time, value);
-
-            return ret;
-        } else {
-            double x = value / 6.;
-            int i = (int)(x * nbValues);
-            assert(0 <= i && i <= nbValues);
-            double alpha = (std::max)( 0., (std::min)(x * nbValues - i, 1.) );
-            double a = _hue[c][i];
-            double b = (i  < nbValues) ? _hue[c][i + 1] : 0.f;
-
-            return a * (1.f - alpha) + b * alpha;
-        }
-    }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1298,10 +1287,20 @@ private:
 
     void setupAndProcess(HueKeyerProcessorBase &, const RenderArguments &args);
 
+    virtual void changedParam(const InstanceChangedArgs & /*args*/,
+                              const std::string &paramName) OVERRIDE FINAL
+    {
+        if (paramName == kParamKeyerHue) {
+            // the curves may have changed without changing their control points
+            _curvesCache.invalidate();
+        }
+    }
+
 private:
     Clip *_dstClip;
     Clip *_srcClip;
     ParametricParam  *_hue;
+    HueCurvesCache<Mutex> _curvesCache;
 };
 
 
@@ -1369,19 +1368,24 @@ void
 HueKeyerPlugin::renderForComponents(const RenderArguments &args,
                                     BitDepthEnum dstBitDepth)
 {
+    const double time = args.time;
+
     switch (dstBitDepth) {
     case eBitDepthUByte: {
-        HueKeyerProcessor<unsigned char, nComponents, 255, 255> fred(*this, args, _hue);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueKeyerProcessor<unsigned char, nComponents, 255> fred(*this, curves.acquire(_hue, time, kCurveKeyerNb, 255) );
         setupAndProcess(fred, args);
         break;
     }
     case eBitDepthUShort: {
-        HueKeyerProcessor<unsigned short, nComponents, 65535, 65535> fred(*this, args, _hue);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueKeyerProcessor<unsigned short, nComponents, 65535> fred(*this, curves.acquire(_hue, time, kCurveKeyerNb, 65535) );
         setupAndProcess(fred, args);
         break;
     }
     case eBitDepthFloat: {
-        HueKeyerProcessor<float, nComponents, 1, 1023> fred(*this, args, _hue);
+        HueCurvesHolder<Mutex> curves(_curvesCache);
+        HueKeyerProcessor<float, nComponents, 1> fred(*this, curves.acquire(_hue, time, kCurveKeyerNb, 1023) );
         setupAndProcess(fred, args);
         break;
     }
@@ -25,6 +25,8 @@
 #include <climits>
 #include <algorithm>
 #include <limits>
+#include <vector>
+#include <list>
 
 #include "ofxsProcessing.H"
 #include "ofxsRectangleInteract.h"
@@ -34,6 +36,7 @@
 #include "ofxsLut.h"
 #include "ofxsThreadSuite.h"
 #include "ofxsMultiThread.h"
+#include "tinythread.h"
 #ifdef OFX_USE_MULTITHREAD_MUTEX
 namespace {
 typedef MultiThread::Mutex Mutex;
@@ -77,8 +80,12 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "The color values of the minimum and maximum luma pixels for an image sequence " \
     "can be used as black and white point in a Grade node to remove flicker from the same sequence."
 #define kPluginIdentifier "net.sf.openfx.ImageStatistics"
+// History:
+// version 1.0: initial version
+// version 1.1: compute all the statistics in a single pass over the image
+// version 1.2: Analyze Sequence can fetch the next frames while analyzing the current one (off by default)
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -112,6 +119,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kParamAutoUpdateLabel "Auto Update"
 #define kParamAutoUpdateHint "Automatically update values when input or rectangle changes if an analysis was performed at current frame. If not checked, values are only updated if the plugin parameters change. "
 
+#define kParamPrefetchFrames "prefetchFrames"
+#define kParamPrefetchFramesLabel "Prefetch Frames"
+#define kParamPrefetchFramesHint "Number of frames fetched ahead in a separate thread by \"Analyze Sequence\", while the current frame is analyzed. 0 (the default) means that each frame is fetched when it is analyzed. The OFX standard only allows fetching images from the threads created by the host, so this should only be enabled with hosts that are known to support fetching images from another thread."
+#define kParamPrefetchFramesDefault 0
+
 #define kParamGroupRGBA "RGBA"
 
 #define kParamStatMin "statMin"
@@ -403,365 +415,215 @@ protected:
 };
 
 
-template <class PIX, int nComponents, int maxValue>
-class ImageMinMaxMeanProcessor
-    : public ImageStatisticsProcessorBase
-{
-private:
-    double _min[nComponents];
-    double _max[nComponents];
-    double _sum[nComponents];
-
-public:
-    ImageMinMaxMeanProcessor(ImageEffect &instance)
-        : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill( _min, _min + nComponents, +std::numeric_limits<double>::infinity() );
-        std::fill( _max, _max + nComponents, -std::numeric_limits<double>::infinity() );
-        std::fill(_sum, _sum + nComponents, 0.);
-    }
-
-    ~ImageMinMaxMeanProcessor()
-    {
-    }
-
-    void setPrevResults(double /* time */,
-                        const Results & /*results*/) OVERRIDE FINAL {}
-
-    void getResults(Results *results) OVERRIDE FINAL
-    {
-        if (_count > 0) {
-            toRGBA<double, nComponents, 1>(_min, &results->min);
-            toRGBA<double, nComponents, 1>(_max, &results->max);
-            double mean[nComponents];
-            for (int c = 0; c < nComponents; ++c) {
-                mean[c] = _sum[c] / _count;
-            }
-            toRGBA<double, nComponents, 1>(mean, &results->mean);
-        }
-    }
-
-private:
-
-    void addResults(double min[nComponents],
-                    double max[nComponents],
-                    double sum[nComponents],
-                    unsigned long count)
-    {
-        AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponents; ++c) {
-            _min[c] = (std::min)(_min[c], min[c]);
-            _max[c] = (std::max)(_max[c], max[c]);
-            _sum[c] += sum[c];
-        }
-        _count += count;
-    }
-
-    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
-    {
-        double min[nComponents], max[nComponents], sum[nComponents];
-
-        std::fill( min, min + nComponents, +std::numeric_limits<double>::infinity() );
-        std::fill( max, max + nComponents, -std::numeric_limits<double>::infinity() );
-        std::fill(sum, sum + nComponents, 0.);
-        unsigned long count = 0;
-
-        assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
-               _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine[nComponents]; // partial sum to avoid underflows
-            std::fill(sumLine, sumLine + nComponents, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                for (int c = 0; c < nComponents; ++c) {
-                    double v = *dstPix;
-                    min[c] = (std::min)(min[c], v);
-                    max[c] = (std::max)(max[c], v);
-                    sumLine[c] += v;
-                    ++dstPix;
-                }
-            }
-            for (int c = 0; c < nComponents; ++c) {
-                sum[c] += sumLine[c];
-            }
-            count += procWindow.x2 - procWindow.x1;
-        }
-
-        addResults(min, max, sum, count);
-    }
-};
-
-
-template <class PIX, int nComponents, int maxValue>
-class ImageSDevProcessor
-    : public ImageStatisticsProcessorBase
+// Mergeable accumulator of the count, min, max, mean and central moments
+// M2, M3, M4 (the sums of the powers of the deviations from the mean) of a
+// set of values.
+// Values are added a row at a time: the moments of the row are computed
+// about the row mean, which is accurate and vectorizable, and then merged
+// with the pairwise update formulas of P. Pébay, "Formulas for robust,
+// one-pass parallel computation of covariances and arbitrary-order
+// statistical moments" (Sandia report SAND2008-6212), which generalize
+// Welford's algorithm.
+struct Moments
 {
-private:
-    double _mean[nComponents];
-    double _sum_p2[nComponents];
-
-public:
-    ImageSDevProcessor(ImageEffect &instance)
-        : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill(_mean, _mean + nComponents, 0.);
-        std::fill(_sum_p2, _sum_p2 + nComponents, 0.);
-    }
-
-    ~ImageSDevProcessor()
-    {
-    }
-
-    void setPrevResults(double /* time */,
-                        const Results &results) OVERRIDE FINAL
-    {
-        toComponents<double, nComponents, 1>(results.mean, _mean);
-    }
-
-    void getResults(Results *results) OVERRIDE FINAL
-    {
-        if (_count > 1) {
-            double sdev[nComponents];
-            for (int c = 0; c < nComponents; ++c) {
-                // sdev^2 is an unbiased estimator for the population variance
-                sdev[c] = std::sqrt( (std::max)( 0., _sum_p2[c] / (_count - 1) ) );
-            }
-            toRGBA<double, nComponents, 1>(sdev, &results->sdev);
-        }
-    }
-
-private:
-
-    void addResults(double sum_p2[nComponents],
-                    unsigned long count)
-    {
-        AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponents; ++c) {
-            _sum_p2[c] += sum_p2[c];
-        }
-        _count += count;
-    }
-
-    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
-    {
-        double sum_p2[nComponents];
-
-        std::fill(sum_p2, sum_p2 + nComponents, 0.);
-        unsigned long count = 0;
-
-        assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
-               _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine_p2[nComponents]; // partial sum to avoid underflows
-            std::fill(sumLine_p2, sumLine_p2 + nComponents, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                for (int c = 0; c < nComponents; ++c) {
-                    double v = (*dstPix - _mean[c]);
-                    sumLine_p2[c] += v * v;
-                    ++dstPix;
-                }
-            }
-            for (int c = 0; c < nComponents; ++c) {
-                sum_p2[c] += sumLine_p2[c];
-            }
-            count += procWindow.x2 - procWindow.x1;
-        }
-
-        addResults(sum_p2, count);
+    double n;
+    double min;
+    double max;
+    double mean;
+    double M2;
+    double M3;
+    double M4;
+
+    Moments()
+        : n(0.)
+        , min( std::numeric_limits<double>::infinity() )
+        , max( -std::numeric_limits<double>::infinity() )
+        , mean(0.)
+        , M2(0.)
+        , M3(0.)
+        , M4(0.)
+    {
+    }
+
+    void addValues(const double *v,
+                   int count)
+    {
+        if (count <= 0) {
+            return;
+        }
+        // the sums are split into kLanes partial sums, to break the dependency
+        // chains and let the compiler vectorize the loops
+        const int kLanes = 4;
+        Moments row;
+        double vmin[kLanes] = { v[0], v[0], v[0], v[0] };
+        double vmax[kLanes] = { v[0], v[0], v[0], v[0] };
+        double sum[kLanes] = { 0., 0., 0., 0. };
+        int i = 0;
+        for (; i + kLanes <= count; i += kLanes) {
+            for (int k = 0; k < kLanes; ++k) {
+                vmin[k] = v[i + k] < vmin[k] ? v[i + k] : vmin[k];
+                vmax[k] = v[i + k] > vmax[k] ? v[i + k] : vmax[k];
+                sum[k] += v[i + k];
+            }
+        }
+        for (; i < count; ++i) {
+            vmin[0] = (std::min)(vmin[0], v[i]);
+            vmax[0] = (std::max)(vmax[0], v[i]);
+            sum[0] += v[i];
+        }
+        row.min = (std::min)( (std::min)(vmin[0], vmin[1]), (std::min)(vmin[2], vmin[3]) );
+        row.max = (std::max)( (std::max)(vmax[0], vmax[1]), (std::max)(vmax[2], vmax[3]) );
+        row.n = count;
+        row.mean = ( (sum[0] + sum[1]) + (sum[2] + sum[3]) ) / count;
+        double M2[kLanes] = { 0., 0., 0., 0. };
+        double M3[kLanes] = { 0., 0., 0., 0. };
+        double M4[kLanes] = { 0., 0., 0., 0. };
+        for (i = 0; i + kLanes <= count; i += kLanes) {
+            for (int k = 0; k < kLanes; ++k) {
+                const double d = v[i + k] - row.mean;
+                const double d2 = d * d;
+                M2[k] += d2;
+                M3[k] += d2 * d;
+                M4[k] += d2 * d2;
+            }
+        }
+        for (; i < count; ++i) {
+            const double d = v[i] - row.mean;
+            const double d2 = d * d;
+            M2[0] += d2;
+            M3[0] += d2 * d;
+            M4[0] += d2 * d2;
+        }
+        row.M2 = (M2[0] + M2[1]) + (M2[2] + M2[3]);
+        row.M3 = (M3[0] + M3[1]) + (M3[2] + M3[3]);
+        row.M4 = (M4[0] + M4[1]) + (M4[2] + M4[3]);
+        merge(row);
+    }
+
+    void merge(const Moments &b)
+    {
+        if (b.n == 0.) {
+            return;
+        }
+        if (n == 0.) {
+            *this = b;
+
+            return;
+        }
+        const double na = n;
+        const double nb = b.n;
+        const double nab = na + nb;
+        const double delta = b.mean - mean;
+        const double deltan = delta / nab;
+        const double deltan2 = deltan * deltan;
+        const double M2ab = M2 + b.M2 + delta * deltan * na * nb;
+        const double M3ab = M3 + b.M3 + delta * deltan2 * na * nb * (na - nb) + 3 * deltan * (na * b.M2 - nb * M2);
+        const double M4ab = ( M4 + b.M4 + delta * deltan2 * deltan * na * nb * (na * na - na * nb + nb * nb) +
+                              6 * deltan2 * (na * na * b.M2 + nb * nb * M2) + 4 * deltan * (na * b.M3 - nb * M3) );
+
+        n = nab;
+        min = (std::min)(min, b.min);
+        max = (std::max)(max, b.max);
+        mean += nb * deltan;
+        M2 = M2ab;
+        M3 = M3ab;
+        M4 = M4ab;
     }
 };
 
-
-template <class PIX, int nComponents, int maxValue>
-class ImageSkewnessKurtosisProcessor
+// Compute all the statistics (min, max, mean, sdev, skewness, kurtosis) of
+// nValues values per pixel in a single pass over the image.
+// Each thread accumulates the moments of its rows, and merges them once
+// into the shared results.
+template <int nValues>
+class ImageMomentsProcessorBase
     : public ImageStatisticsProcessorBase
 {
 private:
-    double _mean[nComponents];
-    double _sdev[nComponents];
-    double _sum_p3[nComponents];
-    double _sum_p4[nComponents];
+    Moments _moments[nValues];
 
 public:
-    ImageSkewnessKurtosisProcessor(ImageEffect &instance)
+    ImageMomentsProcessorBase(ImageEffect &instance)
         : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill(_mean, _mean + nComponents, 0.);
-        std::fill(_sdev, _sdev + nComponents, 0.);
-        std::fill(_sum_p3, _sum_p3 + nComponents, 0.);
-        std::fill(_sum_p4, _sum_p4 + nComponents, 0.);
-    }
-
-    ~ImageSkewnessKurtosisProcessor()
     {
     }
 
     void setPrevResults(double /* time */,
-                        const Results &results) OVERRIDE FINAL
-    {
-        toComponents<double, nComponents, 1>(results.mean, _mean);
-        toComponents<double, nComponents, 1>(results.sdev, _sdev);
-    }
+                        const Results & /*results*/) OVERRIDE FINAL {}
 
     void getResults(Results *results) OVERRIDE FINAL
     {
-        if (_count > 2) {
-            double skewness[nComponents];
+        const double n = _moments[0].n;
+        double min[nValues], max[nValues], mean[nValues], sdev[nValues], sum_p3[nValues], sum_p4[nValues];
+
+        for (int c = 0; c < nValues; ++c) {
+            const Moments &m = _moments[c];
+            min[c] = m.min;
+            max[c] = m.max;
+            mean[c] = m.mean;
+            // sdev^2 is an unbiased estimator for the population variance
+            sdev[c] = n > 1 ? std::sqrt( (std::max)( 0., m.M2 / (n - 1) ) ) : 0.;
+            // sums of the powers of the standardized values
+            const double s2 = sdev[c] * sdev[c];
+            sum_p3[c] = sdev[c] > 0. ? m.M3 / (s2 * sdev[c]) : 0.;
+            sum_p4[c] = sdev[c] > 0. ? m.M4 / (s2 * s2) : 0.;
+        }
+        if (n > 0) {
+            toRGBA<double, nValues, 1>(min, &results->min);
+            toRGBA<double, nValues, 1>(max, &results->max);
+            toRGBA<double, nValues, 1>(mean, &results->mean);
+        }
+        if (n > 1) {
+            toRGBA<double, nValues, 1>(sdev, &results->sdev);
+        }
+        if (n > 2) {
+            double skewness[nValues];
             // factor for the adjusted Fisher-Pearson standardized moment coefficient G_1
-            double skewfac = ( (double)_count * _count ) / ( (double)(_count - 1) * (_count - 2) );
+            double skewfac = (n * n) / ( (n - 1) * (n - 2) );
             assert( !OFX::IsNaN(skewfac) );
-            for (int c = 0; c < nComponents; ++c) {
-                skewness[c] = skewfac * _sum_p3[c] / _count;
+            for (int c = 0; c < nValues; ++c) {
+                skewness[c] = skewfac * sum_p3[c] / n;
             }
-            toRGBA<double, nComponents, 1>(skewness, &results->skewness);
+            toRGBA<double, nValues, 1>(skewness, &results->skewness);
             assert( !OFX::IsNaN(results->skewness.r) && !OFX::IsNaN(results->skewness.g) && !OFX::IsNaN(results->skewness.b) && !OFX::IsNaN(results->skewness.a) );
         }
-        if (_count > 3) {
-            double kurtosis[nComponents];
-            double kurtfac = ( (double)(_count + 1) * _count ) / ( (double)(_count - 1) * (_count - 2) * (_count - 3) );
-            double kurtshift = -3 * ( (double)(_count - 1) * (_count - 1) ) / ( (double)(_count - 2) * (_count - 3) );
+        if (n > 3) {
+            double kurtosis[nValues];
+            double kurtfac = ( (n + 1) * n ) / ( (n - 1) * (n - 2) * (n - 3) );
+            double kurtshift = -3 * ( (n - 1) * (n - 1) ) / ( (n - 2) * (n - 3) );
             assert( !OFX::IsNaN(kurtfac) && !OFX::IsNaN(kurtshift) );
-            for (int c = 0; c < nComponents; ++c) {
-                kurtosis[c] = kurtfac * _sum_p4[c] + kurtshift;
+            for (int c = 0; c < nValues; ++c) {
+                kurtosis[c] = kurtfac * sum_p4[c] + kurtshift;
             }
-            toRGBA<double, nComponents, 1>(kurtosis, &results->kurtosis);
+            toRGBA<double, nValues, 1>(kurtosis, &results->kurtosis);
             assert( !OFX::IsNaN(results->kurtosis.r) && !OFX::IsNaN(results->kurtosis.g) && !OFX::IsNaN(results->kurtosis.b) && !OFX::IsNaN(results->kurtosis.a) );
         }
     }
 
-private:
-
-    void addResults(double sum_p3[nComponents],
-                    double sum_p4[nComponents],
-                    unsigned long count)
-    {
-        AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponents; ++c) {
-            _sum_p3[c] += sum_p3[c];
-            _sum_p4[c] += sum_p4[c];
-        }
-        _count += count;
-    }
-
-    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
-    {
-        double sum_p3[nComponents];
-        double sum_p4[nComponents];
-
-        std::fill(sum_p3, sum_p3 + nComponents, 0.);
-        std::fill(sum_p4, sum_p4 + nComponents, 0.);
-        unsigned long count = 0;
-
-        assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
-               _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine_p3[nComponents]; // partial sum to avoid underflows
-            double sumLine_p4[nComponents]; // partial sum to avoid underflows
-            std::fill(sumLine_p3, sumLine_p3 + nComponents, 0.);
-            std::fill(sumLine_p4, sumLine_p4 + nComponents, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                for (int c = 0; c < nComponents; ++c) {
-                    if (_sdev[c] > 0.) {
-                        double v = (*dstPix - _mean[c]) / _sdev[c];
-                        double v2 = v * v;
-                        sumLine_p3[c] += v2 * v;
-                        sumLine_p4[c] += v2 * v2;
-                    }
-                    ++dstPix;
-                }
-            }
-            for (int c = 0; c < nComponents; ++c) {
-                sum_p3[c] += sumLine_p3[c];
-                sum_p4[c] += sumLine_p4[c];
-            }
-            count += procWindow.x2 - procWindow.x1;
-        }
-
-        addResults(sum_p3, sum_p4, count);
-    }
-};
-
-#define nComponentsHSVL 4
-
-template <class PIX, int nComponents, int maxValue>
-class ImageHSVLMinMaxMeanProcessor
-    : public ImageStatisticsProcessorBase
-{
-private:
-    double _min[nComponentsHSVL];
-    double _max[nComponentsHSVL];
-    double _sum[nComponentsHSVL];
-
-public:
-    ImageHSVLMinMaxMeanProcessor(ImageEffect &instance)
-        : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill( _min, _min + nComponentsHSVL, +std::numeric_limits<double>::infinity() );
-        std::fill( _max, _max + nComponentsHSVL, -std::numeric_limits<double>::infinity() );
-        std::fill(_sum, _sum + nComponentsHSVL, 0.);
-    }
-
-    ~ImageHSVLMinMaxMeanProcessor()
-    {
-    }
-
-    void setPrevResults(double /* time */,
-                        const Results & /*results*/) OVERRIDE FINAL {}
-
-    void getResults(Results *results) OVERRIDE FINAL
-    {
-        if (_count > 0) {
-            toRGBA<double, nComponentsHSVL, 1>(_min, &results->min);
-            toRGBA<double, nComponentsHSVL, 1>(_max, &results->max);
-            double mean[nComponentsHSVL];
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                mean[c] = _sum[c] / _count;
-            }
-            toRGBA<double, nComponentsHSVL, 1>(mean, &results->mean);
-        }
-    }
+protected:
+    // get the values of the pixels [x1,x2) of row y, one array per value
+    virtual void getRowValues(int y, int x1, int x2, double *values[nValues]) = 0;
 
 private:
 
-    void addResults(double min[nComponentsHSVL],
-                    double max[nComponentsHSVL],
-                    double sum[nComponentsHSVL],
-                    unsigned long count)
+    void addResults(const Moments moments[nValues])
     {
         AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponentsHSVL; ++c) {
-            _min[c] = (std::min)(_min[c], min[c]);
-            _max[c] = (std::max)(_max[c], max[c]);
-            _sum[c] += sum[c];
+        for (int c = 0; c < nValues; ++c) {
+            _moments[c].merge(moments[c]);
         }
-        _count += count;
     }
 
     void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
     {
-        double min[nComponentsHSVL], max[nComponentsHSVL], sum[nComponentsHSVL];
+        Moments moments[nValues];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<double> rowBuf(nValues * n);
+        double *values[nValues];
 
-        std::fill( min, min + nComponentsHSVL, +std::numeric_limits<double>::infinity() );
-        std::fill( max, max + nComponentsHSVL, -std::numeric_limits<double>::infinity() );
-        std::fill(sum, sum + nComponentsHSVL, 0.);
-        unsigned long count = 0;
+        for (int c = 0; c < nValues; ++c) {
+            values[c] = &rowBuf[c * n];
+        }
 
         assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
                _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
@@ -770,230 +632,72 @@ private:
                 break;
             }
 
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine[nComponentsHSVL]; // partial sum to avoid underflows
-            std::fill(sumLine, sumLine + nComponentsHSVL, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                float hsvl[nComponentsHSVL];
-                pixToHSVL<PIX, nComponents, maxValue>(dstPix, hsvl);
-                for (int c = 0; c < nComponentsHSVL; ++c) {
-                    double v = hsvl[c];
-                    min[c] = (std::min)(min[c], v);
-                    max[c] = (std::max)(max[c], v);
-                    sumLine[c] += v;
-                }
-                dstPix += nComponents;
-            }
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                sum[c] += sumLine[c];
+            getRowValues(y, procWindow.x1, procWindow.x2, values);
+            for (int c = 0; c < nValues; ++c) {
+                moments[c].addValues(values[c], n);
             }
-            count += procWindow.x2 - procWindow.x1;
         }
 
-        addResults(min, max, sum, count);
+        addResults(moments);
     }
 };
 
 
 template <class PIX, int nComponents, int maxValue>
-class ImageHSVLSDevProcessor
-    : public ImageStatisticsProcessorBase
+class ImageMomentsProcessor
+    : public ImageMomentsProcessorBase<nComponents>
 {
-private:
-    double _mean[nComponentsHSVL];
-    double _sum_p2[nComponentsHSVL];
-
 public:
-    ImageHSVLSDevProcessor(ImageEffect &instance)
-        : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill(_mean, _mean + nComponentsHSVL, 0.);
-        std::fill(_sum_p2, _sum_p2 + nComponentsHSVL, 0.);
-    }
-
-    ~ImageHSVLSDevProcessor()
-    {
-    }
-
-    void setPrevResults(double /* time */,
-                        const Results &results) OVERRIDE FINAL
+    ImageMomentsProcessor(ImageEffect &instance)
+        : ImageMomentsProcessorBase<nComponents>(instance)
     {
-        toComponents<double, nComponentsHSVL, 1>(results.mean, _mean);
-    }
-
-    void getResults(Results *results) OVERRIDE FINAL
-    {
-        if (_count > 1) {
-            double sdev[nComponentsHSVL];
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                // sdev^2 is an unbiased estimator for the population variance
-                sdev[c] = std::sqrt( (std::max)( 0., _sum_p2[c] / (_count - 1) ) );
-            }
-            toRGBA<double, nComponentsHSVL, 1>(sdev, &results->sdev);
-        }
     }
 
 private:
-
-    void addResults(double sum_p2[nComponentsHSVL],
-                    unsigned long count)
+    void getRowValues(int y,
+                      int x1,
+                      int x2,
+                      double *values[nComponents]) OVERRIDE FINAL
     {
-        AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponentsHSVL; ++c) {
-            _sum_p2[c] += sum_p2[c];
-        }
-        _count += count;
-    }
+        const PIX *dstPix = (const PIX *) this->_dstImg->getPixelAddress(x1, y);
 
-    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
-    {
-        double sum_p2[nComponentsHSVL];
-
-        std::fill(sum_p2, sum_p2 + nComponentsHSVL, 0.);
-        unsigned long count = 0;
-
-        assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
-               _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine_p2[nComponentsHSVL]; // partial sum to avoid underflows
-            std::fill(sumLine_p2, sumLine_p2 + nComponentsHSVL, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                float hsvl[nComponentsHSVL];
-                pixToHSVL<PIX, nComponents, maxValue>(dstPix, hsvl);
-                for (int c = 0; c < nComponentsHSVL; ++c) {
-                    double v = (hsvl[c] - _mean[c]);
-                    sumLine_p2[c] += v * v;
-                }
-                dstPix += nComponents;
-            }
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                sum_p2[c] += sumLine_p2[c];
+        for (int i = 0; i < x2 - x1; ++i) {
+            for (int c = 0; c < nComponents; ++c) {
+                values[c][i] = *dstPix;
+                ++dstPix;
             }
-            count += procWindow.x2 - procWindow.x1;
         }
-
-        addResults(sum_p2, count);
     }
 };
 
+#define nComponentsHSVL 4
 
 template <class PIX, int nComponents, int maxValue>
-class ImageHSVLSkewnessKurtosisProcessor
-    : public ImageStatisticsProcessorBase
+class ImageHSVLMomentsProcessor
+    : public ImageMomentsProcessorBase<nComponentsHSVL>
 {
-private:
-    double _mean[nComponentsHSVL];
-    double _sdev[nComponentsHSVL];
-    double _sum_p3[nComponentsHSVL];
-    double _sum_p4[nComponentsHSVL];
-
 public:
-    ImageHSVLSkewnessKurtosisProcessor(ImageEffect &instance)
-        : ImageStatisticsProcessorBase(instance)
-    {
-        std::fill(_mean, _mean + nComponentsHSVL, 0.);
-        std::fill(_sdev, _sdev + nComponentsHSVL, 0.);
-        std::fill(_sum_p3, _sum_p3 + nComponentsHSVL, 0.);
-        std::fill(_sum_p4, _sum_p4 + nComponentsHSVL, 0.);
-    }
-
-    ~ImageHSVLSkewnessKurtosisProcessor()
-    {
-    }
-
-    void setPrevResults(double /* time */,
-                        const Results &results) OVERRIDE FINAL
+    ImageHSVLMomentsProcessor(ImageEffect &instance)
+        : ImageMomentsProcessorBase<nComponentsHSVL>(instance)
     {
-        toComponents<double, nComponentsHSVL, 1>(results.mean, _mean);
-        toComponents<double, nComponentsHSVL, 1>(results.sdev, _sdev);
-    }
-
-    void getResults(Results *results) OVERRIDE FINAL
-    {
-        if (_count > 2) {
-            double skewness[nComponentsHSVL];
-            // factor for the adjusted Fisher-Pearson standardized moment coefficient G_1
-            double skewfac = ( (double)_count * _count ) / ( (double)(_count - 1) * (_count - 2) );
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                skewness[c] = skewfac * _sum_p3[c] / _count;
-            }
-            toRGBA<double, nComponentsHSVL, 1>(skewness, &results->skewness);
-        }
-        if (_count > 3) {
-            double kurtosis[nComponentsHSVL];
-            double kurtfac = ( (double)(_count + 1) * _count ) / ( (double)(_count - 1) * (_count - 2) * (_count - 3) );
-            double kurtshift = -3 * ( (double)(_count - 1) * (_count - 1) ) / ( (double)(_count - 2) * (_count - 3) );
-            for (int c = 0; c < nComponentsHSVL; ++c) {
-                kurtosis[c] = kurtfac * _sum_p4[c] + kurtshift;
-            }
-            toRGBA<double, nComponentsHSVL, 1>(kurtosis, &results->kurtosis);
-        }
     }
 
 private:
-
-    void addResults(double sum_p3[nComponentsHSVL],
-                    double sum_p4[nComponentsHSVL],
-                    unsigned long count)
+    void getRowValues(int y,
+                      int x1,
+                      int x2,
+                      double *values[nComponentsHSVL]) OVERRIDE FINAL
     {
-        AutoMutex l (&_mutex);
-        for (int c = 0; c < nComponentsHSVL; ++c) {
-            _sum_p3[c] += sum_p3[c];
-            _sum_p4[c] += sum_p4[c];
-        }
-        _count += count;
-    }
-
-    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
-    {
-        double sum_p3[nComponentsHSVL];
-        double sum_p4[nComponentsHSVL];
-
-        std::fill(sum_p3, sum_p3 + nComponentsHSVL, 0.);
-        std::fill(sum_p4, sum_p4 + nComponentsHSVL, 0.);
-        unsigned long count = 0;
+        const PIX *dstPix = (const PIX *) _dstImg->getPixelAddress(x1, y);
 
-        assert(_dstImg->getBounds().x1 <= procWindow.x1 && procWindow.y2 <= _dstImg->getBounds().y2 &&
-               _dstImg->getBounds().y1 <= procWindow.y1 && procWindow.y2 <= _dstImg->getBounds().y2);
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            double sumLine_p3[nComponentsHSVL]; // partial sum to avoid underflows
-            double sumLine_p4[nComponentsHSVL]; // partial sum to avoid underflows
-            std::fill(sumLine_p3, sumLine_p3 + nComponentsHSVL, 0.);
-            std::fill(sumLine_p4, sumLine_p4 + nComponentsHSVL, 0.);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x) {
-                float hsvl[nComponentsHSVL];
-                pixToHSVL<PIX, nComponents, maxValue>(dstPix, hsvl);
-                for (int c = 0; c < nComponentsHSVL; ++c) {
-                    if (_sdev[c] > 0.) {
-                        double v = (hsvl[c] - _mean[c]) / _sdev[c];
-                        double v2 = v * v;
-                        sumLine_p3[c] += v2 * v;
-                        sumLine_p4[c] += v2 * v2;
-                    }
-                }
-                dstPix += nComponents;
-            }
+        for (int i = 0; i < x2 - x1; ++i) {
+            float hsvl[nComponentsHSVL];
+            pixToHSVL<PIX, nComponents, maxValue>(dstPix, hsvl);
             for (int c = 0; c < nComponentsHSVL; ++c) {
-                sum_p3[c] += sumLine_p3[c];
-                sum_p4[c] += sumLine_p4[c];
+                values[c][i] = hsvl[c];
             }
-            count += procWindow.x2 - procWindow.x1;
+            dstPix += nComponents;
         }
-
-        addResults(sum_p3, sum_p4, count);
     }
 };
 
@@ -1154,6 +858,133 @@ private:
 };
 
 
+// Fetches the source images of the frames [tmin,tmax] in a separate thread,
+// at most depth frames ahead of the frame being analyzed, so that reading
+// (and rendering upstream) the next frames overlaps with the analysis of the
+// current one. With a depth of 0, images are fetched by take(), from the
+// action thread. The OFX standard does not allow fetching images from a thread
+// that was not created by the host, so a positive depth must be requested by
+// the user.
+class SequencePrefetcher
+{
+public:
+    SequencePrefetcher(Clip* clip,
+                       int tmin,
+                       int tmax,
+                       int depth)
+        : _clip(clip)
+        , _tmax(tmax)
+        , _depth(depth)
+        , _mutex()
+        , _cond()
+        , _ready()
+        , _next(tmin)
+        , _stop(false)
+        , _thread(NULL)
+    {
+        if (_depth > 0) {
+            _thread = new tthread::thread(threadFunction, this);
+        }
+    }
+
+    ~SequencePrefetcher()
+    {
+        if (_thread) {
+            {
+                tthread::lock_guard<tthread::mutex> l(_mutex);
+                _stop = true;
+            }
+            _cond.notify_all();
+            _thread->join();
+            delete _thread;
+        }
+        for (std::list<std::pair<int, Image*> >::iterator it = _ready.begin(); it != _ready.end(); ++it) {
+            delete it->second;
+        }
+    }
+
+    // Get the image at frame t, which is owned by the caller. All the frames
+    // must be taken, in increasing order. If the thread could not fetch the
+    // image, it is fetched here.
+    Image* take(int t)
+    {
+        Image* img = NULL;
+
+        if (_thread) {
+            {
+                tthread::lock_guard<tthread::mutex> l(_mutex);
+                while ( _ready.empty() ) {
+                    _cond.wait(_mutex);
+                }
+                assert(_ready.front().first == t);
+                img = _ready.front().second;
+                _ready.pop_front();
+            }
+            _cond.notify_all();
+        }
+        if (!img) {
+            img = _clip->fetchImage(t);
+        }
+
+        return img;
+    }
+
+private:
+    static void threadFunction(void* arg)
+    {
+        ( (SequencePrefetcher*)arg )->run();
+    }
+
+    void run()
+    {
+        for (;;) {
+            int t;
+            {
+                tthread::lock_guard<tthread::mutex> l(_mutex);
+                while ( !_stop && ( (int)_ready.size() >= _depth ) ) {
+                    _cond.wait(_mutex);
+                }
+                if ( _stop || (_next > _tmax) ) {
+                    return;
+                }
+                t = _next;
+            }
+            Image* img = NULL;
+            try {
+                img = _clip->fetchImage(t);
+            } catch (...) {
+                // the image is fetched again by take(), which reports the error
+                img = NULL;
+            }
+            {
+                tthread::lock_guard<tthread::mutex> l(_mutex);
+                _ready.push_back( std::make_pair(t, img) );
+                ++_next;
+            }
+            _cond.notify_all();
+        }
+    }
+
+    Clip* _clip;
+    int _tmax;
+    int _depth;
+    tthread::mutex _mutex;
+    tthread::condition_variable _cond;
+    std::list<std::pair<int, Image*> > _ready; // fetched frames, in increasing order
+    int _next; // the next frame to fetch
+    bool _stop;
+    tthread::thread* _thread;
+};
+
+// the results of the analysis of a frame by Analyze Sequence
+struct SequenceResults
+{
+    double time;
+    Results rgba;
+    Results hsvl;
+    Results luma;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class ImageStatisticsPlugin
@@ -1169,6 +1000,7 @@ public:
         , _size(NULL)
         , _interactive(NULL)
         , _restrictToRectangle(NULL)
+        , _prefetchFrames(NULL)
     {
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
         assert( _dstClip && (!_dstClip->isConnected() || _dstClip->getPixelComponents() == ePixelComponentAlpha ||
@@ -1185,7 +1017,8 @@ public:
         _interactive = fetchBooleanParam(kParamRectangleInteractInteractive);
         _restrictToRectangle = fetchBooleanParam(kParamRestrictToRectangle);
         _autoUpdate = fetchBooleanParam(kParamAutoUpdate);
-        assert(_btmLeft && _size && _interactive && _restrictToRectangle && _autoUpdate);
+        _prefetchFrames = fetchIntParam(kParamPrefetchFrames);
+        assert(_btmLeft && _size && _interactive && _restrictToRectangle && _autoUpdate && _prefetchFrames);
         _statMin = fetchRGBAParam(kParamStatMin);
         _statMax = fetchRGBAParam(kParamStatMax);
         _statMean = fetchRGBAParam(kParamStatMean);
@@ -1272,6 +1105,16 @@ private:
     void updateHSVL(const Image* srcImg, double time, const OfxRectI& analysisWindow);
     void updateLuma(const Image* srcImg, double time, const OfxRectI& analysisWindow);
 
+    // compute image statistics, return false if the computation was aborted
+    bool compute(const Image* srcImg, double time, const OfxRectI& analysisWindow, Results* results);
+    bool computeHSVL(const Image* srcImg, double time, const OfxRectI& analysisWindow, Results* results);
+    bool computeLuma(const Image* srcImg, double time, const OfxRectI& analysisWindow, Results* results);
+
+    // set the image statistics parameters
+    void setResults(double time, const Results& results);
+    void setResultsHSVL(double time, const Results& results);
+    void setResultsLuma(double time, const Results& results);
+
     template <template<class PIX, int nComponents, int maxValue> class Processor, class PIX, int nComponents, int maxValue>
     void updateSubComponentsDepth(const Image* srcImg,
                                   double time,
@@ -1342,6 +1185,7 @@ private:
     BooleanParam* _interactive;
     BooleanParam* _restrictToRectangle;
     BooleanParam* _autoUpdate;
+    IntParam* _prefetchFrames;
     RGBAParam* _statMin;
     RGBAParam* _statMax;
     RGBAParam* _statMean;
@@ -1634,41 +1478,66 @@ ImageStatisticsPlugin::changedParam(const InstanceChangedArgs &args,
         getPropertySet().propSetInt(kOfxImageEffectPropInAnalysis, 1, false);
 #     endif
         progressStart("Analyzing sequence...");
-        beginEditBlock("analyzeSequence");
         OfxRangeD range = _srcClip->getFrameRange();
         //timeLineGetBounds(range.min, range.max); // wrong: we want the input frame range only
         int tmin = (int)std::ceil(range.min);
         int tmax = (int)std::floor(range.max);
-        for (int t = tmin; t <= tmax; ++t) {
-            auto_ptr<Image> src( ( _srcClip && _srcClip->isConnected() ) ?
-                                      _srcClip->fetchImage(t) : 0 );
-            if ( src.get() ) {
-                if ( (src->getRenderScale().x != args.renderScale.x) ||
-                     ( src->getRenderScale().y != args.renderScale.y) ) {
-                    setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
-                    throwSuiteStatusException(kOfxStatFailed);
-                }
-                bool intersect = computeWindow(src.get(), t, &analysisWindow);
-                if (intersect) {
-                    if (doAnalyzeSequenceRGBA) {
-                        update(src.get(), t, analysisWindow);
+        // the keyframes are set after the analysis, so that the parameter
+        // changes do not interfere with the fetching of the next frames
+        std::vector<SequenceResults> sequenceResults;
+        {
+            SequencePrefetcher prefetcher( _srcClip, tmin, tmax, (std::max)(0, _prefetchFrames->getValue()) );
+            for (int t = tmin; t <= tmax; ++t) {
+                auto_ptr<Image> src( prefetcher.take(t) );
+                if ( src.get() ) {
+                    if ( (src->getRenderScale().x != args.renderScale.x) ||
+                         ( src->getRenderScale().y != args.renderScale.y) ) {
+                        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+                        throwSuiteStatusException(kOfxStatFailed);
                     }
-                    if (doAnalyzeSequenceHSVL) {
-                        updateHSVL(src.get(), t, analysisWindow);
+                    bool intersect = computeWindow(src.get(), t, &analysisWindow);
+                    if (intersect) {
+                        SequenceResults frameResults;
+                        frameResults.time = t;
+                        bool ok = true;
+                        if (doAnalyzeSequenceRGBA) {
+                            ok = ok && compute(src.get(), t, analysisWindow, &frameResults.rgba);
+                        }
+                        if (doAnalyzeSequenceHSVL) {
+                            ok = ok && computeHSVL(src.get(), t, analysisWindow, &frameResults.hsvl);
+                        }
+                        if (doAnalyzeSequenceLuma) {
+                            ok = ok && computeLuma(src.get(), t, analysisWindow, &frameResults.luma);
+                        }
+                        if (!ok) {
+                            break;
+                        }
+                        sequenceResults.push_back(frameResults);
                     }
-                    if (doAnalyzeSequenceLuma) {
-                        updateLuma(src.get(), t, analysisWindow);
+                }
+                if (tmax != tmin) {
+                    if ( !progressUpdate( (t - tmin) / (double)(tmax - tmin) ) ) {
+                        break;
                     }
                 }
             }
-            if (tmax != tmin) {
-                if ( !progressUpdate( (t - tmin) / (double)(tmax - tmin) ) ) {
-                    break;
-                }
+        }
+        // set the keyframes of the frames that were analyzed
+        beginEditBlock("analyzeSequence");
+        for (std::size_t i = 0; i < sequenceResults.size(); ++i) {
+            const SequenceResults& frameResults = sequenceResults[i];
+            if (doAnalyzeSequenceRGBA) {
+                setResults(frameResults.time, frameResults.rgba);
+            }
+            if (doAnalyzeSequenceHSVL) {
+                setResultsHSVL(frameResults.time, frameResults.hsvl);
+            }
+            if (doAnalyzeSequenceLuma) {
+                setResultsLuma(frameResults.time, frameResults.luma);
             }
         }
-        progressEnd();
         endEditBlock();
+        progressEnd();
 #     ifdef kOfxImageEffectPropInAnalysis // removed from OFX 1.4
         getPropertySet().propSetInt(kOfxImageEffectPropInAnalysis, 0, false);
 #     endif
@@ -1745,21 +1614,81 @@ ImageStatisticsPlugin::update(const Image* srcImg,
                               double time,
                               const OfxRectI &analysisWindow)
 {
-    // TODO: CHECK if checkDoubleAnalysis param is true and analysisWindow is the same as btmLeft/sizeAnalysis
     Results results;
 
-    if ( !abort() ) {
-        updateSub<ImageMinMaxMeanProcessor>(srcImg, time, analysisWindow, results, &results);
+    if ( compute(srcImg, time, analysisWindow, &results) ) {
+        setResults(time, results);
+    }
+}
+
+void
+ImageStatisticsPlugin::updateHSVL(const Image* srcImg,
+                                  double time,
+                                  const OfxRectI &analysisWindow)
+{
+    Results results;
+
+    if ( computeHSVL(srcImg, time, analysisWindow, &results) ) {
+        setResultsHSVL(time, results);
+    }
+}
+
+void
+ImageStatisticsPlugin::updateLuma(const Image* srcImg,
+                                  double time,
+                                  const OfxRectI &analysisWindow)
+{
+    Results results;
+
+    if ( computeLuma(srcImg, time, analysisWindow, &results) ) {
+        setResultsLuma(time, results);
     }
+}
+
+bool
+ImageStatisticsPlugin::compute(const Image* srcImg,
+                               double time,
+                               const OfxRectI &analysisWindow,
+                               Results* results)
+{
+    // TODO: CHECK if checkDoubleAnalysis param is true and analysisWindow is the same as btmLeft/sizeAnalysis
     if ( !abort() ) {
-        updateSub<ImageSDevProcessor>(srcImg, time, analysisWindow, results, &results);
+        updateSub<ImageMomentsProcessor>(srcImg, time, analysisWindow, *results, results);
     }
+
+    return !abort();
+}
+
+bool
+ImageStatisticsPlugin::computeHSVL(const Image* srcImg,
+                                   double time,
+                                   const OfxRectI &analysisWindow,
+                                   Results* results)
+{
     if ( !abort() ) {
-        updateSub<ImageSkewnessKurtosisProcessor>(srcImg, time, analysisWindow, results, &results);
+        updateSub<ImageHSVLMomentsProcessor>(srcImg, time, analysisWindow, *results, results);
     }
-    if ( abort() ) {
-        return;
+
+    return !abort();
+}
+
+bool
+ImageStatisticsPlugin::computeLuma(const Image* srcImg,
+                                   double time,
+                                   const OfxRectI &analysisWindow,
+                                   Results* results)
+{
+    if ( !abort() ) {
+        updateSub<ImageLumaProcessor>(srcImg, time, analysisWindow, *results, results);
     }
+
+    return !abort();
+}
+
+void
+ImageStatisticsPlugin::setResults(double time,
+                                  const Results &results)
+{
     _statMin->setValueAtTime(time, results.min.r, results.min.g, results.min.b, results.min.a);
     _statMax->setValueAtTime(time, results.max.r, results.max.g, results.max.b, results.max.a);
     _statMean->setValueAtTime(time, results.mean.r, results.mean.g, results.mean.b, results.mean.a);
@@ -1770,24 +1699,9 @@ ImageStatisticsPlugin::update(const Image* srcImg,
 }
 
 void
-ImageStatisticsPlugin::updateHSVL(const Image* srcImg,
-                                  double time,
-                                  const OfxRectI &analysisWindow)
+ImageStatisticsPlugin::setResultsHSVL(double time,
+                                      const Results &results)
 {
-    Results results;
-
-    if ( !abort() ) {
-        updateSub<ImageHSVLMinMaxMeanProcessor>(srcImg, time, analysisWindow, results, &results);
-    }
-    if ( !abort() ) {
-        updateSub<ImageHSVLSDevProcessor>(srcImg, time, analysisWindow, results, &results);
-    }
-    if ( !abort() ) {
-        updateSub<ImageHSVLSkewnessKurtosisProcessor>(srcImg, time, analysisWindow, results, &results);
-    }
-    if ( abort() ) {
-        return;
-    }
     _statHSVLMin->setValueAtTime(time, results.min.r, results.min.g, results.min.b, results.min.a);
     _statHSVLMax->setValueAtTime(time, results.max.r, results.max.g, results.max.b, results.max.a);
     _statHSVLMean->setValueAtTime(time, results.mean.r, results.mean.g, results.mean.b, results.mean.a);
@@ -1797,18 +1711,9 @@ ImageStatisticsPlugin::updateHSVL(const Image* srcImg,
 }
 
 void
-ImageStatisticsPlugin::updateLuma(const Image* srcImg,
-                                  double time,
-                                  const OfxRectI &analysisWindow)
+ImageStatisticsPlugin::setResultsLuma(double time,
+                                      const Results &results)
 {
-    Results results;
-
-    if ( !abort() ) {
-        updateSub<ImageLumaProcessor>(srcImg, time, analysisWindow, results, &results);
-    }
-    if ( abort() ) {
-        return;
-    }
     _maxLumaPix->setValueAtTime(time, results.maxPos.x, results.maxPos.y);
     _maxLumaPixVal->setValueAtTime(time, results.maxVal.r, results.maxVal.g, results.maxVal.b, results.maxVal.a);
     _minLumaPix->setValueAtTime(time, results.minPos.x, results.minPos.y);
@@ -2033,6 +1938,21 @@ ImageStatisticsPluginFactory::describeInContext(ImageEffectDescriptor &desc,
         }
     }
 
+    // prefetchFrames
+    {
+        IntParamDescriptor *param = desc.defineIntParam(kParamPrefetchFrames);
+        param->setLabel(kParamPrefetchFramesLabel);
+        param->setHint(kParamPrefetchFramesHint);
+        param->setRange(0, 16);
+        param->setDisplayRange(0, 8);
+        param->setDefault(kParamPrefetchFramesDefault);
+        param->setEvaluateOnChange(false);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+
     // interactive
     {
         BooleanParamDescriptor* param = desc.defineBooleanParam(kParamRectangleInteractInteractive);
@@ -0,0 +1,1201 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX LUT3DPattern and ApplyLUT3D plugins.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <cfloat> // DBL_MAX
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ofxsProcessing.H"
+#include "ofxsMaskMix.h"
+#include "ofxsCoords.h"
+#include "ofxsMacros.h"
+#include "ofxsThreadSuite.h"
+#include "ofxsFileOpen.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
+#include "ofxsLUT3D.h"
+
+using namespace OFX;
+
+using std::string;
+
+OFXS_NAMESPACE_ANONYMOUS_ENTER
+
+#define kPluginPatternName "LUT3DPatternOFX"
+#define kPluginPatternDescription "Generate the lattice of a 3D LUT.\n" \
+    "The output image is Size*Size pixels wide and Size pixels high, and each pixel holds the color of a point of the lattice: pixel (x,y) is the lattice point (x % Size, y, x / Size).\n" \
+    "To bake a chain of color nodes (e.g. Grade, ColorCorrect, Saturation, HSVTool, HueCorrect, ColorMatrix) into a 3D LUT, connect this node to the input of the chain, and connect the output of the chain to the Lattice input of an ApplyLUT3D node.\n" \
+    "The processed image should be floating-point, and the Shaper and Range parameters of the ApplyLUT3D node must be the same as in this node."
+#define kPluginPatternIdentifier "net.sf.openfx.LUT3DPattern"
+
+#define kPluginApplyName "ApplyLUT3DOFX"
+#define kPluginApplyDescription "Apply the 3D LUT computed from a lattice image.\n" \
+    "The Lattice input is the output of a LUT3DPattern node, processed by any chain of color nodes: the color transform of the whole chain is then applied to the Source input in a single pass, using trilinear or tetrahedral interpolation. Alpha is not modified.\n" \
+    "The LUT is computed only once for each lattice image, and can be exported as a .cube or .csp file.\n" \
+    "Only color transforms that process each pixel independently can be baked into a 3D LUT, and the colors outside of the range of the LUT are clamped to that range."
+#define kPluginApplyIdentifier "net.sf.openfx.ApplyLUT3D"
+
+#define kPluginGrouping "Color"
+// History:
+// version 1.0: initial version
+// version 1.1: export .csp files, which represent the Log2 shaper precisely
+#define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+
+#define kSupportsTiles 1
+#define kSupportsMultiResolution 1
+#define kSupportsRenderScale 0 // the lattice must be processed at full resolution
+#define kSupportsMultipleClipPARs false
+#define kSupportsMultipleClipDepths false
+#define kRenderThreadSafety eRenderFullySafe
+
+#define kClipLattice "Lattice"
+#define kClipLatticeHint "The output of a LUT3DPattern node, processed by the color transforms to be baked into the 3D LUT."
+
+#define kParamSize "size"
+#define kParamSizeLabel "Size"
+#define kParamSizeHint "Number of lattice points along each axis of the 3D LUT. 33 is a common value, 65 gives a more precise LUT."
+#define kParamSizeDefault 33
+
+#define kParamShaper "shaper"
+#define kParamShaperLabel "Shaper"
+#define kParamShaperHint "Distribution of the lattice points along each axis."
+#define kParamShaperOptionLinear "Linear", "The lattice points are evenly spaced between Range Min and Range Max.", "linear"
+#define kParamShaperOptionLog2 "Log2", "The lattice points are evenly spaced in stops (log2 of the value) between Range Min and Range Max, which must be positive. This gives a precise LUT for high dynamic range floating-point images.", "log2"
+#define kParamShaperDefault eLUT3DShaperLinear
+
+#define kParamRangeMin "rangeMin"
+#define kParamRangeMinLabel "Range Min"
+#define kParamRangeMinHint "Smallest input value of the LUT. Smaller values are clamped to this value."
+#define kParamRangeMinDefault 0.
+
+#define kParamRangeMax "rangeMax"
+#define kParamRangeMaxLabel "Range Max"
+#define kParamRangeMaxHint "Largest input value of the LUT. Larger values are clamped to this value."
+#define kParamRangeMaxDefault 1.
+
+#define kParamInterpolation "interpolation"
+#define kParamInterpolationLabel "Interpolation"
+#define kParamInterpolationHint "Interpolation between the lattice points."
+#define kParamInterpolationOptionTrilinear "Trilinear", "Interpolate between the 8 lattice points around the color.", "trilinear"
+#define kParamInterpolationOptionTetrahedral "Tetrahedral", "Interpolate between the 4 lattice points of the tetrahedron that contains the color. This is faster than trilinear, and it preserves the neutral axis.", "tetrahedral"
+enum InterpolationEnum
+{
+    eInterpolationTrilinear = 0,
+    eInterpolationTetrahedral,
+};
+#define kParamInterpolationDefault eInterpolationTetrahedral
+
+#define kParamExportCube "exportCube"
+#define kParamExportCubeLabel "Export", "Export the 3D LUT as a .cube file, which can be used in Natron, Nuke, DaVinci Resolve and most color grading software, or as a CineSpace .csp file if the file name ends with .csp. With the Log2 shaper, the shaper is written as a 1D LUT before the 3D LUT. The 1D LUT of a .cube file has evenly spaced inputs, and cannot represent the Log2 shaper near a small Range Min: the .csp format, where the shaper inputs are evenly spaced in stops, should be preferred in that case."
+
+#define kParamExportCubeRewrite "exportCubeRewrite"
+#define kParamExportCubeRewriteLabel "Rewrite", "Rewrite the .cube or .csp file."
+
+#define kParamLatticeSizeMax 129
+
+#define kLatticeHashesMax 64 // maximum number of lattice image hashes remembered by ApplyLUT3D
+
+// shared by both plugins
+
+static void
+describeLatticeParams(ImageEffectDescriptor &desc,
+                      PageParamDescriptor *page)
+{
+    {
+        ChoiceParamDescriptor* param = desc.defineChoiceParam(kParamShaper);
+        param->setLabel(kParamShaperLabel);
+        param->setHint(kParamShaperHint);
+        assert(param->getNOptions() == eLUT3DShaperLinear);
+        param->appendOption(kParamShaperOptionLinear);
+        assert(param->getNOptions() == eLUT3DShaperLog2);
+        param->appendOption(kParamShaperOptionLog2);
+        param->setDefault( (int)kParamShaperDefault );
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamRangeMin);
+        param->setLabel(kParamRangeMinLabel);
+        param->setHint(kParamRangeMinHint);
+        param->setDefault(kParamRangeMinDefault);
+        param->setRange(-DBL_MAX, DBL_MAX); // Resolve requires range and display range or values are clamped to (-1,1)
+        param->setDisplayRange(0., 1.);
+        param->setAnimates(false);
+        param->setLayoutHint(eLayoutHintNoNewLine, 1);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamRangeMax);
+        param->setLabel(kParamRangeMaxLabel);
+        param->setHint(kParamRangeMaxHint);
+        param->setDefault(kParamRangeMaxDefault);
+        param->setRange(-DBL_MAX, DBL_MAX); // Resolve requires range and display range or values are clamped to (-1,1)
+        param->setDisplayRange(0., 64.);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+}
+
+// returns false (and posts an error message) if the range is not valid for the shaper
+static bool
+getLatticeParams(ImageEffect &effect,
+                 ChoiceParam *shaperParam,
+                 DoubleParam *rangeMinParam,
+                 DoubleParam *rangeMaxParam,
+                 LUT3DShaperEnum *shaper,
+                 double *rangeMin,
+                 double *rangeMax)
+{
+    *shaper = (LUT3DShaperEnum)shaperParam->getValue();
+    *rangeMin = rangeMinParam->getValue();
+    *rangeMax = rangeMaxParam->getValue();
+    if ( (*shaper == eLUT3DShaperLog2) && (*rangeMin <= 0.) ) {
+        effect.setPersistentMessage(Message::eMessageError, "", "Range Min must be positive with the Log2 shaper");
+
+        return false;
+    }
+    if (*rangeMax <= *rangeMin) {
+        effect.setPersistentMessage(Message::eMessageError, "", "Range Max must be greater than Range Min");
+
+        return false;
+    }
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// LUT3DPattern
+
+class LatticeGeneratorBase
+    : public ImageProcessor
+{
+protected:
+    int _size;
+    std::vector<float> _values; // the value of each lattice coordinate
+
+public:
+    LatticeGeneratorBase(ImageEffect &instance)
+        : ImageProcessor(instance)
+        , _size(0)
+    {
+    }
+
+    void setValues(int size,
+                   LUT3DShaperEnum shaper,
+                   double rangeMin,
+                   double rangeMax)
+    {
+        _size = size;
+        _values.resize(size);
+        for (int i = 0; i < size; ++i) {
+            _values[i] = (float)LUT3D::unshape( shaper, rangeMin, rangeMax, i / (double)(size - 1) );
+        }
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+class LatticeGenerator
+    : public LatticeGeneratorBase
+{
+public:
+    LatticeGenerator(ImageEffect &instance)
+        : LatticeGeneratorBase(instance)
+    {
+    }
+
+private:
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        // the lattice coordinates, quantized for integer images
+        std::vector<PIX> values(_size);
+
+        for (int i = 0; i < _size; ++i) {
+            values[i] = maxValue == 1 ? PIX(_values[i]) : PIX( (std::max)(0.f, (std::min)(_values[i], 1.f) ) * maxValue + 0.5f );
+        }
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+                if ( (x < 0) || (x >= _size * _size) || (y < 0) || (y >= _size) ) {
+                    for (int c = 0; c < nComponents; ++c) {
+                        dstPix[c] = PIX();
+                    }
+                } else {
+                    int r, g, b;
+                    LUT3D::latticeIndex(x, y, _size, &r, &g, &b);
+                    dstPix[0] = values[r];
+                    dstPix[1] = values[g];
+                    dstPix[2] = values[b];
+                    if (nComponents == 4) {
+                        dstPix[3] = PIX(maxValue);
+                    }
+                }
+                dstPix += nComponents;
+            }
+        }
+    }
+};
+
+class LUT3DPatternPlugin
+    : public ImageEffect
+{
+public:
+    LUT3DPatternPlugin(OfxImageEffectHandle handle)
+        : ImageEffect(handle)
+        , _dstClip(NULL)
+        , _size(NULL)
+        , _shaper(NULL)
+        , _rangeMin(NULL)
+        , _rangeMax(NULL)
+    {
+        _dstClip = fetchClip(kOfxImageEffectOutputClipName);
+        assert( _dstClip && (_dstClip->getPixelComponents() == ePixelComponentRGB ||
+                             _dstClip->getPixelComponents() == ePixelComponentRGBA) );
+        _size = fetchIntParam(kParamSize);
+        assert(_size);
+        _shaper = fetchChoiceParam(kParamShaper);
+        _rangeMin = fetchDoubleParam(kParamRangeMin);
+        _rangeMax = fetchDoubleParam(kParamRangeMax);
+        assert(_shaper && _rangeMin && _rangeMax);
+    }
+
+private:
+    virtual void render(const RenderArguments &args) OVERRIDE FINAL;
+    virtual bool getRegionOfDefinition(const RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void getClipPreferences(ClipPreferencesSetter &clipPreferences) OVERRIDE FINAL;
+
+    template <int nComponents>
+    void renderInternal(const RenderArguments &args, BitDepthEnum dstBitDepth);
+
+    void setupAndProcess(LatticeGeneratorBase &, const RenderArguments &args);
+
+private:
+    Clip *_dstClip;
+    IntParam *_size;
+    ChoiceParam *_shaper;
+    DoubleParam *_rangeMin;
+    DoubleParam *_rangeMax;
+};
+
+void
+LUT3DPatternPlugin::setupAndProcess(LatticeGeneratorBase &processor,
+                                    const RenderArguments &args)
+{
+    auto_ptr<Image> dst( _dstClip->fetchImage(args.time) );
+
+    if ( !dst.get() ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    BitDepthEnum dstBitDepth    = dst->getPixelDepth();
+    PixelComponentEnum dstComponents  = dst->getPixelComponents();
+    if ( ( dstBitDepth != _dstClip->getPixelDepth() ) ||
+         ( dstComponents != _dstClip->getPixelComponents() ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong depth or components");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    if ( (dst->getRenderScale().x != args.renderScale.x) ||
+         ( dst->getRenderScale().y != args.renderScale.y) ||
+         ( ( dst->getField() != eFieldNone) /* for DaVinci Resolve */ && ( dst->getField() != args.fieldToRender) ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    LUT3DShaperEnum shaper;
+    double rangeMin, rangeMax;
+    if ( !getLatticeParams(*this, _shaper, _rangeMin, _rangeMax, &shaper, &rangeMin, &rangeMax) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    clearPersistentMessage();
+    processor.setValues(_size->getValue(), shaper, rangeMin, rangeMax);
+    processor.setDstImg( dst.get() );
+    processor.setRenderWindow(args.renderWindow);
+
+    processor.process();
+}
+
+template <int nComponents>
+void
+LUT3DPatternPlugin::renderInternal(const RenderArguments &args,
+                                   BitDepthEnum dstBitDepth)
+{
+    switch (dstBitDepth) {
+    case eBitDepthUByte: {
+        LatticeGenerator<unsigned char, nComponents, 255> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    case eBitDepthUShort: {
+        LatticeGenerator<unsigned short, nComponents, 65535> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    case eBitDepthFloat: {
+        LatticeGenerator<float, nComponents, 1> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    default:
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+}
+
+void
+LUT3DPatternPlugin::render(const RenderArguments &args)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    BitDepthEnum dstBitDepth    = _dstClip->getPixelDepth();
+    PixelComponentEnum dstComponents  = _dstClip->getPixelComponents();
+
+    if (dstComponents == ePixelComponentRGBA) {
+        renderInternal<4>(args, dstBitDepth);
+    } else if (dstComponents == ePixelComponentRGB) {
+        renderInternal<3>(args, dstBitDepth);
+    } else {
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+}
+
+bool
+LUT3DPatternPlugin::getRegionOfDefinition(const RegionOfDefinitionArguments &args,
+                                          OfxRectD &rod)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    const int size = _size->getValue();
+    const double par = _dstClip->getPixelAspectRatio();
+    rod.x1 = 0.;
+    rod.y1 = 0.;
+    rod.x2 = size * size * par;
+    rod.y2 = size;
+
+    return true;
+}
+
+void
+LUT3DPatternPlugin::getClipPreferences(ClipPreferencesSetter &clipPreferences)
+{
+    clipPreferences.setOutputPremultiplication(eImageOpaque);
+}
+
+mDeclarePluginFactory(LUT3DPatternPluginFactory, {ofxsThreadSuiteCheck();}, {});
+void
+LUT3DPatternPluginFactory::describe(ImageEffectDescriptor &desc)
+{
+    desc.setLabel(kPluginPatternName);
+    desc.setPluginGrouping(kPluginGrouping);
+    desc.setPluginDescription(kPluginPatternDescription);
+
+    desc.addSupportedContext(eContextGenerator);
+    desc.addSupportedContext(eContextGeneral);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthFloat);
+
+    // set a few flags
+    desc.setSingleInstance(false);
+    desc.setHostFrameThreading(false);
+    desc.setSupportsMultiResolution(kSupportsMultiResolution);
+    desc.setSupportsTiles(kSupportsTiles);
+    desc.setTemporalClipAccess(false);
+    desc.setRenderTwiceAlways(false);
+    desc.setSupportsMultipleClipPARs(kSupportsMultipleClipPARs);
+    desc.setSupportsMultipleClipDepths(kSupportsMultipleClipDepths);
+    desc.setRenderThreadSafety(kRenderThreadSafety);
+#ifdef OFX_EXTENSIONS_NATRON
+    desc.setChannelSelector(ePixelComponentNone);
+#endif
+}
+
+void
+LUT3DPatternPluginFactory::describeInContext(ImageEffectDescriptor &desc,
+                                             ContextEnum /*context*/)
+{
+    // there has to be an input clip, even for generators
+    ClipDescriptor* srcClip = desc.defineClip( kOfxImageEffectSimpleSourceClipName );
+
+    srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
+    srcClip->setSupportsTiles(kSupportsTiles);
+    srcClip->setOptional(true);
+
+    ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
+    dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->setSupportsTiles(kSupportsTiles);
+
+    PageParamDescriptor *page = desc.definePageParam("Controls");
+
+    {
+        IntParamDescriptor* param = desc.defineIntParam(kParamSize);
+        param->setLabel(kParamSizeLabel);
+        param->setHint(kParamSizeHint);
+        param->setDefault(kParamSizeDefault);
+        param->setRange(2, kParamLatticeSizeMax);
+        param->setDisplayRange(2, 65);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    describeLatticeParams(desc, page);
+}
+
+ImageEffect*
+LUT3DPatternPluginFactory::createInstance(OfxImageEffectHandle handle,
+                                          ContextEnum /*context*/)
+{
+    return new LUT3DPatternPlugin(handle);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ApplyLUT3D
+
+class LUT3DProcessorBase
+    : public ImageProcessor
+{
+protected:
+    const Image *_srcImg;
+    const Image *_maskImg;
+    bool _premult;
+    int _premultChannel;
+    bool _doMasking;
+    double _mix;
+    bool _maskInvert;
+    const LUT3D *_lut;
+    bool _tetrahedral;
+
+public:
+    LUT3DProcessorBase(ImageEffect &instance)
+        : ImageProcessor(instance)
+        , _srcImg(NULL)
+        , _maskImg(NULL)
+        , _premult(false)
+        , _premultChannel(3)
+        , _doMasking(false)
+        , _mix(1.)
+        , _maskInvert(false)
+        , _lut(NULL)
+        , _tetrahedral(true)
+    {
+    }
+
+    void setSrcImg(const Image *v) {_srcImg = v; }
+
+    void setMaskImg(const Image *v,
+                    bool maskInvert) {_maskImg = v; _maskInvert = maskInvert; }
+
+    void doMasking(bool v) {_doMasking = v; }
+
+    void setValues(bool premult,
+                   int premultChannel,
+                   double mix,
+                   const LUT3D *lut,
+                   bool tetrahedral)
+    {
+        _premult = premult;
+        _premultChannel = premultChannel;
+        _mix = mix;
+        _lut = lut;
+        _tetrahedral = tetrahedral;
+    }
+};
+
+template <class PIX, int nComponents, int maxValue>
+class LUT3DProcessor
+    : public LUT3DProcessorBase
+{
+public:
+    LUT3DProcessor(ImageEffect &instance)
+        : LUT3DProcessorBase(instance)
+    {
+    }
+
+private:
+    void multiThreadProcessImages(OfxRectI procWindow)
+    {
+        assert(nComponents == 3 || nComponents == 4);
+        assert(_lut);
+        float unpPix[4];
+        float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
+                for (int c = 0; c < 4; ++c) {
+                    planes[c][i] = unpPix[c];
+                }
+            }
+            if (_tetrahedral) {
+                _lut->apply<true>(planes[0], planes[1], planes[2], n);
+            } else {
+                _lut->apply<false>(planes[0], planes[1], planes[2], n);
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
+                }
+                ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+                if (nComponents == 4) {
+                    dstPix[3] = srcPix ? srcPix[3] : PIX();
+                }
+                dstPix += nComponents;
+            }
+        }
+    }
+};
+
+class ApplyLUT3DPlugin
+    : public ImageEffect
+{
+public:
+    ApplyLUT3DPlugin(OfxImageEffectHandle handle)
+        : ImageEffect(handle)
+        , _dstClip(NULL)
+        , _srcClip(NULL)
+        , _latticeClip(NULL)
+        , _maskClip(NULL)
+        , _shaper(NULL)
+        , _rangeMin(NULL)
+        , _rangeMax(NULL)
+        , _interpolation(NULL)
+        , _exportCube(NULL)
+        , _exportCubeRewrite(NULL)
+        , _premult(NULL)
+        , _premultChannel(NULL)
+        , _mix(NULL)
+        , _maskApply(NULL)
+        , _maskInvert(NULL)
+    {
+        _dstClip = fetchClip(kOfxImageEffectOutputClipName);
+        assert( _dstClip && (_dstClip->getPixelComponents() == ePixelComponentRGB ||
+                             _dstClip->getPixelComponents() == ePixelComponentRGBA) );
+        _srcClip = getContext() == eContextGenerator ? NULL : fetchClip(kOfxImageEffectSimpleSourceClipName);
+        assert( (!_srcClip && getContext() == eContextGenerator) ||
+                ( _srcClip && (_srcClip->getPixelComponents() == ePixelComponentRGB ||
+                               _srcClip->getPixelComponents() == ePixelComponentRGBA) ) );
+        _latticeClip = fetchClip(kClipLattice);
+        assert( _latticeClip && (!_latticeClip->isConnected() || _latticeClip->getPixelComponents() == ePixelComponentRGB ||
+                                 _latticeClip->getPixelComponents() == ePixelComponentRGBA) );
+        _maskClip = fetchClip(getContext() == eContextPaint ? "Brush" : "Mask");
+        assert(!_maskClip || _maskClip->getPixelComponents() == ePixelComponentAlpha);
+
+        _shaper = fetchChoiceParam(kParamShaper);
+        _rangeMin = fetchDoubleParam(kParamRangeMin);
+        _rangeMax = fetchDoubleParam(kParamRangeMax);
+        assert(_shaper && _rangeMin && _rangeMax);
+        _interpolation = fetchChoiceParam(kParamInterpolation);
+        _exportCube = fetchStringParam(kParamExportCube);
+        assert(_interpolation && _exportCube);
+        if ( paramExists(kParamExportCubeRewrite) ) {
+            _exportCubeRewrite = fetchPushButtonParam(kParamExportCubeRewrite);
+        }
+        _premult = fetchBooleanParam(kParamPremult);
+        _premultChannel = fetchChoiceParam(kParamPremultChannel);
+        assert(_premult && _premultChannel);
+        _mix = fetchDoubleParam(kParamMix);
+        _maskApply = ( ofxsMaskIsAlwaysConnected( OFX::getImageEffectHostDescription() ) && paramExists(kParamMaskApply) ) ? fetchBooleanParam(kParamMaskApply) : 0;
+        _maskInvert = fetchBooleanParam(kParamMaskInvert);
+        assert(_mix && _maskInvert);
+    }
+
+private:
+    virtual void render(const RenderArguments &args) OVERRIDE FINAL;
+    virtual bool isIdentity(const IsIdentityArguments &args, Clip * &identityClip, double &identityTime, int& view, std::string& plane) OVERRIDE FINAL;
+    virtual void getRegionsOfInterest(const RegionsOfInterestArguments &args, RegionOfInterestSetter &rois) OVERRIDE FINAL;
+    virtual bool getRegionOfDefinition(const RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+    virtual void changedParam(const InstanceChangedArgs &args, const std::string &paramName) OVERRIDE FINAL;
+    virtual void changedClip(const InstanceChangedArgs &args, const std::string &clipName) OVERRIDE FINAL;
+
+    template <int nComponents>
+    void renderInternal(const RenderArguments &args, BitDepthEnum dstBitDepth);
+
+    void setupAndProcess(LUT3DProcessorBase &, const RenderArguments &args);
+
+    // get the LUT3D computed from the lattice image at the given time, or post an error message and return NULL
+    const LUT3D* getLUT(double time, const OfxPointD &renderScale, LUT3DHolder<Mutex> &holder);
+
+    template <class PIX, int maxValue>
+    static void fillLUT(const Image &lattice, const OfxRectI &latticeRect, LUT3D *lut);
+
+    void exportCube(double time, const OfxPointD &renderScale);
+
+private:
+    Clip *_dstClip;
+    Clip *_srcClip;
+    Clip *_latticeClip;
+    Clip *_maskClip;
+    ChoiceParam* _shaper;
+    DoubleParam* _rangeMin;
+    DoubleParam* _rangeMax;
+    ChoiceParam* _interpolation;
+    StringParam* _exportCube;
+    PushButtonParam* _exportCubeRewrite;
+    BooleanParam* _premult;
+    ChoiceParam* _premultChannel;
+    DoubleParam* _mix;
+    BooleanParam* _maskApply;
+    BooleanParam* _maskInvert;
+    LUT3DCache<Mutex> _lutCache;
+    // the hash of the lattice pixels, for each lattice image unique identifier and lattice parameters,
+    // so that the lattice is only hashed once and not for each rendered tile
+    Mutex _latticeHashesMutex;
+    std::map<std::pair<string, unsigned long long>, unsigned long long> _latticeHashes;
+};
+
+template <class PIX, int maxValue>
+void
+ApplyLUT3DPlugin::fillLUT(const Image &lattice,
+                          const OfxRectI &latticeRect,
+                          LUT3D *lut)
+{
+    const int size = lut->size();
+    const int nComponents = lattice.getPixelComponentCount();
+    float *data = lut->data();
+
+    for (int y = 0; y < size; ++y) {
+        const PIX *pix = (const PIX *)lattice.getPixelAddress(latticeRect.x1, latticeRect.y1 + y);
+        for (int x = 0; x < size * size; ++x, pix += nComponents) {
+            int r, g, b;
+            LUT3D::latticeIndex(x, y, size, &r, &g, &b);
+            float *v = data + 3 * (r + size * (g + size * b) );
+            for (int c = 0; c < 3; ++c) {
+                v[c] = pix[c] / (float)maxValue;
+            }
+        }
+    }
+}
+
+const LUT3D*
+ApplyLUT3DPlugin::getLUT(double time,
+                         const OfxPointD &renderScale,
+                         LUT3DHolder<Mutex> &holder)
+{
+    LUT3DShaperEnum shaper;
+    double rangeMin, rangeMax;
+
+    if ( !getLatticeParams(*this, _shaper, _rangeMin, _rangeMax, &shaper, &rangeMin, &rangeMax) ) {
+        return NULL;
+    }
+    OfxRectI latticeRect;
+    Coords::toPixelEnclosing(_latticeClip->getRegionOfDefinition(time), renderScale, _latticeClip->getPixelAspectRatio(), &latticeRect);
+    const int size = latticeRect.y2 - latticeRect.y1;
+    if ( (size < 2) || (size > kParamLatticeSizeMax) || (latticeRect.x2 - latticeRect.x1 != size * size) ) {
+        setPersistentMessage(Message::eMessageError, "", "The Lattice input must be the output of a LUT3DPattern node");
+
+        return NULL;
+    }
+    auto_ptr<const Image> lattice( _latticeClip->fetchImage(time) );
+    if ( !lattice.get() ) {
+        return NULL;
+    }
+    const OfxRectI &bounds = lattice->getBounds();
+    if ( (bounds.x1 > latticeRect.x1) || (bounds.x2 < latticeRect.x2) ||
+         (bounds.y1 > latticeRect.y1) || (bounds.y2 < latticeRect.y2) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave an incomplete lattice image");
+
+        return NULL;
+    }
+
+    // identify the LUT by the lattice pixels and the lattice parameters
+    const BitDepthEnum depth = lattice->getPixelDepth();
+    const size_t rowBytes = (size_t)size * size * lattice->getPixelComponentCount() * ( depth == eBitDepthUByte ? 1 : (depth == eBitDepthUShort ? 2 : 4) );
+    unsigned long long paramsHash = LUT3D::hash( &size, sizeof(size) );
+    paramsHash = LUT3D::hash(&shaper, sizeof(shaper), paramsHash);
+    paramsHash = LUT3D::hash(&rangeMin, sizeof(rangeMin), paramsHash);
+    paramsHash = LUT3D::hash(&rangeMax, sizeof(rangeMax), paramsHash);
+    paramsHash = LUT3D::hash(&depth, sizeof(depth), paramsHash);
+    // the host changes the unique identifier of the lattice image when its content changes,
+    // so the pixels only need to be hashed once for each identifier (if the host sets it)
+    const std::pair<string, unsigned long long> latticeId(lattice->getPropertySet().propGetString(kOfxImagePropUniqueIdentifier, false), paramsHash);
+    unsigned long long hash = 0;
+    bool hashed = false;
+    if ( !latticeId.first.empty() ) {
+        AutoMutex l(&_latticeHashesMutex);
+        std::map<std::pair<string, unsigned long long>, unsigned long long>::const_iterator it = _latticeHashes.find(latticeId);
+        if ( it != _latticeHashes.end() ) {
+            hash = it->second;
+            hashed = true;
+        }
+    }
+    if (!hashed) {
+        hash = paramsHash;
+        for (int y = latticeRect.y1; y < latticeRect.y2; ++y) {
+            hash = LUT3D::hash(lattice->getPixelAddress(latticeRect.x1, y), rowBytes, hash);
+        }
+        if ( !latticeId.first.empty() ) {
+            AutoMutex l(&_latticeHashesMutex);
+            if (_latticeHashes.size() >= kLatticeHashesMax) {
+                _latticeHashes.clear();
+            }
+            _latticeHashes[latticeId] = hash;
+        }
+    }
+    const LUT3D *lut = holder.acquire(hash);
+    if (lut) {
+        return lut;
+    }
+
+    LUT3D *newLut = new LUT3D(size, shaper, rangeMin, rangeMax);
+    switch (depth) {
+    case eBitDepthUByte:
+        fillLUT<unsigned char, 255>(*lattice, latticeRect, newLut);
+        break;
+    case eBitDepthUShort:
+        fillLUT<unsigned short, 65535>(*lattice, latticeRect, newLut);
+        break;
+    case eBitDepthFloat:
+        fillLUT<float, 1>(*lattice, latticeRect, newLut);
+        break;
+    default:
+        delete newLut;
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+
+    return holder.insert(hash, newLut);
+} // ApplyLUT3DPlugin::getLUT
+
+void
+ApplyLUT3DPlugin::setupAndProcess(LUT3DProcessorBase &processor,
+                                  const RenderArguments &args)
+{
+    const double time = args.time;
+
+    auto_ptr<Image> dst( _dstClip->fetchImage(time) );
+
+    if ( !dst.get() ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    BitDepthEnum dstBitDepth    = dst->getPixelDepth();
+    PixelComponentEnum dstComponents  = dst->getPixelComponents();
+    if ( ( dstBitDepth != _dstClip->getPixelDepth() ) ||
+         ( dstComponents != _dstClip->getPixelComponents() ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong depth or components");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    if ( (dst->getRenderScale().x != args.renderScale.x) ||
+         ( dst->getRenderScale().y != args.renderScale.y) ||
+         ( ( dst->getField() != eFieldNone) /* for DaVinci Resolve */ && ( dst->getField() != args.fieldToRender) ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    auto_ptr<const Image> src( ( _srcClip && _srcClip->isConnected() ) ?
+                                    _srcClip->fetchImage(time) : 0 );
+    if ( src.get() ) {
+        if ( (src->getRenderScale().x != args.renderScale.x) ||
+             ( src->getRenderScale().y != args.renderScale.y) ||
+             ( ( src->getField() != eFieldNone) /* for DaVinci Resolve */ && ( src->getField() != args.fieldToRender) ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        BitDepthEnum srcBitDepth      = src->getPixelDepth();
+        PixelComponentEnum srcComponents = src->getPixelComponents();
+        if ( (srcBitDepth != dstBitDepth) || (srcComponents != dstComponents) ) {
+            throwSuiteStatusException(kOfxStatErrImageFormat);
+        }
+    }
+    bool doMasking = ( ( !_maskApply || _maskApply->getValueAtTime(time) ) && _maskClip && _maskClip->isConnected() );
+    auto_ptr<const Image> mask(doMasking ? _maskClip->fetchImage(time) : 0);
+    if ( mask.get() ) {
+        if ( (mask->getRenderScale().x != args.renderScale.x) ||
+             ( mask->getRenderScale().y != args.renderScale.y) ||
+             ( ( mask->getField() != eFieldNone) /* for DaVinci Resolve */ && ( mask->getField() != args.fieldToRender) ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+    }
+    if (doMasking) {
+        bool maskInvert;
+        _maskInvert->getValueAtTime(time, maskInvert);
+        processor.doMasking(true);
+        processor.setMaskImg(mask.get(), maskInvert);
+    }
+
+    LUT3DHolder<Mutex> lutHolder(_lutCache);
+    const LUT3D *lut = getLUT(time, args.renderScale, lutHolder);
+    if (!lut) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    clearPersistentMessage();
+
+    bool premult;
+    int premultChannel;
+    _premult->getValueAtTime(time, premult);
+    _premultChannel->getValueAtTime(time, premultChannel);
+    double mix;
+    _mix->getValueAtTime(time, mix);
+    InterpolationEnum interpolation = (InterpolationEnum)_interpolation->getValueAtTime(time);
+
+    processor.setDstImg( dst.get() );
+    processor.setSrcImg( src.get() );
+    processor.setRenderWindow(args.renderWindow);
+    processor.setValues(premult, premultChannel, mix, lut, interpolation == eInterpolationTetrahedral);
+    processor.process();
+} // ApplyLUT3DPlugin::setupAndProcess
+
+template <int nComponents>
+void
+ApplyLUT3DPlugin::renderInternal(const RenderArguments &args,
+                                 BitDepthEnum dstBitDepth)
+{
+    switch (dstBitDepth) {
+    case eBitDepthUByte: {
+        LUT3DProcessor<unsigned char, nComponents, 255> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    case eBitDepthUShort: {
+        LUT3DProcessor<unsigned short, nComponents, 65535> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    case eBitDepthFloat: {
+        LUT3DProcessor<float, nComponents, 1> fred(*this);
+        setupAndProcess(fred, args);
+        break;
+    }
+    default:
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+}
+
+void
+ApplyLUT3DPlugin::render(const RenderArguments &args)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    PixelComponentEnum dstComponents  = _dstClip->getPixelComponents();
+    BitDepthEnum dstBitDepth    = _dstClip->getPixelDepth();
+
+    assert( kSupportsMultipleClipPARs   || !_srcClip || _srcClip->getPixelAspectRatio() == _dstClip->getPixelAspectRatio() );
+    assert( kSupportsMultipleClipDepths || !_srcClip || _srcClip->getPixelDepth()       == _dstClip->getPixelDepth() );
+    if (dstComponents == ePixelComponentRGBA) {
+        renderInternal<4>(args, dstBitDepth);
+    } else if (dstComponents == ePixelComponentRGB) {
+        renderInternal<3>(args, dstBitDepth);
+    } else {
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+}
+
+bool
+ApplyLUT3DPlugin::isIdentity(const IsIdentityArguments &args,
+                             Clip * &identityClip,
+                             double & /*identityTime*/
+                             , int& /*view*/, std::string& /*plane*/)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    const double time = args.time;
+    double mix;
+    _mix->getValueAtTime(time, mix);
+
+    if ( (mix == 0.) || !_latticeClip->isConnected() ) {
+        identityClip = _srcClip;
+
+        return true;
+    }
+
+    bool doMasking = ( ( !_maskApply || _maskApply->getValueAtTime(time) ) && _maskClip && _maskClip->isConnected() );
+    if (doMasking) {
+        bool maskInvert;
+        _maskInvert->getValueAtTime(time, maskInvert);
+        if (!maskInvert) {
+            OfxRectI maskRoD;
+            Coords::toPixelEnclosing(_maskClip->getRegionOfDefinition(time), args.renderScale, _maskClip->getPixelAspectRatio(), &maskRoD);
+            // effect is identity if the renderWindow doesn't intersect the mask RoD
+            if ( !Coords::rectIntersection<OfxRectI>(args.renderWindow, maskRoD, 0) ) {
+                identityClip = _srcClip;
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+} // ApplyLUT3DPlugin::isIdentity
+
+void
+ApplyLUT3DPlugin::getRegionsOfInterest(const RegionsOfInterestArguments &args,
+                                       RegionOfInterestSetter &rois)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    // the whole lattice is needed to compute the LUT
+    if ( _latticeClip->isConnected() ) {
+        rois.setRegionOfInterest( *_latticeClip, _latticeClip->getRegionOfDefinition(args.time) );
+    }
+}
+
+bool
+ApplyLUT3DPlugin::getRegionOfDefinition(const RegionOfDefinitionArguments &args,
+                                        OfxRectD & /*rod*/)
+{
+    if ( !kSupportsRenderScale && ( (args.renderScale.x != 1.) || (args.renderScale.y != 1.) ) ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+
+    // the output has the region of definition of the source (and not the union with the lattice)
+    return false;
+}
+
+void
+ApplyLUT3DPlugin::exportCube(double time,
+                             const OfxPointD &renderScale)
+{
+    string filename;
+
+    _exportCube->getValue(filename);
+    if ( filename.empty() ) {
+        // no filename, do nothing
+        return;
+    }
+    if ( !_latticeClip->isConnected() ) {
+        sendMessage(Message::eMessageError, "", "Cannot write " + filename + ": the Lattice input is not connected", false);
+
+        return;
+    }
+    LUT3DHolder<Mutex> lutHolder(_lutCache);
+    const LUT3D *lut = getLUT(time, renderScale, lutHolder);
+    if (!lut) {
+        return;
+    }
+    FILE* f = fopen_utf8(filename.c_str(), "w");
+    if (!f) {
+        sendMessage(Message::eMessageError, "", "Cannot write " + filename + ": " + std::strerror(errno), false);
+
+        return;
+    }
+    const size_t len = filename.size();
+    const bool csp = ( len >= 4 && filename[len - 4] == '.' &&
+                       std::tolower( (unsigned char)filename[len - 3] ) == 'c' &&
+                       std::tolower( (unsigned char)filename[len - 2] ) == 's' &&
+                       std::tolower( (unsigned char)filename[len - 1] ) == 'p' );
+    bool ok = csp ? lut->writeCSP(f, string()) : lut->writeCube(f, string());
+    if (std::fclose(f) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        sendMessage(Message::eMessageError, "", "Cannot write " + filename + ": " + std::strerror(errno), false);
+    } else if ( !csp && !lut->cubeShaperIsAccurate() ) {
+        sendMessage(Message::eMessageWarning, "", "The 1D shaper of " + filename + " cannot represent the Log2 shaper near Range Min, so that the darkest colors are not precise. Export the LUT as a .csp file to get a precise shaper.", false);
+    }
+}
+
+void
+ApplyLUT3DPlugin::changedParam(const InstanceChangedArgs &args,
+                               const std::string &paramName)
+{
+    if ( (args.reason == eChangeUserEdit) &&
+         ( paramName == kParamExportCube ||
+           (_exportCubeRewrite && paramName == kParamExportCubeRewrite) ) ) {
+        exportCube(args.time, args.renderScale);
+    }
+}
+
+void
+ApplyLUT3DPlugin::changedClip(const InstanceChangedArgs &args,
+                              const std::string &clipName)
+{
+    if ( (clipName == kOfxImageEffectSimpleSourceClipName) && _srcClip && (args.reason == eChangeUserEdit) ) {
+        switch ( _srcClip->getPreMultiplication() ) {
+        case eImageOpaque:
+            _premult->setValue(false);
+            break;
+        case eImagePreMultiplied:
+            _premult->setValue(true);
+            break;
+        case eImageUnPreMultiplied:
+            _premult->setValue(false);
+            break;
+        }
+    }
+}
+
+mDeclarePluginFactory(ApplyLUT3DPluginFactory, {ofxsThreadSuiteCheck();}, {});
+void
+ApplyLUT3DPluginFactory::describe(ImageEffectDescriptor &desc)
+{
+    desc.setLabel(kPluginApplyName);
+    desc.setPluginGrouping(kPluginGrouping);
+    desc.setPluginDescription(kPluginApplyDescription);
+
+    desc.addSupportedContext(eContextGeneral);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthFloat);
+
+    // set a few flags
+    desc.setSingleInstance(false);
+    desc.setHostFrameThreading(false);
+    desc.setSupportsMultiResolution(kSupportsMultiResolution);
+    desc.setSupportsTiles(kSupportsTiles);
+    desc.setTemporalClipAccess(false);
+    desc.setRenderTwiceAlways(false);
+    desc.setSupportsMultipleClipPARs(kSupportsMultipleClipPARs);
+    desc.setSupportsMultipleClipDepths(kSupportsMultipleClipDepths);
+    desc.setRenderThreadSafety(kRenderThreadSafety);
+#ifdef OFX_EXTENSIONS_NATRON
+    desc.setChannelSelector(ePixelComponentNone);
+#endif
+}
+
+void
+ApplyLUT3DPluginFactory::describeInContext(ImageEffectDescriptor &desc,
+                                           ContextEnum context)
+{
+    ClipDescriptor *srcClip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
+
+    srcClip->addSupportedComponent(ePixelComponentRGBA);
+    srcClip->addSupportedComponent(ePixelComponentRGB);
+    srcClip->setTemporalClipAccess(false);
+    srcClip->setSupportsTiles(kSupportsTiles);
+    srcClip->setIsMask(false);
+
+    ClipDescriptor *latticeClip = desc.defineClip(kClipLattice);
+    latticeClip->setHint(kClipLatticeHint);
+    latticeClip->addSupportedComponent(ePixelComponentRGBA);
+    latticeClip->addSupportedComponent(ePixelComponentRGB);
+    latticeClip->setTemporalClipAccess(false);
+    latticeClip->setSupportsTiles(kSupportsTiles);
+    latticeClip->setOptional(true);
+    latticeClip->setIsMask(false);
+
+    ClipDescriptor *dstClip = desc.defineClip(kOfxImageEffectOutputClipName);
+    dstClip->addSupportedComponent(ePixelComponentRGBA);
+    dstClip->addSupportedComponent(ePixelComponentRGB);
+    dstClip->setSupportsTiles(kSupportsTiles);
+
+    ClipDescriptor *maskClip = (context == eContextPaint) ? desc.defineClip("Brush") : desc.defineClip("Mask");
+    maskClip->addSupportedComponent(ePixelComponentAlpha);
+    maskClip->setTemporalClipAccess(false);
+    if (context != eContextPaint) {
+        maskClip->setOptional(true);
+    }
+    maskClip->setSupportsTiles(kSupportsTiles);
+    maskClip->setIsMask(true);
+
+    PageParamDescriptor *page = desc.definePageParam("Controls");
+
+    describeLatticeParams(desc, page);
+    {
+        ChoiceParamDescriptor* param = desc.defineChoiceParam(kParamInterpolation);
+        param->setLabel(kParamInterpolationLabel);
+        param->setHint(kParamInterpolationHint);
+        assert(param->getNOptions() == eInterpolationTrilinear);
+        param->appendOption(kParamInterpolationOptionTrilinear);
+        assert(param->getNOptions() == eInterpolationTetrahedral);
+        param->appendOption(kParamInterpolationOptionTetrahedral);
+        param->setDefault( (int)kParamInterpolationDefault );
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        StringParamDescriptor* param = desc.defineStringParam(kParamExportCube);
+        param->setLabelAndHint(kParamExportCubeLabel);
+        param->setStringType(eStringTypeFilePath);
+        param->setFilePathExists(false);
+        param->setAnimates(false);
+        param->setEvaluateOnChange(false);
+        if (!OFX::getImageEffectHostDescription()->isNatron) { // Natron already has a rewrite button
+            param->setLayoutHint(eLayoutHintNoNewLine, 1);
+        }
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    if (!OFX::getImageEffectHostDescription()->isNatron) { // Natron already has a rewrite button
+        PushButtonParamDescriptor* param = desc.definePushButtonParam(kParamExportCubeRewrite);
+        param->setLabelAndHint(kParamExportCubeRewriteLabel);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+
+    ofxsPremultDescribeParams(desc, page);
+    ofxsMaskMixDescribeParams(desc, page);
+} // ApplyLUT3DPluginFactory::describeInContext
+
+ImageEffect*
+ApplyLUT3DPluginFactory::createInstance(OfxImageEffectHandle handle,
+                                        ContextEnum /*context*/)
+{
+    return new ApplyLUT3DPlugin(handle);
+}
+
+static LUT3DPatternPluginFactory p1(kPluginPatternIdentifier, kPluginVersionMajor, kPluginVersionMinor);
+static ApplyLUT3DPluginFactory p2(kPluginApplyIdentifier, kPluginVersionMajor, kPluginVersionMinor);
+mRegisterPluginFactoryInstance(p1)
+mRegisterPluginFactoryInstance(p2)
+
+OFXS_NAMESPACE_ANONYMOUS_EXIT
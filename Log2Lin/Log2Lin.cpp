@@ -22,6 +22,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <vector>
 //#include <iostream>
 
 #include "ofxsProcessing.H"
@@ -29,6 +30,22 @@
 #include "ofxsCoords.h"
 #include "ofxsMacros.h"
 #include "ofxsThreadSuite.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
+#include "ofxsTransferLUT.h"
 
 using namespace OFX;
 
@@ -42,8 +59,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginIdentifier "net.sf.openfx.Log2Lin"
 // History:
 // version 1.0: initial version
+// version 1.1: lookup tables for 8-bit and 16-bit images, fast approximation for float images, added exact parameter
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -118,6 +136,42 @@ enum OperationEnum
 #define kParamGammaHint "The film response gamma value."
 #define kParamGammaDefault 0.6
 
+#define kParamExact "exact"
+#define kParamExactLabel "Exact"
+#define kParamExactHint "Compute the conversion with the exact formula for each pixel, in double precision. " \
+    "If unchecked, 8-bit and 16-bit images use lookup tables computed once for each set of parameters (unless Unpremult is checked), " \
+    "and floating-point images use a fast approximation, which has a relative error below 1e-6 with the default parameters."
+#define kParamExactDefault true
+
+// the conversion formulas as TransferCurves
+static void
+getTransferCurves(OperationEnum operation,
+                  const double black[3],
+                  const double white[3],
+                  const double gamma[3],
+                  TransferCurve curve[3])
+{
+    for (int c = 0; c < 3; ++c) {
+        const double offset = std::pow(10., (black[c] - white[c]) * 0.002 / gamma[c]);
+        const double gain = 1. / (1. - offset);
+        if (operation == eOperationLog2Lin) {
+            // linear = gain * (pow(10,(1023*v - whitepoint)*0.002/gamma) - offset)
+            curve[c].log = false;
+            curve[c].a = gain;
+            curve[c].b = 1023. * 0.002 / gamma[c];
+            curve[c].c = -white[c] * 0.002 / gamma[c];
+            curve[c].d = -gain * offset;
+        } else {
+            // cineon = (log10((v + offset) /gain)/ (0.002 / gamma) + whitepoint)/1023
+            curve[c].log = true;
+            curve[c].a = gamma[c] / (0.002 * 1023.);
+            curve[c].b = 1. / gain;
+            curve[c].c = offset / gain;
+            curve[c].d = white[c] / 1023.;
+        }
+    }
+}
+
 using namespace OFX;
 
 class Log2LinProcessorBase
@@ -132,37 +186,9 @@ protected:
     double _mix;
     bool _maskInvert;
     bool _processR, _processG, _processB;
-    double _offset[3];
-    double _gain[3];
-    double _whitepoint[3];
-    double _gamma[3];
-
-    /*
-       Following the formula:
-       offset = pow(10,(blackpoint - whitepoint) * 0.002 / gamma)
-       gain = 1/(1-offset)
-       linear = gain * (pow(10,(1023*v - whitepoint)*0.002/gamma) - offset)
-       cineon = (log10((v + offset) /gain)/ (0.002 / gamma) + whitepoint)/1023
-       Here we're using: blackpoint = 95.0
-       whitepoint = 685.0
-       gammasensito = 0.6
-     */
-
-    double log2lin(double xLog,
-                   int c)
-    {
-        double retval = _gain[c] * (std::pow(10., (1023. * xLog - _whitepoint[c]) * 0.002 / _gamma[c]) - _offset[c]);
-
-        return retval;
-    }
-
-    double lin2log(double xLin,
-                   int c)
-    {
-        double retval = (std::log10( (xLin + _offset[c]) / _gain[c] ) / (0.002 / _gamma[c]) + _whitepoint[c]) / 1023.;
-
-        return retval;
-    }
+    bool _exact;
+    TransferCurve _curve[3];
+    const TransferLUT *_lut;
 
 public:
     Log2LinProcessorBase(ImageEffect &instance,
@@ -178,6 +204,8 @@ public:
         , _processR(false)
         , _processG(false)
         , _processB(false)
+        , _exact(true)
+        , _lut(NULL)
         // TODO: initialize plugin parameter values
     {
     }
@@ -195,9 +223,9 @@ public:
                    bool processR,
                    bool processG,
                    bool processB,
-                   double black[3],
-                   double white[3],
-                   double gamma[3])
+                   bool exact,
+                   const TransferCurve curve[3],
+                   const TransferLUT *lut)
     {
         _premult = premult;
         _premultChannel = premultChannel;
@@ -206,11 +234,10 @@ public:
         _processG = processG;
         _processB = processB;
         for (int c = 0; c < 3; ++c) {
-            _offset[c] = std::pow(10., (black[c] - white[c]) * 0.002 / gamma[c]);
-            _gain[c] = 1. / (1. - _offset[c]);
-            _whitepoint[c] = white[c];
-            _gamma[c] = gamma[c];
+            _curve[c] = curve[c];
         }
+        _exact = exact;
+        _lut = lut;
     }
 };
 
@@ -274,29 +301,24 @@ private:
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
-        float unpPix[4];
+        const bool doProcess[3] = { processR, processG, processB };
         float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
+            transferRow<PIX, nComponents, maxValue>(_srcImg, _premult, _premultChannel, _curve, _lut, _exact, procWindow.x1, procWindow.x2, y, doProcess, planes);
+
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-
-                // process the pixel (the actual computation goes here)
-                for (int c = 0; c < 3; ++c) {
-                    if ( ( (c == 0) && processR ) ||
-                         ( (c == 1) && processG ) ||
-                         ( (c == 2) && processB ) ) {
-                        tmpPix[c] = log2lin(unpPix[c], c);
-                    } else {
-                        tmpPix[c] = unpPix[c];
-                    }
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
                 }
-                tmpPix[3] = unpPix[3];
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // copy back original values from unprocessed channels
                 if (!processR) {
@@ -377,23 +399,24 @@ private:
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
-        float unpPix[4];
+        const bool doProcess[3] = { processR, processG, processB };
         float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
+            transferRow<PIX, nComponents, maxValue>(_srcImg, _premult, _premultChannel, _curve, _lut, _exact, procWindow.x1, procWindow.x2, y, doProcess, planes);
+
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-
-                // process the pixel (the actual computation goes here)
-                for (int c = 0; c < 3; ++c) {
-                    tmpPix[c] = lin2log(unpPix[c], c);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
                 }
-                tmpPix[3] = unpPix[3];
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // copy back original values from unprocessed channels
                 if (!processR) {
@@ -440,6 +463,7 @@ public:
         , _mix(NULL)
         , _maskApply(NULL)
         , _maskInvert(NULL)
+        , _exact(NULL)
     {
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
         assert( _dstClip && (_dstClip->getPixelComponents() == ePixelComponentRGB ||
@@ -471,6 +495,8 @@ public:
         _white = fetchRGBParam(kParamWhite);
         _gamma = fetchRGBParam(kParamGamma);
         assert(_operation && _black && _white && _gamma);
+        _exact = fetchBooleanParam(kParamExact);
+        assert(_exact);
     }
 
 private:
@@ -508,6 +534,8 @@ private:
     DoubleParam* _mix;
     BooleanParam* _maskApply;
     BooleanParam* _maskInvert;
+    BooleanParam* _exact;
+    TransferLUTCache<Mutex> _lutCache;
 };
 
 
@@ -599,8 +627,19 @@ Log2LinPlugin::setupAndProcess(Log2LinProcessorBase &processor,
     double gamma[3] = { 0. };
     _gamma->getValueAtTime(time, gamma[0], gamma[1], gamma[2]);
 
+    bool exact = _exact->getValueAtTime(time);
+    OperationEnum operation = (OperationEnum)_operation->getValueAtTime(time);
+    TransferCurve curve[3];
+    getTransferCurves(operation, black, white, gamma, curve);
+    TransferLUTHolder<Mutex> lutHolder(_lutCache);
+    const TransferLUT *lut = NULL;
+    if ( !exact && !premult && ( (dstBitDepth == eBitDepthUByte) || (dstBitDepth == eBitDepthUShort) ) ) {
+        lut = lutHolder.acquire(curve, dstBitDepth == eBitDepthUByte ? 255 : 65535);
+    }
+
     processor.setValues(premult, premultChannel, mix,
-                        processR, processG, processB, black, white, gamma);
+                        processR, processG, processB,
+                        exact, curve, lut);
     processor.process();
 } // Log2LinPlugin::setupAndProcess
 
@@ -919,6 +958,17 @@ Log2LinPluginFactory::describeInContext(ImageEffectDescriptor &desc,
         }
     }
 
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamExact);
+        param->setLabel(kParamExactLabel);
+        param->setHint(kParamExactHint);
+        param->setDefault(kParamExactDefault);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+
     ofxsPremultDescribeParams(desc, page);
     ofxsMaskMixDescribeParams(desc, page);
     //std::cout << "describeInContext! OK\n";
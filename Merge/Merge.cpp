@@ -38,6 +38,7 @@
 #include "ofxsMaskMix.h"
 #include "ofxsMacros.h"
 #include "ofxsThreadSuite.h"
+#include "ofxsCPUFeatures.h"
 
 using namespace OFX;
 
@@ -109,8 +110,11 @@ enum MergePluginEnum
 
 #define kPluginIdentifier "net.sf.openfx.MergePlugin"
 #define kPluginIdentifierSub "net.sf.openfx.Merge"
+// History:
+// version 1.0: initial version
+// version 1.1: process whole rows in the common case (one A input, no roto masks, all channels), with AVX2 and AVX-512 variants selected at runtime
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -386,6 +390,23 @@ private:
         for (int c = 0; c < nComponents; ++c) {
             tmpA[c] = tmpB[c] = 0.;
         }
+        // the common case (a single A input, no roto masks, all channels) is processed by rows
+        // where both A and B are defined
+        const bool rowsPossible = ( _srcImgAs.size() == 1 && _srcImgAs[0] && _srcImgB && !_rotoMaskImgB &&
+                                    (_rotoMaskImgAs.empty() || !_rotoMaskImgAs[0]) &&
+                                    (_aChannels.count() == 4) && (_bChannels.count() == 4) && (_outputChannels.count() == 4) );
+        OfxRectI rowsBounds = procWindow;
+        if (rowsPossible) {
+            const OfxRectI boundsA = _srcImgAs[0]->getBounds();
+            const OfxRectI boundsB = _srcImgB->getBounds();
+            rowsBounds.y1 = (std::max)(boundsA.y1, boundsB.y1);
+            rowsBounds.y2 = (std::min)(boundsA.y2, boundsB.y2);
+            if ( (boundsA.x1 > procWindow.x1) || (boundsB.x1 > procWindow.x1) ||
+                 (boundsA.x2 < procWindow.x2) || (boundsB.x2 < procWindow.x2) ) {
+                rowsBounds.y2 = rowsBounds.y1;
+            }
+        }
+
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
                 break;
@@ -393,6 +414,25 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
+            if ( rowsPossible && (rowsBounds.y1 <= y) && (y < rowsBounds.y2) ) {
+                const PIX *srcPixA = (const PIX *) _srcImgAs[0]->getPixelAddress(procWindow.x1, y);
+                const PIX *srcPixB = (const PIX *) _srcImgB->getPixelAddress(procWindow.x1, y);
+                switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+                case CPUFeatures::eISAAVX512:
+                    mergeRowAVX512(srcPixA, srcPixB, dstPix, procWindow.x1, procWindow.x2, y);
+                    break;
+                case CPUFeatures::eISAAVX2:
+                    mergeRowAVX2(srcPixA, srcPixB, dstPix, procWindow.x1, procWindow.x2, y);
+                    break;
+#endif
+                default:
+                    mergeRow(srcPixA, srcPixB, dstPix, procWindow.x1, procWindow.x2, y);
+                    break;
+                }
+                continue;
+            }
+
             for (int x = procWindow.x1; x < procWindow.x2; ++x) {
                 if (_srcImgAs.size() == 0) {
                     const PIX *srcPixB = (const PIX *)  (_srcImgB ? _srcImgB->getPixelAddress(x, y) : 0);
@@ -576,6 +616,62 @@ private:
             }
         }
     } // multiThreadProcessImages
+
+    // same as multiThreadProcessImages() in the common case, on the pixels x1..x2-1 of row y,
+    // where both A and B are defined
+    OFXS_FORCEINLINE void mergeRow(const PIX *srcPixA,
+                                   const PIX *srcPixB,
+                                   PIX *dstPix,
+                                   int x1,
+                                   int x2,
+                                   int y)
+    {
+        float tmpPix[nComponents];
+        float tmpA[nComponents];
+        float tmpB[nComponents];
+
+        for (int x = x1; x < x2; ++x, srcPixA += nComponents, srcPixB += nComponents, dstPix += nComponents) {
+            for (int c = 0; c < nComponents; ++c) {
+                tmpA[c] = (float)srcPixA[c] / maxValue;
+                tmpB[c] = (float)srcPixB[c] / maxValue;
+            }
+            // work in float: clamping is done when mixing
+            const float a = (nComponents == 4) ? tmpA[nComponents - 1] : ( (nComponents == 1) ? tmpA[0] : 1.f );
+            const float b = (nComponents == 4) ? tmpB[nComponents - 1] : ( (nComponents == 1) ? tmpB[0] : 1.f );
+
+            mergePixel<f, float, nComponents, 1>(_alphaMasking, tmpA, a, tmpB, b, tmpPix);
+
+            // denormalize
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] *= maxValue;
+            }
+
+            ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPixB, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+        }
+    }
+
+#ifdef OFXS_CPU_DISPATCH
+    OFXS_TARGET_AVX2 void mergeRowAVX2(const PIX *srcPixA,
+                                       const PIX *srcPixB,
+                                       PIX *dstPix,
+                                       int x1,
+                                       int x2,
+                                       int y)
+    {
+        mergeRow(srcPixA, srcPixB, dstPix, x1, x2, y);
+    }
+
+    OFXS_TARGET_AVX512 void mergeRowAVX512(const PIX *srcPixA,
+                                           const PIX *srcPixB,
+                                           PIX *dstPix,
+                                           int x1,
+                                           int x2,
+                                           int y)
+    {
+        mergeRow(srcPixA, srcPixB, dstPix, x1, x2, y);
+    }
+
+#endif
 };
 
 
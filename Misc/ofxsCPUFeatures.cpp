@@ -0,0 +1,142 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Runtime selection of the instruction set used by the hot pixel kernels.
+ */
+
+#include "ofxsCPUFeatures.h"
+
+#include <cstdlib> // getenv
+#include <cstring> // strcmp
+
+#ifdef OFXS_CPU_DISPATCH
+#include <cpuid.h>
+#endif
+
+namespace OFX {
+namespace CPUFeatures {
+#ifdef OFXS_CPU_DISPATCH
+// the low word of the register state enabled by the OS (XCR0), only valid if CPUID reports OSXSAVE
+static unsigned int
+xgetbv0()
+{
+    unsigned int eax, edx;
+
+    __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+    return eax;
+}
+
+#endif
+
+static ISAEnum
+detectISA()
+{
+#ifdef OFXS_CPU_DISPATCH
+    unsigned int eax, ebx, ecx, edx;
+
+    if ( !__get_cpuid(1, &eax, &ebx, &ecx, &edx) ) {
+        return eISAGeneric;
+    }
+    const bool osxsave = (ecx >> 27) & 1;
+    const bool avx = (ecx >> 28) & 1;
+    const bool fma = (ecx >> 12) & 1;
+    if ( !osxsave || !avx || !fma ) {
+        return eISAGeneric;
+    }
+    const unsigned int xcr0 = xgetbv0();
+    if ( (xcr0 & 0x6) != 0x6 ) {
+        // the OS does not save the XMM and YMM registers
+        return eISAGeneric;
+    }
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return eISAGeneric;
+    }
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    const bool avx2 = (ebx >> 5) & 1;
+    if (!avx2) {
+        return eISAGeneric;
+    }
+    const bool avx512 = ( (ebx >> 16) & 1 ) && // AVX512F
+                        ( (ebx >> 17) & 1 ) && // AVX512DQ
+                        ( (ebx >> 30) & 1 ) && // AVX512BW
+                        ( (ebx >> 31) & 1 ) && // AVX512VL
+                        ( (xcr0 & 0xe6) == 0xe6 ); // the OS saves the opmask and ZMM registers
+
+    return avx512 ? eISAAVX512 : eISAAVX2;
+#else
+
+    return eISAGeneric;
+#endif
+}
+
+static ISAEnum
+selectISA()
+{
+    const ISAEnum supported = detectISA();
+    const char* env = std::getenv(kCPUFeaturesEnvISA);
+
+    if (!env) {
+        return supported;
+    }
+    ISAEnum forced = supported;
+    if (std::strcmp(env, "generic") == 0) {
+        forced = eISAGeneric;
+    } else if (std::strcmp(env, "avx2") == 0) {
+        forced = eISAAVX2;
+    } else if (std::strcmp(env, "avx512") == 0) {
+        forced = eISAAVX512;
+    }
+
+    // never select an instruction set that the CPU does not have
+    return (forced < supported) ? forced : supported;
+}
+
+// computed when the plugin binary is loaded
+static const ISAEnum gSupportedISA = detectISA();
+static const ISAEnum gISA = selectISA();
+
+ISAEnum
+getSupportedISA()
+{
+    return gSupportedISA;
+}
+
+ISAEnum
+getISA()
+{
+    return gISA;
+}
+
+const char*
+getISAName(ISAEnum isa)
+{
+    switch (isa) {
+    case eISAGeneric:
+        return "generic";
+    case eISAAVX2:
+        return "avx2";
+    case eISAAVX512:
+        return "avx512";
+    }
+
+    return "generic";
+}
+} // namespace CPUFeatures
+} // namespace OFX
@@ -0,0 +1,108 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Runtime selection of the instruction set used by the hot pixel kernels.
+ *
+ * The plugins are compiled with generic flags, so that the same binary runs
+ * on any x86-64 CPU. Selected kernels are also compiled for AVX2 and AVX-512,
+ * using function-level target attributes, and the best variant supported by
+ * the CPU (and by the OS, which must save the wide registers) is selected
+ * when the plugin is loaded.
+ *
+ * The OFX_MISC_ISA environment variable forces a variant for testing:
+ * "generic", "avx2" or "avx512". A variant that is not supported by the CPU
+ * is never selected: the best supported one is used instead.
+ *
+ * A kernel is written once, in a function marked OFXS_FORCEINLINE, and
+ * wrapped by functions marked OFXS_TARGET_AVX2 and OFXS_TARGET_AVX512,
+ * so that the compiler inlines and vectorizes it for each instruction set:
+ *
+ *   OFXS_FORCEINLINE void kernel(...) { ... }
+ *   #ifdef OFXS_CPU_DISPATCH
+ *   OFXS_TARGET_AVX2 void kernelAVX2(...) { kernel(...); }
+ *   OFXS_TARGET_AVX512 void kernelAVX512(...) { kernel(...); }
+ *   #endif
+ *
+ *   switch ( CPUFeatures::getISA() ) {
+ *   #ifdef OFXS_CPU_DISPATCH
+ *   case CPUFeatures::eISAAVX512: kernelAVX512(...); break;
+ *   case CPUFeatures::eISAAVX2: kernelAVX2(...); break;
+ *   #endif
+ *   default: kernel(...); break;
+ *   }
+ *
+ * On other compilers and architectures, only the generic variant exists.
+ */
+
+#ifndef Misc_ofxsCPUFeatures_h
+#define Misc_ofxsCPUFeatures_h
+
+#if ( defined(__GNUC__) || defined(__clang__) ) && ( defined(__x86_64__) || defined(__i386__) ) && \
+    ( defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9) )
+#define OFXS_CPU_DISPATCH
+#define OFXS_TARGET_AVX2 __attribute__( ( target("avx2,fma") ) )
+#define OFXS_TARGET_AVX512 __attribute__( ( target("avx512f,avx512dq,avx512bw,avx512vl,avx2,fma") ) )
+#else
+#define OFXS_TARGET_AVX2
+#define OFXS_TARGET_AVX512
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OFXS_FORCEINLINE inline __attribute__( (always_inline) )
+#elif defined(_MSC_VER)
+#define OFXS_FORCEINLINE __forceinline
+#else
+#define OFXS_FORCEINLINE inline
+#endif
+
+// pointers to arrays that do not overlap, so that the compiler may vectorize
+// loops that read and write several arrays without checking for aliasing
+#if defined(__GNUC__) || defined(__clang__)
+#define OFXS_RESTRICT __restrict__
+#elif defined(_MSC_VER)
+#define OFXS_RESTRICT __restrict
+#else
+#define OFXS_RESTRICT
+#endif
+
+#define kCPUFeaturesEnvISA "OFX_MISC_ISA"
+
+namespace OFX {
+namespace CPUFeatures {
+enum ISAEnum
+{
+    eISAGeneric = 0,
+    eISAAVX2,   // AVX2 and FMA
+    eISAAVX512  // AVX-512 F, DQ, BW and VL
+};
+
+/// the best instruction set supported by the CPU and the OS
+ISAEnum getSupportedISA();
+
+/// the instruction set used by the kernels: the supported one, or the one
+/// forced by the OFX_MISC_ISA environment variable, computed once when the
+/// plugin is loaded
+ISAEnum getISA();
+
+/// "generic", "avx2" or "avx512"
+const char* getISAName(ISAEnum isa);
+} // namespace CPUFeatures
+} // namespace OFX
+
+#endif // Misc_ofxsCPUFeatures_h
@@ -0,0 +1,249 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Fast approximations of log2, exp2, pow and of the usual transfer functions.
+ *
+ * The functions have no branches (the selects are done on the bit patterns),
+ * so that loops calling them can be vectorized by the compiler. The array
+ * versions should be preferred, since they are written for that purpose.
+ *
+ * Accuracy (measured against double precision):
+ * - fast_log2(x): absolute error < 1.2e-7 for x in [0.5,2], relative error
+ *   < 1e-7 elsewhere in [1e-30,1e30]
+ * - fast_exp2(x): relative error < 1e-7 for x in [-126,127]
+ * - fast_pow(x,y) = fast_exp2(y * fast_log2(x)): relative error < 1.6e-6 for
+ *   x in [1e-3,64] and y in [0.4,2.5]
+ * - to_func_srgb, from_func_srgb, to_func_Rec709, from_func_Rec709: absolute
+ *   error < 2.5e-7 on [-0.5,1], relative error < 1.4e-6 on [1,64].
+ * These errors are below the quantization step of 16-bit images (1.5e-5).
+ * Non-finite values and values outside of the range of normal floats are not
+ * handled (the result is clamped to the range of normal floats).
+ */
+
+#ifndef Misc_ofxsFastMath_h
+#define Misc_ofxsFastMath_h
+
+#include <cstring> // memcpy
+
+#include "ofxsCPUFeatures.h"
+
+namespace OFX {
+namespace FastMath {
+
+// branch-free selection: m ? a : b
+inline float
+select(bool m,
+       float a,
+       float b)
+{
+    unsigned int ia, ib;
+
+    std::memcpy( &ia, &a, sizeof(float) );
+    std::memcpy( &ib, &b, sizeof(float) );
+    const unsigned int mask = -(unsigned int)m;
+    ia = (ia & mask) | (ib & ~mask);
+    std::memcpy( &a, &ia, sizeof(float) );
+
+    return a;
+}
+
+inline float
+fmax(float a,
+     float b)
+{
+    return select(a > b, a, b);
+}
+
+inline float
+fmin(float a,
+     float b)
+{
+    return select(a < b, a, b);
+}
+
+// log2(x) for x > 0.
+// x = 2^e * m with m in [sqrt(1/2),sqrt(2)), and log2(m) = 2/ln(2) atanh(t)
+// with t = (m-1)/(m+1) in [-0.172,0.172]: the series is truncated at t^9.
+inline float
+fast_log2(float x)
+{
+    x = fmax(x, 1.17549435e-38f); // FLT_MIN, no denormals
+    unsigned int i;
+    std::memcpy( &i, &x, sizeof(float) );
+    int e = (int)( (i >> 23) & 0xff ) - 127;
+    i = (i & 0x007fffff) | 0x3f800000; // m in [1,2)
+    float m;
+    std::memcpy( &m, &i, sizeof(float) );
+    const bool big = m > 1.41421356f;
+    m = select(big, m * 0.5f, m);
+    e += (int)big;
+    const float t = (m - 1.f) / (m + 1.f);
+    const float t2 = t * t;
+
+    return (float)e + t * ( 2.88539008f + t2 * ( 0.961796694f + t2 * ( 0.577078016f + t2 * ( 0.412198583f + t2 * 0.320598898f ) ) ) );
+}
+
+// 2^x.
+// x = i + f with i integer and f in [-0.5,0.5], 2^f is a degree 7
+// polynomial (Taylor series of exp(f ln(2))).
+inline float
+fast_exp2(float x)
+{
+    x = fmin( fmax(x, -126.f), 127.f );
+    const int i = (int)(x + 128.5f) - 128; // round to nearest, x + 128.5 > 0
+    const float f = x - (float)i;
+    const float p = 1.f + f * ( 0.693147181f + f * ( 0.240226507f + f * ( 0.0555041087f + f * ( 0.00961812911f + f * ( 0.00133335581f + f * ( 0.000154035304f + f * 1.52527338e-05f ) ) ) ) ) );
+    const unsigned int bits = (unsigned int)(i + 127) << 23;
+    float scale;
+    std::memcpy( &scale, &bits, sizeof(float) );
+
+    return p * scale;
+}
+
+// x^y for x > 0 (0 is returned for x <= 0)
+inline float
+fast_pow(float x,
+         float y)
+{
+    return select(x > 0.f, fast_exp2( y * fast_log2(x) ), 0.f);
+}
+
+/// to sRGB from Linear Opto-Electronic Transfer Function (OETF), see Color::to_func_srgb
+inline float
+to_func_srgb(float v)
+{
+    const float lin = v * 12.92f;
+    const float pw = 1.055f * fast_pow(v, 1.0f / 2.4f) - 0.055f;
+
+    return select( v < 0.0031308f, fmax(lin, 0.f), pw );
+}
+
+/// from sRGB to Linear Electro-Optical Transfer Function (EOTF), see Color::from_func_srgb
+inline float
+from_func_srgb(float v)
+{
+    const float lin = v * (1.0f / 12.92f);
+    const float pw = fast_pow( (v + 0.055f) * (1.0f / 1.055f), 2.4f );
+
+    return select( v < 0.04045f, fmax(lin, 0.f), pw );
+}
+
+/// to Rec.709 from Linear Opto-Electronic Transfer Function (OETF), see Color::to_func_Rec709
+inline float
+to_func_Rec709(float v)
+{
+    const float lin = v * 4.5f;
+    const float pw = 1.099f * fast_pow(v, 0.45f) - 0.099f;
+
+    return select( v < 0.018f, fmax(lin, 0.f), pw );
+}
+
+/// from Rec.709 to Linear Electro-Optical Transfer Function (EOTF), see Color::from_func_Rec709
+inline float
+from_func_Rec709(float v)
+{
+    const float lin = v * (1.0f / 4.5f);
+    const float pw = fast_pow( (v + 0.099f) * (1.0f / 1.099f), 1.0f / 0.45f );
+
+    return select( v < 0.081f, fmax(lin, 0.f), pw );
+}
+
+// array versions, n is the number of values.
+// The loops are compiled for each instruction set, and the variant is selected
+// at runtime (see ofxsCPUFeatures.h).
+template <float (*func)(float)>
+OFXS_FORCEINLINE void
+applyArrayImpl(float *v,
+               int n)
+{
+    for (int i = 0; i < n; ++i) {
+        v[i] = func(v[i]);
+    }
+}
+
+#ifdef OFXS_CPU_DISPATCH
+template <float (*func)(float)>
+OFXS_TARGET_AVX2 void
+applyArrayAVX2(float *v,
+               int n)
+{
+    applyArrayImpl<func>(v, n);
+}
+
+template <float (*func)(float)>
+OFXS_TARGET_AVX512 void
+applyArrayAVX512(float *v,
+                 int n)
+{
+    applyArrayImpl<func>(v, n);
+}
+
+#endif
+
+template <float (*func)(float)>
+inline void
+applyArray(float *v,
+           int n)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        applyArrayAVX512<func>(v, n);
+        break;
+    case CPUFeatures::eISAAVX2:
+        applyArrayAVX2<func>(v, n);
+        break;
+#endif
+    default:
+        applyArrayImpl<func>(v, n);
+        break;
+    }
+}
+
+inline void
+to_func_srgb(float *v,
+             int n)
+{
+    applyArray<to_func_srgb>(v, n);
+}
+
+inline void
+from_func_srgb(float *v,
+               int n)
+{
+    applyArray<from_func_srgb>(v, n);
+}
+
+inline void
+to_func_Rec709(float *v,
+               int n)
+{
+    applyArray<to_func_Rec709>(v, n);
+}
+
+inline void
+from_func_Rec709(float *v,
+                 int n)
+{
+    applyArray<from_func_Rec709>(v, n);
+}
+} // namespace FastMath
+} // namespace OFX
+
+#endif // Misc_ofxsFastMath_h
@@ -0,0 +1,72 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Bulk fills of constant pixel values.
+ *
+ * Generators use these to render the parts of the image where their output is
+ * constant (e.g. the whole image for Constant, the outside of the shape for
+ * Rectangle and Radial) at memory speed, instead of evaluating every pixel.
+ */
+
+#ifndef Misc_ofxsFill_h
+#define Misc_ofxsFill_h
+
+#include <algorithm>
+
+namespace OFX {
+/// set count consecutive pixels starting at dstPix to the value pix
+template <class PIX, int nComponents>
+void
+ofxsFillPixels(PIX *dstPix,
+               const PIX pix[nComponents],
+               int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    if (nComponents == 1) {
+        std::fill(dstPix, dstPix + count, pix[0]);
+
+        return;
+    }
+    std::copy(pix, pix + nComponents, dstPix);
+    // double the filled part until the span is full: each step is a single block copy
+    int filled = 1;
+    while (filled < count) {
+        const int n = (std::min)(filled, count - filled);
+        std::copy(dstPix, dstPix + n * nComponents, dstPix + filled * nComponents);
+        filled += n;
+    }
+}
+
+/// set count consecutive pixels starting at dstPix to the pixels of the row srcPix
+template <class PIX, int nComponents>
+void
+ofxsCopyPixels(PIX *dstPix,
+               const PIX *srcPix,
+               int count)
+{
+    if (count <= 0) {
+        return;
+    }
+    std::copy(srcPix, srcPix + count * nComponents, dstPix);
+}
+} // namespace OFX
+
+#endif // Misc_ofxsFill_h
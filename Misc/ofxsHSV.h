@@ -0,0 +1,215 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Conversions between RGB and HSV for spans of pixels.
+ *
+ * These compute the same values as Color::rgb_to_hsv and Color::hsv_to_rgb
+ * (see ofxsLut.h), with the same operations, but the branches are replaced by
+ * selects (FastMath::select) so that the loops are vectorized by the compiler. The loops are
+ * compiled for each instruction set, and the variant is selected at runtime
+ * (see ofxsCPUFeatures.h).
+ *
+ * The channels are stored in separate arrays of n values, which must not
+ * overlap (the input and output arrays are distinct). Callers usually
+ * convert a row in chunks of kHSVChunkSize pixels, using buffers on the stack.
+ */
+
+#ifndef Misc_ofxsHSV_h
+#define Misc_ofxsHSV_h
+
+#include <cmath>
+#include <algorithm>
+
+#include "ofxsLut.h"
+#include "ofxsCPUFeatures.h"
+#include "ofxsFastMath.h"
+
+#define kHSVChunkSize 256
+
+namespace OFX {
+namespace HSV {
+// h is in [0,OFXS_HUE_CIRCLE], s and v are not clamped.
+// If s == 0, h = 0 (undefined).
+OFXS_FORCEINLINE void
+rgb_to_hsvImpl(const float *OFXS_RESTRICT r,
+               const float *OFXS_RESTRICT g,
+               const float *OFXS_RESTRICT b,
+               float *OFXS_RESTRICT h,
+               float *OFXS_RESTRICT s,
+               float *OFXS_RESTRICT v,
+               int n)
+{
+    for (int i = 0; i < n; ++i) {
+        const float ri = r[i];
+        const float gi = g[i];
+        const float bi = b[i];
+        const float min = (std::min)((std::min)(ri, gi), bi);
+        const float max = (std::max)((std::max)(ri, gi), bi);
+        const float delta = max - min;
+        // all the candidates are computed, and the right one is selected
+        const float hr = (gi - bi) / delta;      // between yellow & magenta
+        const float hg = 2 + (bi - ri) / delta;  // between cyan & yellow
+        const float hb = 4 + (ri - gi) / delta;  // between magenta & cyan
+        float hi = FastMath::select( ri == max, hr, FastMath::select(gi == max, hg, hb) );
+        hi = (float)( hi * (OFXS_HUE_CIRCLE / 6.) );
+        hi = FastMath::select( hi < 0, (float)(hi + OFXS_HUE_CIRCLE), hi );
+        const float si = delta / max;
+        const bool grey = (max == 0.) | (delta == 0.);
+        h[i] = FastMath::select(grey, 0.f, hi);
+        s[i] = FastMath::select(max != 0., si, 0.f);
+        v[i] = max;
+    }
+}
+
+OFXS_FORCEINLINE void
+hsv_to_rgbImpl(const float *OFXS_RESTRICT h,
+               const float *OFXS_RESTRICT s,
+               const float *OFXS_RESTRICT v,
+               float *OFXS_RESTRICT r,
+               float *OFXS_RESTRICT g,
+               float *OFXS_RESTRICT b,
+               int n)
+{
+    for (int i = 0; i < n; ++i) {
+        const float si = s[i];
+        const float vi = v[i];
+        const float hi = (float)( h[i] * (6. / OFXS_HUE_CIRCLE) ); // sector 0 to 5
+        // same as (int)std::floor(hi), but vectorized by the compiler
+        int sector = (int)hi;
+        sector -= (int)(hi < sector);
+        const float f = hi - sector; // factorial part of h
+        sector = (sector >= 0) ? (sector % 6) : (sector % 6) + 6; // take h modulo 360
+        const float p = vi * ( 1 - si );
+        const float q = vi * ( 1 - si * f );
+        const float t = vi * ( 1 - si * ( 1 - f ) );
+        const float rs = FastMath::select( sector == 0, vi, FastMath::select( sector == 1, q, FastMath::select( sector == 2, p, FastMath::select( sector == 3, p, FastMath::select(sector == 4, t, vi) ) ) ) );
+        const float gs = FastMath::select( sector == 0, t, FastMath::select( sector == 1, vi, FastMath::select( sector == 2, vi, FastMath::select(sector == 3, q, p) ) ) );
+        const float bs = FastMath::select( sector == 0, p, FastMath::select( sector == 1, p, FastMath::select( sector == 2, t, FastMath::select( sector == 3, vi, FastMath::select(sector == 4, vi, q) ) ) ) );
+        // achromatic (grey)
+        const bool grey = (si == 0);
+        r[i] = FastMath::select(grey, vi, rs);
+        g[i] = FastMath::select(grey, vi, gs);
+        b[i] = FastMath::select(grey, vi, bs);
+    }
+}
+
+#ifdef OFXS_CPU_DISPATCH
+inline OFXS_TARGET_AVX2 void
+rgb_to_hsvAVX2(const float *r,
+               const float *g,
+               const float *b,
+               float *h,
+               float *s,
+               float *v,
+               int n)
+{
+    rgb_to_hsvImpl(r, g, b, h, s, v, n);
+}
+
+inline OFXS_TARGET_AVX512 void
+rgb_to_hsvAVX512(const float *r,
+                 const float *g,
+                 const float *b,
+                 float *h,
+                 float *s,
+                 float *v,
+                 int n)
+{
+    rgb_to_hsvImpl(r, g, b, h, s, v, n);
+}
+
+inline OFXS_TARGET_AVX2 void
+hsv_to_rgbAVX2(const float *h,
+               const float *s,
+               const float *v,
+               float *r,
+               float *g,
+               float *b,
+               int n)
+{
+    hsv_to_rgbImpl(h, s, v, r, g, b, n);
+}
+
+inline OFXS_TARGET_AVX512 void
+hsv_to_rgbAVX512(const float *h,
+                 const float *s,
+                 const float *v,
+                 float *r,
+                 float *g,
+                 float *b,
+                 int n)
+{
+    hsv_to_rgbImpl(h, s, v, r, g, b, n);
+}
+
+#endif
+
+/// same as Color::rgb_to_hsv(r[i], g[i], b[i], &h[i], &s[i], &v[i]) for i in [0,n)
+inline void
+rgb_to_hsv(const float *r,
+           const float *g,
+           const float *b,
+           float *h,
+           float *s,
+           float *v,
+           int n)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        rgb_to_hsvAVX512(r, g, b, h, s, v, n);
+        break;
+    case CPUFeatures::eISAAVX2:
+        rgb_to_hsvAVX2(r, g, b, h, s, v, n);
+        break;
+#endif
+    default:
+        rgb_to_hsvImpl(r, g, b, h, s, v, n);
+        break;
+    }
+}
+
+/// same as Color::hsv_to_rgb(h[i], s[i], v[i], &r[i], &g[i], &b[i]) for i in [0,n)
+inline void
+hsv_to_rgb(const float *h,
+           const float *s,
+           const float *v,
+           float *r,
+           float *g,
+           float *b,
+           int n)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        hsv_to_rgbAVX512(h, s, v, r, g, b, n);
+        break;
+    case CPUFeatures::eISAAVX2:
+        hsv_to_rgbAVX2(h, s, v, r, g, b, n);
+        break;
+#endif
+    default:
+        hsv_to_rgbImpl(h, s, v, r, g, b, n);
+        break;
+    }
+}
+} // namespace HSV
+} // namespace OFX
+
+#endif // Misc_ofxsHSV_h
@@ -0,0 +1,216 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Lookup tables for the hue curves of a ParametricParam (HueCorrect, HueKeyer).
+ *
+ * The curves are defined on the periodic hue range [0,6]. A HueCurves holds
+ * their values at nbValues+1 regularly spaced positions, clamped to be
+ * positive, and the values of all curves at a given position are contiguous,
+ * so that a pixel reads all of its curve values from the same cache lines.
+ *
+ * Evaluating the tables takes (nbValues+1) calls to the host per curve
+ * (65536 for 16-bit images), so the HueCurvesCache (a RefCountedCache) keeps
+ * the tables of the last few curve sets of an instance. Tables are identified
+ * by the control points of the curves at the render time, and by a revision
+ * number that the plugin increments with invalidate() when the curves
+ * parameter changes (the interpolation of the curves is not described by the
+ * control points).
+ * A static curve is thus evaluated once, instead of at each render.
+ */
+
+#ifndef Misc_ofxsHueCurves_h
+#define Misc_ofxsHueCurves_h
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+#include <utility>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+#include "ofxsRefCountedCache.h"
+
+namespace OFX {
+// identifies the HueCurves computed for a set of curves
+struct HueCurvesKey
+{
+    int nCurves;
+    int nbValues;
+    unsigned int revision;
+    std::vector<double> controlPoints;
+
+    HueCurvesKey()
+        : nCurves(0)
+        , nbValues(0)
+        , revision(0)
+    {
+    }
+
+    bool operator==(const HueCurvesKey &other) const
+    {
+        return nCurves == other.nCurves && nbValues == other.nbValues && revision == other.revision && controlPoints == other.controlPoints;
+    }
+};
+
+class HueCurves
+{
+public:
+    HueCurves(ParametricParam *param,
+              double time,
+              int nCurves,
+              int nbValues)
+        : _nCurves(nCurves)
+        , _nbValues(nbValues)
+        , _values( (nbValues + 2) * nCurves, 0. ) // the last position is 0, for the interpolation at the end of the range
+    {
+        assert(param && nCurves > 0 && nbValues > 0);
+        for (int position = 0; position <= nbValues; ++position) {
+            // position to evaluate the param at
+            double parametricPos = 6 * double(position) / nbValues;
+            for (int c = 0; c < nCurves; ++c) {
+                // evaluate the parametric param
+                double value = param->getValue(c, time, parametricPos);
+
+                // all the values must be positive. We don't care if sat_thrsh goes above 1.
+                _values[position * nCurves + c] = (std::max)(0., value);
+            }
+        }
+    }
+
+    /// the values of all curves at the hue position pos in [0,6], linearly interpolated
+    void interpolate(double pos,
+                     double *values) const
+    {
+        if ( (pos < 0.) || (6. < pos) ) {
+            // the curves are periodic
+            pos -= 6. * std::floor(pos / 6.);
+        }
+        if ( !( (0. <= pos) && (pos <= 6.) ) ) {
+            // NaN or infinite hue
+            pos = 0.;
+        }
+        double x = pos / 6.;
+        int i = (int)(x * _nbValues);
+        assert(0 <= i && i <= _nbValues);
+        double alpha = (std::max)( 0., (std::min)(x * _nbValues - i, 1.) );
+        const double *a = &_values[i * _nCurves];
+        const double *b = a + _nCurves;
+        for (int c = 0; c < _nCurves; ++c) {
+            values[c] = a[c] * (1.f - alpha) + b[c] * alpha;
+        }
+    }
+
+    /// the control points of the curves at the given time, which identify the tables
+    static void getControlPoints(ParametricParam *param,
+                                 double time,
+                                 int nCurves,
+                                 std::vector<double> *controlPoints)
+    {
+        controlPoints->clear();
+        for (int c = 0; c < nCurves; ++c) {
+            const int n = param->getNControlPoints(c, time);
+            controlPoints->push_back(n);
+            for (int i = 0; i < n; ++i) {
+                const std::pair<double, double> p = param->getNthControlPoint(c, time, i);
+                controlPoints->push_back(p.first);
+                controlPoints->push_back(p.second);
+            }
+        }
+    }
+
+private:
+    int _nCurves;
+    int _nbValues;
+    std::vector<double> _values; // _values[position * _nCurves + c]
+};
+
+// Cache of the HueCurves of the last curve sets.
+template <class MUTEX>
+class HueCurvesCache
+    : public RefCountedCache<HueCurvesKey, HueCurves, MUTEX>
+{
+public:
+    HueCurvesCache(int maxUnused = 4)
+        : RefCountedCache<HueCurvesKey, HueCurves, MUTEX>(maxUnused)
+        , _revisionMutex()
+        , _revision(0)
+    {
+    }
+
+    /// the curves parameter changed: the tables are not used anymore
+    void invalidate()
+    {
+        {
+            OFX::MultiThread::AutoMutexT<MUTEX> l(&_revisionMutex);
+            ++_revision;
+        }
+        this->clearUnused();
+    }
+
+    unsigned int revision()
+    {
+        OFX::MultiThread::AutoMutexT<MUTEX> l(&_revisionMutex);
+
+        return _revision;
+    }
+
+private:
+    MUTEX _revisionMutex;
+    unsigned int _revision;
+};
+
+// gets the HueCurves of the curves parameter from a HueCurvesCache, and
+// releases them when going out of scope
+template <class MUTEX>
+class HueCurvesHolder
+    : public RefCountedCacheHolder<HueCurvesKey, HueCurves, MUTEX>
+{
+public:
+    HueCurvesHolder(HueCurvesCache<MUTEX> &cache)
+        : RefCountedCacheHolder<HueCurvesKey, HueCurves, MUTEX>(cache)
+        , _hueCache(cache)
+    {
+    }
+
+    const HueCurves* acquire(ParametricParam *param,
+                             double time,
+                             int nCurves,
+                             int nbValues)
+    {
+        HueCurvesKey key;
+
+        key.nCurves = nCurves;
+        key.nbValues = nbValues;
+        key.revision = _hueCache.revision();
+        HueCurves::getControlPoints(param, time, nCurves, &key.controlPoints);
+        const HueCurves *curves = RefCountedCacheHolder<HueCurvesKey, HueCurves, MUTEX>::acquire(key);
+        if (!curves) {
+            curves = this->insert( key, new HueCurves(param, time, nCurves, nbValues) );
+        }
+
+        return curves;
+    }
+
+private:
+    HueCurvesCache<MUTEX> &_hueCache;
+};
+} // namespace OFX
+
+#endif // Misc_ofxsHueCurves_h
@@ -0,0 +1,349 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * 3D color lookup tables.
+ *
+ * A LUT3D holds the values of a color transform sampled on a regular
+ * size x size x size lattice. The lattice coordinates of a linear value are
+ * given by a 1D shaper, either linear on [rangeMin,rangeMax] or logarithmic
+ * (log2) on [rangeMin,rangeMax], which spreads the lattice points over a wide
+ * range of HDR values. Values outside of the range are clamped to it.
+ *
+ * The LUT can be written as a .cube file or as a CineSpace .csp file. The 1D
+ * shaper of a .csp file has arbitrary input points, so that it represents the
+ * log2 shaper precisely, while the evenly spaced shaper of a .cube file
+ * cannot represent it near a small rangeMin.
+ *
+ * The lattice is transported as an image (see latticeIndex()), so that any
+ * chain of color nodes can be sampled by rendering the lattice pattern
+ * through it.
+ */
+
+#ifndef Misc_ofxsLUT3D_h
+#define Misc_ofxsLUT3D_h
+
+#include <cmath>
+#include <cstdio>
+#include <cassert>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "ofxsRefCountedCache.h"
+#include "ofxsFastMath.h"
+
+// size of the 1D shaper of .cube files (the largest size supported by DaVinci Resolve)
+#define kLUT3DCubeShaperSize 65536
+// size of the 1D shaper of .csp files
+#define kLUT3DCSPShaperSize 1024
+
+namespace OFX {
+enum LUT3DShaperEnum
+{
+    eLUT3DShaperLinear = 0,
+    eLUT3DShaperLog2,
+};
+
+class LUT3D
+{
+public:
+    LUT3D(int size,
+          LUT3DShaperEnum shaper,
+          double rangeMin,
+          double rangeMax)
+        : _size(size)
+        , _shaper(shaper)
+        , _rangeMin(rangeMin)
+        , _rangeMax(rangeMax)
+        , _data(3 * size * size * size)
+    {
+        assert(size >= 2);
+        if (shaper == eLUT3DShaperLog2) {
+            assert(rangeMin > 0 && rangeMax > rangeMin);
+            _shapeOffset = (float)( -std::log(rangeMin) / std::log(2.) );
+            _shapeScale = (float)( 1. / ( std::log(rangeMax / rangeMin) / std::log(2.) ) );
+        } else {
+            assert(rangeMax > rangeMin);
+            _shapeOffset = (float)-rangeMin;
+            _shapeScale = (float)( 1. / (rangeMax - rangeMin) );
+        }
+    }
+
+    int size() const { return _size; }
+
+    LUT3DShaperEnum shaper() const { return _shaper; }
+
+    double rangeMin() const { return _rangeMin; }
+
+    double rangeMax() const { return _rangeMax; }
+
+    // the RGB values at each lattice point, the red index varies fastest (as in .cube files)
+    float* data() { return &_data[0]; }
+
+    const float* data() const { return &_data[0]; }
+
+    // linear value at the lattice coordinate t in [0,1]
+    static double unshape(LUT3DShaperEnum shaper,
+                          double rangeMin,
+                          double rangeMax,
+                          double t)
+    {
+        if (shaper == eLUT3DShaperLog2) {
+            return rangeMin * std::pow(rangeMax / rangeMin, t);
+        }
+
+        return rangeMin + t * (rangeMax - rangeMin);
+    }
+
+    double unshape(double t) const
+    {
+        return unshape(_shaper, _rangeMin, _rangeMax, t);
+    }
+
+    // lattice coordinate in [0,1] of a linear value
+    float shape(float v) const
+    {
+        if (_shaper == eLUT3DShaperLog2) {
+            v = FastMath::fast_log2(v);
+        }
+        const float t = (v + _shapeOffset) * _shapeScale;
+
+        return FastMath::fmin(FastMath::fmax(t, 0.f), 1.f);
+    }
+
+    // Layout of the lattice image: an image of size*size x size pixels, where
+    // pixel (x,y) holds the lattice point (r,g,b) = (x % size, y, x / size).
+    static void latticeIndex(int x,
+                             int y,
+                             int size,
+                             int *r,
+                             int *g,
+                             int *b)
+    {
+        *r = x % size;
+        *g = y;
+        *b = x / size;
+    }
+
+    // apply the LUT to n pixels given as planar arrays, in place
+    template <bool tetrahedral>
+    void apply(float *r,
+               float *g,
+               float *b,
+               int n) const
+    {
+        const int s1 = _size - 1;
+        const float fs1 = (float)s1;
+        // offsets of the lattice neighbours
+        const int dr = 3;
+        const int dg = 3 * _size;
+        const int db = 3 * _size * _size;
+        const float *lut = &_data[0];
+
+        for (int i = 0; i < n; ++i) {
+            const float tr = shape(r[i]) * fs1;
+            const float tg = shape(g[i]) * fs1;
+            const float tb = shape(b[i]) * fs1;
+            // the last cell is used for t = 1
+            const int ir = (std::min)( (int)tr, s1 - 1 );
+            const int ig = (std::min)( (int)tg, s1 - 1 );
+            const int ib = (std::min)( (int)tb, s1 - 1 );
+            const float fr = tr - ir;
+            const float fg = tg - ig;
+            const float fb = tb - ib;
+            const float *c000 = lut + ir * dr + ig * dg + ib * db;
+            float out[3];
+            if (tetrahedral) {
+                const float *c111 = c000 + dr + dg + db;
+                const float *c1;
+                const float *c2;
+                float w0, w1, w2, w3;
+                if (fr > fg) {
+                    if (fg > fb) {
+                        c1 = c000 + dr; c2 = c000 + dr + dg;
+                        w0 = 1.f - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb;
+                    } else if (fr > fb) {
+                        c1 = c000 + dr; c2 = c000 + dr + db;
+                        w0 = 1.f - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg;
+                    } else {
+                        c1 = c000 + db; c2 = c000 + dr + db;
+                        w0 = 1.f - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg;
+                    }
+                } else {
+                    if (fb > fg) {
+                        c1 = c000 + db; c2 = c000 + dg + db;
+                        w0 = 1.f - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr;
+                    } else if (fb > fr) {
+                        c1 = c000 + dg; c2 = c000 + dg + db;
+                        w0 = 1.f - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr;
+                    } else {
+                        c1 = c000 + dg; c2 = c000 + dr + dg;
+                        w0 = 1.f - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb;
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    out[c] = w0 * c000[c] + w1 * c1[c] + w2 * c2[c] + w3 * c111[c];
+                }
+            } else {
+                for (int c = 0; c < 3; ++c) {
+                    const float c00 = c000[c] + fr * (c000[dr + c] - c000[c]);
+                    const float c10 = c000[dg + c] + fr * (c000[dr + dg + c] - c000[dg + c]);
+                    const float c01 = c000[db + c] + fr * (c000[dr + db + c] - c000[db + c]);
+                    const float c11 = c000[dg + db + c] + fr * (c000[dr + dg + db + c] - c000[dg + db + c]);
+                    const float c0 = c00 + fg * (c10 - c00);
+                    const float c1 = c01 + fg * (c11 - c01);
+                    out[c] = c0 + fb * (c1 - c0);
+                }
+            }
+            r[i] = out[0];
+            g[i] = out[1];
+            b[i] = out[2];
+        }
+    } // apply
+
+    // Write the LUT in the .cube format. With the log2 shaper, the shaper is
+    // written as a 1D LUT before the 3D LUT, as in DaVinci Resolve .cube files.
+    // The input values of a .cube 1D LUT are evenly spaced, so that it only
+    // approximates the log2 shaper near rangeMin (see cubeShaperIsAccurate()).
+    bool writeCube(std::FILE *f,
+                   const std::string &title) const
+    {
+        if ( !title.empty() ) {
+            std::fprintf( f, "TITLE \"%s\"\n", title.c_str() );
+        }
+        if (_shaper == eLUT3DShaperLog2) {
+            std::fprintf(f, "LUT_1D_SIZE %d\n", kLUT3DCubeShaperSize);
+            std::fprintf(f, "LUT_1D_INPUT_RANGE %.9g %.9g\n", _rangeMin, _rangeMax);
+            std::fprintf(f, "LUT_3D_SIZE %d\n", _size);
+            std::fprintf(f, "LUT_3D_INPUT_RANGE 0 1\n");
+            for (int i = 0; i < kLUT3DCubeShaperSize; ++i) {
+                const double t = cubeShaper(i);
+                std::fprintf(f, "%.9g %.9g %.9g\n", t, t, t);
+            }
+        } else {
+            std::fprintf(f, "LUT_3D_SIZE %d\n", _size);
+            std::fprintf(f, "DOMAIN_MIN %.9g %.9g %.9g\n", _rangeMin, _rangeMin, _rangeMin);
+            std::fprintf(f, "DOMAIN_MAX %.9g %.9g %.9g\n", _rangeMax, _rangeMax, _rangeMax);
+        }
+        writeData(f);
+
+        return !std::ferror(f);
+    }
+
+    // True if the 1D shaper written by writeCube() resolves every cell of the
+    // lattice, i.e. its first interval is not wider than a lattice cell.
+    bool cubeShaperIsAccurate() const
+    {
+        return _shaper != eLUT3DShaperLog2 || cubeShaper(1) <= 1. / (_size - 1);
+    }
+
+    // Write the LUT in the CineSpace .csp format, where the shaper is a 1D
+    // LUT with arbitrary input points. With the log2 shaper, the points are
+    // evenly spaced in stops, so that the shaper is precise over the whole range.
+    bool writeCSP(std::FILE *f,
+                  const std::string &title) const
+    {
+        std::fprintf(f, "CSPLUTV100\n3D\n\n");
+        if ( !title.empty() ) {
+            std::fprintf( f, "BEGIN METADATA\n%s\nEND METADATA\n\n", title.c_str() );
+        }
+        const int n = (_shaper == eLUT3DShaperLog2) ? kLUT3DCSPShaperSize : 2;
+        for (int c = 0; c < 3; ++c) {
+            std::fprintf(f, "%d\n", n);
+            for (int i = 0; i < n; ++i) {
+                std::fprintf(f, (i + 1 < n) ? "%.9g " : "%.9g\n", unshape( i / (double)(n - 1) ) );
+            }
+            for (int i = 0; i < n; ++i) {
+                std::fprintf(f, (i + 1 < n) ? "%.9g " : "%.9g\n", i / (double)(n - 1) );
+            }
+        }
+        std::fprintf(f, "\n%d %d %d\n", _size, _size, _size);
+        writeData(f);
+
+        return !std::ferror(f);
+    }
+
+    // FNV-1a hash, used to identify the LUT computed from a lattice image
+    static unsigned long long hash(const void *data,
+                                   size_t len,
+                                   unsigned long long h = 14695981039346656037ULL)
+    {
+        const unsigned char *p = (const unsigned char *)data;
+
+        for (size_t i = 0; i < len; ++i) {
+            h = (h ^ p[i]) * 1099511628211ULL;
+        }
+
+        return h;
+    }
+
+private:
+    // lattice coordinate of the entry i of the 1D shaper written by writeCube()
+    double cubeShaper(int i) const
+    {
+        const double v = _rangeMin + i * (_rangeMax - _rangeMin) / (kLUT3DCubeShaperSize - 1);
+
+        return std::log(v / _rangeMin) / std::log(_rangeMax / _rangeMin);
+    }
+
+    // the lattice values, red varying fastest (the same in .cube and .csp files)
+    void writeData(std::FILE *f) const
+    {
+        const int n = _size * _size * _size;
+
+        for (int i = 0; i < n; ++i) {
+            std::fprintf(f, "%.9g %.9g %.9g\n", _data[3 * i], _data[3 * i + 1], _data[3 * i + 2]);
+        }
+    }
+
+    int _size;
+    LUT3DShaperEnum _shaper;
+    double _rangeMin;
+    double _rangeMax;
+    float _shapeOffset;
+    float _shapeScale;
+    std::vector<float> _data;
+};
+
+// Cache of the last LUT3Ds, identified by a hash of the data they were computed from.
+template <class MUTEX>
+class LUT3DCache
+    : public RefCountedCache<unsigned long long, LUT3D, MUTEX>
+{
+public:
+    LUT3DCache(int maxUnused = 2)
+        : RefCountedCache<unsigned long long, LUT3D, MUTEX>(maxUnused)
+    {
+    }
+};
+
+// releases the LUT3D obtained from a LUT3DCache when going out of scope
+template <class MUTEX>
+class LUT3DHolder
+    : public RefCountedCacheHolder<unsigned long long, LUT3D, MUTEX>
+{
+public:
+    LUT3DHolder(LUT3DCache<MUTEX> &cache)
+        : RefCountedCacheHolder<unsigned long long, LUT3D, MUTEX>(cache)
+    {
+    }
+};
+} // namespace OFX
+
+#endif // Misc_ofxsLUT3D_h
@@ -0,0 +1,382 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Box filter and image pyramid helpers, shared by the blur plugins (CImgBlur, PIKColor).
+ *
+ * A large blur is computed on the coarsest level of the pyramid where it is still
+ * well sampled, i.e. where its standard deviation is at least minSigma pixels of that
+ * level, and the result is expanded back to the full resolution.
+ * Each level is computed from the previous one by averaging 2x2 blocks, which adds
+ * a box blur of variance 1/12 (in pixels of the reduced level), so that the blur
+ * applied on level k has the variance returned by pyramidLevelVariance().
+ *
+ * The images are planar float images: each plane is a width x height array of floats
+ * (this is also the layout of each channel of a CImg of depth 1).
+ * The bounds of the levels are in absolute pixel coordinates, so that the result of a blur
+ * does not depend on the region where it is computed (i.e. on the tiling of the image),
+ * provided that the pyramid level only depends on the blur size and the image RoD, and that
+ * the region includes the support given by pyramidSupport().
+ */
+
+#ifndef Misc_ofxsPyramid_h
+#define Misc_ofxsPyramid_h
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+#include "ofxsMacros.h"
+
+namespace OFX {
+/*
+   The convolution of the step edge with the triangle filter of width s is:
+   x < -s: y = 0
+   x >= -s and x <= 0: y = 1/2 + x/s + x^2/(2*s^2)
+   x > 0 and x <= s: y = 1/2 + x/s - x^2/(2*s^2)
+   x > s: y = 1
+ */
+inline double
+blurredStep(double s,
+            double x)
+{
+    if (s <= 0) {
+        return (x >= 0) ? 1. : 0.;
+    }
+    if (x <= -s) {
+        return 0.;
+    }
+    if (x >= s) {
+        return 1.;
+    }
+    double x_over_s = x / s;
+
+    return 0.5 + x_over_s * ( 1. + (x < 0 ? 0.5 : -0.5) * x_over_s );
+}
+
+// variance (in pixels^2) of the box filter of the given size, iterated iter times
+inline double
+boxFilterVariance(int iter,
+                  double size)
+{
+    return size <= 1. ? 0. : iter * (size * size - 1) / 12.;
+}
+
+// size of the box filter, iterated iter times, with the given variance (the inverse of boxFilterVariance)
+inline double
+boxFilterSize(int iter,
+              double variance)
+{
+    if (variance <= 0.) {
+        return 0.;
+    }
+
+    return std::sqrt(12. * variance / iter + 1.);
+}
+
+// number of pixels on each side used by the box filter of the given size, iterated iter times
+inline int
+boxFilterSupport(int iter,
+                 double size)
+{
+    return size <= 1. ? 0 : iter * ( (int)std::floor( (size - 1) / 2 ) + 1 );
+}
+
+// the coarsest pyramid level on which a blur of standard deviation sigma (in pixels of level 0)
+// can be computed, given the minimum standard deviation and the minimum size of a level
+inline int
+pyramidLevel(double sigma,
+             double minSigma,
+             int minSize,
+             int width,
+             int height)
+{
+    int level = 0;
+
+    while ( (sigma >= minSigma * (1 << (level + 1))) &&
+            ( ( (width >> (level + 1)) >= minSize ) && ( (height >> (level + 1)) >= minSize ) ) ) {
+        ++level;
+    }
+
+    return level;
+}
+
+// the variance (in pixels^2 of the level) of the blur to apply on the given pyramid level
+// to get a blur of the given variance (in pixels^2 of level 0) after expansion
+inline double
+pyramidLevelVariance(double variance,
+                     int level)
+{
+    // each 2x2 averaging adds a box of variance 1/12 (in pixels of the reduced level)
+    const double f = (double)(1 << level);
+    const double reduceVariance = (f * f - 1.) / 12.;
+
+    return (variance - reduceVariance) / (f * f);
+}
+
+// the bounds (in absolute pixel coordinates) of the next pyramid level, computed from the given bounds
+inline OfxRectI
+pyramidReduceBounds(const OfxRectI &bounds)
+{
+    OfxRectI r;
+
+    r.x1 = (int)std::floor(bounds.x1 / 2.);
+    r.y1 = (int)std::floor(bounds.y1 / 2.);
+    r.x2 = (int)std::ceil(bounds.x2 / 2.);
+    r.y2 = (int)std::ceil(bounds.y2 / 2.);
+
+    return r;
+}
+
+// number of pixels (of level 0) on each side used to compute a pixel, when the blur is computed
+// on the given pyramid level with a support of levelSupport pixels (of that level): the 2x2
+// reductions and the bilinear expansions use less than 3 more pixels of that level
+inline int
+pyramidSupport(int levelSupport,
+               int level)
+{
+    return level == 0 ? levelSupport : (levelSupport + 3) << level;
+}
+
+// number of pixels (of level 0) on each side used by the box filter of the given size, iterated
+// iter times, when it is computed on any of the pyramid levels 0..maxLevel
+inline int
+pyramidBoxFilterSupport(int iter,
+                        double size,
+                        int maxLevel)
+{
+    const double variance = boxFilterVariance(iter, size);
+    int support = boxFilterSupport(iter, size);
+
+    for (int level = 1; level <= maxLevel; ++level) {
+        const double levelSize = boxFilterSize( iter, pyramidLevelVariance(variance, level) );
+        support = (std::max)( support, pyramidSupport(boxFilterSupport(iter, levelSize), level) );
+    }
+
+    return support;
+}
+
+// base class for the processors of planar images, which process lines [begin,end)
+class PlanarProcessorBase
+    : public MultiThread::Processor
+{
+public:
+    PlanarProcessorBase(ImageEffect &instance,
+                        int nLines,
+                        int lineSize)
+        : _effect(instance)
+        , _nLines(nLines)
+        , _lineSize(lineSize)
+    {
+    }
+
+    /** @brief called to process everything */
+    void process(void)
+    {
+        if ( (_nLines <= 0) || (_lineSize <= 0) ) {
+            return;
+        }
+        // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+        unsigned int nCPUs = ( (std::min)(_lineSize, 4096) * _nLines ) / 4096;
+
+        // make sure the number of CPUs is valid (and use at least 1 CPU)
+        nCPUs = (std::max)( 1u, (std::min)( nCPUs, MultiThread::getNumCPUs() ) );
+
+        // call the base multi threading code, should put a pre & post thread calls in too
+        multiThread(nCPUs);
+    }
+
+private:
+    /** @brief function that will be called in each thread. ID is from 0..nThreads-1 nThreads are the number of threads it is being run over */
+    virtual void multiThreadFunction(unsigned int threadID,
+                                     unsigned int nThreads) OVERRIDE FINAL
+    {
+        int begin = 0;
+        int end = 0;
+
+        MultiThread::getThreadRange(threadID, nThreads, 0, _nLines, &begin, &end);
+        if (end <= begin) {
+            return;
+        }
+        processLines(begin, end);
+    }
+
+    // process lines [begin,end)
+    virtual void processLines(int begin, int end) = 0;
+
+protected:
+    ImageEffect &_effect;      /**< @brief effect to render with */
+    int const _nLines;
+    int const _lineSize;
+};
+
+// 2x downsampling by averaging 2x2 blocks, to compute the next pyramid level.
+// The bounds are in absolute pixel coordinates of each level: pixel x of the result is the average
+// of pixels 2x and 2x+1 of the source, so that the result does not depend on the source bounds
+// (except on the borders, where the source is clamped), and the bounds of the result are
+// pyramidReduceBounds(srcBounds).
+class PyramidReduceProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PyramidReduceProcessor(ImageEffect &instance,
+                           const float* const *src,
+                           const OfxRectI &srcBounds,
+                           float* const *dst,
+                           int nPlanes)
+        : PlanarProcessorBase(instance,
+                              pyramidReduceBounds(srcBounds).y2 - pyramidReduceBounds(srcBounds).y1,
+                              pyramidReduceBounds(srcBounds).x2 - pyramidReduceBounds(srcBounds).x1)
+        , _src(src)
+        , _srcBounds(srcBounds)
+        , _dstBounds( pyramidReduceBounds(srcBounds) )
+        , _dst(dst)
+        , _nPlanes(nPlanes)
+        , _x0(_lineSize)
+        , _x1(_lineSize)
+    {
+        for (int i = 0; i < _lineSize; ++i) {
+            const int x = _dstBounds.x1 + i;
+            _x0[i] = (std::max)(2 * x, _srcBounds.x1) - _srcBounds.x1;
+            _x1[i] = (std::min)(2 * x + 1, _srcBounds.x2 - 1) - _srcBounds.x1;
+        }
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const int width = _lineSize;
+        const int srcWidth = _srcBounds.x2 - _srcBounds.x1;
+
+        for (int l = begin; l < end; ++l) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            const int y = _dstBounds.y1 + l;
+            const int y0 = (std::max)(2 * y, _srcBounds.y1) - _srcBounds.y1;
+            const int y1 = (std::min)(2 * y + 1, _srcBounds.y2 - 1) - _srcBounds.y1;
+            for (int p = 0; p < _nPlanes; ++p) {
+                const float *s0 = _src[p] + (std::size_t)y0 * srcWidth;
+                const float *s1 = _src[p] + (std::size_t)y1 * srcWidth;
+                float *d = _dst[p] + (std::size_t)l * width;
+                for (int i = 0; i < width; ++i) {
+                    d[i] = 0.25f * (s0[_x0[i]] + s0[_x1[i]] + s1[_x0[i]] + s1[_x1[i]]);
+                }
+            }
+        }
+    }
+
+    const float* const *_src;
+    const OfxRectI _srcBounds;
+    const OfxRectI _dstBounds;
+    float* const *_dst;
+    const int _nPlanes;
+    std::vector<int> _x0, _x1;
+};
+
+// 2x upsampling with bilinear interpolation, the inverse of PyramidReduceProcessor.
+// The bounds are in absolute pixel coordinates of each level: the center of pixel x of the
+// result is at (x + 0.5) / 2 - 0.5 in the source, which is clamped to its bounds.
+class PyramidExpandProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PyramidExpandProcessor(ImageEffect &instance,
+                           const float* const *src,
+                           const OfxRectI &srcBounds,
+                           float* const *dst,
+                           const OfxRectI &dstBounds,
+                           int nPlanes)
+        : PlanarProcessorBase(instance, dstBounds.y2 - dstBounds.y1, dstBounds.x2 - dstBounds.x1)
+        , _src(src)
+        , _srcBounds(srcBounds)
+        , _dstBounds(dstBounds)
+        , _dst(dst)
+        , _nPlanes(nPlanes)
+        , _x0(_lineSize)
+        , _x1(_lineSize)
+        , _fx(_lineSize)
+    {
+        for (int i = 0; i < _lineSize; ++i) {
+            int x0, x1;
+            float fx;
+            sourcePosition(_dstBounds.x1 + i, _srcBounds.x1, _srcBounds.x2, &x0, &x1, &fx);
+            _x0[i] = x0;
+            _x1[i] = x1;
+            _fx[i] = fx;
+        }
+    }
+
+private:
+    // the source pixels (relative to the bounds [b1,b2)) and the interpolation weight for pixel x of the result
+    static void sourcePosition(int x,
+                               int b1,
+                               int b2,
+                               int *x0,
+                               int *x1,
+                               float *fx)
+    {
+        const float u = (std::max)( (float)b1, (std::min)( (float)(b2 - 1), (x + 0.5f) * 0.5f - 0.5f ) );
+        const int u0 = (int)std::floor(u);
+
+        *x0 = u0 - b1;
+        *x1 = (std::min)(u0 + 1, b2 - 1) - b1;
+        *fx = u - u0;
+    }
+
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const int width = _lineSize;
+        const int srcWidth = _srcBounds.x2 - _srcBounds.x1;
+
+        for (int l = begin; l < end; ++l) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            int y0, y1;
+            float fy;
+            sourcePosition(_dstBounds.y1 + l, _srcBounds.y1, _srcBounds.y2, &y0, &y1, &fy);
+            for (int p = 0; p < _nPlanes; ++p) {
+                const float *s0 = _src[p] + (std::size_t)y0 * srcWidth;
+                const float *s1 = _src[p] + (std::size_t)y1 * srcWidth;
+                float *d = _dst[p] + (std::size_t)l * width;
+                for (int i = 0; i < width; ++i) {
+                    const float a = s0[_x0[i]] + _fx[i] * (s0[_x1[i]] - s0[_x0[i]]);
+                    const float b = s1[_x0[i]] + _fx[i] * (s1[_x1[i]] - s1[_x0[i]]);
+                    d[i] = a + fy * (b - a);
+                }
+            }
+        }
+    }
+
+    const float* const *_src;
+    const OfxRectI _srcBounds;
+    const OfxRectI _dstBounds;
+    float* const *_dst;
+    const int _nPlanes;
+    std::vector<int> _x0, _x1;
+    std::vector<float> _fx;
+};
+} // namespace OFX
+
+#endif // Misc_ofxsPyramid_h
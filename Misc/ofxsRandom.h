@@ -0,0 +1,395 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Reproducible, counter-based pseudo-random numbers.
+ *
+ * The random value for pixel (x,y), channel c and seed s is
+ *   irand(s, x, y, c) = hash(hash(hash(s ^ x) ^ y) ^ c)
+ * so that it does not depend on the tiling, on the render window or on the
+ * number of threads. This is the generator used by Rand and by the CImg
+ * plugins (see cimg_rand in CImgFilter.h), and it must not be changed, since
+ * changing it would change existing renders.
+ *
+ * Generator computes the values for a range of pixels of a row at once:
+ * hash(s ^ x) does not depend on the row and is computed once, and the
+ * remaining hashes are computed by loops that are compiled for each
+ * instruction set and selected at runtime (see ofxsCPUFeatures.h).
+ * The conversions to the uniform, gaussian and Poisson distributions are done
+ * in double precision, exactly as in the scalar functions.
+ */
+
+#ifndef Misc_ofxsRandom_h
+#define Misc_ofxsRandom_h
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "ofxsCPUFeatures.h"
+
+namespace OFX {
+namespace Random {
+// number of values processed at once by the functions that need temporary buffers
+#define kRandomChunkSize 256
+
+// Wang-style integer hash
+OFXS_FORCEINLINE unsigned int
+hash(unsigned int a)
+{
+    a = (a ^ 61) ^ (a >> 16);
+    a = a + (a << 3);
+    a = a ^ (a >> 4);
+    a = a * 0x27d4eb2d;
+    a = a ^ (a >> 15);
+
+    return a;
+}
+
+// returns a value from 0 to 0x100000000ULL excluded
+inline unsigned int
+irand(unsigned int seed,
+      int x,
+      int y,
+      int c)
+{
+    return hash(hash(hash(seed ^ x) ^ y) ^ c);
+}
+
+// maps the result of irand to [0,1)
+inline double
+toUnit(unsigned int r)
+{
+    return r / ( (double)0x100000000ULL );
+}
+
+// continue the polar Box-Muller method from the first pair of values
+// r1 = irand(seed, x, y, c) and r2 = irand(r1, x, y, c) (see gaussian())
+inline double
+gaussianFromPair(unsigned int r1,
+                 unsigned int r2,
+                 int x,
+                 int y,
+                 int c)
+{
+    double x1, w;
+
+    for (;;) {
+        const double x2 =  2 * (double) r2 / ( (double)0x100000000ULL ) - 1.;
+        x1 =  2 * (double) r1 / ( (double)0x100000000ULL ) - 1.;
+        w = x1 * x1 + x2 * x2;
+        if ( (w > 0) && (w < 1.0) ) {
+            break;
+        }
+        r1 = irand(r2, x, y, c);
+        r2 = irand(r1, x, y, c);
+    }
+
+    return x1 * std::sqrt( (-2 * std::log(w) ) / w );
+}
+
+// a random variable following a gaussian distribution and a standard deviation of 1
+inline double
+gaussian(unsigned int seed,
+         int x,
+         int y,
+         int c)
+{
+    const unsigned int r1 = irand(seed, x, y, c);
+
+    return gaussianFromPair(r1, irand(r1, x, y, c), x, y, c);
+}
+
+// a random variable following a Poisson distribution of parameter z, from
+// u = toUnit( irand(seed + 1, x, y, c) ) and, if z > 100, g = gaussian(seed, x, y, c)
+inline unsigned int
+poisson(double z,
+        double u,
+        double g)
+{
+    if (z <= 1.0e-10) {
+        return 0;
+    }
+    if (z > 100) {
+        return (unsigned int)( (std::sqrt(z) * g) + z );
+    }
+    unsigned int k = 0;
+    const double y1 = std::exp(-z);
+    for (double s = 1.0; s >= y1; ++k) {
+        s *= u;
+    }
+
+    return k > 0 ? k - 1 : 0;
+}
+
+// the loops over a row, compiled for each instruction set
+
+// keys[i] = hash(seed ^ (x1 + i))
+OFXS_FORCEINLINE void
+hashCounterImpl(unsigned int seed,
+                int x1,
+                int n,
+                unsigned int *keys)
+{
+    for (int i = 0; i < n; ++i) {
+        keys[i] = hash( seed ^ (unsigned int)(x1 + i) );
+    }
+}
+
+// r[i] = hash(keys[i] ^ v)
+OFXS_FORCEINLINE void
+hashXorImpl(const unsigned int *keys,
+            unsigned int v,
+            int n,
+            unsigned int *r)
+{
+    for (int i = 0; i < n; ++i) {
+        r[i] = hash(keys[i] ^ v);
+    }
+}
+
+// r[i] = irand(seeds[i], x1 + i, y, c)
+OFXS_FORCEINLINE void
+irandSeedsImpl(const unsigned int *seeds,
+               int x1,
+               int y,
+               int c,
+               int n,
+               unsigned int *r)
+{
+    for (int i = 0; i < n; ++i) {
+        r[i] = hash( hash( hash( seeds[i] ^ (unsigned int)(x1 + i) ) ^ (unsigned int)y ) ^ (unsigned int)c );
+    }
+}
+
+#ifdef OFXS_CPU_DISPATCH
+inline OFXS_TARGET_AVX2 void
+hashCounterAVX2(unsigned int seed,
+                int x1,
+                int n,
+                unsigned int *keys)
+{
+    hashCounterImpl(seed, x1, n, keys);
+}
+
+inline OFXS_TARGET_AVX512 void
+hashCounterAVX512(unsigned int seed,
+                  int x1,
+                  int n,
+                  unsigned int *keys)
+{
+    hashCounterImpl(seed, x1, n, keys);
+}
+
+inline OFXS_TARGET_AVX2 void
+hashXorAVX2(const unsigned int *keys,
+            unsigned int v,
+            int n,
+            unsigned int *r)
+{
+    hashXorImpl(keys, v, n, r);
+}
+
+inline OFXS_TARGET_AVX512 void
+hashXorAVX512(const unsigned int *keys,
+              unsigned int v,
+              int n,
+              unsigned int *r)
+{
+    hashXorImpl(keys, v, n, r);
+}
+
+inline OFXS_TARGET_AVX2 void
+irandSeedsAVX2(const unsigned int *seeds,
+               int x1,
+               int y,
+               int c,
+               int n,
+               unsigned int *r)
+{
+    irandSeedsImpl(seeds, x1, y, c, n, r);
+}
+
+inline OFXS_TARGET_AVX512 void
+irandSeedsAVX512(const unsigned int *seeds,
+                 int x1,
+                 int y,
+                 int c,
+                 int n,
+                 unsigned int *r)
+{
+    irandSeedsImpl(seeds, x1, y, c, n, r);
+}
+
+#endif
+
+inline void
+hashCounter(unsigned int seed,
+            int x1,
+            int n,
+            unsigned int *keys)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        hashCounterAVX512(seed, x1, n, keys);
+        break;
+    case CPUFeatures::eISAAVX2:
+        hashCounterAVX2(seed, x1, n, keys);
+        break;
+#endif
+    default:
+        hashCounterImpl(seed, x1, n, keys);
+        break;
+    }
+}
+
+inline void
+hashXor(const unsigned int *keys,
+        unsigned int v,
+        int n,
+        unsigned int *r)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        hashXorAVX512(keys, v, n, r);
+        break;
+    case CPUFeatures::eISAAVX2:
+        hashXorAVX2(keys, v, n, r);
+        break;
+#endif
+    default:
+        hashXorImpl(keys, v, n, r);
+        break;
+    }
+}
+
+inline void
+irandSeeds(const unsigned int *seeds,
+           int x1,
+           int y,
+           int c,
+           int n,
+           unsigned int *r)
+{
+    switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+    case CPUFeatures::eISAAVX512:
+        irandSeedsAVX512(seeds, x1, y, c, n, r);
+        break;
+    case CPUFeatures::eISAAVX2:
+        irandSeedsAVX2(seeds, x1, y, c, n, r);
+        break;
+#endif
+    default:
+        irandSeedsImpl(seeds, x1, y, c, n, r);
+        break;
+    }
+}
+
+/// Random values for the pixels [x1,x2) of any row, for a given seed.
+/// The row keys (computed by rowKeys()) hold hash(hash(seed ^ x) ^ y) for
+/// each pixel of the row, and are shared by all channels.
+/// A Generator may be used by several threads, each with its own row keys.
+class Generator
+{
+public:
+    Generator(unsigned int seed,
+              int x1,
+              int x2)
+        : _seed(seed)
+        , _x1(x1)
+        , _n( (std::max)(x2 - x1, 0) )
+        , _keysX(_n)
+    {
+        if (_n > 0) {
+            hashCounter(_seed, _x1, _n, &_keysX.front());
+        }
+    }
+
+    unsigned int seed() const { return _seed; }
+
+    int x1() const { return _x1; }
+
+    /// number of pixels in a row
+    int width() const { return _n; }
+
+    /// keys[i] = hash(hash(seed ^ (x1 + i)) ^ y), width() values
+    void rowKeys(int y,
+                 unsigned int *keys) const
+    {
+        if (_n > 0) {
+            hashXor(&_keysX.front(), (unsigned int)y, _n, keys);
+        }
+    }
+
+    /// r[i] = irand(seed, x1 + i, y, c), where keys are the keys of row y
+    void irand(const unsigned int *keys,
+               int c,
+               unsigned int *r) const
+    {
+        hashXor(keys, (unsigned int)c, _n, r);
+    }
+
+    /// u[i] = toUnit( irand(seed, x1 + i, y, c) ), in [0,1)
+    void uniform(const unsigned int *keys,
+                 int c,
+                 double *u) const
+    {
+        unsigned int r[kRandomChunkSize];
+
+        for (int i0 = 0; i0 < _n; i0 += kRandomChunkSize) {
+            const int m = (std::min)(kRandomChunkSize, _n - i0);
+            hashXor(keys + i0, (unsigned int)c, m, r);
+            for (int i = 0; i < m; ++i) {
+                u[i0 + i] = toUnit(r[i]);
+            }
+        }
+    }
+
+    /// g[i] = gaussian(seed, x1 + i, y, c)
+    void gaussian(const unsigned int *keys,
+                  int y,
+                  int c,
+                  double *g) const
+    {
+        unsigned int r1[kRandomChunkSize];
+        unsigned int r2[kRandomChunkSize];
+
+        for (int i0 = 0; i0 < _n; i0 += kRandomChunkSize) {
+            const int m = (std::min)(kRandomChunkSize, _n - i0);
+            // the first pair of values is accepted in most cases (pi/4)
+            hashXor(keys + i0, (unsigned int)c, m, r1);
+            irandSeeds(r1, _x1 + i0, y, c, m, r2);
+            for (int i = 0; i < m; ++i) {
+                g[i0 + i] = gaussianFromPair(r1[i], r2[i], _x1 + i0 + i, y, c);
+            }
+        }
+    }
+
+private:
+    unsigned int _seed;
+    int _x1;
+    int _n;
+    std::vector<unsigned int> _keysX; // hash(seed ^ x)
+};
+} // namespace Random
+} // namespace OFX
+
+#endif // Misc_ofxsRandom_h
@@ -0,0 +1,218 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * A cache of objects that are expensive to compute (lookup tables, images),
+ * shared by the renders of a plugin instance.
+ *
+ * Each object is identified by a KEY, which must be copyable and comparable
+ * with operator==. An object obtained from acquire() or insert() is in use
+ * until it is given back with release(), and is never deleted while in use.
+ * Each object has a cost (1 by default, or e.g. its size in bytes), and the
+ * least recently used objects that are not in use are deleted when their
+ * total cost exceeds the maxUnusedCost given to the constructor.
+ *
+ * RefCountedCacheHolder releases the object it acquired when going out of
+ * scope, so that it is given back even if the render throws.
+ */
+
+#ifndef Misc_ofxsRefCountedCache_h
+#define Misc_ofxsRefCountedCache_h
+
+#include <cstddef>
+#include <cassert>
+#include <list>
+
+#include "ofxsMultiThread.h"
+
+namespace OFX {
+template <class KEY, class VALUE, class MUTEX>
+class RefCountedCache
+{
+    struct Entry
+    {
+        KEY key;
+        VALUE *value;
+        size_t cost;
+        int users;
+    };
+
+public:
+    RefCountedCache(size_t maxUnusedCost)
+        : _maxUnusedCost(maxUnusedCost)
+    {
+    }
+
+    ~RefCountedCache()
+    {
+        for (typename std::list<Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            delete it->value;
+        }
+    }
+
+    // returns NULL if there is no object with that key
+    const VALUE* acquire(const KEY &key)
+    {
+        OFX::MultiThread::AutoMutexT<MUTEX> l(&_mutex);
+
+        for (typename std::list<Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->key == key) {
+                // move it to the front (most recently used)
+                Entry e = *it;
+                ++e.users;
+                _entries.erase(it);
+                _entries.push_front(e);
+
+                return e.value;
+            }
+        }
+
+        return NULL;
+    }
+
+    // add an object, which is then owned by the cache. If another thread
+    // already added an object with the same key, value is deleted and the
+    // existing one is returned.
+    const VALUE* insert(const KEY &key,
+                        VALUE *value,
+                        size_t cost = 1)
+    {
+        OFX::MultiThread::AutoMutexT<MUTEX> l(&_mutex);
+
+        for (typename std::list<Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->key == key) {
+                delete value;
+                ++it->users;
+
+                return it->value;
+            }
+        }
+        Entry e;
+        e.key = key;
+        e.value = value;
+        e.cost = cost;
+        e.users = 1;
+        _entries.push_front(e);
+        trim(_maxUnusedCost);
+
+        return value;
+    }
+
+    void release(const VALUE *value)
+    {
+        OFX::MultiThread::AutoMutexT<MUTEX> l(&_mutex);
+
+        for (typename std::list<Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->value == value) {
+                assert(it->users > 0);
+                --it->users;
+                break;
+            }
+        }
+        trim(_maxUnusedCost);
+    }
+
+    // delete all the objects that are not in use
+    void clearUnused()
+    {
+        OFX::MultiThread::AutoMutexT<MUTEX> l(&_mutex);
+
+        trim(0);
+    }
+
+private:
+    RefCountedCache(const RefCountedCache &);
+    RefCountedCache& operator=(const RefCountedCache &);
+
+    // delete the least recently used objects that are not in use, until their total cost is at most maxUnusedCost
+    void trim(size_t maxUnusedCost)
+    {
+        size_t unusedCost = 0;
+
+        for (typename std::list<Entry>::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            if (it->users == 0) {
+                unusedCost += it->cost;
+            }
+        }
+        typename std::list<Entry>::iterator it = _entries.end();
+        while ( it != _entries.begin() && (unusedCost > maxUnusedCost) ) {
+            --it;
+            if (it->users == 0) {
+                unusedCost -= it->cost;
+                delete it->value;
+                it = _entries.erase(it);
+            }
+        }
+    }
+
+    MUTEX _mutex;
+    size_t _maxUnusedCost;
+    std::list<Entry> _entries;
+};
+
+// releases the object acquired from a RefCountedCache when going out of scope
+template <class KEY, class VALUE, class MUTEX>
+class RefCountedCacheHolder
+{
+public:
+    RefCountedCacheHolder(RefCountedCache<KEY, VALUE, MUTEX> &cache)
+        : _cache(cache)
+        , _value(NULL)
+    {
+    }
+
+    ~RefCountedCacheHolder()
+    {
+        if (_value) {
+            _cache.release(_value);
+        }
+    }
+
+    const VALUE* acquire(const KEY &key)
+    {
+        assert(!_value);
+        _value = _cache.acquire(key);
+
+        return _value;
+    }
+
+    const VALUE* insert(const KEY &key,
+                        VALUE *value,
+                        size_t cost = 1)
+    {
+        assert(!_value);
+        _value = _cache.insert(key, value, cost);
+
+        return _value;
+    }
+
+    const VALUE* get() const
+    {
+        return _value;
+    }
+
+private:
+    RefCountedCacheHolder(const RefCountedCacheHolder &);
+    RefCountedCacheHolder& operator=(const RefCountedCacheHolder &);
+
+    RefCountedCache<KEY, VALUE, MUTEX> &_cache;
+    const VALUE *_value;
+};
+} // namespace OFX
+
+#endif // Misc_ofxsRefCountedCache_h
@@ -0,0 +1,261 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Transfer function engine for the log/lin conversions (Log2Lin, PLogLin).
+ *
+ * A TransferCurve is either
+ *   y = a * 10^(b * x + c) + d              (log to lin)
+ * or
+ *   y = a * log10(max(x, xmin) * b + c) + d (lin to log)
+ *
+ * transferRow() applies the curves to a row of pixels:
+ * - 8-bit and 16-bit inputs use a lookup table with one entry per code
+ *   value, computed in double precision. The tables for the three channels
+ *   are held by a TransferLUT, and the TransferLUTCache (a RefCountedCache)
+ *   keeps the tables of the last few parameter sets so that they are built
+ *   only once.
+ * - Float inputs use OFX::FastMath::fast_exp2 and fast_log2, i.e. a
+ *   polynomial on each octave, evaluated by a loop that the compiler
+ *   vectorizes. With the default Log2Lin and PLogLin parameters, the error
+ *   of log to lin for x in [-1,2] is below 5e-7 where |y| < 1 and below 1.5e-6
+ *   relative elsewhere. The error of lin to log for x in [1e-10,1e6] is below
+ *   2.5e-7 (absolute where |y| < 1, relative elsewhere).
+ */
+
+#ifndef Misc_ofxsTransferLUT_h
+#define Misc_ofxsTransferLUT_h
+
+#include <cmath>
+#include <cfloat>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMaskMix.h"
+#include "ofxsRefCountedCache.h"
+#include "ofxsFastMath.h"
+
+namespace OFX {
+struct TransferCurve
+{
+    bool log;
+    double a, b, c, d;
+    double xmin; // only used by the log curve
+
+    TransferCurve()
+        : log(false)
+        , a(1.)
+        , b(1.)
+        , c(0.)
+        , d(0.)
+        , xmin(-DBL_MAX)
+    {
+    }
+
+    bool operator==(const TransferCurve &other) const
+    {
+        return log == other.log && a == other.a && b == other.b && c == other.c && d == other.d && xmin == other.xmin;
+    }
+
+    bool operator!=(const TransferCurve &other) const
+    {
+        return !(*this == other);
+    }
+
+    double eval(double x) const
+    {
+        if (log) {
+            return a * std::log10( (std::max)(x, xmin) * b + c ) + d;
+        }
+
+        return a * std::pow(10., b * x + c) + d;
+    }
+
+    // apply the curve to n contiguous values, using the fast approximations
+    void evalFast(float *v,
+                  int n) const
+    {
+        const double log2_10 = 3.32192809488736234787;
+
+        if (log) {
+            const float fa = (float)(a / log2_10);
+            const float fb = (float)b;
+            const float fc = (float)c;
+            const float fd = (float)d;
+            const float fxmin = (float)(std::max)(xmin, -(double)FLT_MAX);
+            for (int i = 0; i < n; ++i) {
+                v[i] = fa * FastMath::fast_log2(FastMath::fmax(v[i], fxmin) * fb + fc) + fd;
+            }
+        } else {
+            const float fa = (float)a;
+            const float fb = (float)(b * log2_10);
+            const float fc = (float)(c * log2_10);
+            const float fd = (float)d;
+            for (int i = 0; i < n; ++i) {
+                v[i] = fa * FastMath::fast_exp2(v[i] * fb + fc) + fd;
+            }
+        }
+    }
+};
+
+// identifies the TransferLUT computed for a parameter set
+struct TransferLUTKey
+{
+    TransferCurve curve[3];
+    int maxValue;
+
+    TransferLUTKey()
+        : maxValue(0)
+    {
+    }
+
+    TransferLUTKey(const TransferCurve curve_[3],
+                   int maxValue_)
+        : maxValue(maxValue_)
+    {
+        for (int c = 0; c < 3; ++c) {
+            curve[c] = curve_[c];
+        }
+    }
+
+    bool operator==(const TransferLUTKey &other) const
+    {
+        return maxValue == other.maxValue && curve[0] == other.curve[0] && curve[1] == other.curve[1] && curve[2] == other.curve[2];
+    }
+};
+
+// lookup tables for the three channels of an 8-bit or 16-bit image
+class TransferLUT
+{
+public:
+    TransferLUT(const TransferCurve curve[3],
+                int maxValue)
+    {
+        for (int c = 0; c < 3; ++c) {
+            _table[c].resize(maxValue + 1);
+            for (int i = 0; i <= maxValue; ++i) {
+                _table[c][i] = (float)curve[c].eval( i / (double)maxValue );
+            }
+        }
+    }
+
+    const float* table(int c) const
+    {
+        return &_table[c][0];
+    }
+
+private:
+    std::vector<float> _table[3];
+};
+
+// Cache of the TransferLUTs of the last parameter sets.
+template <class MUTEX>
+class TransferLUTCache
+    : public RefCountedCache<TransferLUTKey, TransferLUT, MUTEX>
+{
+public:
+    TransferLUTCache(int maxUnused = 4)
+        : RefCountedCache<TransferLUTKey, TransferLUT, MUTEX>(maxUnused)
+    {
+    }
+};
+
+// gets the TransferLUT for a parameter set from a TransferLUTCache, and
+// releases it when going out of scope
+template <class MUTEX>
+class TransferLUTHolder
+    : public RefCountedCacheHolder<TransferLUTKey, TransferLUT, MUTEX>
+{
+public:
+    TransferLUTHolder(TransferLUTCache<MUTEX> &cache)
+        : RefCountedCacheHolder<TransferLUTKey, TransferLUT, MUTEX>(cache)
+    {
+    }
+
+    const TransferLUT* acquire(const TransferCurve curve[3],
+                               int maxValue)
+    {
+        const TransferLUTKey key(curve, maxValue);
+        const TransferLUT *lut = RefCountedCacheHolder<TransferLUTKey, TransferLUT, MUTEX>::acquire(key);
+
+        if (!lut) {
+            lut = this->insert( key, new TransferLUT(curve, maxValue) );
+        }
+
+        return lut;
+    }
+};
+
+// Unpremultiply the pixels [x1,x2) of row y of srcImg into one array per
+// channel, and apply the transfer curves to the processed channels, using
+// either the lookup tables (8-bit and 16-bit images without unpremult), the
+// exact formula, or the fast approximation.
+template <class PIX, int nComponents, int maxValue>
+void
+transferRow(const Image *srcImg,
+            bool premult,
+            int premultChannel,
+            const TransferCurve curve[3],
+            const TransferLUT *lut,
+            bool exact,
+            int x1,
+            int x2,
+            int y,
+            const bool doProcess[3],
+            float *planes[4])
+{
+    const int n = x2 - x1;
+    float unpPix[4];
+
+    assert(!lut || !premult);
+    for (int x = x1, i = 0; x < x2; ++x, ++i) {
+        const PIX *srcPix = (const PIX *)  (srcImg ? srcImg->getPixelAddress(x, y) : 0);
+        ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, premult, premultChannel);
+        for (int c = 0; c < 4; ++c) {
+            planes[c][i] = unpPix[c];
+        }
+        if (lut) {
+            for (int c = 0; c < 3; ++c) {
+                if (doProcess[c]) {
+                    planes[c][i] = lut->table(c)[srcPix ? (int)srcPix[c] : 0];
+                }
+            }
+        }
+    }
+    if (lut) {
+        return;
+    }
+    for (int c = 0; c < 3; ++c) {
+        if (!doProcess[c]) {
+            continue;
+        }
+        float *v = planes[c];
+        if (exact) {
+            for (int i = 0; i < n; ++i) {
+                v[i] = (float)curve[c].eval(v[i]);
+            }
+        } else {
+            curve[c].evalFast(v, n);
+        }
+    }
+}
+} // namespace OFX
+
+#endif // Misc_ofxsTransferLUT_h
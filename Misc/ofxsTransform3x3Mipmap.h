@@ -0,0 +1,781 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * Mipmapped resampling for the Transform3x3 plugins (Transform, CornerPin, Reformat, Card3D).
+ *
+ * When an image is scaled down, the generic Transform3x3 render supersamples each
+ * output pixel from the full resolution source, so that the cost of a large downscale
+ * is close to the cost of a full resolution render.
+ * With the "mipmap" parameter checked, the source image is instead reduced by successive
+ * 2x2 box filters, and each output pixel is interpolated trilinearly in the two levels of
+ * this pyramid whose pixel size is closest to the footprint of the output pixel.
+ * Only the levels needed by the render window are built, once per render: the level count
+ * is given by the largest footprint at the corners of the render window, and the
+ * source RoI is enlarged by the size of a texel of the coarsest level, so that the
+ * result does not depend on how the host tiles the image.
+ *
+ * Where the image is not scaled down, the result is the same as the generic render.
+ * The mipmap is not used with motion blur, nor with the Impulse filter.
+ */
+
+#ifndef Misc_ofxsTransform3x3Mipmap_h
+#define Misc_ofxsTransform3x3Mipmap_h
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsMultiThread.h"
+#include "ofxsProcessing.H"
+#include "ofxsCoords.h"
+#include "ofxsTransform3x3.h"
+#include "ofxsFilter.h"
+#include "ofxsMaskMix.h"
+
+#define kParamMipmap "mipmap"
+#define kParamMipmapLabel "Mipmap"
+#define kParamMipmapHint "When the image is scaled down, interpolate from a pyramid of prefiltered images (mipmap) instead of supersampling the full-resolution source. Much faster for large downscales, and slightly softer. The mipmap is not used with motion blur or with the Impulse filter."
+
+#define kMipmapMaxLevels 16
+
+namespace OFX {
+inline void
+ofxsMipmapDescribeParams(ImageEffectDescriptor &desc,
+                         PageParamDescriptor *page)
+{
+    BooleanParamDescriptor* param = desc.defineBooleanParam(kParamMipmap);
+
+    param->setLabel(kParamMipmapLabel);
+    param->setHint(kParamMipmapHint);
+    param->setDefault(false);
+    param->setAnimates(false);
+    if (page) {
+        page->addChild(*param);
+    }
+}
+
+/** @brief A level of the mipmap: a float image with the same value range as the source */
+struct MipmapLevel
+{
+    OfxRectI bounds;
+    std::vector<float> pixels;
+};
+
+// Compute a level by averaging 2x2 blocks of the previous level (or of the source image for level 1).
+// Pixels outside of the previous level are clamped to its edge.
+template <class PIX, int nComponents>
+class MipmapReduceProcessor
+    : public MultiThread::Processor
+{
+public:
+    MipmapReduceProcessor(ImageEffect &instance,
+                          const Image *srcImg,
+                          const MipmapLevel *srcLevel,
+                          MipmapLevel *dstLevel)
+        : _effect(instance)
+        , _srcImg(srcImg)
+        , _srcData(NULL)
+        , _srcRowBytes(0)
+        , _dstLevel(dstLevel)
+    {
+        if (srcImg) {
+            _srcBounds = srcImg->getBounds();
+            _srcData = (const char*)srcImg->getPixelAddress(_srcBounds.x1, _srcBounds.y1);
+            _srcRowBytes = srcImg->getRowBytes(); // may be negative, @see kOfxImagePropRowBytes
+        } else {
+            assert(srcLevel);
+            _srcBounds = srcLevel->bounds;
+            _srcData = (const char*)&srcLevel->pixels.front();
+            _srcRowBytes = (_srcBounds.x2 - _srcBounds.x1) * nComponents * (int)sizeof(float);
+        }
+    }
+
+    /** @brief called to process everything */
+    void process(void)
+    {
+        const OfxRectI &dstBounds = _dstLevel->bounds;
+        const int nLines = dstBounds.y2 - dstBounds.y1;
+        const int lineSize = dstBounds.x2 - dstBounds.x1;
+
+        if ( (nLines <= 0) || (lineSize <= 0) ) {
+            return;
+        }
+        // make sure there are at least 4096 pixels per CPU and at least 1 line par CPU
+        unsigned int nCPUs = ( (std::min)(lineSize, 4096) * nLines ) / 4096;
+
+        // make sure the number of CPUs is valid (and use at least 1 CPU)
+        nCPUs = (std::max)( 1u, (std::min)( nCPUs, MultiThread::getNumCPUs() ) );
+
+        // call the base multi threading code, should put a pre & post thread calls in too
+        multiThread(nCPUs);
+    }
+
+private:
+    /** @brief function that will be called in each thread. ID is from 0..nThreads-1 nThreads are the number of threads it is being run over */
+    virtual void multiThreadFunction(unsigned int threadID,
+                                     unsigned int nThreads) OVERRIDE FINAL
+    {
+        OfxRectI procWindow = _dstLevel->bounds;
+
+        MultiThread::getThreadRange(threadID, nThreads, _dstLevel->bounds.y1, _dstLevel->bounds.y2, &procWindow.y1, &procWindow.y2);
+        if (procWindow.y2 <= procWindow.y1) {
+            return;
+        }
+        if (_srcImg) {
+            reduce<PIX>(procWindow);
+        } else {
+            reduce<float>(procWindow);
+        }
+    }
+
+    template <class SRC>
+    void reduce(const OfxRectI &procWindow)
+    {
+        const OfxRectI &dstBounds = _dstLevel->bounds;
+        const size_t dstRowElems = (size_t)(dstBounds.x2 - dstBounds.x1) * nComponents;
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            const int sy0 = (std::max)(2 * y, _srcBounds.y1);
+            const int sy1 = (std::min)(2 * y + 1, _srcBounds.y2 - 1);
+            const SRC *srcRow0 = (const SRC*)( _srcData + (ptrdiff_t)(sy0 - _srcBounds.y1) * _srcRowBytes );
+            const SRC *srcRow1 = (const SRC*)( _srcData + (ptrdiff_t)(sy1 - _srcBounds.y1) * _srcRowBytes );
+            float *dstPix = &_dstLevel->pixels[(y - dstBounds.y1) * dstRowElems + (procWindow.x1 - dstBounds.x1) * nComponents];
+
+            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
+                const int sx0 = ( (std::max)(2 * x, _srcBounds.x1) - _srcBounds.x1 ) * nComponents;
+                const int sx1 = ( (std::min)(2 * x + 1, _srcBounds.x2 - 1) - _srcBounds.x1 ) * nComponents;
+                for (int c = 0; c < nComponents; ++c) {
+                    dstPix[c] = 0.25f * ( (float)srcRow0[sx0 + c] + (float)srcRow0[sx1 + c] +
+                                          (float)srcRow1[sx0 + c] + (float)srcRow1[sx1 + c] );
+                }
+            }
+        }
+    }
+
+    ImageEffect &_effect;      /**< @brief effect to render with */
+    const Image *_srcImg;
+    OfxRectI _srcBounds;
+    const char *_srcData;
+    int _srcRowBytes;
+    MipmapLevel *_dstLevel;
+};
+
+/** @brief The mipmap of a source image: level k is the source reduced k times by a 2x2 box filter */
+template <class PIX, int nComponents>
+class MipmapPyramid
+{
+public:
+    MipmapPyramid(const Image *srcImg)
+        : _srcImg(srcImg)
+        , _levels()
+    {
+    }
+
+    // the number of levels, including the source image
+    int getLevelCount() const
+    {
+        return 1 + (int)_levels.size();
+    }
+
+    // build the levels 1 to nLevels-1, or until the level is no larger than 2x2 pixels
+    void build(ImageEffect &effect,
+               int nLevels)
+    {
+        if (!_srcImg) {
+            return;
+        }
+        nLevels = (std::min)(nLevels, kMipmapMaxLevels);
+        _levels.reserve(nLevels - 1);
+        for (int k = 1; k < nLevels; ++k) {
+            const OfxRectI prevBounds = (k == 1) ? _srcImg->getBounds() : _levels[k - 2].bounds;
+            if ( (prevBounds.x2 - prevBounds.x1 <= 2) && (prevBounds.y2 - prevBounds.y1 <= 2) ) {
+                break;
+            }
+            _levels.push_back( MipmapLevel() );
+            MipmapLevel &level = _levels.back();
+            // level pixel i covers the pixels 2i and 2i+1 of the previous level
+            level.bounds.x1 = (int)std::floor(prevBounds.x1 / 2.);
+            level.bounds.y1 = (int)std::floor(prevBounds.y1 / 2.);
+            level.bounds.x2 = (int)std::ceil(prevBounds.x2 / 2.);
+            level.bounds.y2 = (int)std::ceil(prevBounds.y2 / 2.);
+            level.pixels.resize( (size_t)(level.bounds.x2 - level.bounds.x1) * (level.bounds.y2 - level.bounds.y1) * nComponents );
+
+            MipmapReduceProcessor<PIX, nComponents> processor(effect, (k == 1) ? _srcImg : NULL, (k == 1) ? NULL : &_levels[k - 2], &level);
+            processor.process();
+        }
+    }
+
+    // bilinear interpolation in level k > 0, at (fx,fy) in source pixel coordinates
+    void interpolate(int k,
+                     double fx,
+                     double fy,
+                     bool blackOutside,
+                     float *tmpPix) const
+    {
+        assert(k > 0 && k < getLevelCount());
+        const MipmapLevel &level = _levels[k - 1];
+        const OfxRectI &b = level.bounds;
+        const double scale = 1. / (1 << k);
+        // the center of pixel i of the level is at (i+0.5)*2^k in source pixel coordinates
+        const double x = fx * scale - 0.5;
+        const double y = fy * scale - 0.5;
+        const int ix = (int)std::floor(x);
+        const int iy = (int)std::floor(y);
+        const float dx = (float)(x - ix);
+        const float dy = (float)(y - iy);
+        const float w[4] = { (1.f - dx) * (1.f - dy), dx * (1.f - dy), (1.f - dx) * dy, dx * dy };
+        const int px[4] = { ix, ix + 1, ix, ix + 1 };
+        const int py[4] = { iy, iy, iy + 1, iy + 1 };
+
+        for (int c = 0; c < nComponents; ++c) {
+            tmpPix[c] = 0.f;
+        }
+        for (int i = 0; i < 4; ++i) {
+            int sx = px[i];
+            int sy = py[i];
+            if ( (sx < b.x1) || (sx >= b.x2) || (sy < b.y1) || (sy >= b.y2) ) {
+                if (blackOutside) {
+                    continue;
+                }
+                sx = (std::max)( b.x1, (std::min)(sx, b.x2 - 1) );
+                sy = (std::max)( b.y1, (std::min)(sy, b.y2 - 1) );
+            }
+            const float *pix = &level.pixels[( (size_t)(sy - b.y1) * (b.x2 - b.x1) + (sx - b.x1) ) * nComponents];
+            for (int c = 0; c < nComponents; ++c) {
+                tmpPix[c] += w[i] * pix[c];
+            }
+        }
+    }
+
+private:
+    const Image *_srcImg;
+    std::vector<MipmapLevel> _levels; // levels 1 to n
+};
+
+// the mipmap level of detail, i.e. the log2 of the size of the footprint of a destination pixel in the source
+inline double
+mipmapLevelOfDetail(double Jxx,
+                    double Jxy,
+                    double Jyx,
+                    double Jyy)
+{
+    const double size2 = (std::max)(Jxx * Jxx + Jyx * Jyx, Jxy * Jxy + Jyy * Jyy);
+
+    return (size2 > 0.) ? std::log(size2) / (2. * std::log(2.)) : 0.;
+}
+
+// the Jacobian of the back-transform H at the transformed point (x,y,z), in pixel coordinates
+inline void
+mipmapJacobian(const Matrix3x3 &H,
+               const Point3D &transformed,
+               double *Jxx,
+               double *Jxy,
+               double *Jyx,
+               double *Jyy)
+{
+    const double z2 = transformed.z * transformed.z;
+
+    *Jxx = (H(0,0) * transformed.z - transformed.x * H(2,0)) / z2;
+    *Jxy = (H(0,1) * transformed.z - transformed.x * H(2,1)) / z2;
+    *Jyx = (H(1,0) * transformed.z - transformed.y * H(2,0)) / z2;
+    *Jyy = (H(1,1) * transformed.z - transformed.y * H(2,1)) / z2;
+}
+
+// The number of mipmap levels needed to render the window with the back-transform H.
+// The footprint of a homography is largest on the border of the window, so only the corners are checked.
+inline int
+mipmapLevelsNeeded(const Matrix3x3 &H,
+                   const OfxRectI &renderWindow)
+{
+    double lodMax = 0.;
+
+    for (int i = 0; i < 4; ++i) {
+        Point3D p;
+        p.x = ( (i & 1) ? renderWindow.x2 - 1 : renderWindow.x1 ) + 0.5;
+        p.y = ( (i & 2) ? renderWindow.y2 - 1 : renderWindow.y1 ) + 0.5;
+        p.z = 1.;
+        const Point3D transformed = H * p;
+        if (transformed.z <= 0.) {
+            // the back-transformed point is at infinity or behind the camera
+            return kMipmapMaxLevels;
+        }
+        double Jxx, Jxy, Jyx, Jyy;
+        mipmapJacobian(H, transformed, &Jxx, &Jxy, &Jyx, &Jyy);
+        lodMax = (std::max)( lodMax, mipmapLevelOfDetail(Jxx, Jxy, Jyx, Jyy) );
+    }
+
+    return (std::min)( 1 + (int)std::ceil(lodMax), kMipmapMaxLevels );
+}
+
+// The "filter" and "clamp" template parameters allow filter-specific optimization
+// by the compiler, using the same generic code for all filters.
+template <class PIX, int nComponents, int maxValue, FilterEnum filter, bool clamp>
+class MipmapTransform3x3Processor
+    : public Transform3x3ProcessorBase
+{
+public:
+    MipmapTransform3x3Processor(ImageEffect &instance)
+        : Transform3x3ProcessorBase(instance)
+        , _pyramid(NULL)
+    {
+    }
+
+    void setPyramid(const MipmapPyramid<PIX, nComponents> *pyramid)
+    {
+        _pyramid = pyramid;
+    }
+
+    virtual FilterEnum getFilter() const OVERRIDE FINAL
+    {
+        return filter;
+    }
+
+    virtual bool getClamp() const OVERRIDE FINAL
+    {
+        return clamp;
+    }
+
+private:
+    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
+    {
+        assert(_invtransform && _invtransformsize == 1 && _pyramid);
+        float tmpPix[nComponents];
+        float tmpPix1[nComponents];
+        const Matrix3x3 & H = _invtransform[0];
+        const int maxLevel = _pyramid->getLevelCount() - 1;
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+            // the coordinates of the center of the pixel in canonical coordinates
+            // see http://openfx.sourceforge.net/Documentation/1.3/ofxProgrammingReference.html#CanonicalCoordinates
+            Point3D canonicalCoords;
+            canonicalCoords.z = 1;
+            canonicalCoords.y = (double)y + 0.5;
+
+            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
+                canonicalCoords.x = (double)x + 0.5;
+                Point3D transformed = H * canonicalCoords;
+                if ( !_srcImg || (transformed.z <= 0.) ) {
+                    // the back-transformed point is at infinity (==0) or behind the camera (<0)
+                    for (int c = 0; c < nComponents; ++c) {
+                        tmpPix[c] = 0;
+                    }
+                } else {
+                    double fx = transformed.x / transformed.z;
+                    double fy = transformed.y / transformed.z;
+                    double Jxx, Jxy, Jyx, Jyy;
+                    mipmapJacobian(H, transformed, &Jxx, &Jxy, &Jyx, &Jyy);
+                    const double lod = (std::min)( mipmapLevelOfDetail(Jxx, Jxy, Jyx, Jyy), (double)maxLevel );
+                    if (lod <= 0.) {
+                        // not scaled down: same as the generic Transform3x3 render
+                        ofxsFilterInterpolate2DSuper<PIX, nComponents, filter, clamp>(fx, fy, Jxx, Jxy, Jyx, Jyy, _srcImg, _blackOutside, tmpPix);
+                    } else {
+                        // trilinear interpolation between levels k and k+1
+                        const int k = (std::min)( (int)lod, maxLevel - 1 );
+                        const float t = (float)(lod - k);
+                        if (k == 0) {
+                            ofxsFilterInterpolate2D<PIX, nComponents, filter, clamp>(fx, fy, _srcImg, _blackOutside, tmpPix);
+                        } else {
+                            _pyramid->interpolate(k, fx, fy, _blackOutside, tmpPix);
+                        }
+                        if (t > 0.f) {
+                            _pyramid->interpolate(k + 1, fx, fy, _blackOutside, tmpPix1);
+                            for (int c = 0; c < nComponents; ++c) {
+                                tmpPix[c] += t * (tmpPix1[c] - tmpPix[c]);
+                            }
+                        }
+                    }
+                }
+
+                ofxsMaskMix<PIX, nComponents, maxValue, true>(tmpPix, x, y, _srcImg, _domask, _maskImg, (float)_mix, _maskInvert, dstPix);
+            }
+        }
+    } // multiThreadProcessImages
+
+    const MipmapPyramid<PIX, nComponents> *_pyramid;
+};
+
+/** @brief A Transform3x3Plugin that renders downscales with a mipmap when the "mipmap" parameter is checked.
+   All other cases (motion blur, Impulse filter, no downscale) are rendered by Transform3x3Plugin::render(). */
+class Transform3x3MipmapPlugin
+    : public Transform3x3Plugin
+{
+public:
+    Transform3x3MipmapPlugin(OfxImageEffectHandle handle,
+                             bool masked,
+                             Transform3x3ParamsTypeEnum paramsType)
+        : Transform3x3Plugin(handle, masked, paramsType)
+        , _mipmap(NULL)
+    {
+        if ( paramExists(kParamMipmap) ) {
+            _mipmap = fetchBooleanParam(kParamMipmap);
+        }
+    }
+
+    virtual void render(const RenderArguments &args) OVERRIDE
+    {
+        if ( !renderMipmap(args) ) {
+            Transform3x3Plugin::render(args);
+        }
+    }
+
+    // The texels of mipmap level k are averages of 2^k x 2^k source pixels, and pixels outside of
+    // the source image are clamped to its edge. If the RoI were not enlarged, the texels near the edge
+    // of each tile would be computed from replicated pixels, and the result would depend on the tiling.
+    virtual void getRegionsOfInterest(const RegionsOfInterestArguments &args,
+                                      RegionOfInterestSetter &rois) OVERRIDE
+    {
+        FilterEnum filter;
+        bool clamp;
+
+        if ( !mipmapEnabled(args.time, &filter, &clamp) ) {
+            Transform3x3Plugin::getRegionsOfInterest(args, rois);
+
+            return;
+        }
+        bool invert = false;
+        if (_invert) {
+            _invert->getValueAtTime(args.time, invert);
+        }
+        const double srcPar = _srcClip->getPixelAspectRatio();
+        const double dstPar = _dstClip->getPixelAspectRatio();
+        Matrix3x3 invtransform;
+        // the level count is estimated for the first view, which is close enough to get the margin
+        if (getInverseTransformsBlur(args.time, 0, args.renderScale, false, srcPar, dstPar, invert, 0., 1., &invtransform, 0, 1) != 1) {
+            Transform3x3Plugin::getRegionsOfInterest(args, rois);
+
+            return;
+        }
+        OfxRectI renderWindow;
+        Coords::toPixelEnclosing(args.regionOfInterest, args.renderScale, dstPar, &renderWindow);
+        const int nLevels = mipmapLevelsNeeded(invtransform, renderWindow);
+        if (nLevels <= 1) {
+            Transform3x3Plugin::getRegionsOfInterest(args, rois);
+
+            return;
+        }
+        // enlarge the source RoI by the size of a texel of the coarsest level, in canonical coordinates
+        const double margin = (double)(1 << nLevels);
+        MipmapRoISetter mipmapRois(rois, _srcClip, margin * srcPar / args.renderScale.x, margin / args.renderScale.y);
+        Transform3x3Plugin::getRegionsOfInterest(args, mipmapRois);
+    }
+
+private:
+    // forwards the RoIs set by Transform3x3Plugin::getRegionsOfInterest(), enlarging the RoI of the source clip
+    class MipmapRoISetter
+        : public RegionOfInterestSetter
+    {
+public:
+        MipmapRoISetter(RegionOfInterestSetter &rois,
+                        const Clip *srcClip,
+                        double marginX,
+                        double marginY)
+            : _rois(rois)
+            , _srcClip(srcClip)
+            , _marginX(marginX)
+            , _marginY(marginY)
+        {
+        }
+
+        virtual void setRegionOfInterest(const Clip &clip,
+                                         const OfxRectD &RoI) OVERRIDE FINAL
+        {
+            if ( (&clip != _srcClip) || Coords::rectIsEmpty(RoI) ) {
+                _rois.setRegionOfInterest(clip, RoI);
+
+                return;
+            }
+            OfxRectD srcRoI = RoI;
+            srcRoI.x1 -= _marginX;
+            srcRoI.y1 -= _marginY;
+            srcRoI.x2 += _marginX;
+            srcRoI.y2 += _marginY;
+            _rois.setRegionOfInterest(clip, srcRoI);
+        }
+
+private:
+        RegionOfInterestSetter &_rois;
+        const Clip *_srcClip;
+        double _marginX;
+        double _marginY;
+    };
+
+    struct MipmapRenderArgs
+    {
+        const Image *src;
+        Image *dst;
+        const Image *mask;
+        bool maskInvert;
+        Matrix3x3 invtransform;
+        bool blackOutside;
+        double mix;
+        int nLevels;
+    };
+
+    // true if the "mipmap" parameter is checked and the mipmap can be used at this time
+    bool mipmapEnabled(double time,
+                       FilterEnum *filter,
+                       bool *clamp)
+    {
+        if ( !_mipmap || !_mipmap->getValueAtTime(time) ||
+             !_srcClip || !_srcClip->isConnected() ) {
+            return false;
+        }
+        *filter = _filter ? (FilterEnum)_filter->getValueAtTime(time) : eFilterCubic;
+        double motionblur = 0.;
+        if (_motionblur) {
+            _motionblur->getValueAtTime(time, motionblur);
+        }
+        if ( (*filter == eFilterImpulse) || (motionblur != 0.) ) {
+            return false;
+        }
+        *clamp = false;
+        if (_clamp) {
+            _clamp->getValueAtTime(time, *clamp);
+        }
+
+        return true;
+    }
+
+    // render with the mipmap, or return false if the generic render should be used
+    bool renderMipmap(const RenderArguments &args)
+    {
+        const double time = args.time;
+
+        FilterEnum filter;
+        bool clamp;
+
+        if ( args.renderQualityDraft || !mipmapEnabled(time, &filter, &clamp) ) {
+            return false;
+        }
+
+        auto_ptr<const Image> src( _srcClip->fetchImage(time) );
+        if ( !src.get() ) {
+            return false;
+        }
+        auto_ptr<Image> dst( _dstClip->fetchImage(time) );
+        if ( !dst.get() ) {
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        const BitDepthEnum dstBitDepth = dst->getPixelDepth();
+        const PixelComponentEnum dstComponents = dst->getPixelComponents();
+        if ( ( dstBitDepth != _dstClip->getPixelDepth() ) ||
+             ( dstComponents != _dstClip->getPixelComponents() ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong depth or components");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        if ( (dst->getRenderScale().x != args.renderScale.x) ||
+             ( dst->getRenderScale().y != args.renderScale.y) ||
+             ( ( dst->getField() != eFieldNone) /* for DaVinci Resolve */ && ( dst->getField() != args.fieldToRender) ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        if ( ( src->getPixelDepth() != dstBitDepth ) || ( src->getPixelComponents() != dstComponents ) ) {
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+
+        MipmapRenderArgs margs;
+        bool invert = false;
+        if (_invert) {
+            _invert->getValueAtTime(time, invert);
+        }
+        margs.blackOutside = true;
+        if (_blackOutside) {
+            _blackOutside->getValueAtTime(time, margs.blackOutside);
+        }
+        margs.mix = 1.;
+        if (_mix) {
+            _mix->getValueAtTime(time, margs.mix);
+        }
+        const bool fielded = args.fieldToRender == eFieldLower || args.fieldToRender == eFieldUpper;
+        if (getInverseTransformsBlur(time, args.renderView, args.renderScale, fielded, src->getPixelAspectRatio(), dst->getPixelAspectRatio(), invert, 0., 1., &margs.invtransform, 0, 1) != 1) {
+            return false;
+        }
+        // compose with the input transform
+        if ( !src->getTransformIsIdentity() ) {
+            double srcTransform[9]; // transform to apply to the source image, in pixel coordinates, from source to destination
+            src->getTransform(srcTransform);
+            Matrix3x3 srcTransformMat;
+            srcTransformMat(0,0) = srcTransform[0];
+            srcTransformMat(0,1) = srcTransform[1];
+            srcTransformMat(0,2) = srcTransform[2];
+            srcTransformMat(1,0) = srcTransform[3];
+            srcTransformMat(1,1) = srcTransform[4];
+            srcTransformMat(1,2) = srcTransform[5];
+            srcTransformMat(2,0) = srcTransform[6];
+            srcTransformMat(2,1) = srcTransform[7];
+            srcTransformMat(2,2) = srcTransform[8];
+            // invert it
+            Matrix3x3 srcTransformInverse;
+            if ( srcTransformMat.inverse(&srcTransformInverse) ) {
+                margs.invtransform = srcTransformInverse * margs.invtransform;
+            }
+        }
+        margs.nLevels = mipmapLevelsNeeded(margs.invtransform, args.renderWindow);
+        if (margs.nLevels <= 1) {
+            // not scaled down
+            return false;
+        }
+
+        // auto ptr for the mask.
+        const bool doMasking = ( ( !_maskApply || _maskApply->getValueAtTime(time) ) && _maskClip && _maskClip->isConnected() );
+        auto_ptr<const Image> mask(doMasking ? _maskClip->fetchImage(time) : 0);
+        margs.maskInvert = false;
+        if (doMasking && _maskInvert) {
+            _maskInvert->getValueAtTime(time, margs.maskInvert);
+        }
+        margs.src = src.get();
+        margs.dst = dst.get();
+        margs.mask = mask.get();
+
+        if (dstComponents == ePixelComponentRGBA) {
+            renderMipmapForComponents<4>(args, margs, filter, clamp, dstBitDepth);
+        } else if (dstComponents == ePixelComponentRGB) {
+            renderMipmapForComponents<3>(args, margs, filter, clamp, dstBitDepth);
+#ifdef OFX_EXTENSIONS_NATRON
+        } else if (dstComponents == ePixelComponentXY) {
+            renderMipmapForComponents<2>(args, margs, filter, clamp, dstBitDepth);
+#endif
+        } else {
+            assert(dstComponents == ePixelComponentAlpha);
+            renderMipmapForComponents<1>(args, margs, filter, clamp, dstBitDepth);
+        }
+
+        return true;
+    } // renderMipmap
+
+    template <int nComponents>
+    void renderMipmapForComponents(const RenderArguments &args,
+                                   const MipmapRenderArgs &margs,
+                                   FilterEnum filter,
+                                   bool clamp,
+                                   BitDepthEnum dstBitDepth)
+    {
+        switch (dstBitDepth) {
+        case eBitDepthUByte:
+            renderMipmapForBitDepth<unsigned char, nComponents, 255>(args, margs, filter, clamp);
+            break;
+        case eBitDepthUShort:
+            renderMipmapForBitDepth<unsigned short, nComponents, 65535>(args, margs, filter, clamp);
+            break;
+        case eBitDepthFloat:
+            renderMipmapForBitDepth<float, nComponents, 1>(args, margs, filter, clamp);
+            break;
+        default:
+            throwSuiteStatusException(kOfxStatErrUnsupported);
+        }
+    }
+
+    // as in the generic render, some filters don't need explicit clamping, since they are
+    // "clamped" by construction.
+    template <class PIX, int nComponents, int maxValue>
+    void renderMipmapForBitDepth(const RenderArguments &args,
+                                 const MipmapRenderArgs &margs,
+                                 FilterEnum filter,
+                                 bool clamp)
+    {
+        switch (filter) {
+        case eFilterImpulse:
+            assert(false);
+            break;
+        case eFilterBox:
+            processMipmap<PIX, nComponents, maxValue, eFilterBox, false>(args, margs);
+            break;
+        case eFilterBilinear:
+            processMipmap<PIX, nComponents, maxValue, eFilterBilinear, false>(args, margs);
+            break;
+        case eFilterCubic:
+            processMipmap<PIX, nComponents, maxValue, eFilterCubic, false>(args, margs);
+            break;
+        case eFilterKeys:
+            if (clamp) {
+                processMipmap<PIX, nComponents, maxValue, eFilterKeys, true>(args, margs);
+            } else {
+                processMipmap<PIX, nComponents, maxValue, eFilterKeys, false>(args, margs);
+            }
+            break;
+        case eFilterSimon:
+            if (clamp) {
+                processMipmap<PIX, nComponents, maxValue, eFilterSimon, true>(args, margs);
+            } else {
+                processMipmap<PIX, nComponents, maxValue, eFilterSimon, false>(args, margs);
+            }
+            break;
+        case eFilterRifman:
+            if (clamp) {
+                processMipmap<PIX, nComponents, maxValue, eFilterRifman, true>(args, margs);
+            } else {
+                processMipmap<PIX, nComponents, maxValue, eFilterRifman, false>(args, margs);
+            }
+            break;
+        case eFilterMitchell:
+            if (clamp) {
+                processMipmap<PIX, nComponents, maxValue, eFilterMitchell, true>(args, margs);
+            } else {
+                processMipmap<PIX, nComponents, maxValue, eFilterMitchell, false>(args, margs);
+            }
+            break;
+        case eFilterParzen:
+            processMipmap<PIX, nComponents, maxValue, eFilterParzen, false>(args, margs);
+            break;
+        case eFilterNotch:
+            processMipmap<PIX, nComponents, maxValue, eFilterNotch, false>(args, margs);
+            break;
+        } // switch
+    } // renderMipmapForBitDepth
+
+    template <class PIX, int nComponents, int maxValue, FilterEnum filter, bool clamp>
+    void processMipmap(const RenderArguments &args,
+                       const MipmapRenderArgs &margs)
+    {
+        MipmapPyramid<PIX, nComponents> pyramid(margs.src);
+        pyramid.build(*this, margs.nLevels);
+        if ( abort() ) {
+            return;
+        }
+
+        MipmapTransform3x3Processor<PIX, nComponents, maxValue, filter, clamp> processor(*this);
+        if (margs.mask) {
+            processor.doMasking(true);
+            processor.setMaskImg(margs.mask, margs.maskInvert);
+        }
+        processor.setDstImg(margs.dst);
+        processor.setSrcImg(margs.src);
+        processor.setPyramid(&pyramid);
+        processor.setRenderWindow(args.renderWindow);
+        processor.setValues(&margs.invtransform, 0, 1, margs.blackOutside, 0., margs.mix);
+        processor.process();
+    }
+
+    BooleanParam* _mipmap;
+};
+} // namespace OFX
+
+#endif // Misc_ofxsTransform3x3Mipmap_h
@@ -105,6 +105,7 @@
 #include <cfloat> // DBL_MAX
 #include <limits>
 #include <algorithm>
+#include <vector>
 
 #include "ofxsProcessing.H"
 #include "ofxsMacros.h"
@@ -160,8 +161,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "- https://compositingmentor.com/2014/07/19/advanced-keying-breakdown-alpha-1-4-ibk-stacked-technique/"
 
 #define kPluginIdentifier "net.sf.openfx.PIK"
+// History:
+// version 1.0: initial version
+// version 1.1: row-based processing
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -935,479 +939,610 @@ private:
         }
 
 
-        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            assert(dstPix);
-
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
-                const PIX *fgPix = (const PIX *)  ( (_fgImg) ? _fgImg->getPixelAddress(x, y) : 0 );
-                const PIX *pfgPix = (const PIX *)  ( (!_noKey && _pfgImg) ? _pfgImg->getPixelAddress(x, y) : 0 );
-                const PIX *cPix = (const PIX *)  ( (/*!_noKey &&*/ _cImg) ? _cImg->getPixelAddress(x, y) : 0 );
-                const PIX *bgPix = (const PIX *)  ( ( ( _ubc || _ubl || (_outputMode == eOutputModeComposite) ) && _bgImg ) ? _bgImg->getPixelAddress(x, y) : 0 );
-                const PIX *inMaskPix = (const PIX *)  (_inMaskImg ? _inMaskImg->getPixelAddress(x, y) : 0);
-                const PIX *outMaskPix = (const PIX *)  (_outMaskImg ? _outMaskImg->getPixelAddress(x, y) : 0);
-                float inMask = inMaskPix ? sampleToFloat<PIX, maxValue>(*inMaskPix) : 0.f;
-                if ( (_sourceAlpha == eSourceAlphaAddToInsideMask) && (nComponents == 4) && fgPix ) {
-                    // take the max of inMask and the source Alpha
-                    inMask = (std::max)( inMask, sampleToFloat<PIX, maxValue>(fgPix[3]) );
-                }
-                float outMask = outMaskPix ? sampleToFloat<PIX, maxValue>(*outMaskPix) : 0.f;
-
-                // clamp inMask and outMask in the [0,1] range
-                inMask = (std::max)( 0.f, (std::min)(inMask, 1.f) );
-                outMask = (std::max)( 0.f, (std::min)(outMask, 1.f) );
-
-                float fg[4] = {0., 0., 0., 1.};
-                float pfg[4] = {0., 0., 0., 1.};
-                float bg[4] = {0., 0., 0., 1.};
-                float out[4] = {0., 0., 0., 1.};
+        switch (_outputMode) {
+        case eOutputModeScreenMatte:
+            processRows<eOutputModeScreenMatte>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModeCombinedMatte:
+            processRows<eOutputModeCombinedMatte>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModeStatus:
+            processRows<eOutputModeStatus>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModeIntermediate:
+            processRows<eOutputModeIntermediate>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModePremultiplied:
+            processRows<eOutputModePremultiplied>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModeUnpremultiplied:
+            processRows<eOutputModeUnpremultiplied>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        case eOutputModeComposite:
+            processRows<eOutputModeComposite>(procWindow, fgComponents, pfgComponents, cComponents, bgComponents);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    } // multiThreadProcessImages
 
-                if (fgPix) {
-                    for (int i = 0; i < fgComponents; ++i) {
-                        fg[i] = sampleToFloat<PIX, maxValue>(fgPix[i]);
-                    }
-                }
-                if (pfgPix) {
-                    for (int i = 0; i < pfgComponents; ++i) {
-                        pfg[i] = sampleToFloat<PIX, maxValue>(pfgPix[i]);
-                        if (i < 3) {
-                            pfg[i] /= _alphaBias[i];
-                        }
+    // Convert the pixels of row y of img that are within [x1,x2) to float, and store them in the
+    // RGBA buffer row, which starts at x1. The RGB components are divided by bias (if not NULL).
+    // Pixels outside of img are set to (0,0,0,1). The range of pixels that were read is returned in [*xa,*xb).
+    static void loadRow(const Image *img,
+                        int comps,
+                        const float *bias,
+                        int y,
+                        int x1,
+                        int x2,
+                        float *row,
+                        int *xa,
+                        int *xb)
+    {
+        *xa = *xb = x1;
+        if (img) {
+            const OfxRectI &bounds = img->getBounds();
+            if ( (bounds.y1 <= y) && (y < bounds.y2) ) {
+                *xa = (std::min)( (std::max)(x1, bounds.x1), x2 );
+                *xb = (std::max)( (std::min)(x2, bounds.x2), *xa );
+            }
+        }
+        for (int x = x1; x < *xa; ++x, row += 4) {
+            row[0] = row[1] = row[2] = 0.f;
+            row[3] = 1.f;
+        }
+        if (*xa < *xb) {
+            const PIX *pix = (const PIX *) img->getPixelAddress(*xa, y);
+            assert(pix);
+            float *span = row;
+            if (comps == 4) {
+                for (int x = *xa; x < *xb; ++x, pix += 4, row += 4) {
+                    for (int i = 0; i < 4; ++i) {
+                        row[i] = sampleToFloat<PIX, maxValue>(pix[i]);
                     }
                 }
-                if (cPix && !_useColor) {
-                    for (int i = 0; i < cComponents; ++i) {
-                        c[i] = sampleToFloat<PIX, maxValue>(cPix[i]);
-                        if (i < 3) {
-                            c[i] /= _alphaBias[i];
-                        }
+            } else {
+                assert(comps == 3);
+                for (int x = *xa; x < *xb; ++x, pix += 3, row += 4) {
+                    for (int i = 0; i < 3; ++i) {
+                        row[i] = sampleToFloat<PIX, maxValue>(pix[i]);
                     }
+                    row[3] = 1.f;
                 }
-
-                if ( bgPix && (_ubc || _ubl) ) {
-                    for (int i = 0; i < bgComponents; ++i) {
-                        bg[i] = sampleToFloat<PIX, maxValue>(bgPix[i]);
+            }
+            if (bias) {
+                for (; span < row; span += 4) {
+                    for (int i = 0; i < 3; ++i) {
+                        span[i] /= bias[i];
                     }
                 }
+            }
+        }
+        for (int x = *xb; x < x2; ++x, row += 4) {
+            row[0] = row[1] = row[2] = 0.f;
+            row[3] = 1.f;
+        }
+    }
 
-                float status[4] = {0., 0., 0., 1.}; // only used for status output
+    // Same as loadRow, for the first component of a mask image. Pixels outside of img are set to 0.
+    static void loadMaskRow(const Image *img,
+                            int y,
+                            int x1,
+                            int x2,
+                            float *row)
+    {
+        int xa = x1, xb = x1;
+        if (img) {
+            const OfxRectI &bounds = img->getBounds();
+            if ( (bounds.y1 <= y) && (y < bounds.y2) ) {
+                xa = (std::min)( (std::max)(x1, bounds.x1), x2 );
+                xb = (std::max)( (std::min)(x2, bounds.x2), xa );
+            }
+        }
+        std::fill(row, row + (xa - x1), 0.f);
+        if (xa < xb) {
+            const int comps = img->getPixelComponentCount();
+            const PIX *pix = (const PIX *) img->getPixelAddress(xa, y);
+            assert(pix);
+            float *m = row + (xa - x1);
+            for (int x = xa; x < xb; ++x, pix += comps, ++m) {
+                *m = sampleToFloat<PIX, maxValue>(*pix);
+            }
+        }
+        std::fill(row + (xb - x1), row + (x2 - x1), 0.f);
+    }
 
-                float alpha = 0.;
-                if (_noKey) {
-                    alpha = fg[3];
-                } else {
-                    if (_screenType == eScreenTypeGreen) {
-                        if (c[1] <= 0.) {
-                            alpha = 1.;
-                        } else {
-                            //alpha = (Ag-Ar*rw-Ab*gbw)<=0?1:clamp(1-(Ag-Ar*rw-Ab*gbw)/(Bg-Br*rw-Bb*gbw))
-                            //A is pfg and B is c.
-                            double pfgKey = pfg[1] - pfg[0] * _redWeight - pfg[2] * _blueGreenWeight;
-                            if (pfgKey <= 0.) {
-                                alpha = 1.;
-                            } else {
-                                double cKey = c[1] - c[0] * _redWeight - c[2] * _blueGreenWeight;
-                                if (cKey <= 0) {
-                                    alpha = 1.;
-                                } else {
-                                    alpha = 1. - pfgKey / cKey;
+    // Compute the screen matte of a row, key is the screen channel (1 for green, 2 for blue).
+    // The loop has no dependency between pixels and no early exit, so that it can be vectorized.
+    template<int key>
+    void keyRow(int width,
+                const float *pfg,
+                const float *c,
+                float *alpha) const
+    {
+        const int other = 3 - key; // blue for a green screen, green for a blue screen
+        const double redWeight = _redWeight;
+        const double blueGreenWeight = _blueGreenWeight;
+
+        for (int i = 0; i < width; ++i) {
+            const float *A = pfg + 4 * i;
+            const float *B = c + 4 * i;
+            //alpha = (Ag-Ar*rw-Ab*gbw)<=0?1:clamp(1-(Ag-Ar*rw-Ab*gbw)/(Bg-Br*rw-Bb*gbw))
+            //A is pfg and B is c.
+            const double pfgKey = A[key] - A[0] * redWeight - A[other] * blueGreenWeight;
+            const double cKey = B[key] - B[0] * redWeight - B[other] * blueGreenWeight;
+            alpha[i] = ( (B[key] <= 0.) || (pfgKey <= 0.) || (cKey <= 0) ) ? 1.f : (float)(1. - pfgKey / cKey);
+        }
 #ifndef DISABLE_RGBAL
 #pragma message WARN("RGBAL is not yet properly implemented")
-                                    // wrong
-                                    if (_rgbal) {
-                                        float k[3] = {0., 0., 0.};
-                                        for (int i = 0; i < 3; ++i) {
-                                            if (c[i] > 0) {
-                                                k[i] = pfg[i] / c[i];
-                                            }
-                                        }
-                                        double kmax = -DBL_MAX;
-                                        for (int i = 0; i < 3; ++i) {
-                                            if (k[i] > kmax) {
-                                                kmax = k[i];
-                                            }
-                                        }
-                                        float kKey = pfgKey / cKey;
-                                        if ( (kKey > kmax) && (kKey > 1.) ) {
-                                            alpha = 0.; // the "zero zone" is OK
-                                        } else {
-                                            // the second part ((kmax - kKey) / (50*kKey)) is wrong, but that's
-                                            // the closest I could get to IBK
-                                            alpha = (std::max)( (double)alpha, (std::min)( (kmax - kKey) / (50 * kKey), 1. ) );
-                                        }
-                                    }
-#endif
-                                }
-                            }
-                        }
-                    } else if (_screenType == eScreenTypeBlue) {
-                        if (c[2] <= 0.) {
-                            alpha = 1.;
-                        } else {
-                            //alpha = (Ag-Ar*rw-Ab*gbw)<=0?1:clamp(1-(Ag-Ar*rw-Ab*gbw)/(Bg-Br*rw-Bb*gbw))
-                            //A is pfg and B is c.
-                            double pfgKey = pfg[2] - pfg[0] * _redWeight - pfg[1] * _blueGreenWeight;
-                            if (pfgKey <= 0.) {
-                                alpha = 1.;
-                            } else {
-                                double cKey = c[2] - c[0] * _redWeight - c[1] * _blueGreenWeight;
-                                if (cKey <= 0) {
-                                    alpha = 1.;
-                                } else {
-                                    alpha = 1. - pfgKey / cKey;
-#ifndef DISABLE_RGBAL
-                                    if (_rgbal) {
-                                        float k[3] = {0., 0., 0.};
-                                        for (int i = 0; i < 3; ++i) {
-                                            if (c[i] > 0) {
-                                                k[i] = pfg[i] / c[i];
-                                            }
-                                        }
-                                        double kmax = -DBL_MAX;
-                                        for (int i = 0; i < 3; ++i) {
-                                            if (k[i] > kmax) {
-                                                kmax = k[i];
-                                            }
-                                        }
-                                        float kKey = pfgKey / cKey;
-                                        if ( (kKey > kmax) && (kKey > 1.) ) {
-                                            alpha = 0.; // the "zero zone" is OK
-                                        } else {
-                                            // the second part ((kmax - kKey) / (50*kKey)) is wrong, but that's
-                                            // the closest I could get to IBK
-                                            alpha = (std::max)( (double)alpha, (std::min)( (kmax - kKey) / (50 * kKey), 1. ) );
-                                        }
-                                    }
-#endif
-                                }
-                            }
-                        }
-                    }
-                } // if (!_noKey)
-                if (_outputMode == eOutputModeScreenMatte) {
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = alpha;
+        // wrong
+        if (_rgbal) {
+            for (int i = 0; i < width; ++i) {
+                const float *A = pfg + 4 * i;
+                const float *B = c + 4 * i;
+                const double pfgKey = A[key] - A[0] * redWeight - A[other] * blueGreenWeight;
+                const double cKey = B[key] - B[0] * redWeight - B[other] * blueGreenWeight;
+                if ( (B[key] <= 0.) || (pfgKey <= 0.) || (cKey <= 0) ) {
+                    continue;
+                }
+                float k[3] = {0., 0., 0.};
+                for (int j = 0; j < 3; ++j) {
+                    if (B[j] > 0) {
+                        k[j] = A[j] / B[j];
                     }
-                    if (nComponents == 4) {
-                        out[3] = 1.;
+                }
+                double kmax = -DBL_MAX;
+                for (int j = 0; j < 3; ++j) {
+                    if (k[j] > kmax) {
+                        kmax = k[j];
                     }
-                    goto FINISH;
                 }
-
-                if (alpha <= 0) {
-                    status[0] = status[1] = status[2] = 0.;
-                } else if (alpha >= 1.) {
-                    status[0] = status[1] = status[2] = 1.;
+                float kKey = pfgKey / cKey;
+                if ( (kKey > kmax) && (kKey > 1.) ) {
+                    alpha[i] = 0.; // the "zero zone" is OK
                 } else {
-                    status[0] = status[1] = status[2] = 0.5;
+                    // the second part ((kmax - kKey) / (50*kKey)) is wrong, but that's
+                    // the closest I could get to IBK
+                    alpha[i] = (std::max)( (double)alpha[i], (std::min)( (kmax - kKey) / (50 * kKey), 1. ) );
                 }
+            }
+        }
+#endif
+    }
 
-                if ( !_ss || (alpha >= 1) ) {
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = fg[i];
-                    }
-                } else {
-                    // screen subtraction / despill
-                    for (int i = 0; i < 3; ++i) {
-                        float v = fg[i] + c[i] * _despillBias[i] * (alpha - 1.);
-                        out[i] = v < 0. ? 0 : v;
-                    }
+    // The keying pipeline works on rows: the inputs of a row are first converted to float buffers,
+    // the screen matte is computed for the whole row, and the remaining per-pixel operations are
+    // specialized on the output mode.
+    template<OutputModeEnum outputMode>
+    void processRows(const OfxRectI &procWindow,
+                     int fgComponents,
+                     int pfgComponents,
+                     int cComponents,
+                     int bgComponents)
+    {
+        const int x1 = procWindow.x1;
+        const int x2 = procWindow.x2;
+        const int width = x2 - x1;
+        std::vector<float> fgRow(width * 4);
+        std::vector<float> pfgRow(width * 4);
+        std::vector<float> cRow(width * 4);
+        std::vector<float> bgRow(width * 4);
+        std::vector<float> inMaskRow(width);
+        std::vector<float> outMaskRow(width);
+        std::vector<float> alphaRow(width);
+        // C pixels outside of the C image get the value of the last pixel read (or the screen color)
+        float c[4] = {_color[0], _color[1], _color[2], 1.};
+        const bool useC = _cImg && !_useColor;
+        const bool useBg = _bgImg && (_ubc || _ubl);
+        const bool addSourceAlpha = (_sourceAlpha == eSourceAlphaAddToInsideMask) && (fgComponents == 4);
+        int xa, xb;
+
+        if (!useC) {
+            for (int i = 0; i < width; ++i) {
+                std::copy(c, c + 4, &cRow[4 * i]);
+            }
+        }
+        if (!useBg) {
+            loadRow(NULL, 0, NULL, procWindow.y1, x1, x2, &bgRow.front(), &xa, &xb);
+        }
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            loadRow(_fgImg, fgComponents, NULL, y, x1, x2, &fgRow.front(), &xa, &xb);
+            loadMaskRow(_inMaskImg, y, x1, x2, &inMaskRow.front());
+            if (addSourceAlpha) {
+                // take the max of inMask and the source Alpha
+                for (int x = xa; x < xb; ++x) {
+                    inMaskRow[x - x1] = (std::max)(inMaskRow[x - x1], fgRow[4 * (x - x1) + 3]);
                 }
-                    /*
-                       } else if (_rgbal) {
-                       double alphamin = DBL_MAX;
-                       for (int i = 0; i < 3; ++i) {
-                        if (c[i] > 0) {
-                            double a = 1. - pfg[i] / c[i];
-                            if (a < alphamin) {
-                                alphamin = a;
-                            }
-                        }
-                       }
-                       // alphamin, which corresponds to black is mapped to alpha=0
-                       // alpha = alphamin -> 0.
-                       // alpha = 1 -> 1.
-                       alpha = (alpha - alphamin) / (1. - alphamin);
-                       if (alpha <= 0.) {
-                        alpha = 0.;
-                        dstPix[0] = dstPix[1] = dstPix[2] = 0;
-                        dstPix[0] = dstPix[1] = dstPix[2] = 1;alpha=1;
-                       } else {
-                        for (int i = 0; i < 3; ++i) {
-                            dstPix[i] = floatToSample<PIX, maxValue>(fg[i]*alpha);
-                        }
-                       }
-                     */
-
-                if (_clampAlpha) {
-                    if (alpha < 0.) {
-                        alpha = 0.;
-                    } else if (alpha > 1.) {
-                        alpha = 1.;
-                    }
+            }
+            loadMaskRow(_outMaskImg, y, x1, x2, &outMaskRow.front());
+            // clamp inMask and outMask in the [0,1] range
+            for (int i = 0; i < width; ++i) {
+                inMaskRow[i] = (std::max)( 0.f, (std::min)(inMaskRow[i], 1.f) );
+                outMaskRow[i] = (std::max)( 0.f, (std::min)(outMaskRow[i], 1.f) );
+            }
+            if (useC) {
+                loadRow(_cImg, cComponents, _alphaBias, y, x1, x2, &cRow.front(), &xa, &xb);
+                for (int x = x1; x < xa; ++x) {
+                    std::copy(c, c + 4, &cRow[4 * (x - x1)]);
+                }
+                if (xa < xb) {
+                    std::copy(&cRow[4 * (xb - 1 - x1)], &cRow[4 * (xb - 1 - x1)] + 4, c);
+                }
+                for (int x = xb; x < x2; ++x) {
+                    std::copy(c, c + 4, &cRow[4 * (x - x1)]);
+                }
+            }
+            if (useBg) {
+                loadRow(_bgImg, bgComponents, NULL, y, x1, x2, &bgRow.front(), &xa, &xb);
+            }
+
+            if (_noKey) {
+                for (int i = 0; i < width; ++i) {
+                    alphaRow[i] = fgRow[4 * i + 3];
                 }
-                ////////////////////////////////////////
-                // Screen Matte options
-
-                // the clip function is piecewise linear and continuous:
-                // 0. from 0 to screenClipMin
-                // 0. to 1. from screenClipMin to screenClipMax
-                // 1. from screenClipMax to 1.
-                float alphaClipped;
-                if (alpha <= _screenClipMin) {
-                    alphaClipped = 0.;
-                } else if (alpha >= _screenClipMax) {
-                    alphaClipped = 1.;
+            } else {
+                loadRow(_pfgImg, pfgComponents, _alphaBias, y, x1, x2, &pfgRow.front(), &xa, &xb);
+                if (_screenType == eScreenTypeGreen) {
+                    keyRow<1>(width, &pfgRow.front(), &cRow.front(), &alphaRow.front());
+                } else if (_screenType == eScreenTypeBlue) {
+                    keyRow<2>(width, &pfgRow.front(), &cRow.front(), &alphaRow.front());
                 } else {
-                    alphaClipped = (alpha - _screenClipMin) / (_screenClipMax - _screenClipMin);
+                    std::fill(alphaRow.begin(), alphaRow.end(), 0.f);
                 }
+            }
 
-                if (alphaClipped > alpha) {
-                    float diff = alphaClipped - alpha;
-                    // method 1
-                    status[1] += diff / 2.;
-                    // method 2
-                    //status[0] = diff;
-                    //status[1] = 1;
-                    //status[2] = diff;
-
-                    if (_outputMode == eOutputModePremultiplied ||
-                        _outputMode == eOutputModeUnpremultiplied ||
-                        _outputMode == eOutputModeComposite) {
-                        switch (_screenReplace) {
-                            case eReplaceNone:
-                                // do nothing
-                                break;
-
-                            case eReplaceSource:
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + fg[i] * diff;
-                                }
-                                break;
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(x1, y);
+            assert(dstPix);
 
-                            case eReplaceHardColor:
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + _screenReplaceColor[i] * diff;
-                                }
-                                break;
+            for (int i = 0; i < width; ++i, dstPix += nComponents) {
+                float out[4] = {0., 0., 0., 1.};
+                processPixel<outputMode>(&fgRow[4 * i], &cRow[4 * i], &bgRow[4 * i], inMaskRow[i], outMaskRow[i], alphaRow[i], out);
+                for (int k = 0; k < nComponents; ++k) {
+                    dstPix[k] = floatToSample<PIX, maxValue>(out[k]);
+                }
+            }
+        }
+    } // processRows
+
+    // Everything that comes after the screen matte: despill, screen matte clipping, inside and outside masks,
+    // background luminance and chroma, and the output.
+    template<OutputModeEnum outputMode>
+    void processPixel(const float *fg,
+                      const float *c,
+                      const float *bg,
+                      float inMask,
+                      float outMask,
+                      float alpha,
+                      float *out)
+    {
+        float status[4] = {0., 0., 0., 1.}; // only used for status output
 
-                            case eReplaceSoftColor: {
-                                // match the luminance of fg
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + _screenReplaceColor[i] * diff * luminance(_colorspace, fg);
-                                }
-                                break;
-                            }
-                        }
-                    }
-                    alpha = alphaClipped;
-                } else if (alphaClipped < alpha) {
-                    assert(alpha > 0.);
-                    if (alphaClipped == 0.) {
-                        status[0] = 0.;
-                        status[1] = (alpha - alphaClipped) / 2.;
-                        status[2] = 0.;
-                    } else {
-                        status[0] = 0.5 - (alpha - alphaClipped) / 2.;
-                        status[1] = 0.5;
-                        status[2] = 0.5 - (alpha - alphaClipped) / 2.;
-                    }
-                    // re-premultiply output
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = out[i] * alphaClipped / alpha; // no division by zero: alpha > 0
+        if (outputMode == eOutputModeScreenMatte) {
+            for (int i = 0; i < 3; ++i) {
+                out[i] = alpha;
+            }
+            if (nComponents == 4) {
+                out[3] = 1.;
+            }
+
+            return;
+        }
+        if (alpha <= 0) {
+            status[0] = status[1] = status[2] = 0.;
+        } else if (alpha >= 1.) {
+            status[0] = status[1] = status[2] = 1.;
+        } else {
+            status[0] = status[1] = status[2] = 0.5;
+        }
+
+        if ( !_ss || (alpha >= 1) ) {
+            for (int i = 0; i < 3; ++i) {
+                out[i] = fg[i];
+            }
+        } else {
+            // screen subtraction / despill
+            for (int i = 0; i < 3; ++i) {
+                float v = fg[i] + c[i] * _despillBias[i] * (alpha - 1.);
+                out[i] = v < 0. ? 0 : v;
+            }
+        }
+            /*
+               } else if (_rgbal) {
+               double alphamin = DBL_MAX;
+               for (int i = 0; i < 3; ++i) {
+                if (c[i] > 0) {
+                    double a = 1. - pfg[i] / c[i];
+                    if (a < alphamin) {
+                        alphamin = a;
                     }
-                    alpha = alphaClipped;
                 }
+               }
+               // alphamin, which corresponds to black is mapped to alpha=0
+               // alpha = alphamin -> 0.
+               // alpha = 1 -> 1.
+               alpha = (alpha - alphamin) / (1. - alphamin);
+               if (alpha <= 0.) {
+                alpha = 0.;
+                dstPix[0] = dstPix[1] = dstPix[2] = 0;
+                dstPix[0] = dstPix[1] = dstPix[2] = 1;alpha=1;
+               } else {
+                for (int i = 0; i < 3; ++i) {
+                    dstPix[i] = floatToSample<PIX, maxValue>(fg[i]*alpha);
+                }
+               }
+             */
+
+        if (_clampAlpha) {
+            if (alpha < 0.) {
+                alpha = 0.;
+            } else if (alpha > 1.) {
+                alpha = 1.;
+            }
+        }
+        ////////////////////////////////////////
+        // Screen Matte options
+
+        // the clip function is piecewise linear and continuous:
+        // 0. from 0 to screenClipMin
+        // 0. to 1. from screenClipMin to screenClipMax
+        // 1. from screenClipMax to 1.
+        float alphaClipped;
+        if (alpha <= _screenClipMin) {
+            alphaClipped = 0.;
+        } else if (alpha >= _screenClipMax) {
+            alphaClipped = 1.;
+        } else {
+            alphaClipped = (alpha - _screenClipMin) / (_screenClipMax - _screenClipMin);
+        }
+
+        if (alphaClipped > alpha) {
+            float diff = alphaClipped - alpha;
+            // method 1
+            status[1] += diff / 2.;
+            // method 2
+            //status[0] = diff;
+            //status[1] = 1;
+            //status[2] = diff;
+
+            if (outputMode == eOutputModePremultiplied ||
+                outputMode == eOutputModeUnpremultiplied ||
+                outputMode == eOutputModeComposite) {
+                switch (_screenReplace) {
+                    case eReplaceNone:
+                        // do nothing
+                        break;
 
-                // nonadditive mix between the key generator and the garbage matte (outMask)
-                // outside mask has priority over inside mask, treat inside first
-                if ( (inMask > 0.) && (alpha < inMask) ) {
-                    float diff = inMask - alpha;
-                    // method 1
-                    status[2] += diff / 2.;
-                    // method 2
-                    //status[0] = diff;
-                    //status[1] = diff;
-                    //status[2] = 1;
-
-                    if (_outputMode == eOutputModePremultiplied ||
-                        _outputMode == eOutputModeUnpremultiplied ||
-                        _outputMode == eOutputModeComposite) {
-                        switch (_insideReplace) {
-                            case eReplaceNone:
-                                // do nothing
-                                break;
-
-                            case eReplaceSource:
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + fg[i] * diff;
-                                }
-                                break;
+                    case eReplaceSource:
+                        for (int i = 0; i < 3; ++i) {
+                            out[i] = out[i] + fg[i] * diff;
+                        }
+                        break;
 
-                            case eReplaceHardColor:
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + _insideReplaceColor[i] * diff;
-                                }
-                                break;
+                    case eReplaceHardColor:
+                        for (int i = 0; i < 3; ++i) {
+                            out[i] = out[i] + _screenReplaceColor[i] * diff;
+                        }
+                        break;
 
-                            case eReplaceSoftColor: {
-                                // match the luminance of fg
-                                for (int i = 0; i < 3; ++i) {
-                                    out[i] = out[i] + _insideReplaceColor[i] * diff * luminance(_colorspace, fg);
-                                }
-                                break;
-                            }
+                    case eReplaceSoftColor: {
+                        // match the luminance of fg
+                        for (int i = 0; i < 3; ++i) {
+                            out[i] = out[i] + _screenReplaceColor[i] * diff * luminance(_colorspace, fg);
                         }
+                        break;
                     }
-                    alpha = inMask;
                 }
+            }
+            alpha = alphaClipped;
+        } else if (alphaClipped < alpha) {
+            assert(alpha > 0.);
+            if (alphaClipped == 0.) {
+                status[0] = 0.;
+                status[1] = (alpha - alphaClipped) / 2.;
+                status[2] = 0.;
+            } else {
+                status[0] = 0.5 - (alpha - alphaClipped) / 2.;
+                status[1] = 0.5;
+                status[2] = 0.5 - (alpha - alphaClipped) / 2.;
+            }
+            // re-premultiply output
+            for (int i = 0; i < 3; ++i) {
+                out[i] = out[i] * alphaClipped / alpha; // no division by zero: alpha > 0
+            }
+            alpha = alphaClipped;
+        }
+
+        // nonadditive mix between the key generator and the garbage matte (outMask)
+        // outside mask has priority over inside mask, treat inside first
+        if ( (inMask > 0.) && (alpha < inMask) ) {
+            float diff = inMask - alpha;
+            // method 1
+            status[2] += diff / 2.;
+            // method 2
+            //status[0] = diff;
+            //status[1] = diff;
+            //status[2] = 1;
+
+            if (outputMode == eOutputModePremultiplied ||
+                outputMode == eOutputModeUnpremultiplied ||
+                outputMode == eOutputModeComposite) {
+                switch (_insideReplace) {
+                    case eReplaceNone:
+                        // do nothing
+                        break;
 
-                if ( (outMask > 0.) && (alpha > 1. - outMask) ) {
-                    assert(alpha > 0.);
-                    status[1] -= ( alpha - (1. - outMask) ) / 2.;
-                    status[2] -= ( alpha - (1. - outMask) ) / 2.;
-                    if (_outputMode == eOutputModePremultiplied ||
-                        _outputMode == eOutputModeUnpremultiplied ||
-                        _outputMode == eOutputModeComposite) {
-                        // re-premultiply output
+                    case eReplaceSource:
                         for (int i = 0; i < 3; ++i) {
-                            out[i] = out[i] * (1. - outMask) / alpha; // no division by zero: alpha > 0
+                            out[i] = out[i] + fg[i] * diff;
                         }
-                    }
-                    alpha = 1. - outMask;
-                }
+                        break;
 
-                if (_outputMode == eOutputModeStatus) {
-                    for (int i = 0; i < 4; ++i) {
-                        out[i] = status[i];
-                    }
-                    goto FINISH;
-                }
-                if (_outputMode == eOutputModeCombinedMatte) {
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = alpha;
-                    }
-                    if (nComponents == 4) {
-                        out[3] = 1.;
+                    case eReplaceHardColor:
+                        for (int i = 0; i < 3; ++i) {
+                            out[i] = out[i] + _insideReplaceColor[i] * diff;
+                        }
+                        break;
+
+                    case eReplaceSoftColor: {
+                        // match the luminance of fg
+                        for (int i = 0; i < 3; ++i) {
+                            out[i] = out[i] + _insideReplaceColor[i] * diff * luminance(_colorspace, fg);
+                        }
+                        break;
                     }
-                    goto FINISH;
                 }
-                if (_outputMode == eOutputModeIntermediate) {
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = fg[i];
-                    }
-                    if (nComponents == 4) {
-                        out[3] = alpha;
-                    }
-                    goto FINISH;
+            }
+            alpha = inMask;
+        }
+
+        if ( (outMask > 0.) && (alpha > 1. - outMask) ) {
+            assert(alpha > 0.);
+            status[1] -= ( alpha - (1. - outMask) ) / 2.;
+            status[2] -= ( alpha - (1. - outMask) ) / 2.;
+            if (outputMode == eOutputModePremultiplied ||
+                outputMode == eOutputModeUnpremultiplied ||
+                outputMode == eOutputModeComposite) {
+                // re-premultiply output
+                for (int i = 0; i < 3; ++i) {
+                    out[i] = out[i] * (1. - outMask) / alpha; // no division by zero: alpha > 0
                 }
+            }
+            alpha = 1. - outMask;
+        }
 
-                if (!_ss) { // if no screen subtraction, just premult
-                    for (int i = 0; i < 3; ++i) {
-                        out[i] = out[i] * alpha;
-                    }
-                }
+        if (outputMode == eOutputModeStatus) {
+            for (int i = 0; i < 4; ++i) {
+                out[i] = status[i];
+            }
+            return;
+        }
+        if (outputMode == eOutputModeCombinedMatte) {
+            for (int i = 0; i < 3; ++i) {
+                out[i] = alpha;
+            }
+            if (nComponents == 4) {
+                out[3] = 1.;
+            }
+            return;
+        }
+        if (outputMode == eOutputModeIntermediate) {
+            for (int i = 0; i < 3; ++i) {
+                out[i] = fg[i];
+            }
+            if (nComponents == 4) {
                 out[3] = alpha;
+            }
+            return;
+        }
 
-                // ubl, ubc
-                if (_ubl || _ubc) {
-                    // we use the CIE xyZ colorspace to separate luminance from chrominance
-                    float out_Y, out_x, out_y;
-                    // Convert to XYZ
-                    {
-                        float X, Y, Z, x, y, XYZ, invXYZ;
-                        switch (_colorspace) {
-                        case eColorspaceRec709:
-                        default:
-                            Color::rgb709_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
-                            break;
-
-                        case eColorspaceRec2020:
-                            Color::rgb2020_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
-                            break;
-
-                        case eColorspaceACESAP0:
-                            Color::rgbACESAP0_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
-                            break;
-
-                        case eColorspaceACESAP1:
-                            Color::rgbACESAP1_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
-                            break;
-                        }
-                        XYZ = X + Y + Z;
-                        invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
-                        // convert to xyY
-                        x = X * invXYZ;
-                        y = Y * invXYZ;
-
-                        //out_X = X;
-                        out_Y = Y;
-                        //out_Z = Z;
-                        out_x = x;
-                        out_y = y;
-                    }
-                    float bg_Y, bg_x, bg_y;
-                    {
-                        float X, Y, Z, x, y, XYZ, invXYZ;
-                        Color::rgb709_to_xyz(bg[0], bg[1], bg[2], &X, &Y, &Z);
-                        XYZ = X + Y + Z;
-                        invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
-                        // convert to xyY
-                        x = X * invXYZ;
-                        y = Y * invXYZ;
-
-                        //bg_X = X;
-                        bg_Y = Y;
-                        //bg_Z = Z;
-                        bg_x = x;
-                        bg_y = y;
-                    }
+        if (!_ss) { // if no screen subtraction, just premult
+            for (int i = 0; i < 3; ++i) {
+                out[i] = out[i] * alpha;
+            }
+        }
+        out[3] = alpha;
+
+        // ubl, ubc
+        if (_ubl || _ubc) {
+            // we use the CIE xyZ colorspace to separate luminance from chrominance
+            float out_Y, out_x, out_y;
+            // Convert to XYZ
+            {
+                float X, Y, Z, x, y, XYZ, invXYZ;
+                switch (_colorspace) {
+                case eColorspaceRec709:
+                default:
+                    Color::rgb709_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
+                    break;
 
-                    // mix
-                    float a = (std::max)(0.f, out[3]);
-                    if ( _ubc && (bg_Y > 0.) ) {
-                        out_x = a * out_x + (1 - a) * bg_x;
-                        out_y = a * out_y + (1 - a) * bg_y;
-                        //out_X = a * out_X + (1 - a) * bg_X;
-                        //out_Z = a * out_Z + (1 - a) * bg_Z;
-                    }
-                    if (_ubl) {
-                        // magic number (to look like IBK, really)
-                        out_Y = out_Y * (a * 1 + (1 - a) * 5.38845 * bg_Y);
-                    }
+                case eColorspaceRec2020:
+                    Color::rgb2020_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
+                    break;
 
-                    // convert to RGB
-                    {
-                        float Y = out_Y;
-                        //float X = out_X;
-                        //float Z = out_Z;
-                        float X = (out_y == 0.) ? 0. : out_x * Y / out_y;
-                        float Z = (out_y == 0.) ? 0. : (1. - out_x - out_y) * Y / out_y;
-
-                        switch (_colorspace) {
-                        case eColorspaceRec709:
-                        default:
-                            Color::xyz_to_rgb709(X, Y, Z, &out[0], &out[1], &out[2]);
-                            break;
-
-                        case eColorspaceRec2020:
-                            Color::xyz_to_rgb2020(X, Y, Z, &out[0], &out[1], &out[2]);
-                            break;
-
-                        case eColorspaceACESAP0:
-                            Color::xyz_to_rgbACESAP0(X, Y, Z, &out[0], &out[1], &out[2]);
-                            break;
-
-                        case eColorspaceACESAP1:
-                            Color::xyz_to_rgbACESAP1(X, Y, Z, &out[0], &out[1], &out[2]);
-                            break;
-                        }
-                    }
+                case eColorspaceACESAP0:
+                    Color::rgbACESAP0_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
+                    break;
+
+                case eColorspaceACESAP1:
+                    Color::rgbACESAP1_to_xyz(out[0], out[1], out[2], &X, &Y, &Z);
+                    break;
+                }
+                XYZ = X + Y + Z;
+                invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
+                // convert to xyY
+                x = X * invXYZ;
+                y = Y * invXYZ;
+
+                //out_X = X;
+                out_Y = Y;
+                //out_Z = Z;
+                out_x = x;
+                out_y = y;
+            }
+            float bg_Y, bg_x, bg_y;
+            {
+                float X, Y, Z, x, y, XYZ, invXYZ;
+                Color::rgb709_to_xyz(bg[0], bg[1], bg[2], &X, &Y, &Z);
+                XYZ = X + Y + Z;
+                invXYZ = XYZ <= 0 ? 0. : (1. / XYZ);
+                // convert to xyY
+                x = X * invXYZ;
+                y = Y * invXYZ;
+
+                //bg_X = X;
+                bg_Y = Y;
+                //bg_Z = Z;
+                bg_x = x;
+                bg_y = y;
+            }
+
+            // mix
+            float a = (std::max)(0.f, out[3]);
+            if ( _ubc && (bg_Y > 0.) ) {
+                out_x = a * out_x + (1 - a) * bg_x;
+                out_y = a * out_y + (1 - a) * bg_y;
+                //out_X = a * out_X + (1 - a) * bg_X;
+                //out_Z = a * out_Z + (1 - a) * bg_Z;
+            }
+            if (_ubl) {
+                // magic number (to look like IBK, really)
+                out_Y = out_Y * (a * 1 + (1 - a) * 5.38845 * bg_Y);
+            }
+
+            // convert to RGB
+            {
+                float Y = out_Y;
+                //float X = out_X;
+                //float Z = out_Z;
+                float X = (out_y == 0.) ? 0. : out_x * Y / out_y;
+                float Z = (out_y == 0.) ? 0. : (1. - out_x - out_y) * Y / out_y;
+
+                switch (_colorspace) {
+                case eColorspaceRec709:
+                default:
+                    Color::xyz_to_rgb709(X, Y, Z, &out[0], &out[1], &out[2]);
+                    break;
+
+                case eColorspaceRec2020:
+                    Color::xyz_to_rgb2020(X, Y, Z, &out[0], &out[1], &out[2]);
+                    break;
+
+                case eColorspaceACESAP0:
+                    Color::xyz_to_rgbACESAP0(X, Y, Z, &out[0], &out[1], &out[2]);
+                    break;
+
+                case eColorspaceACESAP1:
+                    Color::xyz_to_rgbACESAP1(X, Y, Z, &out[0], &out[1], &out[2]);
+                    break;
                 }
+            }
+        }
 
 #ifndef DISABLE_LM
 #pragma message WARN("luminance match not yet implemented")
@@ -1416,38 +1551,31 @@ private:
 #pragma message WARN("autolevels not yet implemented")
 #endif
 
-                if (_outputMode == eOutputModeUnpremultiplied) {
-                    if (out[3] <= 0) {
-                        for (int i = 0; i < 3; ++i) {
-                            out[i] = 0;
-                        }
-                    } else {
-                        for (int i = 0; i < 3; ++i) {
-                            out[i] = out[i] / out[3];
-                        }
-                    }
-                    goto FINISH;
+        if (outputMode == eOutputModeUnpremultiplied) {
+            if (out[3] <= 0) {
+                for (int i = 0; i < 3; ++i) {
+                    out[i] = 0;
                 }
+            } else {
+                for (int i = 0; i < 3; ++i) {
+                    out[i] = out[i] / out[3];
+                }
+            }
+            return;
+        }
 
-                if (_outputMode == eOutputModeComposite) {
-                    if (out[3] <= 0) {
-                        for (int i = 0; i < 4; ++i) {
-                            out[i] = bg[i];
-                        }
-                    } else {
-                        for (int i = 0; i < 4; ++i) {
-                            out[i] = out[i] + bg[i] * (1 - out[3]);
-                        }
-                    }
-                    goto FINISH;
+        if (outputMode == eOutputModeComposite) {
+            if (out[3] <= 0) {
+                for (int i = 0; i < 4; ++i) {
+                    out[i] = bg[i];
                 }
-FINISH:
-                for (int i = 0; i < nComponents; ++i) {
-                    dstPix[i] = floatToSample<PIX, maxValue>(out[i]);
+            } else {
+                for (int i = 0; i < 4; ++i) {
+                    out[i] = out[i] + bg[i] * (1 - out[3]);
                 }
             }
         }
-    } // multiThreadProcessImages
+    } // processPixel
 };
 
 
@@ -0,0 +1,1311 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of openfx-misc <https://github.com/devernay/openfx-misc>,
+ * Copyright (C) 2013-2018 INRIA
+ *
+ * openfx-misc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * openfx-misc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with openfx-misc.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+/*
+ * OFX PIKColor plugin.
+ *
+ * This is a native implementation of the PIKColor PyPlug (PIKColor.py), which is kept for
+ * the projects that were saved with version 1.
+ * The node graph of the PyPlug is computed in a single render action, on planar float buffers
+ * that cover the render window plus the support of all the filters:
+ *
+ * - source: the source is graded (lights, darks, with a mix of 0.326), and keyed by the PIK
+ *   algorithm, using the graded image as Fg, PFg and C. The key is 1 on the screen and 0
+ *   elsewhere (or where the inside mask is 1).
+ * - erode: the key is eroded (ErodeBlur), which gives the output alpha.
+ * - color: the source, premultiplied by the eroded key, is blurred (quadratic filter of width
+ *   'size') and unpremultiplied. The screen mask is where the screen channel of the result is
+ *   positive.
+ * - patch black (if 'Patch Black' is not zero): the color is blurred over a larger area
+ *   (quadratic filter of width 3*size*multi) and unpremultiplied, and merged over the previous
+ *   color using a mask computed by dilating and blurring the inverse of the screen mask.
+ *
+ * All filters use the same boundary conditions as the nodes of the PyPlug (black outside of
+ * the source RoD for the blurs, nearest pixel for the dilate). The key, erode and color stages
+ * are computed exactly, since their result is thresholded. The wide blurs of the patch black
+ * stage are computed on the coarsest level of an image pyramid where they are still well
+ * sampled, as in CImgBlur, and the Gaussian blur of the patch mask is replaced by a quadratic
+ * filter of the same variance. The pyramid level only depends on the parameters and the source
+ * RoD, and the levels are aligned on absolute pixel coordinates, so that the result does not
+ * depend on the tiling.
+ */
+
+#include <cmath>
+#include <cfloat> // DBL_MAX, FLT_EPSILON, FLT_MAX
+#include <climits> // INT_MAX
+#include <cassert>
+#include <algorithm>
+#include <vector>
+
+#include "ofxsImageEffect.h"
+#include "ofxsThreadSuite.h"
+#include "ofxsMultiThread.h"
+#include "ofxsCoords.h"
+#include "ofxsMacros.h"
+#include "ofxsPyramid.h"
+
+using namespace OFX;
+
+OFXS_NAMESPACE_ANONYMOUS_ENTER
+
+#define kPluginName "PIKColor"
+#define kPluginGrouping "Keyer"
+#define kPluginDescription \
+    "This node provides the PIK per-pixel keyer a pseudo clean-plate to be used as color reference.\n" \
+    "The idea is to remove the foreground image and only leave the shades and hues of the original blue/greenscreen.\n" \
+    "Attach the output of this node to the 'C' input of a PIK node. Attach the input of this node and the 'PFg' input of PIK to the original screen, or preferably the denoised screen.\n" \
+    "Pick which color your screen type is in both nodes and then while viewing the alpha output from PIK lower the darks.b (if a bluescreen - adjust darks.g if a greenscreen) in this node until you see a change in the garbage area of the matte. Once you see a change then you have gone too far -back off a step. If you are still left with discolored edges you can use the other colors in the lights and darks to eliminate them. Remember the idea is to be left with the original shades of the screen and the foreground blacked out. While swapping between viewing the matte from the PIK and the rgb output of PIKColor adjust the other colors until you see a change in the garbage area of the matte. Simple rule of thumb - if you have a light red discolored area increase the lights.r - if you have a dark green discolored area increase darks.g. If your screen does not have a very saturated hue you may still be left with areas of discoloration after the above process. The 'erode' slider can help with this - while viewing the rgb output adjust the erode until those areas disappear.\n" \
+    "The 'Patch Black' slider allows you to fill in the black areas with screen color. This is not always necessary but if you see blue squares in your composite increase this value and it'll fix it.\n" \
+    "The optional 'InM' input can be used to provide an inside mask (a.k.a. core matte or holdout matte), which is excluded from the clean plate. If an inside mask is fed into the Keyer (PIK or another Keyer), the same inside mask should be fed inside PIKColor.\n" \
+    "The above is the only real workflow for this node - working from the top parameter to the bottom parameter- going back to tweak darks/lights with 'erode' and 'patch black' activated is not really going to work."
+
+#define kPluginIdentifier "fr.inria.PIKColor"
+// History:
+// version 1.0: PyPlug (PIKColor.py)
+// version 2.0: native plugin
+// version 2.1: the patch black result does not depend on the tiling
+#define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+
+#define kSupportsTiles 1
+#define kSupportsMultiResolution 1
+#define kSupportsRenderScale 1
+#define kSupportsMultipleClipPARs false
+#define kSupportsMultipleClipDepths false
+#define kRenderThreadSafety eRenderFullySafe
+
+#define kClipInsideMask "InM"
+#define kClipInsideMaskHint "The Inside Mask, or holdout matte, or core matte, which is excluded from the clean plate."
+
+#define kParamScreenType "screenType"
+#define kParamScreenTypeLabel "Screen Type"
+#define kParamScreenTypeHint "The type of background screen used for the key."
+#define kParamScreenTypeOptionGreen "Green", "Background screen with a green tint.", "green"
+#define kParamScreenTypeOptionBlue "Blue", "Background screen with a blue tint.", "blue"
+enum ScreenTypeEnum
+{
+    eScreenTypeGreen = 0,
+    eScreenTypeBlue,
+};
+
+#define kParamScreenTypeDefault eScreenTypeBlue
+
+#define kParamSize "size"
+#define kParamSizeLabel "Size"
+#define kParamSizeHint "Size of color expansion."
+#define kParamSizeDefault 10
+
+#define kParamOff "off"
+#define kParamOffLabel "Darks"
+#define kParamOffHint \
+    "adjust the color values to get the best separation between black and the screen type color.\n" \
+    "You want to be left with only shades of the screen color and black.\n" \
+    "If a green screen is selected start by bringing down darks->green\n" \
+    "If a blue screen is selected start by bringing down darks->blue"
+
+#define kParamMult "mult"
+#define kParamMultLabel "Lights"
+#define kParamMultHint kParamOffHint
+
+#define kParamErode "erode"
+#define kParamErodeLabel "Erode"
+#define kParamErodeHint "increase this value if you still see traces of the foreground edge color in the output"
+
+#define kParamMulti "multi"
+#define kParamMultiLabel "Patch Black"
+#define kParamMultiHint \
+    "Increase this to optionally remove the black from the output.\n" \
+    "This should only be used once the the above darks/lights have been set."
+
+#define kParamFilt "filt"
+#define kParamFiltLabel "Filter"
+#define kParamFiltHint "Use a smooth filter for the patch black mask. If unchecked, a smaller box filter is used."
+#define kParamFiltDefault true
+
+#define kParamLevel "level"
+#define kParamLevelLabel "Level"
+#define kParamLevelHint "multiply the rgb output. Helps remove noise from main key"
+#define kParamLevelDefault 1
+
+#define kGradeMix 0.326 // mix of the lights/darks grade with the source, before keying
+#define kPyramidMinSigma 4. // minimum standard deviation of the blur kernels computed on a pyramid level, in pixels of that level (twice the one of CImgBlur, because the result is unpremultiplied)
+#define kPyramidMinSize 16 // minimum width and height of a pyramid level
+#define kColumnBlockSize 16 // number of adjacent columns filtered together (16 floats = one 64-byte cache line)
+
+template<class PIX, int maxValue>
+static float
+sampleToFloat(PIX value)
+{
+    return (maxValue == 1) ? value : (value / (float)maxValue);
+}
+
+template<class PIX, int maxValue>
+static PIX
+floatToSample(float value)
+{
+    if (maxValue == 1) {
+        return PIX(value);
+    }
+    if (value <= 0) {
+        return PIX();
+    } else if (value >= 1.) {
+        return PIX(maxValue);
+    }
+
+    return PIX(value * maxValue + 0.5);
+}
+
+struct PIKColorParams
+{
+    ScreenTypeEnum screenType;
+    double size;
+    double off[3];
+    double mult[3];
+    double erode;
+    double multi;
+    bool filt;
+    double level;
+};
+
+// the sizes of the filters along one axis, in pixels at the render scale
+struct PIKColorSizes
+{
+    double erode; // triangle filter of the ErodeBlur
+    double color; // quadratic filter of the color
+    double patchColor; // quadratic filter of the patch black color
+    int patchDilate; // radius of the dilate of the patch black mask
+    double patchBlur; // filter of the patch black mask
+    int patchBlurIter; // number of box filter iterations for patchBlur
+
+    PIKColorSizes(const PIKColorParams& params,
+                  double renderScale)
+    {
+        erode = 2 * std::abs(params.erode) * renderScale;
+        color = params.size * renderScale;
+        patchColor = params.size * 3 * params.multi * renderScale;
+        if (params.filt) {
+            patchDilate = (int)std::floor( (params.size / 5) * params.multi * 2 * renderScale );
+            // the Gaussian of the PyPlug is replaced by a quadratic filter of the same variance
+            const double sigma = (params.size / 5) * params.multi * 4 * renderScale / 2.4;
+            patchBlur = (sigma < 0.1) ? 0. : boxFilterSize(3, sigma * sigma);
+            patchBlurIter = 3;
+        } else {
+            patchDilate = (int)std::floor( (params.size / 5) * renderScale );
+            patchBlur = (params.size / 5) * 2 * renderScale;
+            patchBlurIter = 1;
+        }
+    }
+
+    // number of pixels on each side of the render window needed to compute it
+    int margin(bool patch) const
+    {
+        int m = boxFilterSupport(2, erode) + boxFilterSupport(3, color);
+
+        if (patch) {
+            // the pyramid level of each blur is at most the one given by the size along this axis
+            m += (std::max)( pyramidBoxFilterSupport( 3, patchColor, pyramidLevel(3, patchColor, patchColor, INT_MAX, INT_MAX) ),
+                             patchDilate + pyramidBoxFilterSupport( patchBlurIter, patchBlur, pyramidLevel(patchBlurIter, patchBlur, patchBlur, INT_MAX, INT_MAX) ) );
+        }
+
+        return m;
+    }
+
+    // the pyramid level on which the box filter of size (sx,sy), iterated iter times, is computed,
+    // given the size of the source RoD (so that it does not depend on the tiling)
+    static int pyramidLevel(int iter,
+                            double sx,
+                            double sy,
+                            int width,
+                            int height)
+    {
+        const double sigma = std::sqrt( (std::min)( boxFilterVariance(iter, sx), boxFilterVariance(iter, sy) ) );
+
+        return OFX::pyramidLevel(sigma, kPyramidMinSigma, kPyramidMinSize, width, height);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// multithread processing classes for the stages of the pipeline.
+// The intermediate images are planar float images covering the processed region,
+// each plane is a width x height array of floats, processed by a PlanarProcessorBase (see ofxsPyramid.h).
+
+// Grade the source and key it.
+// Writes the source color to rgb[0..2], and the inverted key (1 on the screen) to key.
+template <class PIX, int nComponents, int maxValue>
+class PIKColorSourceProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PIKColorSourceProcessor(ImageEffect &instance,
+                            const Image *srcImg,
+                            const Image *inMaskImg,
+                            const OfxRectI &region,
+                            const PIKColorParams &params,
+                            float* const *rgb,
+                            float *key)
+        : PlanarProcessorBase(instance, region.y2 - region.y1, region.x2 - region.x1)
+        , _srcImg(srcImg)
+        , _inMaskImg(inMaskImg)
+        , _region(region)
+        , _params(params)
+        , _rgb(rgb)
+        , _key(key)
+    {
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const int width = _region.x2 - _region.x1;
+        // the screen channel and the two other channels
+        const int cs = (_params.screenType == eScreenTypeGreen) ? 1 : 2;
+        const int c1 = 0;
+        const int c2 = (_params.screenType == eScreenTypeGreen) ? 2 : 1;
+
+        for (int l = begin; l < end; ++l) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            const int y = _region.y1 + l;
+            const std::size_t offset = (std::size_t)l * width;
+            for (int i = 0; i < width; ++i) {
+                const int x = _region.x1 + i;
+                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+                const PIX *inMaskPix = (const PIX *)  (_inMaskImg ? _inMaskImg->getPixelAddress(x, y) : 0);
+                float src[3] = {0.f, 0.f, 0.f};
+                if (srcPix) {
+                    for (int c = 0; c < 3; ++c) {
+                        src[c] = sampleToFloat<PIX, maxValue>(srcPix[c]);
+                    }
+                }
+                // grade (with clamp black), mix with the source, and clamp black
+                float g[3];
+                for (int c = 0; c < 3; ++c) {
+                    const float graded = (std::max)( 0.f, (float)(src[c] * _params.mult[c] + _params.off[c]) );
+                    g[c] = (std::max)( 0.f, (float)(src[c] + (graded - src[c]) * kGradeMix) );
+                }
+                // PIK with Fg = PFg = C: alpha is 0 where the key is positive, 1 elsewhere
+                const double pfgKey = (double)g[cs] - (double)g[c1] - (double)g[c2];
+                float alpha = (pfgKey > 0.) ? 0.f : 1.f;
+                if (inMaskPix) {
+                    const float inMask = (std::max)( 0.f, (std::min)(sampleToFloat<PIX, maxValue>(*inMaskPix), 1.f) );
+                    alpha = (std::max)(alpha, inMask);
+                }
+                for (int c = 0; c < 3; ++c) {
+                    _rgb[c][offset + i] = src[c];
+                }
+                _key[offset + i] = 1.f - alpha;
+            }
+        }
+    }
+
+    const Image *_srcImg;
+    const Image *_inMaskImg;
+    const OfxRectI _region;
+    const PIKColorParams &_params;
+    float* const *_rgb;
+    float *_key;
+};
+
+// Finish the ErodeBlur on the blurred key, which gives the output alpha, and premultiply the
+// color by it.
+class PIKColorErodeProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PIKColorErodeProcessor(ImageEffect &instance,
+                           int width,
+                           int height,
+                           double t0,
+                           double t1,
+                           float *key,
+                           float* const *rgba)
+        : PlanarProcessorBase(instance, height, width)
+        , _t0( (float)t0 )
+        , _t1( (float)t1 )
+        , _key(key)
+        , _rgba(rgba)
+    {
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const float scale = 1.f / (_t1 - _t0);
+
+        for (std::size_t i = (std::size_t)begin * _lineSize; i < (std::size_t)end * _lineSize; ++i) {
+            float v = _key[i];
+            v = (v < _t0) ? 0.f : ( (v > _t1) ? 1.f : (v - _t0) * scale );
+            _key[i] = v;
+            _rgba[0][i] *= v;
+            _rgba[1][i] *= v;
+            _rgba[2][i] *= v;
+            _rgba[3][i] = v;
+        }
+    }
+
+    const float _t0;
+    const float _t1;
+    float *_key;
+    float* const *_rgba;
+};
+
+// Unpremultiply the blurred color and compute the screen mask, which replaces the alpha.
+// If patchMask is not NULL, the inverse of the screen mask is written to it.
+class PIKColorScreenMaskProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PIKColorScreenMaskProcessor(ImageEffect &instance,
+                                int width,
+                                int height,
+                                ScreenTypeEnum screenType,
+                                float* const *rgba,
+                                float *patchMask)
+        : PlanarProcessorBase(instance, height, width)
+        , _cs( (screenType == eScreenTypeGreen) ? 1 : 2 )
+        , _rgba(rgba)
+        , _patchMask(patchMask)
+    {
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        for (std::size_t i = (std::size_t)begin * _lineSize; i < (std::size_t)end * _lineSize; ++i) {
+            const float a = _rgba[3][i];
+            if (a > FLT_EPSILON) {
+                _rgba[0][i] /= a;
+                _rgba[1][i] /= a;
+                _rgba[2][i] /= a;
+            }
+            const float m = (_rgba[_cs][i] > 0.f) ? 1.f : 0.f;
+            _rgba[3][i] = m;
+            if (_patchMask) {
+                _patchMask[i] = 1.f - m;
+            }
+        }
+    }
+
+    const int _cs;
+    float* const *_rgba;
+    float *_patchMask;
+};
+
+enum LineFilterEnum
+{
+    eLineFilterBox = 0, // box filter of size 'size', iterated 'iter' times, black outside
+    eLineFilterMax, // max over [x-size,x+size], clipped to the line
+};
+
+// Filter each row (or each column) of the planes.
+// Columns are processed by blocks of kColumnBlockSize, which are transposed to contiguous lines.
+class PIKColorLineFilterProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PIKColorLineFilterProcessor(ImageEffect &instance,
+                                float* const *planes,
+                                int nPlanes,
+                                int width,
+                                int height,
+                                bool rows,
+                                LineFilterEnum filter,
+                                double size,
+                                int iter)
+        : PlanarProcessorBase(instance,
+                                rows ? height : (width + kColumnBlockSize - 1) / kColumnBlockSize,
+                                rows ? width : height * kColumnBlockSize)
+        , _planes(planes)
+        , _nPlanes(nPlanes)
+        , _width(width)
+        , _height(height)
+        , _rows(rows)
+        , _filter(filter)
+        , _size(size)
+        , _iter(iter)
+    {
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const int n = _rows ? _width : _height;
+        std::vector<float> lines( (std::size_t)(_rows ? 1 : kColumnBlockSize) * n );
+        std::vector<float> tmp1, tmp2;
+        std::vector<double> sum;
+
+        for (int l = begin; l < end; ++l) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            for (int p = 0; p < _nPlanes; ++p) {
+                float *plane = _planes[p];
+                if (_rows) {
+                    filterLine(plane + (std::size_t)l * _width, n, tmp1, tmp2, sum);
+                } else {
+                    const int x0 = l * kColumnBlockSize;
+                    const int nb = (std::min)(kColumnBlockSize, _width - x0);
+                    for (int y = 0; y < n; ++y) {
+                        const float *pix = plane + (std::size_t)y * _width + x0;
+                        for (int b = 0; b < nb; ++b) {
+                            lines[(std::size_t)b * n + y] = pix[b];
+                        }
+                    }
+                    for (int b = 0; b < nb; ++b) {
+                        filterLine(&lines[(std::size_t)b * n], n, tmp1, tmp2, sum);
+                    }
+                    for (int y = 0; y < n; ++y) {
+                        float *pix = plane + (std::size_t)y * _width + x0;
+                        for (int b = 0; b < nb; ++b) {
+                            pix[b] = lines[(std::size_t)b * n + y];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    void filterLine(float *v,
+                    int n,
+                    std::vector<float> &tmp1,
+                    std::vector<float> &tmp2,
+                    std::vector<double> &sum) const
+    {
+        if (_filter == eLineFilterBox) {
+            boxFilterLine(v, n, tmp1, sum);
+        } else {
+            maxFilterLine(v, n, tmp1, tmp2);
+        }
+    }
+
+    // Same as the box filter of CImg: for a non-integer size, the two samples next to the
+    // window are weighted by the fractional part.
+    void boxFilterLine(float *v,
+                       int n,
+                       std::vector<float> &src,
+                       std::vector<double> &sum) const
+    {
+        if ( (_size <= 1) || (_iter <= 0) ) {
+            return;
+        }
+        const int w2 = (int)(_size - 1) / 2;
+        const double frac = ( _size - (2 * w2 + 1) ) / 2.;
+        const double norm = 1. / _size;
+        src.resize(n);
+        sum.resize(n + 1);
+        for (int iter = 0; iter < _iter; ++iter) {
+            // sum[i] is the sum of the first i samples
+            sum[0] = 0.;
+            for (int i = 0; i < n; ++i) {
+                src[i] = v[i];
+                sum[i + 1] = sum[i] + v[i];
+            }
+            for (int i = 0; i < n; ++i) {
+                const int a = i - w2;
+                const int b = i + w2;
+                double s = sum[(std::min)(b + 1, n)] - sum[(std::max)(a, 0)];
+                if (frac > 0.) {
+                    s += frac * ( (a > 0 ? src[a - 1] : 0.f) + (b + 1 < n ? src[b + 1] : 0.f) );
+                }
+                v[i] = (float)(s * norm);
+            }
+        }
+    }
+
+    // van Herk/Gil-Werman algorithm: the line is padded with -FLT_MAX, and cut into blocks of
+    // size k = 2*size+1. The max over each window is the max of the suffix max of the block
+    // of its first sample and of the prefix max of the block of its last sample.
+    void maxFilterLine(float *v,
+                       int n,
+                       std::vector<float> &prefix,
+                       std::vector<float> &suffix) const
+    {
+        const int r = (int)_size;
+
+        if (r <= 0) {
+            return;
+        }
+        const int k = 2 * r + 1;
+        const int m = n + 2 * r;
+        prefix.resize(m);
+        suffix.resize(m);
+        for (int i = 0; i < m; ++i) {
+            const int j = i - r;
+            prefix[i] = (j >= 0 && j < n) ? v[j] : -FLT_MAX;
+        }
+        for (int i = 0; i < m; ++i) {
+            suffix[i] = prefix[i];
+        }
+        for (int i = 1; i < m; ++i) {
+            if (i % k != 0) {
+                prefix[i] = (std::max)(prefix[i], prefix[i - 1]);
+            }
+        }
+        for (int i = m - 2; i >= 0; --i) {
+            if ( (i + 1) % k != 0 ) {
+                suffix[i] = (std::max)(suffix[i], suffix[i + 1]);
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            v[i] = (std::max)(suffix[i], prefix[i + 2 * r]);
+        }
+    }
+
+    float* const *_planes;
+    const int _nPlanes;
+    const int _width;
+    const int _height;
+    const bool _rows;
+    const LineFilterEnum _filter;
+    const double _size;
+    const int _iter;
+};
+
+// Merge the patch black color over the color, apply the level, and write the result.
+// rgbm holds the color and the screen mask, E the eroded key.
+// If patch is not NULL, it holds the blurred color and screen mask, and the patch mask.
+template <class PIX, int maxValue>
+class PIKColorOutputProcessor
+    : public PlanarProcessorBase
+{
+public:
+    PIKColorOutputProcessor(ImageEffect &instance,
+                            Image *dstImg,
+                            const OfxRectI &renderWindow,
+                            const OfxRectI &region,
+                            float* const *rgbm,
+                            const float *key,
+                            float* const *patch,
+                            double level)
+        : PlanarProcessorBase(instance, renderWindow.y2 - renderWindow.y1, renderWindow.x2 - renderWindow.x1)
+        , _dstImg(dstImg)
+        , _renderWindow(renderWindow)
+        , _region(region)
+        , _rgbm(rgbm)
+        , _key(key)
+        , _patch(patch)
+        , _level( (float)level )
+    {
+    }
+
+private:
+    virtual void processLines(int begin,
+                              int end) OVERRIDE FINAL
+    {
+        const int regionWidth = _region.x2 - _region.x1;
+
+        for (int l = begin; l < end; ++l) {
+            if ( _effect.abort() ) {
+                return;
+            }
+            const int y = _renderWindow.y1 + l;
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(_renderWindow.x1, y);
+            assert(dstPix);
+            for (int x = _renderWindow.x1; x < _renderWindow.x2; ++x, dstPix += 4) {
+                if ( (x < _region.x1) || (x >= _region.x2) || (y < _region.y1) || (y >= _region.y2) ) {
+                    // outside of the source RoD
+                    for (int c = 0; c < 4; ++c) {
+                        dstPix[c] = PIX();
+                    }
+                    continue;
+                }
+                const std::size_t i = (std::size_t)(y - _region.y1) * regionWidth + (x - _region.x1);
+                float out[3] = { _rgbm[0][i], _rgbm[1][i], _rgbm[2][i] };
+                if (_patch) {
+                    // unpremult the patch color, merge it over the color using the patch mask, and unpremult
+                    const float a = _patch[3][i];
+                    const float inva = (a > FLT_EPSILON) ? 1.f / a : 1.f;
+                    const float sw = _patch[4][i];
+                    const float alpha = sw + _rgbm[3][i] * (1.f - sw);
+                    for (int c = 0; c < 3; ++c) {
+                        out[c] = _patch[c][i] * inva * sw + out[c] * (1.f - sw);
+                        if (alpha > FLT_EPSILON) {
+                            out[c] /= alpha;
+                        }
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    dstPix[c] = floatToSample<PIX, maxValue>( (std::max)(0.f, out[c] * _level) );
+                }
+                dstPix[3] = floatToSample<PIX, maxValue>(_key[i]);
+            }
+        }
+    }
+
+    Image *_dstImg;
+    const OfxRectI _renderWindow;
+    const OfxRectI _region;
+    float* const *_rgbm;
+    const float *_key;
+    float* const *_patch;
+    const float _level;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/** @brief The plugin that does our work */
+class PIKColorPlugin
+    : public ImageEffect
+{
+public:
+    /** @brief ctor */
+    PIKColorPlugin(OfxImageEffectHandle handle)
+        : ImageEffect(handle)
+        , _dstClip(NULL)
+        , _srcClip(NULL)
+        , _inMaskClip(NULL)
+        , _screenType(NULL)
+        , _size(NULL)
+        , _off(NULL)
+        , _mult(NULL)
+        , _erode(NULL)
+        , _multi(NULL)
+        , _filt(NULL)
+        , _level(NULL)
+    {
+        _dstClip = fetchClip(kOfxImageEffectOutputClipName);
+        assert( _dstClip && (!_dstClip->isConnected() || _dstClip->getPixelComponents() == ePixelComponentRGBA) );
+        _srcClip = getContext() == eContextGenerator ? NULL : fetchClip(kOfxImageEffectSimpleSourceClipName);
+        assert( ( !_srcClip && getContext() == eContextGenerator ) ||
+                ( _srcClip && (!_srcClip->isConnected() || _srcClip->getPixelComponents() ==  ePixelComponentRGB ||
+                               _srcClip->getPixelComponents() == ePixelComponentRGBA) ) );
+        _inMaskClip = fetchClip(kClipInsideMask);
+        assert( _inMaskClip && (!_inMaskClip->isConnected() || _inMaskClip->getPixelComponents() == ePixelComponentAlpha) );
+
+        _screenType = fetchChoiceParam(kParamScreenType);
+        _size = fetchDoubleParam(kParamSize);
+        _off = fetchRGBParam(kParamOff);
+        _mult = fetchRGBParam(kParamMult);
+        _erode = fetchDoubleParam(kParamErode);
+        _multi = fetchDoubleParam(kParamMulti);
+        _filt = fetchBooleanParam(kParamFilt);
+        _level = fetchDoubleParam(kParamLevel);
+        assert(_screenType && _size && _off && _mult && _erode && _multi && _filt && _level);
+    }
+
+private:
+    /* Override the render */
+    virtual void render(const RenderArguments &args) OVERRIDE FINAL;
+
+    /** @brief the get RoI action */
+    virtual void getRegionsOfInterest(const RegionsOfInterestArguments &args, RegionOfInterestSetter &rois) OVERRIDE FINAL;
+
+    /** @brief get the region of definition */
+    virtual bool getRegionOfDefinition(const RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
+
+    /** @brief get the clip preferences */
+    virtual void getClipPreferences(ClipPreferencesSetter &clipPreferences) OVERRIDE FINAL;
+
+    template<class PIX, int maxValue>
+    void renderForBitDepth(const RenderArguments &args);
+
+    template<class PIX, int nComponents, int maxValue>
+    void processSource(const Image *src,
+                       const Image *inMask,
+                       const OfxRectI &region,
+                       const PIKColorParams &params,
+                       float* const *rgb,
+                       float *key);
+
+    void getValuesAtTime(double time, PIKColorParams *params);
+
+    void filter(float* const *planes, int nPlanes, int width, int height, LineFilterEnum filter, double sx, double sy, int iter);
+
+    void blurPyramid(float* const *src, float* const *dst, int nPlanes, const OfxRectI &region, const OfxRectI &srcRoD, double sx, double sy, int iter);
+
+private:
+    // do not need to delete these, the ImageEffect is managing them for us
+    Clip *_dstClip;
+    Clip *_srcClip;
+    Clip *_inMaskClip;
+    ChoiceParam* _screenType;
+    DoubleParam* _size;
+    RGBParam* _off;
+    RGBParam* _mult;
+    DoubleParam* _erode;
+    DoubleParam* _multi;
+    BooleanParam* _filt;
+    DoubleParam* _level;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////
+/** @brief render for the filter */
+
+////////////////////////////////////////////////////////////////////////////////
+// basic plugin render function, just a skelington to instantiate templates from
+
+void
+PIKColorPlugin::getValuesAtTime(double time,
+                                PIKColorParams *params)
+{
+    params->screenType = (ScreenTypeEnum)_screenType->getValueAtTime(time);
+    params->size = (std::max)( 0., _size->getValueAtTime(time) );
+    _off->getValueAtTime(time, params->off[0], params->off[1], params->off[2]);
+    _mult->getValueAtTime(time, params->mult[0], params->mult[1], params->mult[2]);
+    params->erode = (std::max)( 0., _erode->getValueAtTime(time) );
+    params->multi = (std::max)( 0., _multi->getValueAtTime(time) );
+    params->filt = _filt->getValueAtTime(time);
+    params->level = _level->getValueAtTime(time);
+}
+
+// filter the planes along x with size sx, then along y with size sy
+void
+PIKColorPlugin::filter(float* const *planes,
+                       int nPlanes,
+                       int width,
+                       int height,
+                       LineFilterEnum filter,
+                       double sx,
+                       double sy,
+                       int iter)
+{
+    {
+        PIKColorLineFilterProcessor processor(*this, planes, nPlanes, width, height, true, filter, sx, iter);
+        processor.process();
+    }
+    if ( abort() ) {
+        return;
+    }
+    {
+        PIKColorLineFilterProcessor processor(*this, planes, nPlanes, width, height, false, filter, sy, iter);
+        processor.process();
+    }
+}
+
+// Blur src, which covers region, with the box filter of size (sx,sy) iterated iter times, and put
+// the result in dst (which may be the same as src).
+// The blur is computed on the coarsest pyramid level where it is well sampled, and the blur
+// size is reduced to compensate for the blur introduced by the reductions (see ofxsPyramid.h).
+// The level is chosen from the size of the source RoD, and the levels are aligned on absolute
+// pixel coordinates, so that the result does not depend on the region.
+void
+PIKColorPlugin::blurPyramid(float* const *src,
+                            float* const *dst,
+                            int nPlanes,
+                            const OfxRectI &region,
+                            const OfxRectI &srcRoD,
+                            double sx,
+                            double sy,
+                            int iter)
+{
+    const int width = region.x2 - region.x1;
+    const int height = region.y2 - region.y1;
+    const int maxLevel = PIKColorSizes::pyramidLevel(iter, sx, sy, srcRoD.x2 - srcRoD.x1, srcRoD.y2 - srcRoD.y1);
+
+    if (maxLevel == 0) {
+        if (src != dst) {
+            for (int p = 0; p < nPlanes; ++p) {
+                std::copy(src[p], src[p] + (std::size_t)width * height, dst[p]);
+            }
+        }
+        filter(dst, nPlanes, width, height, eLineFilterBox, sx, sy, iter);
+
+        return;
+    }
+
+    // the levels 1..maxLevel are stored in one buffer
+    std::vector<OfxRectI> bounds(maxLevel + 1);
+    std::vector<std::size_t> offsets(maxLevel + 1);
+    std::size_t nPixels = 0;
+    bounds[0] = region;
+    for (int k = 1; k <= maxLevel; ++k) {
+        bounds[k] = pyramidReduceBounds(bounds[k - 1]);
+        offsets[k] = nPixels;
+        nPixels += (std::size_t)(bounds[k].x2 - bounds[k].x1) * (bounds[k].y2 - bounds[k].y1) * nPlanes;
+    }
+    auto_ptr<ImageMemory> mem( new ImageMemory(nPixels * sizeof(float), this) );
+    float *data = (float*)mem->lock();
+    if (!data) {
+        throwSuiteStatusException(kOfxStatErrMemory);
+    }
+    std::vector<std::vector<float*> > levels(maxLevel + 1);
+    levels[0].assign(src, src + nPlanes);
+    for (int k = 1; k <= maxLevel; ++k) {
+        const std::size_t levelSize = (std::size_t)(bounds[k].x2 - bounds[k].x1) * (bounds[k].y2 - bounds[k].y1);
+        levels[k].resize(nPlanes);
+        for (int p = 0; p < nPlanes; ++p) {
+            levels[k][p] = data + offsets[k] + p * levelSize;
+        }
+    }
+
+    for (int k = 1; k <= maxLevel; ++k) {
+        PyramidReduceProcessor processor(*this, &levels[k - 1][0], bounds[k - 1], &levels[k][0], nPlanes);
+        processor.process();
+        if ( abort() ) {
+            return;
+        }
+    }
+
+    const double lsx = boxFilterSize( iter, pyramidLevelVariance(boxFilterVariance(iter, sx), maxLevel) );
+    const double lsy = boxFilterSize( iter, pyramidLevelVariance(boxFilterVariance(iter, sy), maxLevel) );
+    filter(&levels[maxLevel][0], nPlanes, bounds[maxLevel].x2 - bounds[maxLevel].x1, bounds[maxLevel].y2 - bounds[maxLevel].y1, eLineFilterBox, lsx, lsy, iter);
+
+    // expand back to level 0, into dst
+    levels[0].assign(dst, dst + nPlanes);
+    for (int k = maxLevel; k > 0; --k) {
+        if ( abort() ) {
+            return;
+        }
+        PyramidExpandProcessor processor(*this, &levels[k][0], bounds[k], &levels[k - 1][0], bounds[k - 1], nPlanes);
+        processor.process();
+    }
+} // PIKColorPlugin::blurPyramid
+
+template<class PIX, int nComponents, int maxValue>
+void
+PIKColorPlugin::processSource(const Image *src,
+                              const Image *inMask,
+                              const OfxRectI &region,
+                              const PIKColorParams &params,
+                              float* const *rgb,
+                              float *key)
+{
+    PIKColorSourceProcessor<PIX, nComponents, maxValue> processor(*this, src, inMask, region, params, rgb, key);
+    processor.process();
+}
+
+template<class PIX, int maxValue>
+void
+PIKColorPlugin::renderForBitDepth(const RenderArguments &args)
+{
+    const double time = args.time;
+
+    auto_ptr<Image> dst( _dstClip->fetchImage(time) );
+
+    if ( !dst.get() ) {
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    BitDepthEnum dstBitDepth    = dst->getPixelDepth();
+    PixelComponentEnum dstComponents  = dst->getPixelComponents();
+    if ( ( dstBitDepth != _dstClip->getPixelDepth() ) ||
+         ( dstComponents != _dstClip->getPixelComponents() ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong depth or components");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    if ( (dst->getRenderScale().x != args.renderScale.x) ||
+         ( dst->getRenderScale().y != args.renderScale.y) ||
+         ( ( dst->getField() != eFieldNone) /* for DaVinci Resolve */ && ( dst->getField() != args.fieldToRender) ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    auto_ptr<const Image> src( ( _srcClip && _srcClip->isConnected() ) ?
+                               _srcClip->fetchImage(time) : 0 );
+    if ( src.get() ) {
+        if ( (src->getRenderScale().x != args.renderScale.x) ||
+             ( src->getRenderScale().y != args.renderScale.y) ||
+             ( ( src->getField() != eFieldNone) /* for DaVinci Resolve */ && ( src->getField() != args.fieldToRender) ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+        BitDepthEnum srcBitDepth      = src->getPixelDepth();
+        if (srcBitDepth != dstBitDepth) {
+            throwSuiteStatusException(kOfxStatErrImageFormat);
+        }
+    }
+    auto_ptr<const Image> inMask( ( _inMaskClip && _inMaskClip->isConnected() ) ?
+                                  _inMaskClip->fetchImage(time) : 0 );
+    if ( inMask.get() ) {
+        if ( (inMask->getRenderScale().x != args.renderScale.x) ||
+             ( inMask->getRenderScale().y != args.renderScale.y) ||
+             ( ( inMask->getField() != eFieldNone) /* for DaVinci Resolve */ && ( inMask->getField() != args.fieldToRender) ) ) {
+            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+            throwSuiteStatusException(kOfxStatFailed);
+        }
+    }
+
+    PIKColorParams params;
+    getValuesAtTime(time, &params);
+    const bool patch = (params.multi > 0.);
+    const PIKColorSizes sizesX(params, args.renderScale.x);
+    const PIKColorSizes sizesY(params, args.renderScale.y);
+
+    // the processed region: the render window plus the support of the filters, inside the source RoD
+    // (the filters are black outside of the source RoD)
+    OfxRectI region = {0, 0, 0, 0};
+    OfxRectI srcRoD = {0, 0, 0, 0};
+    if ( src.get() ) {
+        Coords::toPixelEnclosing(_srcClip->getRegionOfDefinition(time), args.renderScale, _srcClip->getPixelAspectRatio(), &srcRoD);
+        OfxRectI window = args.renderWindow;
+        const int mx = sizesX.margin(patch);
+        const int my = sizesY.margin(patch);
+        window.x1 -= mx;
+        window.x2 += mx;
+        window.y1 -= my;
+        window.y2 += my;
+        if ( !Coords::rectIntersection<OfxRectI>(window, srcRoD, &region) ) {
+            region.x1 = region.x2 = region.y1 = region.y2 = 0;
+        }
+    }
+    const int width = region.x2 - region.x1;
+    const int height = region.y2 - region.y1;
+
+    if ( (width <= 0) || (height <= 0) ) {
+        // nothing to process: the output is black and transparent
+        PIKColorOutputProcessor<PIX, maxValue> processor(*this, dst.get(), args.renderWindow, region, NULL, NULL, NULL, params.level);
+        processor.process();
+
+        return;
+    }
+
+    // the planes: color and screen mask (4), eroded key (1), patch black color (4) and mask (1)
+    const std::size_t planeSize = (std::size_t)width * height;
+    const int nPlanes = patch ? 10 : 5;
+    auto_ptr<ImageMemory> mem( new ImageMemory(nPlanes * planeSize * sizeof(float), this) );
+    float *data = (float*)mem->lock();
+    if (!data) {
+        throwSuiteStatusException(kOfxStatErrMemory);
+    }
+    float *rgba[4];
+    float *patchPlanes[5];
+    for (int p = 0; p < 4; ++p) {
+        rgba[p] = data + p * planeSize;
+    }
+    float *key = data + 4 * planeSize;
+    for (int p = 0; p < 5; ++p) {
+        patchPlanes[p] = patch ? data + (5 + p) * planeSize : NULL;
+    }
+
+    // grade and key the source
+    if (src.get() && src->getPixelComponents() == ePixelComponentRGB) {
+        processSource<PIX, 3, maxValue>(src.get(), inMask.get(), region, params, rgba, key);
+    } else {
+        processSource<PIX, 4, maxValue>(src.get(), inMask.get(), region, params, rgba, key);
+    }
+    if ( abort() ) {
+        return;
+    }
+
+    // erode the key (ErodeBlur), and premultiply the color by the result
+    filter(&key, 1, width, height, eLineFilterBox, sizesX.erode, sizesY.erode, 2);
+    if ( abort() ) {
+        return;
+    }
+    {
+        // the thresholds do not depend on the render scale (same as ErodeBlur)
+        const double t0 = blurredStep(2 * params.erode, params.erode - 0.5);
+        const double t1 = blurredStep(2 * params.erode, params.erode + 0.5);
+        PIKColorErodeProcessor processor(*this, width, height, t0, t1, key, rgba);
+        processor.process();
+    }
+    if ( abort() ) {
+        return;
+    }
+
+    // blur the color, unpremultiply, and compute the screen mask
+    filter(rgba, 4, width, height, eLineFilterBox, sizesX.color, sizesY.color, 3);
+    if ( abort() ) {
+        return;
+    }
+    {
+        PIKColorScreenMaskProcessor processor(*this, width, height, params.screenType, rgba, patchPlanes[4]);
+        processor.process();
+    }
+    if ( abort() ) {
+        return;
+    }
+
+    if (patch) {
+        // patch black: blur the color and mask over a large area
+        blurPyramid(rgba, patchPlanes, 4, region, srcRoD, sizesX.patchColor, sizesY.patchColor, 3);
+        if ( abort() ) {
+            return;
+        }
+        // and compute the mask where it is merged over the color
+        filter(&patchPlanes[4], 1, width, height, eLineFilterMax, sizesX.patchDilate, sizesY.patchDilate, 1);
+        if ( abort() ) {
+            return;
+        }
+        blurPyramid(&patchPlanes[4], &patchPlanes[4], 1, region, srcRoD, sizesX.patchBlur, sizesY.patchBlur, sizesX.patchBlurIter);
+        if ( abort() ) {
+            return;
+        }
+    }
+
+    PIKColorOutputProcessor<PIX, maxValue> processor(*this, dst.get(), args.renderWindow, region, rgba, key, patch ? patchPlanes : NULL, params.level);
+    processor.process();
+} // PIKColorPlugin::renderForBitDepth
+
+// the overridden render function
+void
+PIKColorPlugin::render(const RenderArguments &args)
+{
+    // instantiate the render code based on the pixel depth of the dst clip
+    BitDepthEnum dstBitDepth    = _dstClip->getPixelDepth();
+    PixelComponentEnum dstComponents  = _dstClip->getPixelComponents();
+
+    assert( kSupportsMultipleClipPARs   || !_srcClip || !_srcClip->isConnected() || _srcClip->getPixelAspectRatio() == _dstClip->getPixelAspectRatio() );
+    assert( kSupportsMultipleClipDepths || !_srcClip || !_srcClip->isConnected() || _srcClip->getPixelDepth()       == _dstClip->getPixelDepth() );
+    if (dstComponents != ePixelComponentRGBA) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host dit not take into account output components");
+        throwSuiteStatusException(kOfxStatErrImageFormat);
+
+        return;
+    }
+
+    switch (dstBitDepth) {
+    case eBitDepthUByte:
+        renderForBitDepth<unsigned char, 255>(args);
+        break;
+    case eBitDepthUShort:
+        renderForBitDepth<unsigned short, 65535>(args);
+        break;
+    case eBitDepthFloat:
+        renderForBitDepth<float, 1>(args);
+        break;
+    default:
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+    }
+}
+
+/** @brief the get RoI action */
+void
+PIKColorPlugin::getRegionsOfInterest(const RegionsOfInterestArguments &args,
+                                     RegionOfInterestSetter &rois)
+{
+    if ( Coords::rectIsEmpty(args.regionOfInterest) || !_srcClip ) {
+        return;
+    }
+    const double time = args.time;
+    PIKColorParams params;
+    getValuesAtTime(time, &params);
+    const bool patch = (params.multi > 0.);
+    const double par = _srcClip->getPixelAspectRatio();
+    const PIKColorSizes sizesX(params, args.renderScale.x);
+    const PIKColorSizes sizesY(params, args.renderScale.y);
+    OfxRectD roi = args.regionOfInterest;
+    const double mx = sizesX.margin(patch) * par / args.renderScale.x;
+    const double my = sizesY.margin(patch) / args.renderScale.y;
+
+    roi.x1 -= mx;
+    roi.x2 += mx;
+    roi.y1 -= my;
+    roi.y2 += my;
+
+    // intersect the roi with the rod of the source clip (see PIK)
+    const OfxRectD emptyRoD = {0, 0, 1, 1}; // Nuke's reader issues an "out of memory" error when asked for an empty RoD
+    OfxRectD srcRoD = _srcClip->getRegionOfDefinition(time);
+    if ( !Coords::rectIntersection(srcRoD, roi, &roi) ) {
+        roi = emptyRoD;
+    }
+    rois.setRegionOfInterest(*_srcClip, roi);
+    rois.setRegionOfInterest(*_inMaskClip, roi);
+}
+
+bool
+PIKColorPlugin::getRegionOfDefinition(const RegionOfDefinitionArguments &args,
+                                      OfxRectD &rod)
+{
+    if ( !_srcClip || !_srcClip->isConnected() ) {
+        return false;
+    }
+    // same as the source, the inside mask does not extend the RoD
+    rod = _srcClip->getRegionOfDefinition(args.time);
+
+    return true;
+}
+
+/* Override the clip preferences */
+void
+PIKColorPlugin::getClipPreferences(ClipPreferencesSetter &clipPreferences)
+{
+    // the output alpha is the eroded key, the color is not premultiplied by it
+    clipPreferences.setOutputPremultiplication(eImageUnPreMultiplied);
+
+    // Output is RGBA
+    clipPreferences.setClipComponents(*_dstClip, ePixelComponentRGBA);
+}
+
+mDeclarePluginFactory(PIKColorPluginFactory, {ofxsThreadSuiteCheck();}, {});
+void
+PIKColorPluginFactory::describe(ImageEffectDescriptor &desc)
+{
+    // basic labels
+    desc.setLabel(kPluginName);
+    desc.setPluginGrouping(kPluginGrouping);
+    desc.setPluginDescription(kPluginDescription);
+
+    desc.addSupportedContext(eContextFilter);
+    desc.addSupportedContext(eContextGeneral);
+    desc.addSupportedBitDepth(eBitDepthUByte);
+    desc.addSupportedBitDepth(eBitDepthUShort);
+    desc.addSupportedBitDepth(eBitDepthFloat);
+
+    // set a few flags
+    desc.setSingleInstance(false);
+    desc.setHostFrameThreading(false);
+    desc.setSupportsMultiResolution(kSupportsMultiResolution);
+    desc.setSupportsTiles(kSupportsTiles);
+    desc.setTemporalClipAccess(false);
+    desc.setRenderTwiceAlways(false);
+    desc.setSupportsMultipleClipPARs(kSupportsMultipleClipPARs);
+    desc.setSupportsMultipleClipDepths(kSupportsMultipleClipDepths);
+    desc.setRenderThreadSafety(kRenderThreadSafety);
+#ifdef OFX_EXTENSIONS_NATRON
+    desc.setChannelSelector(ePixelComponentNone);
+#endif
+}
+
+void
+PIKColorPluginFactory::describeInContext(ImageEffectDescriptor &desc,
+                                         ContextEnum /*context*/)
+{
+    {
+        ClipDescriptor* clip = desc.defineClip(kOfxImageEffectSimpleSourceClipName);
+        clip->addSupportedComponent( ePixelComponentRGBA );
+        clip->addSupportedComponent( ePixelComponentRGB );
+        clip->setTemporalClipAccess(false);
+        clip->setSupportsTiles(kSupportsTiles);
+        clip->setOptional(false);
+    }
+    {
+        // inside mask clip (core matte)
+        ClipDescriptor *clip =  desc.defineClip(kClipInsideMask);
+        clip->setHint(kClipInsideMaskHint);
+        clip->addSupportedComponent(ePixelComponentAlpha);
+        clip->setTemporalClipAccess(false);
+        clip->setOptional(true);
+        clip->setSupportsTiles(kSupportsTiles);
+        clip->setIsMask(true);
+    }
+    {
+        ClipDescriptor *clip = desc.defineClip(kOfxImageEffectOutputClipName);
+        clip->addSupportedComponent(ePixelComponentRGBA);
+        clip->setSupportsTiles(kSupportsTiles);
+    }
+
+    // make some pages and to things in
+    PageParamDescriptor *page = desc.definePageParam("Controls");
+
+    {
+        ChoiceParamDescriptor* param = desc.defineChoiceParam(kParamScreenType);
+        param->setLabel(kParamScreenTypeLabel);
+        param->setHint(kParamScreenTypeHint);
+        assert(param->getNOptions() == (int)eScreenTypeGreen);
+        param->appendOption(kParamScreenTypeOptionGreen);
+        assert(param->getNOptions() == (int)eScreenTypeBlue);
+        param->appendOption(kParamScreenTypeOptionBlue);
+        param->setDefault( (int)kParamScreenTypeDefault );
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamSize);
+        param->setLabel(kParamSizeLabel);
+        param->setHint(kParamSizeHint);
+        param->setRange(0., DBL_MAX);
+        param->setDisplayRange(0., 100.);
+        param->setDefault(kParamSizeDefault);
+        param->setAnimates(true);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        RGBParamDescriptor* param = desc.defineRGBParam(kParamOff);
+        param->setLabel(kParamOffLabel);
+        param->setHint(kParamOffHint);
+        param->setDefault(0., 0., 0.);
+        param->setRange(-DBL_MAX, -DBL_MAX, -DBL_MAX, DBL_MAX, DBL_MAX, DBL_MAX);
+        param->setDisplayRange(-1., -1., -1., 1., 1., 1.);
+        param->setAnimates(true);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        RGBParamDescriptor* param = desc.defineRGBParam(kParamMult);
+        param->setLabel(kParamMultLabel);
+        param->setHint(kParamMultHint);
+        param->setDefault(1., 1., 1.);
+        param->setRange(0., 0., 0., DBL_MAX, DBL_MAX, DBL_MAX);
+        param->setDisplayRange(0., 0., 0., 2., 2., 2.);
+        param->setAnimates(true);
+        param->setLayoutHint(eLayoutHintDivider);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamErode);
+        param->setLabel(kParamErodeLabel);
+        param->setHint(kParamErodeHint);
+        param->setRange(0., DBL_MAX);
+        param->setDisplayRange(0., 5.);
+        param->setDefault(0.);
+        param->setAnimates(true);
+        param->setLayoutHint(eLayoutHintDivider);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamMulti);
+        param->setLabel(kParamMultiLabel);
+        param->setHint(kParamMultiHint);
+        param->setRange(0., DBL_MAX);
+        param->setDisplayRange(0., 5.);
+        param->setDefault(0.);
+        param->setAnimates(true);
+        param->setLayoutHint(eLayoutHintNoNewLine, 1);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamFilt);
+        param->setLabel(kParamFiltLabel);
+        param->setHint(kParamFiltHint);
+        param->setDefault(kParamFiltDefault);
+        param->setAnimates(true);
+        param->setLayoutHint(eLayoutHintDivider);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+    {
+        DoubleParamDescriptor* param = desc.defineDoubleParam(kParamLevel);
+        param->setLabel(kParamLevelLabel);
+        param->setHint(kParamLevelHint);
+        param->setRange(-DBL_MAX, DBL_MAX);
+        param->setDisplayRange(0., 1.);
+        param->setDefault(kParamLevelDefault);
+        param->setAnimates(true);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+} // PIKColorPluginFactory::describeInContext
+
+ImageEffect*
+PIKColorPluginFactory::createInstance(OfxImageEffectHandle handle,
+                                      ContextEnum /*context*/)
+{
+    return new PIKColorPlugin(handle);
+}
+
+static PIKColorPluginFactory p(kPluginIdentifier, kPluginVersionMajor, kPluginVersionMinor);
+mRegisterPluginFactoryInstance(p)
+
+OFXS_NAMESPACE_ANONYMOUS_EXIT
@@ -22,6 +22,7 @@
 
 #include <cmath>
 #include <algorithm>
+#include <vector>
 //#include <iostream>
 
 #include "ofxsProcessing.H"
@@ -29,6 +30,22 @@
 #include "ofxsCoords.h"
 #include "ofxsMacros.h"
 #include "ofxsThreadSuite.h"
+#include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+    typedef MultiThread::Mutex Mutex;
+    typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+    typedef tthread::fast_mutex Mutex;
+    typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
+#include "ofxsTransferLUT.h"
 
 using namespace OFX;
 
@@ -44,8 +61,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginIdentifier "net.sf.openfx.PLogLin"
 // History:
 // version 1.0: initial version
+// version 1.1: lookup tables for 8-bit and 16-bit images, fast approximation for float images, added exact parameter
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -165,6 +183,42 @@ enum OperationEnum
 #define kParamDensityHint "Density per code value. The change in the negative gamma for each log space code value. This is usually left to the default value of 0.002."
 #define kParamDensityDefault 0.002
 
+#define kParamExact "exact"
+#define kParamExactLabel "Exact"
+#define kParamExactHint "Compute the conversion with the exact formula for each pixel, in double precision. " \
+    "If unchecked, 8-bit and 16-bit images use lookup tables computed once for each set of parameters (unless Unpremult is checked), " \
+    "and floating-point images use a fast approximation, which has a relative error below 1.5e-6 with the default parameters."
+#define kParamExactDefault true
+
+// the conversion formulas as TransferCurves
+static void
+getTransferCurves(OperationEnum operation,
+                  const double linRef[3],
+                  const double logRef[3],
+                  const double nGamma[3],
+                  const double density[3],
+                  TransferCurve curve[3])
+{
+    for (int c = 0; c < 3; ++c) {
+        if (operation == eOperationLog2Lin) {
+            // xLin = linRef * pow( 10.0, (xLog * 1023. - logRef)*density/nGamma )
+            curve[c].log = false;
+            curve[c].a = linRef[c];
+            curve[c].b = 1023. * density[c] / nGamma[c];
+            curve[c].c = -logRef[c] * density[c] / nGamma[c];
+            curve[c].d = 0.;
+        } else {
+            // xLog = (logRef + log10(max( xLin, 1e-10 ) / linRef)*nGamma/density) / 1023.
+            curve[c].log = true;
+            curve[c].a = nGamma[c] / density[c] / 1023.;
+            curve[c].b = 1. / linRef[c];
+            curve[c].c = 0.;
+            curve[c].d = logRef[c] / 1023.;
+            curve[c].xmin = 1e-10;
+        }
+    }
+}
+
 using namespace OFX;
 
 class PLogLinProcessorBase
@@ -179,22 +233,9 @@ protected:
     double _mix;
     bool _maskInvert;
     bool _processR, _processG, _processB;
-    double _linRef[3];
-    double _logRef[3];
-    double _nGamma[3];
-    double _density[3];
-
-    double log2lin(double xLog,
-                   int c)
-    {
-        return _linRef[c] * std::pow( 10.0, (xLog * 1023. - _logRef[c]) * _density[c] / _nGamma[c] );
-    }
-
-    double lin2log(double xLin,
-                   int c)
-    {
-        return (_logRef[c] + std::log10((std::max)(xLin, 1e-10) / _linRef[c]) * _nGamma[c] / _density[c]) / 1023.;
-    }
+    bool _exact;
+    TransferCurve _curve[3];
+    const TransferLUT *_lut;
 
 public:
     PLogLinProcessorBase(ImageEffect &instance,
@@ -210,6 +251,8 @@ public:
         , _processR(false)
         , _processG(false)
         , _processB(false)
+        , _exact(true)
+        , _lut(NULL)
         // TODO: initialize plugin parameter values
     {
     }
@@ -227,10 +270,9 @@ public:
                    bool processR,
                    bool processG,
                    bool processB,
-                   double linRef[3],
-                   double logRef[3],
-                   double nGamma[3],
-                   double density[3])
+                   bool exact,
+                   const TransferCurve curve[3],
+                   const TransferLUT *lut)
     {
         _premult = premult;
         _premultChannel = premultChannel;
@@ -239,11 +281,10 @@ public:
         _processG = processG;
         _processB = processB;
         for (int c = 0; c < 3; ++c) {
-            _linRef[c] = linRef[c];
-            _logRef[c] = logRef[c];
-            _nGamma[c] = nGamma[c];
-            _density[c] = density[c];
+            _curve[c] = curve[c];
         }
+        _exact = exact;
+        _lut = lut;
     }
 };
 
@@ -307,23 +348,24 @@ private:
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
-        float unpPix[4];
+        const bool doProcess[3] = { processR, processG, processB };
         float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
+            transferRow<PIX, nComponents, maxValue>(_srcImg, _premult, _premultChannel, _curve, _lut, _exact, procWindow.x1, procWindow.x2, y, doProcess, planes);
+
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-
-                // process the pixel (the actual computation goes here)
-                for (int c = 0; c < 3; ++c) {
-                    tmpPix[c] = log2lin(unpPix[c], c);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
                 }
-                tmpPix[3] = unpPix[3];
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // copy back original values from unprocessed channels
                 if (!processR) {
@@ -404,23 +446,24 @@ private:
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert(nComponents == 3 || nComponents == 4);
-        float unpPix[4];
+        const bool doProcess[3] = { processR, processG, processB };
         float tmpPix[4];
+        const int n = procWindow.x2 - procWindow.x1;
+        std::vector<float> rowBuf(4 * n);
+        float *planes[4] = { &rowBuf[0], &rowBuf[n], &rowBuf[2 * n], &rowBuf[3 * n] };
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
             }
 
+            transferRow<PIX, nComponents, maxValue>(_srcImg, _premult, _premultChannel, _curve, _lut, _exact, procWindow.x1, procWindow.x2, y, doProcess, planes);
+
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
+            for (int x = procWindow.x1, i = 0; x < procWindow.x2; x++, i++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                ofxsUnPremult<PIX, nComponents, maxValue>(srcPix, unpPix, _premult, _premultChannel);
-
-                // process the pixel (the actual computation goes here)
-                for (int c = 0; c < 3; ++c) {
-                    tmpPix[c] = lin2log(unpPix[c], c);
+                for (int c = 0; c < 4; ++c) {
+                    tmpPix[c] = planes[c][i];
                 }
-                tmpPix[3] = unpPix[3];
                 ofxsPremultMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, _premult, _premultChannel, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
                 // copy back original values from unprocessed channels
                 if (!processR) {
@@ -468,6 +511,7 @@ public:
         , _mix(NULL)
         , _maskApply(NULL)
         , _maskInvert(NULL)
+        , _exact(NULL)
     {
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
         assert( _dstClip && (_dstClip->getPixelComponents() == ePixelComponentRGB ||
@@ -500,6 +544,8 @@ public:
         _nGamma = fetchRGBParam(kParamNGamma);
         _density = fetchRGBParam(kParamDensity);
         assert(_operation && _linRef && _logRef && _nGamma && _density);
+        _exact = fetchBooleanParam(kParamExact);
+        assert(_exact);
     }
 
 private:
@@ -538,6 +584,8 @@ private:
     DoubleParam* _mix;
     BooleanParam* _maskApply;
     BooleanParam* _maskInvert;
+    BooleanParam* _exact;
+    TransferLUTCache<Mutex> _lutCache;
 };
 
 
@@ -631,8 +679,19 @@ PLogLinPlugin::setupAndProcess(PLogLinProcessorBase &processor,
     double density[3] = { 0. };
     _density->getValueAtTime(time, density[0], density[1], density[2]);
 
+    bool exact = _exact->getValueAtTime(time);
+    OperationEnum operation = (OperationEnum)_operation->getValueAtTime(time);
+    TransferCurve curve[3];
+    getTransferCurves(operation, linRef, logRef, nGamma, density, curve);
+    TransferLUTHolder<Mutex> lutHolder(_lutCache);
+    const TransferLUT *lut = NULL;
+    if ( !exact && !premult && ( (dstBitDepth == eBitDepthUByte) || (dstBitDepth == eBitDepthUShort) ) ) {
+        lut = lutHolder.acquire(curve, dstBitDepth == eBitDepthUByte ? 255 : 65535);
+    }
+
     processor.setValues(premult, premultChannel, mix,
-                        processR, processG, processB, linRef, logRef, nGamma, density);
+                        processR, processG, processB,
+                        exact, curve, lut);
     processor.process();
 } // PLogLinPlugin::setupAndProcess
 
@@ -963,6 +1022,17 @@ PLogLinPluginFactory::describeInContext(ImageEffectDescriptor &desc,
         }
     }
 
+    {
+        BooleanParamDescriptor* param = desc.defineBooleanParam(kParamExact);
+        param->setLabel(kParamExactLabel);
+        param->setHint(kParamExactHint);
+        param->setDefault(kParamExactDefault);
+        param->setAnimates(false);
+        if (page) {
+            page->addChild(*param);
+        }
+    }
+
     ofxsPremultDescribeParams(desc, page);
     ofxsMaskMixDescribeParams(desc, page);
     //std::cout << "describeInContext! OK\n";
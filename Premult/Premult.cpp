@@ -31,6 +31,7 @@
 #include "ofxsProcessing.H"
 #include "ofxsCopier.h"
 #include "ofxsMacros.h"
+#include "ofxsCPUFeatures.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -64,8 +65,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
 // version 2.1: do not guess checkbox values from input premult, leave kParamPremultChanged for backward compatibility
+// version 2.2: process whole rows when possible, with AVX2 and AVX-512 variants selected at runtime
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -283,6 +285,16 @@ private:
         doc[1] = processG;
         doc[2] = processB;
         doc[3] = processA;
+        // rows where both the source and the premult channel image are defined are processed
+        // as contiguous arrays
+        const bool rowsPossible = ( _srcImg && _premultChanImg && (_premultChanIndex >= 0) && (_srcNComps == nComponents) &&
+                                    (processR || processG || processB || processA) );
+        const OfxRectI srcBounds = _srcImg ? _srcImg->getBounds() : procWindow;
+        const OfxRectI premultBounds = _premultChanImg ? _premultChanImg->getBounds() : procWindow;
+        const int premultNComps = _premultChanImg ? _premultChanImg->getPixelComponentCount() : 0;
+        const bool rowsInside = ( (srcBounds.x1 <= procWindow.x1) && (procWindow.x2 <= srcBounds.x2) &&
+                                  (premultBounds.x1 <= procWindow.x1) && (procWindow.x2 <= premultBounds.x2) );
+
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
@@ -290,6 +302,27 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
+            if ( rowsPossible && rowsInside &&
+                 (srcBounds.y1 <= y) && (y < srcBounds.y2) && (premultBounds.y1 <= y) && (y < premultBounds.y2) ) {
+                const PIX *srcPix = (const PIX *) _srcImg->getPixelAddress(procWindow.x1, y);
+                const PIX *premultPix = (const PIX *) _premultChanImg->getPixelAddress(procWindow.x1, y) + _premultChanIndex;
+                const int n = procWindow.x2 - procWindow.x1;
+                switch ( CPUFeatures::getISA() ) {
+#ifdef OFXS_CPU_DISPATCH
+                case CPUFeatures::eISAAVX512:
+                    processRowAVX512<processR, processG, processB, processA>(srcPix, premultPix, premultNComps, dstPix, n);
+                    break;
+                case CPUFeatures::eISAAVX2:
+                    processRowAVX2<processR, processG, processB, processA>(srcPix, premultPix, premultNComps, dstPix, n);
+                    break;
+#endif
+                default:
+                    processRow<processR, processG, processB, processA>(srcPix, premultPix, premultNComps, dstPix, n);
+                    break;
+                }
+                continue;
+            }
+
             for (int x = procWindow.x1; x < procWindow.x2; x++) {
                 const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
                 const PIX *premultPix = (const PIX *)  (_premultChanImg ? _premultChanImg->getPixelAddress(x, y) : 0);
@@ -329,6 +362,59 @@ private:
             }
         }
     } // process
+
+    // same as process(), on n pixels where the source and the premult channel are defined.
+    // alphaPix points to the premult channel of the first pixel.
+    template<bool processR, bool processG, bool processB, bool processA>
+    OFXS_FORCEINLINE void processRow(const PIX *srcPix,
+                                     const PIX *alphaPix,
+                                     int alphaNComps,
+                                     PIX *dstPix,
+                                     int n)
+    {
+        const bool doc[4] = { processR, processG, processB, processA };
+
+        for (int i = 0; i < n; ++i, srcPix += nComponents, alphaPix += alphaNComps, dstPix += nComponents) {
+            const PIX alpha = *alphaPix;
+            for (int c = 0; c < nComponents; c++) {
+                const PIX srcPixVal = srcPix[c];
+                if (isPremult) {
+                    dstPix[c] = doc[c] ? ( ( (float)srcPixVal * alpha ) / maxValue ) : srcPixVal;
+                } else {
+                    PIX val;
+                    if ( !doc[c] || ( alpha <= (PIX)(FLT_EPSILON * maxValue) ) ) {
+                        val = srcPixVal;
+                    } else {
+                        val = ClampNonFloat<PIX, maxValue>( ( (float)srcPixVal * maxValue ) / alpha );
+                    }
+                    dstPix[c] = val;
+                }
+            }
+        }
+    }
+
+#ifdef OFXS_CPU_DISPATCH
+    template<bool processR, bool processG, bool processB, bool processA>
+    OFXS_TARGET_AVX2 void processRowAVX2(const PIX *srcPix,
+                                         const PIX *alphaPix,
+                                         int alphaNComps,
+                                         PIX *dstPix,
+                                         int n)
+    {
+        processRow<processR, processG, processB, processA>(srcPix, alphaPix, alphaNComps, dstPix, n);
+    }
+
+    template<bool processR, bool processG, bool processB, bool processA>
+    OFXS_TARGET_AVX512 void processRowAVX512(const PIX *srcPix,
+                                             const PIX *alphaPix,
+                                             int alphaNComps,
+                                             PIX *dstPix,
+                                             int n)
+    {
+        processRow<processR, processG, processB, processA>(srcPix, alphaPix, alphaNComps, dstPix, n);
+    }
+
+#endif
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -30,6 +30,7 @@
 #include "ofxsMaskMix.h"
 #include "ofxsMacros.h"
 #include "ofxsGenerator.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -73,8 +74,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
 // version 2.1: antialiased render
+// version 2.2: fill the constant regions when there is no source or mask, identity outside of the ellipse
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -326,13 +328,20 @@ private:
 
 private:
 
+    // clamp the integral value v to [lo,hi]
+    static int clampCoord(double v,
+                          int lo,
+                          int hi)
+    {
+        return (v <= lo) ? lo : ( (v >= hi) ? hi : (int)v );
+    }
+
     template<bool processR, bool processG, bool processB, bool processA>
     void process(const OfxRectI& procWindow)
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert( !processA || (nComponents == 1 || nComponents == 4) );
 
-        float tmpPix[4];
         OfxPointD rs = _dstImg->getRenderScale();
         double par = _dstImg->getPixelAspectRatio();
 
@@ -346,6 +355,29 @@ private:
         r.x = r_canonical.x * rs.x / par;
         r.y = r_canonical.y * rs.y;
 
+        // Without a source image and without a mask image, the output is constant outside of the
+        // ellipse (color0) and inside of the ellipse shrunk by the softness (color1). These parts
+        // are filled, and only the other pixels are computed.
+        // Pixels at least one pixel away from these regions are always computed, so that they
+        // are the same as if every pixel were computed.
+        const double kMaxCoord = 1e9;
+        const bool constantRegions = ( !_srcImg && !(_doMasking && _maskImg) &&
+                                       (r.x > 0) && (r.y > 0) && (r.x < kMaxCoord) && (r.y < kMaxCoord) &&
+                                       (std::abs(c.x) < kMaxCoord) && (std::abs(c.y) < kMaxCoord) );
+        // relative radius of the inside
+        const double rInside = (_softness == 0) ? 1. : (1. - _softness);
+        PIX outsidePix[nComponents];
+        PIX insidePix[nComponents];
+        if (constantRegions) {
+            float tmpPix[4] = { (float)_color0.r, (float)_color0.g, (float)_color0.b, (float)_color0.a };
+            mixPixel<processR, processG, processB, processA>(tmpPix, procWindow.x1, procWindow.y1, NULL, outsidePix);
+            tmpPix[0] = (float)_color1.r;
+            tmpPix[1] = (float)_color1.g;
+            tmpPix[2] = (float)_color1.b;
+            tmpPix[3] = (float)_color1.a;
+            mixPixel<processR, processG, processB, processA>(tmpPix, procWindow.x1, procWindow.y1, NULL, insidePix);
+        }
+
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
                 break;
@@ -353,149 +385,203 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-
-                // approximate subpixel rendering of the disc:
-                // - test the pixel corner closer to the center. if it is outside, the pixel is fully outside
-                // - test the pixel corner farther to the center. if it is inside, the pixel is fully outside
-                // - else the pixel is mixed, and its value is (color0*abs(sqrt(dsq_farther)-1)+color1_smoothed*abs(sqrt(dsq_closer)-1))/(sqrt(dsq_farther)+sqrt(dsq_closer))
-                OfxPointD p_closer = {(double)x, (double)y};
-                OfxPointD p_farther = {(double)x, (double)y};
-
-                if (x <= c.x - 0.5) {
-                    p_closer.x += 0.5;
-                    p_farther.x -= 0.5;
-                } else if (x >= c.x + 0.5) {
-                    p_closer.x -= 0.5;
-                    p_farther.x += 0.5;
-                }
-                if (y <= c.y - 0.5) {
-                    p_closer.y += 0.5;
-                    p_farther.y -= 0.5;
-                } else if (y >= c.y + 0.5) {
-                    p_closer.y -= 0.5;
-                    p_farther.y += 0.5;
+            if (!constantRegions) {
+                processPixels<processR, processG, processB, processA>(c, r, procWindow.x1, procWindow.x2, y, dstPix);
+                continue;
+            }
+            if (std::abs(y - c.y) >= r.y + 1) {
+                // outside of the ellipse
+                ofxsFillPixels<PIX, nComponents>(dstPix, outsidePix, procWindow.x2 - procWindow.x1);
+                continue;
+            }
+            const int xShape1 = clampCoord(std::floor(c.x - r.x - 1) + 1, procWindow.x1, procWindow.x2);
+            const int xShape2 = clampCoord(std::ceil(c.x + r.x + 1), xShape1, procWindow.x2);
+            int xInside1 = xShape2;
+            int xInside2 = xShape2;
+            // the pixel corner farther from the center is at most (std::abs(y - c.y) + 0.5) from the center in y
+            const double dy = (std::abs(y - c.y) + 0.5) / r.y;
+            if (dy < rInside) {
+                const double halfWidth = r.x * std::sqrt(rInside * rInside - dy * dy) - 1.5;
+                if (halfWidth >= 0) {
+                    xInside1 = clampCoord(std::ceil(c.x - halfWidth), xShape1, xShape2);
+                    xInside2 = clampCoord(std::floor(c.x + halfWidth) + 1, xShape1, xShape2);
+                    if (xInside2 <= xInside1) {
+                        xInside1 = xInside2 = xShape2;
+                    }
                 }
-                double dx_closer = (p_closer.x - c.x) / r.x;
-                double dy_closer = (p_closer.y - c.y) / r.y;
-                double dx_farther = (p_farther.x - c.x) / r.x;
-                double dy_farther = (p_farther.y - c.y) / r.y;
+            }
+            ofxsFillPixels<PIX, nComponents>(dstPix, outsidePix, xShape1 - procWindow.x1);
+            processPixels<processR, processG, processB, processA>(c, r, xShape1, xInside1, y, dstPix + (xShape1 - procWindow.x1) * nComponents);
+            ofxsFillPixels<PIX, nComponents>(dstPix + (xInside1 - procWindow.x1) * nComponents, insidePix, xInside2 - xInside1);
+            processPixels<processR, processG, processB, processA>(c, r, xInside2, xShape2, y, dstPix + (xInside2 - procWindow.x1) * nComponents);
+            ofxsFillPixels<PIX, nComponents>(dstPix + (xShape2 - procWindow.x1) * nComponents, outsidePix, procWindow.x2 - xShape2);
+        }
+    } // process
 
+    // compute the pixels [x1,x2) of row y, c and r are the center and radius of the ellipse in pixels
+    template<bool processR, bool processG, bool processB, bool processA>
+    void processPixels(const OfxPointD& c,
+                       const OfxPointD& r,
+                       int x1,
+                       int x2,
+                       int y,
+                       PIX *dstPix)
+    {
+        float tmpPix[4];
 
-                if ( (dx_closer >= 1) || (dy_closer >= 1) ) {
-                    // outside
+        for (int x = x1; x < x2; ++x, dstPix += nComponents) {
+            const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+
+            // approximate subpixel rendering of the disc:
+            // - test the pixel corner closer to the center. if it is outside, the pixel is fully outside
+            // - test the pixel corner farther to the center. if it is inside, the pixel is fully outside
+            // - else the pixel is mixed, and its value is (color0*abs(sqrt(dsq_farther)-1)+color1_smoothed*abs(sqrt(dsq_closer)-1))/(sqrt(dsq_farther)+sqrt(dsq_closer))
+            OfxPointD p_closer = {(double)x, (double)y};
+            OfxPointD p_farther = {(double)x, (double)y};
+
+            if (x <= c.x - 0.5) {
+                p_closer.x += 0.5;
+                p_farther.x -= 0.5;
+            } else if (x >= c.x + 0.5) {
+                p_closer.x -= 0.5;
+                p_farther.x += 0.5;
+            }
+            if (y <= c.y - 0.5) {
+                p_closer.y += 0.5;
+                p_farther.y -= 0.5;
+            } else if (y >= c.y + 0.5) {
+                p_closer.y -= 0.5;
+                p_farther.y += 0.5;
+            }
+            double dx_closer = (p_closer.x - c.x) / r.x;
+            double dy_closer = (p_closer.y - c.y) / r.y;
+            double dx_farther = (p_farther.x - c.x) / r.x;
+            double dy_farther = (p_farther.y - c.y) / r.y;
+
+
+            if ( (dx_closer >= 1) || (dy_closer >= 1) ) {
+                // outside
+                tmpPix[0] = (float)_color0.r;
+                tmpPix[1] = (float)_color0.g;
+                tmpPix[2] = (float)_color0.b;
+                tmpPix[3] = (float)_color0.a;
+            } else {
+                // maybe inside
+
+                //double dsq = dx * dx + dy * dy;
+                double dsq_closer = dx_closer * dx_closer + dy_closer * dy_closer;
+                double dsq_farther = dx_farther * dx_farther + dy_farther * dy_farther;
+                assert(dsq_closer <= dsq_farther);
+                if (dsq_closer > dsq_farther) {
+                    // protect against bug
+                    std::swap(dsq_closer, dsq_farther);
+                }
+                if (dsq_closer >= 1) {
+                    // fully outside
                     tmpPix[0] = (float)_color0.r;
                     tmpPix[1] = (float)_color0.g;
                     tmpPix[2] = (float)_color0.b;
                     tmpPix[3] = (float)_color0.a;
                 } else {
-                    // maybe inside
-
-                    //double dsq = dx * dx + dy * dy;
-                    double dsq_closer = dx_closer * dx_closer + dy_closer * dy_closer;
-                    double dsq_farther = dx_farther * dx_farther + dy_farther * dy_farther;
-                    assert(dsq_closer <= dsq_farther);
-                    if (dsq_closer > dsq_farther) {
-                        // protect against bug
-                        std::swap(dsq_closer, dsq_farther);
-                    }
-                    if (dsq_closer >= 1) {
-                        // fully outside
-                        tmpPix[0] = (float)_color0.r;
-                        tmpPix[1] = (float)_color0.g;
-                        tmpPix[2] = (float)_color0.b;
-                        tmpPix[3] = (float)_color0.a;
+                    // always consider the value closest top the center to avoid discontinuities/artifacts
+                    if ( (dsq_closer <= 0) || (_softness == 0) ) {
+                        // solid color
+                        tmpPix[0] = (float)_color1.r;
+                        tmpPix[1] = (float)_color1.g;
+                        tmpPix[2] = (float)_color1.b;
+                        tmpPix[3] = (float)_color1.a;
                     } else {
-                        // always consider the value closest top the center to avoid discontinuities/artifacts
-                        if ( (dsq_closer <= 0) || (_softness == 0) ) {
-                            // solid color
+                        // mixed
+                        float t = ( 1.f - (float)std::sqrt( (std::max)(dsq_closer, 0.) ) ) / (float)_softness;
+                        if (t >= 1) {
                             tmpPix[0] = (float)_color1.r;
                             tmpPix[1] = (float)_color1.g;
                             tmpPix[2] = (float)_color1.b;
                             tmpPix[3] = (float)_color1.a;
                         } else {
-                            // mixed
-                            float t = ( 1.f - (float)std::sqrt( (std::max)(dsq_closer, 0.) ) ) / (float)_softness;
-                            if (t >= 1) {
-                                tmpPix[0] = (float)_color1.r;
-                                tmpPix[1] = (float)_color1.g;
-                                tmpPix[2] = (float)_color1.b;
-                                tmpPix[3] = (float)_color1.a;
-                            } else {
-                                t = (float)rampSmooth(t);
-
-                                if (_plinear) {
-                                    // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
-                                    t = t * t * t;
-                                }
-                                tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
-                                tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
-                                tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
-                                tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
+                            t = (float)rampSmooth(t);
+
+                            if (_plinear) {
+                                // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
+                                t = t * t * t;
                             }
-                        }
-                        float a;
-                        if (dsq_farther <= 1) {
-                            // fully inside
-                            a = 1.;
-                        } else {
-                            // mixed pixel, partly inside / partly outside, center of pixel is outside
-                            assert(dsq_closer < 1 && dsq_farther > 1);
-                            // now mix with the outside pix;
-                            a = ( 1 - std::sqrt( (std::max)(dsq_closer, 0.) ) ) / ( std::sqrt( (std::max)(dsq_farther, 0.) ) - std::sqrt( (std::max)(dsq_closer, 0.) ) );
-                        }
-                        assert(a >= 0. && a <= 1.);
-                        if (a != 1.) {
-                            tmpPix[0] = (float)_color0.r * (1.f - a) + tmpPix[0] * a;
-                            tmpPix[1] = (float)_color0.g * (1.f - a) + tmpPix[1] * a;
-                            tmpPix[2] = (float)_color0.b * (1.f - a) + tmpPix[2] * a;
-                            tmpPix[3] = (float)_color0.a * (1.f - a) + tmpPix[3] * a;
+                            tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
+                            tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
+                            tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
+                            tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
                         }
                     }
-                }
-                float a = tmpPix[3];
-
-                // ofxsMaskMixPix takes non-normalized values
-                tmpPix[0] *= maxValue;
-                tmpPix[1] *= maxValue;
-                tmpPix[2] *= maxValue;
-                tmpPix[3] *= maxValue;
-                float srcPixRGBA[4] = {0, 0, 0, 0};
-                if (srcPix) {
-                    if (nComponents >= 3) {
-                        srcPixRGBA[0] = srcPix[0];
-                        srcPixRGBA[1] = srcPix[1];
-                        srcPixRGBA[2] = srcPix[2];
+                    float a;
+                    if (dsq_farther <= 1) {
+                        // fully inside
+                        a = 1.;
+                    } else {
+                        // mixed pixel, partly inside / partly outside, center of pixel is outside
+                        assert(dsq_closer < 1 && dsq_farther > 1);
+                        // now mix with the outside pix;
+                        a = ( 1 - std::sqrt( (std::max)(dsq_closer, 0.) ) ) / ( std::sqrt( (std::max)(dsq_farther, 0.) ) - std::sqrt( (std::max)(dsq_closer, 0.) ) );
                     }
-                    if ( (nComponents == 1) || (nComponents == 4) ) {
-                        srcPixRGBA[3] = srcPix[nComponents - 1];
+                    assert(a >= 0. && a <= 1.);
+                    if (a != 1.) {
+                        tmpPix[0] = (float)_color0.r * (1.f - a) + tmpPix[0] * a;
+                        tmpPix[1] = (float)_color0.g * (1.f - a) + tmpPix[1] * a;
+                        tmpPix[2] = (float)_color0.b * (1.f - a) + tmpPix[2] * a;
+                        tmpPix[3] = (float)_color0.a * (1.f - a) + tmpPix[3] * a;
                     }
                 }
-                if (processR) {
-                    tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - a);
-                } else {
-                    tmpPix[0] = srcPixRGBA[0];
-                }
-                if (processG) {
-                    tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - a);
-                } else {
-                    tmpPix[1] = srcPixRGBA[1];
-                }
-                if (processB) {
-                    tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - a);
-                } else {
-                    tmpPix[2] = srcPixRGBA[2];
-                }
-                if (processA) {
-                    tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - a);
-                } else {
-                    tmpPix[3] = srcPixRGBA[3];
-                }
-                ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
             }
+            mixPixel<processR, processG, processB, processA>(tmpPix, x, y, srcPix, dstPix);
         }
-    } // process
+    } // processPixels
+
+    // composite the shape color tmpPix over srcPix, and apply the mask and mix
+    template<bool processR, bool processG, bool processB, bool processA>
+    void mixPixel(float tmpPix[4],
+                  int x,
+                  int y,
+                  const PIX *srcPix,
+                  PIX *dstPix)
+    {
+        float a = tmpPix[3];
+
+        // ofxsMaskMixPix takes non-normalized values
+        tmpPix[0] *= maxValue;
+        tmpPix[1] *= maxValue;
+        tmpPix[2] *= maxValue;
+        tmpPix[3] *= maxValue;
+        float srcPixRGBA[4] = {0, 0, 0, 0};
+        if (srcPix) {
+            if (nComponents >= 3) {
+                srcPixRGBA[0] = srcPix[0];
+                srcPixRGBA[1] = srcPix[1];
+                srcPixRGBA[2] = srcPix[2];
+            }
+            if ( (nComponents == 1) || (nComponents == 4) ) {
+                srcPixRGBA[3] = srcPix[nComponents - 1];
+            }
+        }
+        if (processR) {
+            tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - a);
+        } else {
+            tmpPix[0] = srcPixRGBA[0];
+        }
+        if (processG) {
+            tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - a);
+        } else {
+            tmpPix[1] = srcPixRGBA[1];
+        }
+        if (processB) {
+            tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - a);
+        } else {
+            tmpPix[2] = srcPixRGBA[2];
+        }
+        if (processA) {
+            tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - a);
+        } else {
+            tmpPix[3] = srcPixRGBA[3];
+        }
+        ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+    }
 };
 
 
@@ -795,6 +881,31 @@ RadialPlugin::isIdentity(const IsIdentityArguments &args,
         return true;
     }
 
+    if ( (color0.r == 0.) && (color0.g == 0.) && (color0.b == 0.) && (color0.a == 0.) ) {
+        // the source is unchanged outside of the ellipse: the effect is identity if the renderWindow
+        // doesn't intersect the ellipse bounds, expanded by one pixel for antialiasing
+        OfxRectD shapeRod;
+        if ( !GeneratorPlugin::getRegionOfDefinition(time, shapeRod) ) {
+            OfxPointD siz = getProjectSize();
+            OfxPointD off = getProjectOffset();
+            shapeRod.x1 = off.x;
+            shapeRod.x2 = off.x + siz.x;
+            shapeRod.y1 = off.y;
+            shapeRod.y2 = off.y + siz.y;
+        }
+        OfxRectI shapeBounds;
+        Coords::toPixelEnclosing(shapeRod, args.renderScale, _dstClip->getPixelAspectRatio(), &shapeBounds);
+        shapeBounds.x1 -= 1;
+        shapeBounds.y1 -= 1;
+        shapeBounds.x2 += 1;
+        shapeBounds.y2 += 1;
+        if ( !Coords::rectIntersection<OfxRectI>(args.renderWindow, shapeBounds, 0) ) {
+            identityClip = _srcClip;
+
+            return true;
+        }
+    }
+
     bool doMasking = ( ( !_maskApply || _maskApply->getValueAtTime(time) ) && _maskClip && _maskClip->isConnected() );
     if (doMasking) {
         bool maskInvert = _maskInvert->getValueAtTime(time);
@@ -28,6 +28,7 @@
 #include "ofxsMaskMix.h"
 #include "ofxsMacros.h"
 #include "ofxsRamp.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -62,8 +63,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // History:
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
+// version 2.1: compute horizontal and vertical ramps once per row or column when there is no source or mask
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -307,10 +309,15 @@ private:
     template<bool processR, bool processG, bool processB, bool processA, RampTypeEnum type>
     void processForType(const OfxRectI& procWindow)
     {
-        float tmpPix[4];
         const double norm2 = (_point1.x - _point0.x) * (_point1.x - _point0.x) + (_point1.y - _point0.y) * (_point1.y - _point0.y);
         const double nx = norm2 == 0. ? 0. : (_point1.x - _point0.x) / norm2;
         const double ny = norm2 == 0. ? 0. : (_point1.y - _point0.y) / norm2;
+        const int width = procWindow.x2 - procWindow.x1;
+        // Without a source image and without a mask image, the output only depends on the ramp parameter:
+        // a vertical ramp (or no ramp at all) is constant along each row, and a horizontal ramp gives
+        // identical rows.
+        const bool separable = !_srcImg && !(_doMasking && _maskImg);
+        const PIX *firstRowPix = NULL;
 
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
@@ -319,62 +326,84 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                OfxPointI p_pixel;
-                OfxPointD p;
-                p_pixel.x = x;
-                p_pixel.y = y;
-                Coords::toCanonical(p_pixel, _dstImg->getRenderScale(), _dstImg->getPixelAspectRatio(), &p);
-                double t = ofxsRampFunc<type>(_point0, nx, ny, p);
-
-                tmpPix[0] = (float)_color0.r * (1 - (float)t) + (float)_color1.r * (float)t;
-                tmpPix[1] = (float)_color0.g * (1 - (float)t) + (float)_color1.g * (float)t;
-                tmpPix[2] = (float)_color0.b * (1 - (float)t) + (float)_color1.b * (float)t;
-                tmpPix[3] = (float)_color0.a * (1 - (float)t) + (float)_color1.a * (float)t;
-
-                float a = tmpPix[3];
-
-                // ofxsMaskMixPix takes non-normalized values
-                tmpPix[0] *= maxValue;
-                tmpPix[1] *= maxValue;
-                tmpPix[2] *= maxValue;
-                tmpPix[3] *= maxValue;
-                float srcPixRGBA[4] = {0, 0, 0, 0};
-                if (srcPix) {
-                    if (nComponents >= 3) {
-                        srcPixRGBA[0] = srcPix[0];
-                        srcPixRGBA[1] = srcPix[1];
-                        srcPixRGBA[2] = srcPix[2];
-                    }
-                    if ( (nComponents == 1) || (nComponents == 4) ) {
-                        srcPixRGBA[3] = srcPix[nComponents - 1];
-                    }
-                }
-                if (processR) {
-                    tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - a);
-                } else {
-                    tmpPix[0] = srcPixRGBA[0];
-                }
-                if (processG) {
-                    tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - a);
-                } else {
-                    tmpPix[1] = srcPixRGBA[1];
-                }
-                if (processB) {
-                    tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - a);
-                } else {
-                    tmpPix[2] = srcPixRGBA[2];
+            if ( separable && (nx == 0.) ) {
+                processPixels<processR, processG, processB, processA, type>(nx, ny, procWindow.x1, procWindow.x1 + 1, y, dstPix);
+                ofxsFillPixels<PIX, nComponents>(dstPix + nComponents, dstPix, width - 1);
+            } else if ( separable && (ny == 0.) && firstRowPix ) {
+                ofxsCopyPixels<PIX, nComponents>(dstPix, firstRowPix, width);
+            } else {
+                processPixels<processR, processG, processB, processA, type>(nx, ny, procWindow.x1, procWindow.x2, y, dstPix);
+                firstRowPix = dstPix;
+            }
+        }
+    } // processForType
+
+    // compute the pixels [x1,x2) of row y
+    template<bool processR, bool processG, bool processB, bool processA, RampTypeEnum type>
+    void processPixels(double nx,
+                       double ny,
+                       int x1,
+                       int x2,
+                       int y,
+                       PIX *dstPix)
+    {
+        float tmpPix[4];
+
+        for (int x = x1; x < x2; ++x, dstPix += nComponents) {
+            const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+            OfxPointI p_pixel;
+            OfxPointD p;
+            p_pixel.x = x;
+            p_pixel.y = y;
+            Coords::toCanonical(p_pixel, _dstImg->getRenderScale(), _dstImg->getPixelAspectRatio(), &p);
+            double t = ofxsRampFunc<type>(_point0, nx, ny, p);
+
+            tmpPix[0] = (float)_color0.r * (1 - (float)t) + (float)_color1.r * (float)t;
+            tmpPix[1] = (float)_color0.g * (1 - (float)t) + (float)_color1.g * (float)t;
+            tmpPix[2] = (float)_color0.b * (1 - (float)t) + (float)_color1.b * (float)t;
+            tmpPix[3] = (float)_color0.a * (1 - (float)t) + (float)_color1.a * (float)t;
+
+            float a = tmpPix[3];
+
+            // ofxsMaskMixPix takes non-normalized values
+            tmpPix[0] *= maxValue;
+            tmpPix[1] *= maxValue;
+            tmpPix[2] *= maxValue;
+            tmpPix[3] *= maxValue;
+            float srcPixRGBA[4] = {0, 0, 0, 0};
+            if (srcPix) {
+                if (nComponents >= 3) {
+                    srcPixRGBA[0] = srcPix[0];
+                    srcPixRGBA[1] = srcPix[1];
+                    srcPixRGBA[2] = srcPix[2];
                 }
-                if (processA) {
-                    tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - a);
-                } else {
-                    tmpPix[3] = srcPixRGBA[3];
+                if ( (nComponents == 1) || (nComponents == 4) ) {
+                    srcPixRGBA[3] = srcPix[nComponents - 1];
                 }
-                ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
             }
+            if (processR) {
+                tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - a);
+            } else {
+                tmpPix[0] = srcPixRGBA[0];
+            }
+            if (processG) {
+                tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - a);
+            } else {
+                tmpPix[1] = srcPixRGBA[1];
+            }
+            if (processB) {
+                tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - a);
+            } else {
+                tmpPix[2] = srcPixRGBA[2];
+            }
+            if (processA) {
+                tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - a);
+            } else {
+                tmpPix[3] = srcPixRGBA[3];
+            }
+            ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
         }
-    } // processForType
+    } // processPixels
 };
 
 
@@ -23,6 +23,7 @@
 #include <limits>
 #include <cmath>
 #include <cfloat> // DBL_MAX
+#include <vector>
 
 #include "ofxsImageEffect.h"
 #include "ofxsThreadSuite.h"
@@ -32,6 +33,7 @@
 #include "ofxsGenerator.h"
 #include "ofxsMacros.h"
 #include "ofxsMaskMix.h"
+#include "ofxsRandom.h"
 
 //#define USE_RANDOMGENERATOR // randomGenerator is more than 10 times slower than our pseudo-random hash
 #ifdef USE_RANDOMGENERATOR
@@ -53,8 +55,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginGrouping "Draw"
 #define kPluginDescription "Generate a random field of noise. The field does not resample if you change the resolution or density (you can animate the density without pixels randomly changing)."
 #define kPluginIdentifier "net.sf.openfx.Noise" // don't ever change the plugin ID
+// History:
+// version 1.0: initial version
+// version 1.1: compute the random values of a row at once (same values as 1.0)
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -122,18 +127,6 @@ public:
     }
 };
 
-static unsigned int
-hash(unsigned int a)
-{
-    a = (a ^ 61) ^ (a >> 16);
-    a = a + (a << 3);
-    a = a ^ (a >> 4);
-    a = a * 0x27d4eb2d;
-    a = a ^ (a >> 15);
-
-    return a;
-}
-
 /** @brief templated class to blend between two images */
 template <class PIX, int nComponents, int maxValue>
 class RandGenerator
@@ -150,10 +143,9 @@ public:
     {
         float noiseLevel = _noiseLevel;
 
-        // set up a random number generator and set the seed
 #ifdef USE_RANDOMGENERATOR
+        // set up a random number generator and set the seed
         RandomGenerator randy;
-#endif
 
         // push pixels
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
@@ -165,22 +157,51 @@ public:
 
             for (int x = procWindow.x1; x < procWindow.x2; x++) {
                 // for a given x,y position, the output should always be the same.
-#ifdef USE_RANDOMGENERATOR
-                randy.reseed(hash(x + 0x10000 * _seed) + y);
-#endif
-#ifdef USE_RANDOMGENERATOR
+                randy.reseed(Random::hash(x + 0x10000 * _seed) + y);
                 double randValue = randy.random();
-#else
-                double randValue = hash(hash(hash(_seed ^ x) ^ y) ^ nComponents) / ( (double)0x100000000ULL );
-#endif
                 if (randValue <= _density) {
                     for (int c = 0; c < nComponents; c++) {
                         // get the random value out of it, scale up by the pixel max level and the noise level
-#ifdef USE_RANDOMGENERATOR
                         randValue = randy.random() - 0.5;
+                        randValue = _mean + noiseLevel * randValue;
+                        dstPix[c] = ofxsClampIfInt<PIX, maxValue>(randValue * maxValue, 0, maxValue);
+                    }
+                } else {
+                    std::fill(dstPix, dstPix + nComponents, 0);
+                }
+                dstPix += nComponents;
+            }
+        }
 #else
-                        randValue = hash(hash(hash(_seed ^ x) ^ y) ^ c) / ( (double)0x100000000ULL ) - 0.5;
-#endif
+        // for a given x,y position, the output should always be the same:
+        // the value of channel c is Random::irand(_seed, x, y, c), and the density
+        // test uses channel nComponents
+        const Random::Generator gen(_seed, procWindow.x1, procWindow.x2);
+        const int width = gen.width();
+        if (width <= 0) {
+            return;
+        }
+        std::vector<unsigned int> keys(width);
+        std::vector<unsigned int> r( (nComponents + 1) * width );
+
+        // push pixels
+        for (int y = procWindow.y1; y < procWindow.y2; y++) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+
+            gen.rowKeys(y, &keys.front());
+            for (int c = 0; c <= nComponents; c++) {
+                gen.irand(&keys.front(), c, &r[c * width]);
+            }
+            const unsigned int *densityValues = &r[nComponents * width];
+            for (int i = 0; i < width; i++) {
+                if (Random::toUnit(densityValues[i]) <= _density) {
+                    for (int c = 0; c < nComponents; c++) {
+                        // get the random value out of it, scale up by the pixel max level and the noise level
+                        double randValue = Random::toUnit(r[c * width + i]) - 0.5;
                         randValue = _mean + noiseLevel * randValue;
                         dstPix[c] = ofxsClampIfInt<PIX, maxValue>(randValue * maxValue, 0, maxValue);
                     }
@@ -190,6 +211,7 @@ public:
                 dstPix += nComponents;
             }
         }
+#endif // ifdef USE_RANDOMGENERATOR
     }
 };
 
@@ -279,12 +301,12 @@ RandPlugin::setupAndProcess(RandGeneratorBase &processor,
     _density->getValueAtTime(time, density);
 
     bool staticSeed = _staticSeed->getValueAtTime(time);
-    uint32_t seed = hash( (unsigned int)_seed->getValueAtTime(time) );
+    uint32_t seed = Random::hash( (unsigned int)_seed->getValueAtTime(time) );
     if (!staticSeed) {
         float time_f = args.time;
 
         // set the seed based on the current time, and double it we get difference seeds on different fields
-        seed = hash( *( (uint32_t*)&time_f ) ^ seed );
+        seed = Random::hash( *( (uint32_t*)&time_f ) ^ seed );
     }
     // set the scales
     // noise level depends on the render scale
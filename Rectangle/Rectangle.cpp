@@ -39,6 +39,7 @@
 #include "ofxsRectangleInteract.h"
 #include "ofxsMacros.h"
 #include "ofxsGenerator.h"
+#include "ofxsFill.h"
 #ifdef OFX_EXTENSIONS_NATRON
 #include "ofxNatron.h"
 #endif
@@ -82,8 +83,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 2.0: use kNatronOfxParamProcess* parameters
 // version 2.1: antialiased render & remove blackOutside parameter (the outside color is always color0)
+// version 2.2: fill the constant regions when there is no source or mask, identity outside of the rectangle
 #define kPluginVersionMajor 2 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 2 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsByte true
 #define kSupportsUShort true
@@ -339,27 +341,69 @@ private:
 
 private:
 
+    // the geometry of the rectangle, in pixel coordinates
+    struct Shape
+    {
+        OfxPointD rs;
+        double par;
+        OfxPointD btmLeft;
+        OfxPointD topRight;
+        OfxPointD softness;
+        OfxPointD r; // corner radius
+    };
+
+    // clamp the integral value v to [lo,hi]
+    static int clampCoord(double v,
+                          int lo,
+                          int hi)
+    {
+        return (v <= lo) ? lo : ( (v >= hi) ? hi : (int)v );
+    }
+
     template<bool processR, bool processG, bool processB, bool processA>
     void process(const OfxRectI& procWindow)
     {
         assert( (!processR && !processG && !processB) || (nComponents == 3 || nComponents == 4) );
         assert( !processA || (nComponents == 1 || nComponents == 4) );
 
-        float tmpPix[4];
-        OfxPointD rs = _dstImg->getRenderScale();
-        double par = _dstImg->getPixelAspectRatio();
+        Shape shape;
+        shape.rs = _dstImg->getRenderScale();
+        shape.par = _dstImg->getPixelAspectRatio();
+        const OfxPointD& rs = shape.rs;
+        const double par = shape.par;
         OfxPointD btmLeft_canonical = { _btmLeft.x, _btmLeft.y };
         OfxPointD topRight_canonical = { _btmLeft.x + _size.x, _btmLeft.y + _size.y };
-        OfxPointD btmLeft; // btmLeft position in pixel
-        Coords::toPixelSub(btmLeft_canonical, rs, par, &btmLeft);
-        OfxPointD topRight; // topRight position in pixel
-        Coords::toPixelSub(topRight_canonical, rs, par, &topRight);
-        OfxPointD softness; // softness value in pixel
-        softness.x = _softness * rs.x / par;
-        softness.y = _softness * rs.y;
-        OfxPointD r; // cornerRadius value in pixel
-        r.x = _cornerRadius.x * rs.x / par;
-        r.y = _cornerRadius.y * rs.y;
+        Coords::toPixelSub(btmLeft_canonical, rs, par, &shape.btmLeft);
+        Coords::toPixelSub(topRight_canonical, rs, par, &shape.topRight);
+        shape.softness.x = _softness * rs.x / par;
+        shape.softness.y = _softness * rs.y;
+        shape.r.x = _cornerRadius.x * rs.x / par;
+        shape.r.y = _cornerRadius.y * rs.y;
+
+        // Without a source image and without a mask image, the output is constant outside of the
+        // rectangle (color0) and inside of it, away from the softness ramp and the rounded corners
+        // (color1). These parts are filled, and only the other pixels are computed.
+        // Pixels at least one pixel away from these regions are always computed, so that they
+        // are the same as if every pixel were computed.
+        const bool corners = (shape.r.x > 0) && (shape.r.y > 0);
+        const double mx = (std::max)( (std::max)(0.5, shape.softness.x), corners ? shape.r.x : 0. ) + 1;
+        const double my = (std::max)( (std::max)(0.5, shape.softness.y), corners ? shape.r.y : 0. ) + 1;
+        const double kMaxCoord = 1e9;
+        const bool constantRegions = ( !_srcImg && !(_doMasking && _maskImg) &&
+                                       (std::abs(shape.btmLeft.x) < kMaxCoord) && (std::abs(shape.btmLeft.y) < kMaxCoord) &&
+                                       (std::abs(shape.topRight.x) < kMaxCoord) && (std::abs(shape.topRight.y) < kMaxCoord) &&
+                                       (mx < kMaxCoord) && (my < kMaxCoord) );
+        PIX outsidePix[nComponents];
+        PIX insidePix[nComponents];
+        if (constantRegions) {
+            float tmpPix[4] = { (float)_color0.r, (float)_color0.g, (float)_color0.b, (float)_color0.a };
+            mixPixel<processR, processG, processB, processA>(tmpPix, procWindow.x1, procWindow.y1, NULL, outsidePix);
+            tmpPix[0] = (float)_color1.r;
+            tmpPix[1] = (float)_color1.g;
+            tmpPix[2] = (float)_color1.b;
+            tmpPix[3] = (float)_color1.a;
+            mixPixel<processR, processG, processB, processA>(tmpPix, procWindow.x1, procWindow.y1, NULL, insidePix);
+        }
 
         for (int y = procWindow.y1; y < procWindow.y2; ++y) {
             if ( _effect.abort() ) {
@@ -368,259 +412,313 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
-                const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
-                double dx = (std::min)(x - btmLeft.x, topRight.x - x);
-                double dy = (std::min)(y - btmLeft.y, topRight.y - y);
-
-                if ( (dx <= -0.5) || (dy <= -0.5) ) {
-                    // outside of the rectangle
-                    tmpPix[0] = (float)_color0.r;
-                    tmpPix[1] = (float)_color0.g;
-                    tmpPix[2] = (float)_color0.b;
-                    tmpPix[3] = (float)_color0.a;
-                } else {
-                    float a = 1.; // mix factor with the outside
-                    // test if the center of the pixel is within one of the rounded corners
-                    if ( (r.x > 0) && (r.y > 0) &&
-                         ( ( x < (btmLeft.x + r.x) ) || ( x > (topRight.x - r.x) ) ) &&
-                         ( ( y < (btmLeft.y + r.y) ) || ( y > (topRight.y - r.y) ) ) ) {
-                        // CORNERS
-
-                        // compute the corresponding ellipse center (in pixel coordinates
-                        OfxPointD c; // center position in pixel
-                        c.x = x < (btmLeft.x + r.x) ? (btmLeft.x + r.x) : (topRight.x - r.x);
-                        c.y = y < (btmLeft.y + r.y) ? (btmLeft.y + r.y) : (topRight.y - r.y);
-
-                        // The following is the ellipse drawing code from the Radial plugin
-
-                        // approximate subpixel rendering of the disc:
-                        // - test the pixel corner closer to the center. if it is outside, the pixel is fully outside
-                        // - test the pixel corner farther to the center. if it is inside, the pixel is fully outside
-                        // - else the pixel is mixed, and its value is (color0*abs(sqrt(dsq_farther)-1)+color1_smoothed*abs(sqrt(dsq_closer)-1))/(sqrt(dsq_farther)+sqrt(dsq_closer))
-                        OfxPointD p_closer = {(double)x, (double)y};
-                        OfxPointD p_farther = {(double)x, (double)y};
-
-                        if (x <= c.x - 0.5) {
-                            p_closer.x += 0.5;
-                            p_farther.x -= 0.5;
-                        } else if (x >= c.x + 0.5) {
-                            p_closer.x -= 0.5;
-                            p_farther.x += 0.5;
-                        }
-                        if (y <= c.y - 0.5) {
-                            p_closer.y += 0.5;
-                            p_farther.y -= 0.5;
-                        } else if (y >= c.y + 0.5) {
-                            p_closer.y -= 0.5;
-                            p_farther.y += 0.5;
-                        }
-                        double dx_closer = (p_closer.x - c.x) / r.x;
-                        double dy_closer = (p_closer.y - c.y) / r.y;
-                        double dx_farther = (p_farther.x - c.x) / r.x;
-                        double dy_farther = (p_farther.y - c.y) / r.y;
-
+            if (!constantRegions) {
+                processPixels<processR, processG, processB, processA>(shape, procWindow.x1, procWindow.x2, y, dstPix);
+                continue;
+            }
+            if ( (y <= shape.btmLeft.y - 1) || (y >= shape.topRight.y + 1) ) {
+                // outside of the rectangle
+                ofxsFillPixels<PIX, nComponents>(dstPix, outsidePix, procWindow.x2 - procWindow.x1);
+                continue;
+            }
+            const int xShape1 = clampCoord(std::floor(shape.btmLeft.x - 1) + 1, procWindow.x1, procWindow.x2);
+            const int xShape2 = clampCoord(std::ceil(shape.topRight.x + 1), xShape1, procWindow.x2);
+            int xInside1 = xShape2;
+            int xInside2 = xShape2;
+            if ( (y >= shape.btmLeft.y + my) && (y <= shape.topRight.y - my) ) {
+                xInside1 = clampCoord(std::ceil(shape.btmLeft.x + mx), xShape1, xShape2);
+                xInside2 = clampCoord(std::floor(shape.topRight.x - mx) + 1, xShape1, xShape2);
+                if (xInside2 <= xInside1) {
+                    xInside1 = xInside2 = xShape2;
+                }
+            }
+            ofxsFillPixels<PIX, nComponents>(dstPix, outsidePix, xShape1 - procWindow.x1);
+            processPixels<processR, processG, processB, processA>(shape, xShape1, xInside1, y, dstPix + (xShape1 - procWindow.x1) * nComponents);
+            ofxsFillPixels<PIX, nComponents>(dstPix + (xInside1 - procWindow.x1) * nComponents, insidePix, xInside2 - xInside1);
+            processPixels<processR, processG, processB, processA>(shape, xInside2, xShape2, y, dstPix + (xInside2 - procWindow.x1) * nComponents);
+            ofxsFillPixels<PIX, nComponents>(dstPix + (xShape2 - procWindow.x1) * nComponents, outsidePix, procWindow.x2 - xShape2);
+        }
+    } // process
 
-                        if ( (dx_closer >= 1) || (dy_closer >= 1) ) {
-                            // outside
+    // compute the pixels [x1,x2) of row y
+    template<bool processR, bool processG, bool processB, bool processA>
+    void processPixels(const Shape& shape,
+                       int x1,
+                       int x2,
+                       int y,
+                       PIX *dstPix)
+    {
+        float tmpPix[4];
+        const OfxPointD& rs = shape.rs;
+        const double par = shape.par;
+        const OfxPointD& btmLeft = shape.btmLeft; // btmLeft position in pixel
+        const OfxPointD& topRight = shape.topRight; // topRight position in pixel
+        const OfxPointD& softness = shape.softness; // softness value in pixel
+        const OfxPointD& r = shape.r; // cornerRadius value in pixel
+
+        for (int x = x1; x < x2; ++x, dstPix += nComponents) {
+            const PIX *srcPix = (const PIX *)  (_srcImg ? _srcImg->getPixelAddress(x, y) : 0);
+            double dx = (std::min)(x - btmLeft.x, topRight.x - x);
+            double dy = (std::min)(y - btmLeft.y, topRight.y - y);
+
+            if ( (dx <= -0.5) || (dy <= -0.5) ) {
+                // outside of the rectangle
+                tmpPix[0] = (float)_color0.r;
+                tmpPix[1] = (float)_color0.g;
+                tmpPix[2] = (float)_color0.b;
+                tmpPix[3] = (float)_color0.a;
+            } else {
+                float a = 1.; // mix factor with the outside
+                // test if the center of the pixel is within one of the rounded corners
+                if ( (r.x > 0) && (r.y > 0) &&
+                     ( ( x < (btmLeft.x + r.x) ) || ( x > (topRight.x - r.x) ) ) &&
+                     ( ( y < (btmLeft.y + r.y) ) || ( y > (topRight.y - r.y) ) ) ) {
+                    // CORNERS
+
+                    // compute the corresponding ellipse center (in pixel coordinates
+                    OfxPointD c; // center position in pixel
+                    c.x = x < (btmLeft.x + r.x) ? (btmLeft.x + r.x) : (topRight.x - r.x);
+                    c.y = y < (btmLeft.y + r.y) ? (btmLeft.y + r.y) : (topRight.y - r.y);
+
+                    // The following is the ellipse drawing code from the Radial plugin
+
+                    // approximate subpixel rendering of the disc:
+                    // - test the pixel corner closer to the center. if it is outside, the pixel is fully outside
+                    // - test the pixel corner farther to the center. if it is inside, the pixel is fully outside
+                    // - else the pixel is mixed, and its value is (color0*abs(sqrt(dsq_farther)-1)+color1_smoothed*abs(sqrt(dsq_closer)-1))/(sqrt(dsq_farther)+sqrt(dsq_closer))
+                    OfxPointD p_closer = {(double)x, (double)y};
+                    OfxPointD p_farther = {(double)x, (double)y};
+
+                    if (x <= c.x - 0.5) {
+                        p_closer.x += 0.5;
+                        p_farther.x -= 0.5;
+                    } else if (x >= c.x + 0.5) {
+                        p_closer.x -= 0.5;
+                        p_farther.x += 0.5;
+                    }
+                    if (y <= c.y - 0.5) {
+                        p_closer.y += 0.5;
+                        p_farther.y -= 0.5;
+                    } else if (y >= c.y + 0.5) {
+                        p_closer.y -= 0.5;
+                        p_farther.y += 0.5;
+                    }
+                    double dx_closer = (p_closer.x - c.x) / r.x;
+                    double dy_closer = (p_closer.y - c.y) / r.y;
+                    double dx_farther = (p_farther.x - c.x) / r.x;
+                    double dy_farther = (p_farther.y - c.y) / r.y;
+
+
+                    if ( (dx_closer >= 1) || (dy_closer >= 1) ) {
+                        // outside
+                        tmpPix[0] = (float)_color0.r;
+                        tmpPix[1] = (float)_color0.g;
+                        tmpPix[2] = (float)_color0.b;
+                        tmpPix[3] = (float)_color0.a;
+                    } else {
+                        // maybe inside
+
+                        //double dsq = dxe * dxe + dye * dye;
+                        double dsq_closer = dx_closer * dx_closer + dy_closer * dy_closer;
+                        double dsq_farther = dx_farther * dx_farther + dy_farther * dy_farther;
+                        assert(dsq_closer <= dsq_farther);
+                        if (dsq_closer > dsq_farther) {
+                            // protect against bug
+                            std::swap(dsq_closer, dsq_farther);
+                        }
+                        if (dsq_closer >= 1) {
+                            // fully outside
                             tmpPix[0] = (float)_color0.r;
                             tmpPix[1] = (float)_color0.g;
                             tmpPix[2] = (float)_color0.b;
                             tmpPix[3] = (float)_color0.a;
                         } else {
-                            // maybe inside
-
-                            //double dsq = dxe * dxe + dye * dye;
-                            double dsq_closer = dx_closer * dx_closer + dy_closer * dy_closer;
-                            double dsq_farther = dx_farther * dx_farther + dy_farther * dy_farther;
-                            assert(dsq_closer <= dsq_farther);
-                            if (dsq_closer > dsq_farther) {
-                                // protect against bug
-                                std::swap(dsq_closer, dsq_farther);
-                            }
-                            if (dsq_closer >= 1) {
-                                // fully outside
-                                tmpPix[0] = (float)_color0.r;
-                                tmpPix[1] = (float)_color0.g;
-                                tmpPix[2] = (float)_color0.b;
-                                tmpPix[3] = (float)_color0.a;
+                            // always consider the value closest top the center to avoid discontinuities/artifacts
+                            if (_softness == 0) {
+                                // solid color
+                                tmpPix[0] = (float)_color1.r;
+                                tmpPix[1] = (float)_color1.g;
+                                tmpPix[2] = (float)_color1.b;
+                                tmpPix[3] = (float)_color1.a;
                             } else {
-                                // always consider the value closest top the center to avoid discontinuities/artifacts
-                                if (_softness == 0) {
-                                    // solid color
+                                // compute the non-round rect coeff (tx*ty) first.
+                                float tx, ty;
+                                if (dx >= softness.x) {
+                                    tx = 1.f;
+                                } else {
+                                    tx = (float)rampSmooth(dx / softness.x);
+                                }
+                                if (dy >= softness.y) {
+                                    ty = 1.f;
+                                } else {
+                                    ty = (float)rampSmooth(dy / softness.y);
+                                }
+
+                                // then the corner coeff.
+                                double dellipse; // distance to the ellipse along the radius
+                                // compute the point on the ellipse that goes through the ellipse center and the considered point.
+                                if (dsq_closer <= 0) {
+                                    dellipse = (std::min)(r.x, r.y);
+                                } else {
+                                    double radius = std::sqrt(dsq_closer);
+                                    // distance must be measured at full scale in canonical coords
+                                    double vx = (p_closer.x - c.x) * (1 / radius - 1) * par / rs.x;
+                                    double vy = (p_closer.y - c.y) * (1 / radius - 1) / rs.y;
+                                    dellipse = std::sqrt(vx * vx + vy * vy);
+                                }
+                                assert(dellipse >= 0.);
+                                float t = dellipse / _softness;
+                                if (t < 1) {
+                                    t = (float)rampSmooth(t);
+                                }
+
+                                // take the min of the rectangle softness and the corner softness
+                                t = (std::min)(t, tx * ty);
+
+                                if (t >= 1) {
                                     tmpPix[0] = (float)_color1.r;
                                     tmpPix[1] = (float)_color1.g;
                                     tmpPix[2] = (float)_color1.b;
                                     tmpPix[3] = (float)_color1.a;
                                 } else {
-                                    // compute the non-round rect coeff (tx*ty) first.
-                                    float tx, ty;
-                                    if (dx >= softness.x) {
-                                        tx = 1.f;
-                                    } else {
-                                        tx = (float)rampSmooth(dx / softness.x);
-                                    }
-                                    if (dy >= softness.y) {
-                                        ty = 1.f;
-                                    } else {
-                                        ty = (float)rampSmooth(dy / softness.y);
-                                    }
-
-                                    // then the corner coeff.
-                                    double dellipse; // distance to the ellipse along the radius
-                                    // compute the point on the ellipse that goes through the ellipse center and the considered point.
-                                    if (dsq_closer <= 0) {
-                                        dellipse = (std::min)(r.x, r.y);
-                                    } else {
-                                        double radius = std::sqrt(dsq_closer);
-                                        // distance must be measured at full scale in canonical coords
-                                        double vx = (p_closer.x - c.x) * (1 / radius - 1) * par / rs.x;
-                                        double vy = (p_closer.y - c.y) * (1 / radius - 1) / rs.y;
-                                        dellipse = std::sqrt(vx * vx + vy * vy);
-                                    }
-                                    assert(dellipse >= 0.);
-                                    float t = dellipse / _softness;
-                                    if (t < 1) {
-                                        t = (float)rampSmooth(t);
-                                    }
-
-                                    // take the min of the rectangle softness and the corner softness
-                                    t = (std::min)(t, tx * ty);
-
-                                    if (t >= 1) {
-                                        tmpPix[0] = (float)_color1.r;
-                                        tmpPix[1] = (float)_color1.g;
-                                        tmpPix[2] = (float)_color1.b;
-                                        tmpPix[3] = (float)_color1.a;
-                                    } else {
-                                        //if (_plinear) {
-                                        //    // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
-                                        //    t = t * t * t;
-                                        //}
-                                        tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
-                                        tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
-                                        tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
-                                        tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
-                                    }
+                                    //if (_plinear) {
+                                    //    // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
+                                    //    t = t * t * t;
+                                    //}
+                                    tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
+                                    tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
+                                    tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
+                                    tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
                                 }
+                            }
 
-                                if (dsq_farther <= 1) {
-                                    // fully inside
-                                    a = 1.;
-                                } else {
-                                    // mixed pixel, partly inside / partly outside, center of pixel is outside
-                                    assert(dsq_closer < 1 && dsq_farther > 1);
-                                    // now mix with the outside pix;
-                                    a = ( 1 - std::sqrt( (std::max)(dsq_closer, 0.) ) ) / ( std::sqrt( (std::max)(dsq_farther, 0.) ) - std::sqrt( (std::max)(dsq_closer, 0.) ) );
-                                }
-                            } // if (!fully_outside
-                        } // if (outside vs. maybe inside)
-                    } else {
-                        // RECTANGLE
+                            if (dsq_farther <= 1) {
+                                // fully inside
+                                a = 1.;
+                            } else {
+                                // mixed pixel, partly inside / partly outside, center of pixel is outside
+                                assert(dsq_closer < 1 && dsq_farther > 1);
+                                // now mix with the outside pix;
+                                a = ( 1 - std::sqrt( (std::max)(dsq_closer, 0.) ) ) / ( std::sqrt( (std::max)(dsq_farther, 0.) ) - std::sqrt( (std::max)(dsq_closer, 0.) ) );
+                            }
+                        } // if (!fully_outside
+                    } // if (outside vs. maybe inside)
+                } else {
+                    // RECTANGLE
 
-                        // within the rectangle area minus the corners
+                    // within the rectangle area minus the corners
 
-                        // inside or mixed
-                        // is it a mixed pixel?
-                        if (dx < 0.5) {
-                            a *= dx + 0.5;
-                            dx = 0.5;
+                    // inside or mixed
+                    // is it a mixed pixel?
+                    if (dx < 0.5) {
+                        a *= dx + 0.5;
+                        dx = 0.5;
+                    }
+                    if (dy < 0.5) {
+                        a *= dy + 0.5;
+                        dy = 0.5;
+                    }
+                    if ( (_softness == 0) || ( (dx >= softness.x) && (dy >= softness.y) ) ) {
+                        // inside of the rectangle
+                        tmpPix[0] = (float)_color1.r;
+                        tmpPix[1] = (float)_color1.g;
+                        tmpPix[2] = (float)_color1.b;
+                        tmpPix[3] = (float)_color1.a;
+                    } else {
+                        float tx, ty;
+                        if (dx >= softness.x) {
+                            tx = 1.f;
+                        } else {
+                            tx = (float)rampSmooth(dx / softness.x);
                         }
-                        if (dy < 0.5) {
-                            a *= dy + 0.5;
-                            dy = 0.5;
+                        if (dy >= softness.y) {
+                            ty = 1.f;
+                        } else {
+                            ty = (float)rampSmooth(dy / softness.y);
                         }
-                        if ( (_softness == 0) || ( (dx >= softness.x) && (dy >= softness.y) ) ) {
-                            // inside of the rectangle
+                        float t = tx * ty;
+                        if (t >= 1) {
                             tmpPix[0] = (float)_color1.r;
                             tmpPix[1] = (float)_color1.g;
                             tmpPix[2] = (float)_color1.b;
                             tmpPix[3] = (float)_color1.a;
                         } else {
-                            float tx, ty;
-                            if (dx >= softness.x) {
-                                tx = 1.f;
-                            } else {
-                                tx = (float)rampSmooth(dx / softness.x);
-                            }
-                            if (dy >= softness.y) {
-                                ty = 1.f;
-                            } else {
-                                ty = (float)rampSmooth(dy / softness.y);
-                            }
-                            float t = tx * ty;
-                            if (t >= 1) {
-                                tmpPix[0] = (float)_color1.r;
-                                tmpPix[1] = (float)_color1.g;
-                                tmpPix[2] = (float)_color1.b;
-                                tmpPix[3] = (float)_color1.a;
-                            } else {
-                                //if (_plinear) {
-                                //    // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
-                                //    t = t*t*t;
-                                //}
-                                tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
-                                tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
-                                tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
-                                tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
-                            }
+                            //if (_plinear) {
+                            //    // it seems to be the way Nuke does it... I could understand t*t, but why t*t*t?
+                            //    t = t*t*t;
+                            //}
+                            tmpPix[0] = (float)_color0.r * (1.f - t) + (float)_color1.r * t;
+                            tmpPix[1] = (float)_color0.g * (1.f - t) + (float)_color1.g * t;
+                            tmpPix[2] = (float)_color0.b * (1.f - t) + (float)_color1.b * t;
+                            tmpPix[3] = (float)_color0.a * (1.f - t) + (float)_color1.a * t;
                         }
                     }
-                    assert(a >= 0. && a <= 1.);
-                    if (a != 1.) {
-                        // mixed pixel (inside/outside)
-                        assert(0 <= a && a <= 1.);
-                        tmpPix[0] = (float)_color0.r * (1.f - a) + tmpPix[0] * a;
-                        tmpPix[1] = (float)_color0.g * (1.f - a) + tmpPix[1] * a;
-                        tmpPix[2] = (float)_color0.b * (1.f - a) + tmpPix[2] * a;
-                        tmpPix[3] = (float)_color0.a * (1.f - a) + tmpPix[3] * a;
-                    }
-                }
-                float a = tmpPix[3];
-
-                // ofxsMaskMixPix takes non-normalized values
-                tmpPix[0] *= maxValue;
-                tmpPix[1] *= maxValue;
-                tmpPix[2] *= maxValue;
-                tmpPix[3] *= maxValue;
-                float srcPixRGBA[4] = {0, 0, 0, 0};
-                if (srcPix) {
-                    if (nComponents >= 3) {
-                        srcPixRGBA[0] = srcPix[0];
-                        srcPixRGBA[1] = srcPix[1];
-                        srcPixRGBA[2] = srcPix[2];
-                    }
-                    if ( (nComponents == 1) || (nComponents == 4) ) {
-                        srcPixRGBA[3] = srcPix[nComponents - 1];
-                    }
-                }
-                if (processR) {
-                    tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - (float)a);
-                } else {
-                    tmpPix[0] = srcPixRGBA[0];
-                }
-                if (processG) {
-                    tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - (float)a);
-                } else {
-                    tmpPix[1] = srcPixRGBA[1];
-                }
-                if (processB) {
-                    tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - (float)a);
-                } else {
-                    tmpPix[2] = srcPixRGBA[2];
-                }
-                if (processA) {
-                    tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - (float)a);
-                } else {
-                    tmpPix[3] = srcPixRGBA[3];
                 }
-                if (nComponents == 1) {
-                    tmpPix[0] = tmpPix[3];
+                assert(a >= 0. && a <= 1.);
+                if (a != 1.) {
+                    // mixed pixel (inside/outside)
+                    assert(0 <= a && a <= 1.);
+                    tmpPix[0] = (float)_color0.r * (1.f - a) + tmpPix[0] * a;
+                    tmpPix[1] = (float)_color0.g * (1.f - a) + tmpPix[1] * a;
+                    tmpPix[2] = (float)_color0.b * (1.f - a) + tmpPix[2] * a;
+                    tmpPix[3] = (float)_color0.a * (1.f - a) + tmpPix[3] * a;
                 }
-                ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
             }
+            mixPixel<processR, processG, processB, processA>(tmpPix, x, y, srcPix, dstPix);
         }
-    } // process
+    } // processPixels
+
+    // composite the shape color tmpPix over srcPix, and apply the mask and mix
+    template<bool processR, bool processG, bool processB, bool processA>
+    void mixPixel(float tmpPix[4],
+                  int x,
+                  int y,
+                  const PIX *srcPix,
+                  PIX *dstPix)
+    {
+        float a = tmpPix[3];
+
+        // ofxsMaskMixPix takes non-normalized values
+        tmpPix[0] *= maxValue;
+        tmpPix[1] *= maxValue;
+        tmpPix[2] *= maxValue;
+        tmpPix[3] *= maxValue;
+        float srcPixRGBA[4] = {0, 0, 0, 0};
+        if (srcPix) {
+            if (nComponents >= 3) {
+                srcPixRGBA[0] = srcPix[0];
+                srcPixRGBA[1] = srcPix[1];
+                srcPixRGBA[2] = srcPix[2];
+            }
+            if ( (nComponents == 1) || (nComponents == 4) ) {
+                srcPixRGBA[3] = srcPix[nComponents - 1];
+            }
+        }
+        if (processR) {
+            tmpPix[0] = tmpPix[0] + srcPixRGBA[0] * (1.f - (float)a);
+        } else {
+            tmpPix[0] = srcPixRGBA[0];
+        }
+        if (processG) {
+            tmpPix[1] = tmpPix[1] + srcPixRGBA[1] * (1.f - (float)a);
+        } else {
+            tmpPix[1] = srcPixRGBA[1];
+        }
+        if (processB) {
+            tmpPix[2] = tmpPix[2] + srcPixRGBA[2] * (1.f - (float)a);
+        } else {
+            tmpPix[2] = srcPixRGBA[2];
+        }
+        if (processA) {
+            tmpPix[3] = tmpPix[3] + srcPixRGBA[3] * (1.f - (float)a);
+        } else {
+            tmpPix[3] = srcPixRGBA[3];
+        }
+        if (nComponents == 1) {
+            tmpPix[0] = tmpPix[3];
+        }
+        ofxsMaskMixPix<PIX, nComponents, maxValue, true>(tmpPix, x, y, srcPix, _doMasking, _maskImg, (float)_mix, _maskInvert, dstPix);
+    }
 };
 
 
@@ -932,6 +1030,31 @@ RectanglePlugin::isIdentity(const IsIdentityArguments &args,
         return true;
     }
 
+    if ( (color0.r == 0.) && (color0.g == 0.) && (color0.b == 0.) && (color0.a == 0.) ) {
+        // the source is unchanged outside of the rectangle: the effect is identity if the renderWindow
+        // doesn't intersect the rectangle bounds, expanded by one pixel for antialiasing
+        OfxRectD shapeRod;
+        if ( !GeneratorPlugin::getRegionOfDefinition(time, shapeRod) ) {
+            OfxPointD siz = getProjectSize();
+            OfxPointD off = getProjectOffset();
+            shapeRod.x1 = off.x;
+            shapeRod.x2 = off.x + siz.x;
+            shapeRod.y1 = off.y;
+            shapeRod.y2 = off.y + siz.y;
+        }
+        OfxRectI shapeBounds;
+        Coords::toPixelEnclosing(shapeRod, args.renderScale, _dstClip->getPixelAspectRatio(), &shapeBounds);
+        shapeBounds.x1 -= 1;
+        shapeBounds.y1 -= 1;
+        shapeBounds.x2 += 1;
+        shapeBounds.y2 += 1;
+        if ( !Coords::rectIntersection<OfxRectI>(args.renderWindow, shapeBounds, 0) ) {
+            identityClip = _srcClip;
+
+            return true;
+        }
+    }
+
     bool doMasking = ( ( !_maskApply || _maskApply->getValueAtTime(time) ) && _maskClip && _maskClip->isConnected() );
     if (doMasking) {
         bool maskInvert = _maskInvert->getValueAtTime(time);
@@ -27,6 +27,7 @@
 #include <algorithm>
 
 #include "ofxsTransform3x3.h"
+#include "ofxsTransform3x3Mipmap.h"
 #include "ofxsTransformInteract.h"
 #include "ofxsFormatResolution.h"
 #include "ofxsCoords.h"
@@ -55,8 +56,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 1.0: initial version
 // version 1.1: fix https://github.com/MrKepzie/Natron/issues/1397
 // version 1.2: add useRoD parameter for Natron
+// version 1.3: add mipmap parameter, for faster downscaling
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 3 // Increment this when you have fixed a bug or made it faster.
 
 #define kParamUseRoD "useRoD"
 #define kParamUseRoDLabel "Use Source RoD"
@@ -166,12 +168,12 @@ static bool gHostSupportsFormat = false;
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class ReformatPlugin
-    : public Transform3x3Plugin
+    : public Transform3x3MipmapPlugin
 {
 public:
     /** @brief ctor */
     ReformatPlugin(OfxImageEffectHandle handle)
-        : Transform3x3Plugin(handle, false, eTransform3x3ParamsTypeNone)
+        : Transform3x3MipmapPlugin(handle, false, eTransform3x3ParamsTypeNone)
         , _type(NULL)
         , _format(NULL)
         , _formatBoxSize(NULL)
@@ -1079,6 +1081,7 @@ ReformatPluginFactory::describeInContext(ImageEffectDescriptor &desc,
 
     // clamp, filter, black outside
     ofxsFilterDescribeParamsInterpolate2D(desc, page, /*blackOutsideDefault*/ false);
+    ofxsMipmapDescribeParams(desc, page);
 } // ReformatPluginFactory::describeInContext
 
 ImageEffect*
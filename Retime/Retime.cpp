@@ -33,15 +33,30 @@
 #include <cmath> // for floor
 #include <cfloat> // DBL_MAX
 #include <cassert>
+#include <vector>
 
 #include "ofxsImageEffect.h"
 #include "ofxsThreadSuite.h"
 #include "ofxsMultiThread.h"
+#ifdef OFX_USE_MULTITHREAD_MUTEX
+namespace {
+typedef MultiThread::Mutex Mutex;
+typedef MultiThread::AutoMutex AutoMutex;
+}
+#else
+// some OFX hosts do not have mutex handling in the MT-Suite (e.g. Sony Catalyst Edit)
+// prefer using the fast mutex by Marcus Geelnard http://tinythreadpp.bitsnbites.eu/
+#include "fast_mutex.h"
+namespace {
+typedef tthread::fast_mutex Mutex;
+typedef OFX::MultiThread::AutoMutexT<tthread::fast_mutex> AutoMutex;
+}
+#endif
 
 #include "ofxsProcessing.H"
-#include "ofxsImageBlender.H"
 #include "ofxsCopier.h"
 #include "ofxsMacros.h"
+#include "ofxsRefCountedCache.h"
 
 using namespace OFX;
 
@@ -53,8 +68,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
     "See also: http://opticalenquiry.com/nuke/index.php?title=Retime"
 
 #define kPluginIdentifier "net.sf.openfx.Retime"
+// History:
+// version 1.0: initial version
+// version 1.1: source frames are reused across the frames of a sequence render, fixed-point blending of integer images
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -102,6 +120,291 @@ enum FilterEnum
 #define kParamWarpLabel "Warp"
 #define kParamWarpHint "Curve that maps input range (after applying speed) to the output range. A low positive slope slows down the input clip, and a negative slope plays it backwards."
 
+#define kSourceFrameCacheMaxBytes (512 * 1024 * 1024) // memory used by the source frames kept during a sequence render
+
+#define kBlendShift 16 // precision of the fixed-point blend weights for integer images
+#define kBlendOne (1U << kBlendShift)
+
+
+////////////////////////////////////////////////////////////////////////////////
+// source frames
+
+/** @brief Identifies a source frame */
+struct SourceFrameKey
+{
+    double time;
+    int view;
+    OfxPointD renderScale;
+    FieldEnum field;
+
+    bool operator==(const SourceFrameKey &other) const
+    {
+        return ( time == other.time && view == other.view && renderScale.x == other.renderScale.x &&
+                 renderScale.y == other.renderScale.y && field == other.field );
+    }
+};
+
+/** @brief A copy of a source frame, kept between the renders of a sequence */
+struct SourceFrame
+{
+    BitDepthEnum bitDepth;
+    PixelComponentEnum pixelComponents;
+    int pixelComponentCount;
+    OfxRectI bounds;
+    int rowBytes;
+    std::vector<unsigned char> pixelData;
+
+    bool covers(const OfxRectI &window) const
+    {
+        return bounds.x1 <= window.x1 && window.x2 <= bounds.x2 && bounds.y1 <= window.y1 && window.y2 <= bounds.y2;
+    }
+};
+
+/** @brief The source frames fetched during non-interactive sequential renders.
+   When the clip is slowed down, consecutive output frames are blended from the same source frames,
+   which are then fetched only once. The cost of a frame is its size in bytes, and the least recently
+   used frames that are not in use are deleted when the byte budget is exceeded, and all of them at the end
+   of the sequence. Interactive renders do not use the cache, since the input may change between two renders. */
+typedef RefCountedCache<SourceFrameKey, SourceFrame, Mutex> SourceFrameCache;
+
+/** @brief The source frame used by a render: either an image fetched from the source clip, or a cached frame */
+class SourceFrameHolder
+{
+public:
+    explicit SourceFrameHolder(SourceFrameCache &cache)
+        : _cached(cache)
+        , _img()
+        , _frame(NULL)
+    {
+    }
+
+    // use the cached frame with that key, if it covers the render window
+    bool acquire(const SourceFrameKey &key,
+                 const OfxRectI &renderWindow)
+    {
+        assert(!_frame);
+        const SourceFrame *frame = _cached.acquire(key);
+        if ( frame && frame->covers(renderWindow) ) {
+            _frame = frame;
+        }
+
+        return _frame != NULL;
+    }
+
+    // give a frame to the cache, and use the cached frame if it covers the render window
+    bool insert(const SourceFrameKey &key,
+                SourceFrame *frame,
+                const OfxRectI &renderWindow)
+    {
+        assert(!_frame);
+        if ( _cached.get() ) {
+            // a frame with that key, which does not cover the render window, is already cached
+            delete frame;
+
+            return false;
+        }
+        const SourceFrame *cachedFrame = _cached.insert( key, frame, frame->pixelData.size() );
+        if ( cachedFrame->covers(renderWindow) ) {
+            _frame = cachedFrame;
+        }
+
+        return _frame != NULL;
+    }
+
+    void setImage(Image *img)
+    {
+        _img.reset(img);
+    }
+
+    const void* getPixelData() const
+    {
+        if (_frame) {
+            return &_frame->pixelData.front();
+        }
+
+        return _img.get() ? _img->getPixelData() : NULL;
+    }
+
+    OfxRectI getBounds() const
+    {
+        if (_frame) {
+            return _frame->bounds;
+        }
+        if ( _img.get() ) {
+            return _img->getBounds();
+        }
+        OfxRectI r = {0, 0, 0, 0};
+
+        return r;
+    }
+
+    int getRowBytes() const
+    {
+        if (_frame) {
+            return _frame->rowBytes;
+        }
+
+        return _img.get() ? _img->getRowBytes() : 0;
+    }
+
+private:
+    SourceFrameHolder(const SourceFrameHolder &);
+    SourceFrameHolder& operator=(const SourceFrameHolder &);
+
+    RefCountedCacheHolder<SourceFrameKey, SourceFrame, Mutex> _cached;
+    auto_ptr<Image> _img;
+    const SourceFrame *_frame;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// blending
+
+class RetimeProcessorBase
+    : public ImageProcessor
+{
+protected:
+    const void *_fromPixelData;
+    OfxRectI _fromBounds;
+    int _fromRowBytes;
+    const void *_toPixelData;
+    OfxRectI _toBounds;
+    int _toRowBytes;
+    float _blend;
+
+public:
+    RetimeProcessorBase(ImageEffect &instance)
+        : ImageProcessor(instance)
+        , _fromPixelData(NULL)
+        , _fromRowBytes(0)
+        , _toPixelData(NULL)
+        , _toRowBytes(0)
+        , _blend(0.f)
+    {
+        _fromBounds.x1 = _fromBounds.y1 = _fromBounds.x2 = _fromBounds.y2 = 0;
+        _toBounds.x1 = _toBounds.y1 = _toBounds.x2 = _toBounds.y2 = 0;
+    }
+
+    void setFromImg(const SourceFrameHolder &frame)
+    {
+        _fromPixelData = frame.getPixelData();
+        _fromBounds = frame.getBounds();
+        _fromRowBytes = frame.getRowBytes();
+    }
+
+    void setToImg(const SourceFrameHolder &frame)
+    {
+        _toPixelData = frame.getPixelData();
+        _toBounds = frame.getBounds();
+        _toRowBytes = frame.getRowBytes();
+    }
+
+    void setBlend(float blend)
+    {
+        _blend = blend;
+    }
+};
+
+// integer images use fixed-point weights, which sum to kBlendOne
+template <class PIX>
+static inline PIX
+blendSamples(PIX from,
+             PIX to,
+             float /*fromBlend*/,
+             float /*toBlend*/,
+             unsigned int fromWeight,
+             unsigned int toWeight)
+{
+    return PIX( (from * fromWeight + to * toWeight + kBlendOne / 2) >> kBlendShift );
+}
+
+template <>
+inline float
+blendSamples<float>(float from,
+                    float to,
+                    float fromBlend,
+                    float toBlend,
+                    unsigned int /*fromWeight*/,
+                    unsigned int /*toWeight*/)
+{
+    return from * fromBlend + to * toBlend;
+}
+
+// Linear blend between the two source frames. Pixels outside of a source frame are black.
+template <class PIX, int nComponents>
+class RetimeProcessor
+    : public RetimeProcessorBase
+{
+public:
+    RetimeProcessor(ImageEffect &instance)
+        : RetimeProcessorBase(instance)
+    {
+    }
+
+private:
+    static const PIX* getPixelAddress(const void *pixelData,
+                                      const OfxRectI &bounds,
+                                      int rowBytes,
+                                      int x,
+                                      int y)
+    {
+        if ( !pixelData || (x < bounds.x1) || (x >= bounds.x2) || (y < bounds.y1) || (y >= bounds.y2) ) {
+            return NULL;
+        }
+
+        return (const PIX*)( (const char*)pixelData + (size_t)(y - bounds.y1) * rowBytes ) + (size_t)(x - bounds.x1) * nComponents;
+    }
+
+    // the address of the first pixel of the row, if the whole row is inside the frame
+    static const PIX* getRowAddress(const void *pixelData,
+                                    const OfxRectI &bounds,
+                                    int rowBytes,
+                                    const OfxRectI &procWindow,
+                                    int y)
+    {
+        if ( (procWindow.x1 < bounds.x1) || (bounds.x2 < procWindow.x2) ) {
+            return NULL;
+        }
+
+        return getPixelAddress(pixelData, bounds, rowBytes, procWindow.x1, y);
+    }
+
+    void multiThreadProcessImages(OfxRectI procWindow) OVERRIDE FINAL
+    {
+        const float toBlend = _blend;
+        const float fromBlend = 1.f - _blend;
+        const unsigned int toWeight = (unsigned int)(_blend * kBlendOne + 0.5f);
+        const unsigned int fromWeight = kBlendOne - toWeight;
+        const int rowSize = (procWindow.x2 - procWindow.x1) * nComponents;
+
+        for (int y = procWindow.y1; y < procWindow.y2; ++y) {
+            if ( _effect.abort() ) {
+                break;
+            }
+
+            PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
+            assert(dstPix);
+
+            const PIX *fromPix = getRowAddress(_fromPixelData, _fromBounds, _fromRowBytes, procWindow, y);
+            const PIX *toPix = getRowAddress(_toPixelData, _toBounds, _toRowBytes, procWindow, y);
+            if (fromPix && toPix) {
+                // the row is inside both frames: blend it as a single array
+                for (int i = 0; i < rowSize; ++i) {
+                    dstPix[i] = blendSamples<PIX>(fromPix[i], toPix[i], fromBlend, toBlend, fromWeight, toWeight);
+                }
+                continue;
+            }
+
+            for (int x = procWindow.x1; x < procWindow.x2; ++x, dstPix += nComponents) {
+                fromPix = getPixelAddress(_fromPixelData, _fromBounds, _fromRowBytes, x, y);
+                toPix = getPixelAddress(_toPixelData, _toBounds, _toRowBytes, x, y);
+                for (int c = 0; c < nComponents; ++c) {
+                    dstPix[c] = blendSamples<PIX>(fromPix ? fromPix[c] : PIX(), toPix ? toPix[c] : PIX(), fromBlend, toBlend, fromWeight, toWeight);
+                }
+            }
+        }
+    } // multiThreadProcessImages
+};
+
 
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
@@ -118,6 +421,7 @@ protected:
     ParametricParam  *_warp;      /**< @brief only used in the filter or general context. */
     DoubleParam  *_duration;   /**< @brief how long the output should be as a proportion of input. General context only. */
     ChoiceParam  *_filter;   /**< @brief how images are interpolated (or not). */
+    SourceFrameCache _sourceFrames; /**< @brief source frames kept during a sequence render */
 
 public:
     /** @brief ctor */
@@ -132,6 +436,7 @@ public:
         , _warp(NULL)
         , _duration(NULL)
         , _filter(NULL)
+        , _sourceFrames(kSourceFrameCacheMaxBytes)
     {
         _dstClip = fetchClip(kOfxImageEffectOutputClipName);
         _srcClip = getContext() == eContextGenerator ? NULL : fetchClip(kOfxImageEffectSimpleSourceClipName);
@@ -161,6 +466,7 @@ public:
 
     /* Override the render */
     virtual void render(const RenderArguments &args) OVERRIDE FINAL;
+    virtual void endSequenceRender(const EndSequenceRenderArguments &args) OVERRIDE FINAL;
 
     template <int nComponents>
     void renderInternal(const RenderArguments &args, double sourceTime, FilterEnum filter, BitDepthEnum dstBitDepth);
@@ -174,10 +480,12 @@ public:
     virtual bool getRegionOfDefinition(const RegionOfDefinitionArguments &args, OfxRectD &rod) OVERRIDE FINAL;
 
     /* set up and run a processor */
-    void setupAndProcess(ImageBlenderBase &, const RenderArguments &args, double sourceTime, FilterEnum filter);
+    void setupAndProcess(RetimeProcessorBase &, const RenderArguments &args, double sourceTime, FilterEnum filter);
 
 private:
+    void fetchSourceFrame(double time, const RenderArguments &args, BitDepthEnum dstBitDepth, PixelComponentEnum dstComponents, bool cached, bool keep, SourceFrameHolder &frame);
 
+    double getSourceTime(double time);
 
     bool isIdentityInternal(OfxTime time, Clip* &identityClip, OfxTime &identityTime);
 };
@@ -204,6 +512,26 @@ checkComponents(const Image &src,
     }
 }
 
+static int
+componentBytes(BitDepthEnum bitDepth)
+{
+    switch (bitDepth) {
+    case eBitDepthUByte:
+
+        return sizeof(unsigned char);
+    case eBitDepthUShort:
+
+        return sizeof(unsigned short);
+    case eBitDepthFloat:
+
+        return sizeof(float);
+    default:
+        throwSuiteStatusException(kOfxStatErrUnsupported);
+
+        return 0;
+    }
+}
+
 static void
 framesNeeded(double sourceTime,
              FieldEnum fieldToRender,
@@ -242,7 +570,7 @@ framesNeeded(double sourceTime,
 
 /* set up and run a processor */
 void
-RetimePlugin::setupAndProcess(ImageBlenderBase &processor,
+RetimePlugin::setupAndProcess(RetimeProcessorBase &processor,
                               const RenderArguments &args,
                               double sourceTime,
                               FilterEnum filter)
@@ -296,36 +624,30 @@ RetimePlugin::setupAndProcess(ImageBlenderBase &processor,
     double blend;
     framesNeeded(sourceTime, args.fieldToRender, &fromTime, &toTime, &blend);
 
-    // fetch the two source images
-    auto_ptr<Image> fromImg( ( _srcClip && _srcClip->isConnected() ) ?
-                                  _srcClip->fetchImage(fromTime) : 0 );
-    auto_ptr<Image> toImg( ( _srcClip && _srcClip->isConnected() ) ?
-                                _srcClip->fetchImage(toTime) : 0 );
-
-    // make sure bit depths are sane
-    if ( fromImg.get() ) {
-        if ( (fromImg->getRenderScale().x != args.renderScale.x) ||
-             ( fromImg->getRenderScale().y != args.renderScale.y) ||
-             ( ( fromImg->getField() != eFieldNone) /* for DaVinci Resolve */ && ( fromImg->getField() != args.fieldToRender) ) ) {
-            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
-            throwSuiteStatusException(kOfxStatFailed);
-        }
-        checkComponents(*fromImg, dstBitDepth, dstComponents);
-    }
-    if ( toImg.get() ) {
-        if ( (toImg->getRenderScale().x != args.renderScale.x) ||
-             ( toImg->getRenderScale().y != args.renderScale.y) ||
-             ( ( toImg->getField() != eFieldNone) /* for DaVinci Resolve */ && ( toImg->getField() != args.fieldToRender) ) ) {
-            setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
-            throwSuiteStatusException(kOfxStatFailed);
-        }
-        checkComponents(*toImg, dstBitDepth, dstComponents);
+    // The input does not change during a non-interactive sequential render, so that
+    // source frames can be kept. A source frame is only copied to the cache if the
+    // next output frame also needs it, e.g. when the clip is slowed down.
+    const bool cached = args.sequentialRenderStatus && !args.interactiveRenderStatus;
+    bool keepFrom = false;
+    bool keepTo = false;
+    if (cached) {
+        double nextFromTime, nextToTime;
+        double nextBlend;
+        framesNeeded(getSourceTime(time + 1), args.fieldToRender, &nextFromTime, &nextToTime, &nextBlend);
+        keepFrom = (fromTime == nextFromTime) || (fromTime == nextToTime);
+        keepTo = (toTime == nextFromTime) || (toTime == nextToTime);
     }
 
+    // fetch the two source images
+    SourceFrameHolder fromFrame(_sourceFrames);
+    SourceFrameHolder toFrame(_sourceFrames);
+    fetchSourceFrame(fromTime, args, dstBitDepth, dstComponents, cached, keepFrom, fromFrame);
+    fetchSourceFrame(toTime, args, dstBitDepth, dstComponents, cached, keepTo, toFrame);
+
     // set the images
     processor.setDstImg( dst.get() );
-    processor.setFromImg( fromImg.get() );
-    processor.setToImg( toImg.get() );
+    processor.setFromImg(fromFrame);
+    processor.setToImg(toFrame);
 
     // set the render window
     processor.setRenderWindow(args.renderWindow);
@@ -337,6 +659,99 @@ RetimePlugin::setupAndProcess(ImageBlenderBase &processor,
     processor.process();
 } // RetimePlugin::setupAndProcess
 
+// Fetch a source frame, or get it from the source frames of the sequence being rendered.
+// If keep is true, the fetched frame is copied to the cache for the next renders.
+void
+RetimePlugin::fetchSourceFrame(double time,
+                               const RenderArguments &args,
+                               BitDepthEnum dstBitDepth,
+                               PixelComponentEnum dstComponents,
+                               bool cached,
+                               bool keep,
+                               SourceFrameHolder &frame)
+{
+    if ( !_srcClip || !_srcClip->isConnected() ) {
+        return;
+    }
+    SourceFrameKey key;
+    key.time = time;
+    key.view = args.renderView;
+    key.renderScale = args.renderScale;
+    key.field = args.fieldToRender;
+    if ( cached && frame.acquire(key, args.renderWindow) ) {
+        return;
+    }
+    auto_ptr<Image> img( _srcClip->fetchImage(time) );
+    if ( !img.get() ) {
+        return;
+    }
+    // make sure bit depths are sane
+    if ( (img->getRenderScale().x != args.renderScale.x) ||
+         ( img->getRenderScale().y != args.renderScale.y) ||
+         ( ( img->getField() != eFieldNone) /* for DaVinci Resolve */ && ( img->getField() != args.fieldToRender) ) ) {
+        setPersistentMessage(Message::eMessageError, "", "OFX Host gave image with wrong scale or field properties");
+        throwSuiteStatusException(kOfxStatFailed);
+    }
+    checkComponents(*img, dstBitDepth, dstComponents);
+
+    const OfxRectI bounds = img->getBounds();
+    if ( !cached || !keep || (bounds.x2 <= bounds.x1) || (bounds.y2 <= bounds.y1) ) {
+        frame.setImage( img.release() );
+
+        return;
+    }
+
+    // keep a copy of the image for the next frames of the sequence
+    auto_ptr<SourceFrame> sourceFrame(new SourceFrame);
+    sourceFrame->bitDepth = img->getPixelDepth();
+    sourceFrame->pixelComponents = img->getPixelComponents();
+    sourceFrame->pixelComponentCount = img->getPixelComponentCount();
+    sourceFrame->bounds = bounds;
+    sourceFrame->rowBytes = (bounds.x2 - bounds.x1) * sourceFrame->pixelComponentCount * componentBytes(sourceFrame->bitDepth);
+    sourceFrame->pixelData.resize( (size_t)sourceFrame->rowBytes * (bounds.y2 - bounds.y1) );
+    copyPixels(*this, bounds, img.get(), &sourceFrame->pixelData.front(), sourceFrame->bounds, sourceFrame->pixelComponents, sourceFrame->pixelComponentCount, sourceFrame->bitDepth, sourceFrame->rowBytes);
+    if ( abort() ) {
+        // the copy may be incomplete
+        frame.setImage( img.release() );
+
+        return;
+    }
+    if ( !frame.insert(key, sourceFrame.release(), args.renderWindow) ) {
+        frame.setImage( img.release() );
+    }
+}
+
+// the source time of the output frame at time
+double
+RetimePlugin::getSourceTime(double time)
+{
+    if (getContext() == eContextRetimer) {
+        // the host is specifying it, so fetch it from the kOfxImageEffectRetimerParamName pseudo-param
+        return _sourceTime->getValueAtTime(time);
+    }
+    if (!_srcClip) {
+        return time;
+    }
+    bool reverse_input;
+    OfxRangeD srcRange = _srcClip->getFrameRange();
+    double sourceTime;
+    _reverse_input->getValueAtTime(time, reverse_input);
+    // we have our own param, which is a speed, so we integrate it to get the time we want
+    if (reverse_input) {
+        sourceTime = srcRange.max - _speed->integrate(srcRange.min, time);
+    } else {
+        sourceTime = srcRange.min + _speed->integrate(srcRange.min, time);
+    }
+    if (_warp) {
+        double r = srcRange.max - srcRange.min;
+        if (r != 0.) {
+            sourceTime = srcRange.min + r * _warp->getValue(0, time, (sourceTime - srcRange.min) / r);
+        }
+    }
+
+    return sourceTime;
+}
+
 void
 RetimePlugin::getFramesNeeded(const FramesNeededArguments &args,
                               FramesNeededSetter &frames)
@@ -498,17 +913,17 @@ RetimePlugin::renderInternal(const RenderArguments &args,
 {
     switch (dstBitDepth) {
     case eBitDepthUByte: {
-        ImageBlender<unsigned char, nComponents> fred(*this);
+        RetimeProcessor<unsigned char, nComponents> fred(*this);
         setupAndProcess(fred, args, sourceTime, filter);
         break;
     }
     case eBitDepthUShort: {
-        ImageBlender<unsigned short, nComponents> fred(*this);
+        RetimeProcessor<unsigned short, nComponents> fred(*this);
         setupAndProcess(fred, args, sourceTime, filter);
         break;
     }
     case eBitDepthFloat: {
-        ImageBlender<float, nComponents> fred(*this);
+        RetimeProcessor<float, nComponents> fred(*this);
         setupAndProcess(fred, args, sourceTime, filter);
         break;
     }
@@ -530,28 +945,7 @@ RetimePlugin::render(const RenderArguments &args)
     assert( kSupportsMultipleClipDepths || !_srcClip || _srcClip->getPixelDepth()       == _dstClip->getPixelDepth() );
 
     // figure the frame we should be retiming from
-    double sourceTime = time;
-
-    if (getContext() == eContextRetimer) {
-        // the host is specifying it, so fetch it from the kOfxImageEffectRetimerParamName pseudo-param
-        sourceTime = _sourceTime->getValueAtTime(time);
-    } else if (_srcClip) {
-        bool reverse_input;
-        OfxRangeD srcRange = _srcClip->getFrameRange();
-        _reverse_input->getValueAtTime(time, reverse_input);
-        // we have our own param, which is a speed, so we integrate it to get the time we want
-        if (reverse_input) {
-            sourceTime = srcRange.max - _speed->integrate(srcRange.min, time);
-        } else {
-            sourceTime = srcRange.min + _speed->integrate(srcRange.min, time);
-        }
-        if (_warp) {
-            double r = srcRange.max - srcRange.min;
-            if (r != 0.) {
-                sourceTime = srcRange.min + r * _warp->getValue(0, time, (sourceTime - srcRange.min) / r);
-            }
-        }
-    }
+    double sourceTime = getSourceTime(time);
 
     FilterEnum filter = (FilterEnum)_filter->getValueAtTime(time);
 
@@ -578,6 +972,13 @@ RetimePlugin::render(const RenderArguments &args)
     }
 } // RetimePlugin::render
 
+void
+RetimePlugin::endSequenceRender(const EndSequenceRenderArguments & /*args*/)
+{
+    // the source frames are not needed anymore
+    _sourceFrames.clearUnused();
+}
+
 mDeclarePluginFactory(RetimePluginFactory,; , {});
 void
 RetimePluginFactory::load()
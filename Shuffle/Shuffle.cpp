@@ -21,6 +21,7 @@
  */
 
 #include <cmath>
+#include <cstring>
 #include <set>
 #include <algorithm>
 
@@ -43,8 +44,9 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 // version 2.0: support multiplane
 // version 2.1: add kParamSetGBAFromR
 // version 3.0: B input is now the default, pass-through when plugin is disabled
+// version 3.1: process rows with strided copies, memcpy when the output is the input
 #define kPluginVersionMajor 3 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -149,6 +151,18 @@ static PixelComponentEnum gOutputComponentsMap[4]; // 3 components + a sentinel
 static BitDepthEnum gOutputBitDepthMap[4]; // 3 possible bit depths + a sentinel
 
 
+// Where the values of an output channel come from. The channel map is
+// compiled once per render into one ShuffleChannel per output component,
+// which is then applied row by row by shuffleRows().
+struct ShuffleChannel
+{
+    const Image* img; // NULL if the channel is a constant
+    int comp; // component of img
+    float value; // constant value if there is no img
+
+    ShuffleChannel() : img(NULL), comp(0), value(0.f) {}
+};
+
 class ShufflerBase
     : public ImageProcessor
 {
@@ -159,6 +173,7 @@ protected:
     int _outputComponentCount;
     BitDepthEnum _outputBitDepth;
     std::vector<InputChannelEnum> _channelMap;
+    std::vector<ShuffleChannel> _channels;
 
 public:
     ShufflerBase(ImageEffect &instance)
@@ -169,6 +184,7 @@ public:
         , _outputComponentCount(0)
         , _outputBitDepth(eBitDepthNone)
         , _channelMap()
+        , _channels()
     {
     }
 
@@ -185,6 +201,106 @@ public:
         _outputBitDepth = outputBitDepth;
         assert( _outputComponentCount == (int)channelMap.size() );
         _channelMap = channelMap;
+        compileChannelMap();
+    }
+
+private:
+    // resolve the channel map, given the components of the source images.
+    // The source images must be set before calling this.
+    void compileChannelMap()
+    {
+        int srcMapComp[4]; // R,G,B,A components for src
+        PixelComponentEnum srcComponents = ePixelComponentNone;
+
+        if (_srcImgA) {
+            srcComponents = _srcImgA->getPixelComponents();
+        } else if (_srcImgB) {
+            srcComponents = _srcImgB->getPixelComponents();
+        }
+        switch (srcComponents) {
+        case ePixelComponentRGBA:
+            srcMapComp[0] = 0;
+            srcMapComp[1] = 1;
+            srcMapComp[2] = 2;
+            srcMapComp[3] = 3;
+            break;
+        case ePixelComponentRGB:
+            srcMapComp[0] = 0;
+            srcMapComp[1] = 1;
+            srcMapComp[2] = 2;
+            srcMapComp[3] = -1;
+            break;
+        case ePixelComponentAlpha:
+            srcMapComp[0] = -1;
+            srcMapComp[1] = -1;
+            srcMapComp[2] = -1;
+            srcMapComp[3] = 0;
+            break;
+#ifdef OFX_EXTENSIONS_NATRON
+        case ePixelComponentXY:
+            srcMapComp[0] = 0;
+            srcMapComp[1] = 1;
+            srcMapComp[2] = -1;
+            srcMapComp[3] = -1;
+            break;
+#endif
+        default:
+            srcMapComp[0] = -1;
+            srcMapComp[1] = -1;
+            srcMapComp[2] = -1;
+            srcMapComp[3] = -1;
+            break;
+        }
+        _channels.assign( _channelMap.size(), ShuffleChannel() );
+        for (std::size_t c = 0; c < _channelMap.size(); ++c) {
+            ShuffleChannel &channel = _channels[c];
+            const Image* srcImg = NULL;
+            int srcComp = -1;
+            switch (_channelMap[c]) {
+            case eInputChannelAR:
+                srcImg = _srcImgA;
+                srcComp = srcMapComp[0]; // srcImg may not have R!!!
+                break;
+            case eInputChannelAG:
+                srcImg = _srcImgA;
+                srcComp = srcMapComp[1];
+                break;
+            case eInputChannelAB:
+                srcImg = _srcImgA;
+                srcComp = srcMapComp[2];
+                break;
+            case eInputChannelAA:
+                srcImg = _srcImgA;
+                srcComp = srcMapComp[3];
+                break;
+            case eInputChannel0:
+                channel.value = 0.f;
+                break;
+            case eInputChannel1:
+                channel.value = 1.f;
+                break;
+            case eInputChannelBR:
+                srcImg = _srcImgB;
+                srcComp = srcMapComp[0];
+                break;
+            case eInputChannelBG:
+                srcImg = _srcImgB;
+                srcComp = srcMapComp[1];
+                break;
+            case eInputChannelBB:
+                srcImg = _srcImgB;
+                srcComp = srcMapComp[2];
+                break;
+            case eInputChannelBA:
+                srcImg = _srcImgB;
+                srcComp = srcMapComp[3];
+                break;
+            } // switch
+            if ( srcImg && (srcComp >= 0) ) {
+                channel.img = srcImg;
+                channel.comp = srcComp;
+            }
+        }
     }
 };
 
@@ -283,6 +399,122 @@ convertPixelDepth(float pix)
     return pix;
 }
 
+template <class PIXSRC, class PIXDST>
+struct IsSamePixelType
+{
+    static const bool value = false;
+};
+
+template <class PIX>
+struct IsSamePixelType<PIX, PIX>
+{
+    static const bool value = true;
+};
+
+// convert n values, read every srcStride values from src, and written every
+// dstStride values to dst
+template <class PIXSRC, class PIXDST, int dstStride>
+static void
+convertPixelDepthRow(const PIXSRC *src,
+                     int srcStride,
+                     PIXDST *dst,
+                     int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i * dstStride] = convertPixelDepth<PIXSRC, PIXDST>(src[i * srcStride]);
+    }
+}
+
+template <class PIXDST, int dstStride>
+static void
+fillRow(PIXDST value,
+        PIXDST *dst,
+        int n)
+{
+    for (int i = 0; i < n; ++i) {
+        dst[i * dstStride] = value;
+    }
+}
+
+// intersection of the row y of procWindow with the bounds of img, as [*x1,*x2)
+static void
+rowSpan(const Image* img,
+        const OfxRectI &procWindow,
+        int y,
+        int *x1,
+        int *x2)
+{
+    const OfxRectI& bounds = img->getBounds();
+
+    if ( (y < bounds.y1) || (bounds.y2 <= y) ) {
+        *x1 = *x2 = procWindow.x1;
+
+        return;
+    }
+    *x1 = (std::min)( (std::max)(procWindow.x1, bounds.x1), procWindow.x2 );
+    *x2 = (std::max)( (std::min)(procWindow.x2, bounds.x2), *x1 );
+}
+
+// Apply the compiled channel map to the rows of procWindow. Each output
+// channel is a strided copy (with bit depth conversion) from its source
+// image, or a constant fill. If the output is the source image itself (same
+// components in the same order and the same bit depth), rows are copied with
+// memcpy. Outside of the bounds of a source image, the values are 0 (black
+// and transparent).
+template <class PIXSRC, class PIXDST, int nComponentsDst>
+static void
+shuffleRows(ImageEffect &effect,
+            Image* dstImg,
+            const ShuffleChannel channels[nComponentsDst],
+            const OfxRectI &procWindow)
+{
+    bool identity = IsSamePixelType<PIXSRC, PIXDST>::value && channels[0].img &&
+                    channels[0].img->getPixelComponentCount() == nComponentsDst;
+
+    for (int c = 0; c < nComponentsDst; ++c) {
+        identity = identity && channels[c].img == channels[0].img && channels[c].comp == c;
+    }
+    PIXDST constant[nComponentsDst];
+    for (int c = 0; c < nComponentsDst; ++c) {
+        constant[c] = convertPixelDepth<float, PIXDST>(channels[c].value);
+    }
+
+    for (int y = procWindow.y1; y < procWindow.y2; y++) {
+        if ( effect.abort() ) {
+            break;
+        }
+
+        PIXDST *dstPix = (PIXDST *) dstImg->getPixelAddress(procWindow.x1, y);
+
+        if (identity) {
+            int x1, x2;
+            rowSpan(channels[0].img, procWindow, y, &x1, &x2);
+            std::fill( dstPix, dstPix + (x1 - procWindow.x1) * nComponentsDst, PIXDST() );
+            if (x1 < x2) {
+                std::memcpy( dstPix + (x1 - procWindow.x1) * nComponentsDst, channels[0].img->getPixelAddress(x1, y), (x2 - x1) * nComponentsDst * sizeof(PIXDST) );
+            }
+            std::fill( dstPix + (x2 - procWindow.x1) * nComponentsDst, dstPix + (procWindow.x2 - procWindow.x1) * nComponentsDst, PIXDST() );
+            continue;
+        }
+        for (int c = 0; c < nComponentsDst; ++c) {
+            const Image* srcImg = channels[c].img;
+            if (!srcImg) {
+                fillRow<PIXDST, nComponentsDst>(constant[c], dstPix + c, procWindow.x2 - procWindow.x1);
+                continue;
+            }
+            int x1, x2;
+            rowSpan(srcImg, procWindow, y, &x1, &x2);
+            fillRow<PIXDST, nComponentsDst>(PIXDST(), dstPix + c, x1 - procWindow.x1);
+            if (x1 < x2) {
+                const PIXSRC *srcPix = (const PIXSRC *) srcImg->getPixelAddress(x1, y);
+                convertPixelDepthRow<PIXSRC, PIXDST, nComponentsDst>(srcPix + channels[c].comp, srcImg->getPixelComponentCount(),
+                                                                     dstPix + (x1 - procWindow.x1) * nComponentsDst + c, x2 - x1);
+            }
+            fillRow<PIXDST, nComponentsDst>(PIXDST(), dstPix + (x2 - procWindow.x1) * nComponentsDst + c, procWindow.x2 - x2);
+        }
+    }
+}
+
 template <class PIXSRC, class PIXDST, int nComponentsDst>
 class Shuffler
     : public ShufflerBase
@@ -296,131 +528,9 @@ public:
 private:
     void multiThreadProcessImages(OfxRectI procWindow)
     {
-        const Image* channelMapImg[nComponentsDst];
-        int channelMapComp[nComponentsDst]; // channel component, or value if no image
-        int srcMapComp[4]; // R,G,B,A components for src
-        PixelComponentEnum srcComponents = ePixelComponentNone;
-
-        if (_srcImgA) {
-            srcComponents = _srcImgA->getPixelComponents();
-        } else if (_srcImgB) {
-            srcComponents = _srcImgB->getPixelComponents();
-        }
-        switch (srcComponents) {
-        case ePixelComponentRGBA:
-            srcMapComp[0] = 0;
-            srcMapComp[1] = 1;
-            srcMapComp[2] = 2;
-            srcMapComp[3] = 3;
-            break;
-        case ePixelComponentRGB:
-            srcMapComp[0] = 0;
-            srcMapComp[1] = 1;
-            srcMapComp[2] = 2;
-            srcMapComp[3] = -1;
-            break;
-        case ePixelComponentAlpha:
-            srcMapComp[0] = -1;
-            srcMapComp[1] = -1;
-            srcMapComp[2] = -1;
-            srcMapComp[3] = 0;
-            break;
-#ifdef OFX_EXTENSIONS_NATRON
-        case ePixelComponentXY:
-            srcMapComp[0] = 0;
-            srcMapComp[1] = 1;
-            srcMapComp[2] = -1;
-            srcMapComp[3] = -1;
-            break;
-#endif
-        default:
-            srcMapComp[0] = -1;
-            srcMapComp[1] = -1;
-            srcMapComp[2] = -1;
-            srcMapComp[3] = -1;
-            break;
-        }
-        for (int c = 0; c < nComponentsDst; ++c) {
-            channelMapImg[c] = NULL;
-            channelMapComp[c] = 0;
-            switch (_channelMap[c]) {
-            case eInputChannelAR:
-                if ( _srcImgA && ( srcMapComp[0] >= 0) ) {
-                    channelMapImg[c] = _srcImgA;
-                    channelMapComp[c] = srcMapComp[0];     // srcImg may not have R!!!
-                }
-                break;
-            case eInputChannelAG:
-                if ( _srcImgA && ( srcMapComp[1] >= 0) ) {
-                    channelMapImg[c] = _srcImgA;
-                    channelMapComp[c] = srcMapComp[1];
-                }
-                break;
-            case eInputChannelAB:
-                if ( _srcImgA && ( srcMapComp[2] >= 0) ) {
-                    channelMapImg[c] = _srcImgA;
-                    channelMapComp[c] = srcMapComp[2];
-                }
-                break;
-            case eInputChannelAA:
-                if ( _srcImgA && ( srcMapComp[3] >= 0) ) {
-                    channelMapImg[c] = _srcImgA;
-                    channelMapComp[c] = srcMapComp[3];
-                }
-                break;
-            case eInputChannel0:
-                channelMapComp[c] = 0;
-                break;
-            case eInputChannel1:
-                channelMapComp[c] = 1;
-                break;
-            case eInputChannelBR:
-                if ( _srcImgB && ( srcMapComp[0] >= 0) ) {
-                    channelMapImg[c] = _srcImgB;
-                    channelMapComp[c] = srcMapComp[0];
-                }
-                break;
-            case eInputChannelBG:
-                if ( _srcImgB && ( srcMapComp[1] >= 0) ) {
-                    channelMapImg[c] = _srcImgB;
-                    channelMapComp[c] = srcMapComp[1];
-                }
-                break;
-            case eInputChannelBB:
-                if ( _srcImgB && ( srcMapComp[2] >= 0) ) {
-                    channelMapImg[c] = _srcImgB;
-                    channelMapComp[c] = srcMapComp[2];
-                }
-                break;
-            case eInputChannelBA:
-                if ( _srcImgB && ( srcMapComp[3] >= 0) ) {
-                    channelMapImg[c] = _srcImgB;
-                    channelMapComp[c] = srcMapComp[3];
-                }
-                break;
-            } // switch
-        }
-        // now compute the transformed image, component by component
-        for (int c = 0; c < nComponentsDst; ++c) {
-            const Image* srcImg = channelMapImg[c];
-            int srcComp = channelMapComp[c];
-
-            for (int y = procWindow.y1; y < procWindow.y2; y++) {
-                if ( _effect.abort() ) {
-                    break;
-                }
-
-                PIXDST *dstPix = (PIXDST *) _dstImg->getPixelAddress(procWindow.x1, y);
-
-                for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                    PIXSRC *srcPix = (PIXSRC *)  (srcImg ? srcImg->getPixelAddress(x, y) : 0);
-                    // if there is a srcImg but we are outside of its RoD, it should be considered black and transparent
-                    dstPix[c] = srcImg ? convertPixelDepth<PIXSRC, PIXDST>(srcPix ? srcPix[srcComp] : 0) : convertPixelDepth<float, PIXDST>(srcComp);
-                    dstPix += nComponentsDst;
-                }
-            }
-        }
-    } // multiThreadProcessImages
+        assert(_channels.size() == nComponentsDst);
+        shuffleRows<PIXSRC, PIXDST, nComponentsDst>(_effect, _dstImg, &_channels[0], procWindow);
+    }
 };
 
 struct InputPlaneChannel
@@ -441,6 +551,7 @@ protected:
     BitDepthEnum _outputBitDepth;
     int _nComponentsDst;
     std::vector<InputPlaneChannel> _inputPlanes;
+    std::vector<ShuffleChannel> _channels;
 
 public:
     MultiPlaneShufflerBase(ImageEffect &instance)
@@ -449,6 +560,7 @@ public:
         , _outputBitDepth(eBitDepthNone)
         , _nComponentsDst(0)
         , _inputPlanes(_nComponentsDst)
+        , _channels()
     {
     }
 
@@ -459,6 +571,17 @@ public:
         _outputComponentCount = outputComponentCount,
         _outputBitDepth = outputBitDepth;
         _inputPlanes = planes;
+        _channels.assign( planes.size(), ShuffleChannel() );
+        for (std::size_t c = 0; c < planes.size(); ++c) {
+            assert( !planes[c].img || ( planes[c].channelIndex >= 0 && planes[c].channelIndex < planes[c].img->getPixelComponentCount() ) );
+            if (planes[c].img) {
+                _channels[c].img = planes[c].img;
+                _channels[c].comp = planes[c].channelIndex;
+            } else {
+                // No input image: this is a constant value, depending on fillZero
+                _channels[c].value = planes[c].fillZero ? 0.f : 1.f;
+            }
+        }
     }
 };
 
@@ -476,49 +599,9 @@ public:
 private:
     void multiThreadProcessImages(OfxRectI procWindow)
     {
-        assert(_inputPlanes.size() == nComponentsDst);
-        // now compute the transformed image, component by component
-
-        int srcChannels[nComponentsDst];
-        for (int c = 0; c < nComponentsDst; ++c) {
-            const Image* srcImg = _inputPlanes[c].img;
-            srcChannels[c] = _inputPlanes[c].channelIndex;
-            if (!srcImg) {
-                srcChannels[c] = _inputPlanes[c].fillZero ? 0 : 1;
-            }
-            assert( !srcImg || ( srcChannels[c] >= 0 && srcChannels[c] < srcImg->getPixelComponentCount() ) );
-
-        }
-
-        for (int y = procWindow.y1; y < procWindow.y2; y++) {
-            if ( _effect.abort() ) {
-                break;
-            }
-
-            PIXDST *dstPix = (PIXDST *) _dstImg->getPixelAddress(procWindow.x1, y);
-
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-
-                for (int c = 0; c < nComponentsDst; ++c) {
-                    // if there is a srcImg but we are outside of its RoD, it should be considered black and transparent
-                    PIXSRC *srcPix = (PIXSRC *)  (_inputPlanes[c].img ? _inputPlanes[c].img->getPixelAddress(x, y) : 0);
-
-                    if (!_inputPlanes[c].img) {
-                        // No input image: this is a constant value.
-                        // Use constant value depending on fillZero
-                        dstPix[c] = convertPixelDepth<float, PIXDST>(srcChannels[c]);
-                    } else {
-                        // Be black and transparent if we are outside of _inputPlanes[c].img's RoD
-                        dstPix[c] = convertPixelDepth<PIXSRC, PIXDST>(srcPix ? srcPix[srcChannels[c]] : 0);
-                    }
-
-                }
-                dstPix += nComponentsDst;
-
-            }
-        }
+        assert(_channels.size() == nComponentsDst);
+        shuffleRows<PIXSRC, PIXDST, nComponentsDst>(_effect, _dstImg, &_channels[0], procWindow);
     }
-    
 };
 
 
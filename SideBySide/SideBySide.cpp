@@ -36,8 +36,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginGrouping "Views/Stereo"
 #define kPluginDescription "Put the left and right view of the input next to each other."
 #define kPluginIdentifier "net.sf.openfx.sideBySidePlugin"
+// History:
+// version 1.0: initial version
+// version 1.1: copy whole spans of rows from each view
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kSupportsTiles 1
 #define kSupportsMultiResolution 1
@@ -106,10 +109,12 @@ public:
 
 private:
     // and do some processing
+    // Each destination row is made of at most two spans, one from each view, which are copied as
+    // whole rows of pixels.
     void multiThreadProcessImages(OfxRectI procWindow)
     {
         assert(_srcOffset.max != 0);
-        double offset = _srcOffset.max - _srcOffset.min;
+        int offset = _srcOffset.max - _srcOffset.min;
         for (int y = procWindow.y1; y < procWindow.y2; y++) {
             if ( _effect.abort() ) {
                 break;
@@ -117,29 +122,55 @@ private:
 
             PIX *dstPix = (PIX *) _dstImg->getPixelAddress(procWindow.x1, y);
 
-            for (int x = procWindow.x1; x < procWindow.x2; x++) {
-                const PIX *srcPix;
-                if ( ( _vertical && (y >= _srcOffset.max) ) || ( !_vertical && (x < _srcOffset.max) ) ) {
-                    srcPix = (const PIX *)(_srcImg1 ? _srcImg1->getPixelAddress(x, _vertical ? y - offset : y) : 0);
+            if (_vertical) {
+                if (y >= _srcOffset.max) {
+                    copySpan(dstPix, _srcImg1, procWindow.x1, procWindow.x2, 0, y - offset);
                 } else {
-                    srcPix = (const PIX *)(_srcImg2 ? _srcImg2->getPixelAddress(_vertical ? x : x - offset, y ) : 0);
-                }
-
-                if (srcPix) {
-                    for (int c = 0; c < nComponents; c++) {
-                        dstPix[c] = srcPix[c];
-                    }
-                } else {
-                    // no data here, be black and transparent
-                    for (int c = 0; c < nComponents; c++) {
-                        dstPix[c] = 0;
-                    }
+                    copySpan(dstPix, _srcImg2, procWindow.x1, procWindow.x2, 0, y);
                 }
+            } else {
+                // x < _srcOffset.max comes from the first view
+                int xSplit = (std::max)( procWindow.x1, (std::min)(_srcOffset.max, procWindow.x2) );
+                copySpan(dstPix, _srcImg1, procWindow.x1, xSplit, 0, y);
+                copySpan(dstPix + (xSplit - procWindow.x1) * nComponents, _srcImg2, xSplit, procWindow.x2, offset, y);
+            }
+        }
+    }
 
-                // increment the dst pixel
-                dstPix += nComponents;
+    // copy the pixels (x - dx, srcY) of srcImg, x in [x1,x2), to dstPix, filling with black and transparent
+    // where there is no data
+    static void copySpan(PIX *dstPix,
+                         const Image *srcImg,
+                         int x1,
+                         int x2,
+                         int dx,
+                         int srcY)
+    {
+        if (x1 >= x2) {
+            return;
+        }
+        int xIn1 = x2;
+        int xIn2 = x2;
+        const PIX *srcPix = NULL;
+        if (srcImg) {
+            const OfxRectI& srcBounds = srcImg->getBounds();
+            xIn1 = (std::min)( x2, (std::max)(x1, srcBounds.x1 + dx) );
+            xIn2 = (std::max)( xIn1, (std::min)(x2, srcBounds.x2 + dx) );
+            if (xIn1 < xIn2) {
+                // NULL if srcY is outside of the bounds
+                srcPix = (const PIX *) srcImg->getPixelAddress(xIn1 - dx, srcY);
             }
+            if (!srcPix) {
+                xIn1 = xIn2 = x2;
+            }
+        }
+        std::fill(dstPix, dstPix + (xIn1 - x1) * nComponents, PIX());
+        dstPix += (xIn1 - x1) * nComponents;
+        if (srcPix) {
+            std::copy(srcPix, srcPix + (xIn2 - xIn1) * nComponents, dstPix);
+            dstPix += (xIn2 - xIn1) * nComponents;
         }
+        std::fill(dstPix, dstPix + (x2 - xIn2) * nComponents, PIX());
     }
 };
 
@@ -24,6 +24,7 @@
 #include <iostream>
 
 #include "ofxsTransform3x3.h"
+#include "ofxsTransform3x3Mipmap.h"
 #include "ofxsTransformInteract.h"
 #include "ofxsCoords.h"
 #include "ofxsThreadSuite.h"
@@ -48,8 +49,11 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 #define kPluginDirBlurDescription "Apply directional blur to an image.\n" \
     "This plugin concatenates transforms upstream."
 #define kPluginDirBlurIdentifier "net.sf.openfx.DirBlur"
+// History:
+// version 1.0: initial version
+// version 1.1: add mipmap parameter, for faster downscaling
 #define kPluginVersionMajor 1 // Incrementing this number means that you have broken backwards compatibility of the plug-in.
-#define kPluginVersionMinor 0 // Increment this when you have fixed a bug or made it faster.
+#define kPluginVersionMinor 1 // Increment this when you have fixed a bug or made it faster.
 
 #define kParamSrcClipChanged "srcClipChanged"
 
@@ -57,14 +61,14 @@ OFXS_NAMESPACE_ANONYMOUS_ENTER
 ////////////////////////////////////////////////////////////////////////////////
 /** @brief The plugin that does our work */
 class TransformPlugin
-    : public Transform3x3Plugin
+    : public Transform3x3MipmapPlugin
 {
 public:
     /** @brief ctor */
     TransformPlugin(OfxImageEffectHandle handle,
                     bool masked,
                     bool isDirBlur)
-        : Transform3x3Plugin(handle, masked, isDirBlur ? eTransform3x3ParamsTypeDirBlur : eTransform3x3ParamsTypeMotionBlur)
+        : Transform3x3MipmapPlugin(handle, masked, isDirBlur ? eTransform3x3ParamsTypeDirBlur : eTransform3x3ParamsTypeMotionBlur)
         , _translate(NULL)
         , _rotate(NULL)
         , _scale(NULL)
@@ -429,6 +433,7 @@ TransformPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     TransformPluginDescribeInContext(desc, context, page);
 
     Transform3x3DescribeInContextEnd(desc, context, page, false, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur);
+    ofxsMipmapDescribeParams(desc, page);
 
     {
         BooleanParamDescriptor* param = desc.defineBooleanParam(kParamSrcClipChanged);
@@ -473,6 +478,7 @@ TransformMaskedPluginFactory::describeInContext(ImageEffectDescriptor &desc,
     TransformPluginDescribeInContext(desc, context, page);
 
     Transform3x3DescribeInContextEnd(desc, context, page, true, Transform3x3Plugin::eTransform3x3ParamsTypeMotionBlur);
+    ofxsMipmapDescribeParams(desc, page);
 
     {
         BooleanParamDescriptor* param = desc.defineBooleanParam(kParamSrcClipChanged);